@@ -16,7 +16,7 @@
 
   This is significantly changed from library implementation.  Summary of changes:
   - Moved all serial communication with GPS into communicator.cpp, for more flexibility
-  - Removed parsing of strings other than GPRMC and GGA
+  - Removed parsing of strings other than GPRMC and GGA (GPGSA added back, for PDOP and the 2D/3D fix mode)
   - Altered parsing function - see comment in it about checksum now starting from buffer index 1 (instead 2)
   - The raw NMEA string is now housed in communicator
   - This class essentially only functions by being passed a raw NMEA string to be parsed. It takes care of checksum.
@@ -39,6 +39,11 @@ void Adafruit_GPS::init() {
   latitude = longitude = geoidheight = altitudeMeters =	speedKnots = speedMPS = angle = magvariation = 0.0; // float
   lat = lon = '0';
   HDOP = 5.0; //Ensures the HDOP initializes to 'bad'
+  PDOP = VDOP = 0;
+  fixMode = 0;
+  timeLastGSA = 0;
+  positionSentence = false;
+  quality.reset();
 
 }
 
@@ -185,6 +190,7 @@ boolean Adafruit_GPS::parse(char *nmea) {
       year = (fulldate % 100);
     }
     // we dont parse the remaining, yet!
+    positionSentence = true;
     return true;
   }  // End of  if (strstr(nmea, "$GPRMC"))
 
@@ -296,12 +302,58 @@ boolean Adafruit_GPS::parse(char *nmea) {
       geoidheight = atof(p);
     }
 
-    //Updates HDOP OK variable
-    HDOPCheck();
-    
+    //Fix mode and PDOP only count if GSA is still coming in
+    boolean gsaFresh = timeLastGSA != 0 && millisSince(timeLastGSA) < GSA_MAX_AGE_MS;
+    int32_t latitudeE7 = lat == 'S' ? -latitude_fixed : latitude_fixed;
+    int32_t longitudeE7 = lon == 'W' ? -longitude_fixed : longitude_fixed;
+    quality.update(fixquality, satellites, HDOP, gsaFresh ? fixMode : 0, gsaFresh ? PDOP : 0, latitudeE7, longitudeE7, speedMPS, angle, systemMicros());
+
+    positionSentence = true;
     return true;
   }
-  
+
+
+  //--------------------- GSA ----------------------------/
+  if (strstr(nmea, "$GPGSA")) {
+    char *p = nmea;
+
+    // Skip the selection mode (M/A)
+    p = strchr(p, ',') + 1;
+
+    p = strchr(p, ',') + 1;
+    if (',' != *p)
+    {
+      fixMode = atoi(p);
+    }
+
+    // Skip the 12 satellite IDs
+    for (int i = 0; i < 12; i++) {
+      p = strchr(p, ',') + 1;
+    }
+
+    p = strchr(p, ',') + 1;
+    if (',' != *p)
+    {
+      PDOP = atof(p);
+    }
+
+    p = strchr(p, ',') + 1;
+    if (',' != *p)
+    {
+      HDOP = atof(p);
+    }
+
+    p = strchr(p, ',') + 1;
+    if (',' != *p && '*' != *p)
+    {
+      VDOP = atof(p);
+    }
+
+    timeLastGSA = systemMicros();
+    positionSentence = false;
+    return true;
+  }
+
 
   return false;
 }
@@ -323,18 +375,3 @@ uint8_t Adafruit_GPS::parseHex(char c) {
   // if (c > 'F')
   return 0;
 }
-
-
-//Checks whether the current fix is accurate enough to autodrop
-void Adafruit_GPS::HDOPCheck() {
-	if(HDOP > 3) { //If accuracy is not high enough
-		msSinceValidHDOP = millis()-timeLastValidHDOP;
-		HDOP_OK = msSinceValidHDOP < 5000;
-	} else {
-		timeLastValidHDOP = millis();
-		msSinceValidHDOP = 0;
-    HDOP_OK = true;
-	}
-}
-
-
@@ -39,8 +39,8 @@
 #define ENABLE_USING_WAAS_WITH_SBAS_SATS "$PMTK301,2*2E"  //Must be after ^. Allow using those sattelites to get 3d DGPS fix (using WAAS)
 #define ENABLE_USING_WAAS_WITH_SBAS_SATS_COMMANDNUM 301 
 
-#define PMTK_SET_NMEA_OUTPUT_RMCGGA "$PMTK314,0,1,0,1,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0*28"
-#define PMTK_SET_NMEA_OUTPUT_RMCGGA_COMMANDNUM 314 
+#define PMTK_SET_NMEA_OUTPUT_RMCGGAGSA "$PMTK314,0,1,0,1,5,0,0,0,0,0,0,0,0,0,0,0,0,0,0*2D"  //RMC and GGA every fix, GSA every 5th (1Hz at 5Hz - all three every fix doesn't fit in 9600 baud)
+#define PMTK_SET_NMEA_OUTPUT_RMCGGAGSA_COMMANDNUM 314 
 
 
 //TO CREATE NEW COMMANDS
@@ -102,6 +102,10 @@
 #define MAXWAITSENTENCE 5
 
 #include "Arduino.h"
+#include "SystemClock.h"
+#include "GpsQuality.h"
+
+#define GSA_MAX_AGE_MS 3000  //GSA comes once a second - after this its fix mode and PDOP aren't used
 
 class Adafruit_GPS {
   public:
@@ -113,7 +117,6 @@ class Adafruit_GPS {
     void init();
     uint8_t parseHex(char c);
     boolean parse(char *);
-    void HDOPCheck();
 
 
     uint8_t hour, minute, seconds, year, month, day;
@@ -124,13 +127,18 @@ class Adafruit_GPS {
     // and minutes stored in units of 1/100000 degrees.  See pull #13 for more details:
     //   https://github.com/adafruit/Adafruit-GPS-Library/pull/13
     int32_t latitude_fixed, longitude_fixed;
-	  unsigned long msSinceValidHDOP, timeLastValidHDOP;
     float latitudeDegrees, longitudeDegrees;
     float geoidheight, altitudeMeters;
     float speedKnots, speedMPS, angle, magvariation, HDOP;
+    float PDOP, VDOP;  //From GSA, 0 until one arrives
     char lat, lon, mag;
-    boolean fix, HDOP_OK;
+    boolean fix;
+    boolean positionSentence;  //Whether the last parsed sentence had a position in it (RMC, GGA) or not (GSA)
     uint8_t fixquality, satellites;
+    uint8_t fixMode;  //From GSA: 1 = no fix, 2 = 2D, 3 = 3D
+    uint64_t timeLastGSA;
+
+    GpsQuality quality;  //Updated with each GGA
 	
 
 
@@ -60,7 +60,7 @@ boolean Adafruit_MPL3115A2::begin() {
   write8(MPL3115A2_CTRL_REG1,
          MPL3115A2_CTRL_REG1_SBYB |
          MPL3115A2_CTRL_REG1_OS128 |
-         MPL3115A2_CTRL_REG1_ALT);
+         MPL3115A2_CTRL_REG1_BAR);
   write8(MPL3115A2_PT_DATA_CFG,
          MPL3115A2_PT_DATA_CFG_TDEFE |
          MPL3115A2_PT_DATA_CFG_PDEFE |
@@ -68,9 +68,69 @@ boolean Adafruit_MPL3115A2::begin() {
   return true;
 }
 
-void Adafruit_MPL3115A2::zero() {
-  zeroAltitudeFt = 0;
-  zeroAltitudeFt = getAltitudeFt(true);
+void Adafruit_MPL3115A2::startCalibration() {
+  calibrationState = ALTIMETER_CALIBRATING;
+  calibrationCount = 0;
+  calibrationStart = systemMicros();
+}
+
+//Restore a previously measured zero reference (warm restart) instead of re-zeroing at the current altitude
+void Adafruit_MPL3115A2::setReferencePressure(uint32_t pressure) {
+  referencePressure = pressure;
+  lnReference = lnQ24(pressure);
+  calibrationState = ALTIMETER_CALIBRATED;
+}
+
+// The field's pressure from its QNH, down the hypsometric equation (taking the measured temperature as the field's)
+void Adafruit_MPL3115A2::setQnh(float qnhPa, float fieldElevationM) {
+  float meanTemperatureK = lastTemperatureC + 273.15 + 0.0065 * fieldElevationM / 2;
+  float fieldPressurePa = qnhPa * exp(-fieldElevationM * 9.80665 / (287.05287 * meanTemperatureK));
+  setReferencePressure(lround(fieldPressurePa * 4));
+}
+
+void Adafruit_MPL3115A2::addCalibrationSample(int32_t pressure) {
+  calibrationSamples[calibrationCount++] = pressure;
+  if (calibrationCount == MPL3115A2_CALIBRATION_SAMPLES)
+    finishCalibration();
+}
+
+// Median, then the mean of the samples within a few median absolute deviations of it
+void Adafruit_MPL3115A2::finishCalibration() {
+
+  int32_t sorted[MPL3115A2_CALIBRATION_SAMPLES], deviation[MPL3115A2_CALIBRATION_SAMPLES];
+  uint8_t n = calibrationCount;
+  for (uint8_t i = 0; i < n; i++) {
+    int32_t v = calibrationSamples[i];
+    uint8_t k = i;
+    for (; k > 0 && sorted[k - 1] > v; k--)
+      sorted[k] = sorted[k - 1];
+    sorted[k] = v;
+  }
+  int32_t median = sorted[n / 2];
+
+  for (uint8_t i = 0; i < n; i++) {
+    int32_t v = abs(sorted[i] - median);
+    uint8_t k = i;
+    for (; k > 0 && deviation[k - 1] > v; k--)
+      deviation[k] = deviation[k - 1];
+    deviation[k] = v;
+  }
+  int32_t limit = MPL3115A2_CALIBRATION_OUTLIER_MADS * max(deviation[n / 2], (int32_t)MPL3115A2_CALIBRATION_MIN_SPREAD);
+
+  int32_t sum = 0;
+  uint8_t used = 0;
+  for (uint8_t i = 0; i < n; i++) {
+    if (abs(sorted[i] - median) <= limit) {
+      sum += sorted[i];
+      used++;
+    }
+  }
+  if (used < MPL3115A2_CALIBRATION_MIN_SAMPLES) {
+    calibrationState = ALTIMETER_UNCALIBRATED;
+    return;
+  }
+
+  setReferencePressure((sum + used / 2) / used);
 }
 
 void Adafruit_MPL3115A2::setReadTimeout(int timeoutToSet) {
@@ -119,17 +179,13 @@ float Adafruit_MPL3115A2::getPressure() {
 }
 
 float Adafruit_MPL3115A2::getAltitudeFt(boolean ignoreTimeout) {
-  int32_t alt;
-
-  write8(MPL3115A2_CTRL_REG1,
-         MPL3115A2_CTRL_REG1_SBYB |
-         MPL3115A2_CTRL_REG1_OS128 |
-         MPL3115A2_CTRL_REG1_ALT);
+  uint32_t pressure;
 
+  // Already converting continuously in barometer mode (begin), so no mode write per sample
   uint8_t sta = 0;
-  unsigned int timeSinceStartOfReading = millis();
+  uint64_t startOfReading = systemMicros();
   while (! (sta & MPL3115A2_REGISTER_STATUS_PDR)) {
-    if (millis() - timeSinceStartOfReading >= readTimeout && !ignoreTimeout) {
+    if (millisSince(startOfReading) >= (uint32_t)readTimeout && !ignoreTimeout) {
       return -999;
     }
     sta = read8(MPL3115A2_REGISTER_STATUS);
@@ -146,20 +202,42 @@ float Adafruit_MPL3115A2::getAltitudeFt(boolean ignoreTimeout) {
 
   DueWire.requestFrom((uint8_t) MPL3115A2_ADDRESS, (uint8_t) 3, (uint32_t) MPL3115A2_WHOAMI, (uint8_t) 3);
 
-  alt = DueWire.read(); // receive DATA
-  alt <<= 8;
-  alt |= DueWire.read(); // receive DATA
-  alt <<= 8;
-  alt |= DueWire.read(); // receive DATA
-  alt >>= 4;
+  pressure = DueWire.read(); // receive DATA
+  pressure <<= 8;
+  pressure |= DueWire.read(); // receive DATA
+  pressure <<= 8;
+  pressure |= DueWire.read(); // receive DATA
+  pressure >>= 4;  //Q18.2 Pa
+  if (pressure == 0)
+    return -999;
+
+  // The temperature of the same conversion is latched in OUT_T (Q8.4 C)
+  int32_t temperature = (int32_t)(((int8_t)read8(MPL3115A2_REGISTER_TEMP_MSB) << 4) | (read8(MPL3115A2_REGISTER_TEMP_LSB) >> 4));
+  return getAltitudeFt(pressure, temperature);
+}
+
+// The rest of a reading, from the raw sample: calibration, and altitude above the reference
+float Adafruit_MPL3115A2::getAltitudeFt(uint32_t pressure, int32_t temperature) {
 
-  if (alt & 0x80000) {
-    alt |= 0xFFF00000;
+  if (calibrationState == ALTIMETER_CALIBRATING && millisSince(calibrationStart) > MPL3115A2_CALIBRATION_WINDOW_MS) {
+    if (calibrationCount >= MPL3115A2_CALIBRATION_MIN_SAMPLES)
+      finishCalibration();
+    else
+      calibrationState = ALTIMETER_UNCALIBRATED;
   }
 
-  float altitudeNonStdUnits = alt;  //I think not any standard unit
-  float altitudeDecimeters = altitudeNonStdUnits /= 16.0;  //I think it is now in decimeters
-  return (altitudeDecimeters / DEC_TO_FEET) - zeroAltitudeFt;
+  lastPressure = pressure;
+  lastTemperatureC = temperature * (1.0f / 16);
+
+  if (calibrationState == ALTIMETER_CALIBRATING)
+    addCalibrationSample(pressure);
+
+  // Hypsometric equation (see the header). ln ratio Q24 * T Q4 = Q28, the lapse factor is Q24, then ft/K Q16 takes it to Q8 ft
+  int32_t lnRatio = lnReference - lnQ24(pressure);
+  int64_t h = (int64_t)lnRatio * (temperature + ZERO_C_Q4);
+  h = (h * ((1L << 24) + (((int64_t)lnRatio * HYPSOMETRIC_HALF_LAPSE_Q24) >> 24))) >> 24;
+  h = (h * HYPSOMETRIC_FT_PER_K_Q16) >> 36;
+  return (int32_t)h * (1.0f / 256);
 }
 
 /**************************************************************************/
@@ -228,4 +306,4 @@ void Adafruit_MPL3115A2::write8(uint8_t a, uint8_t d) {
   DueWire.write(a); // Sends register address to write to
   DueWire.write(d); // Sends register data
   DueWire.endTransmission(false); // End transmission
-}
+}
@@ -30,7 +30,38 @@
 #include "DueWire.h"
 #endif
 
-#define DEC_TO_FEET 0.32808399
+#include "SystemClock.h"
+#include "FastMath.h"
+
+/*
+  The sensor runs in barometer mode, and altitude above the reference pressure (the zero) is worked out here in fixed point with the
+  hypsometric equation rather than by the chip's standard atmosphere:
+    h = R / g * Tmean * (ln P0 - ln P)
+  with the logs from lnQ24 (FastMath.h - a table, so the two logs' errors cancel to ~2 cm at any height) and Tmean the layer's mean
+  temperature: the measured temperature plus half the standard lapse rate over h (first order, so no divide). Against a standard lapse
+  atmosphere that is within 0.2 ft up to 300 m, 0.1% at 3 km.
+  The pressure is Q18.2 Pa and the temperature Q8.4 C, straight from the output registers. The only float is the final scaling.
+
+  The reference is set either by ground calibration (zeroing), or from a field QNH and elevation (setQnh, which works in the air).
+  Calibration runs in the background on the samples getAltitudeFt reads anyway, so it never blocks: once
+  MPL3115A2_CALIBRATION_SAMPLES have come in, samples further than MPL3115A2_CALIBRATION_OUTLIER_MADS median absolute deviations
+  from the median are dropped and the rest averaged.
+*/
+#define MPL3115A2_CALIBRATION_SAMPLES 8  //~4s at OS128
+#define MPL3115A2_CALIBRATION_MIN_SAMPLES 5  //Left after outlier rejection, or the calibration fails
+#define MPL3115A2_CALIBRATION_OUTLIER_MADS 3
+#define MPL3115A2_CALIBRATION_MIN_SPREAD 24  //Q18.2 Pa (~0.5 m) - floor on the MAD, so a run of identical samples doesn't reject everything else
+#define MPL3115A2_CALIBRATION_WINDOW_MS 10000  //Fails if the samples haven't come in by then
+
+#define HYPSOMETRIC_FT_PER_K_Q16 6293702  //R / g (dry air), in ft/K
+#define HYPSOMETRIC_HALF_LAPSE_Q24 1596043  //R / g * 0.0065 K/m / 2 - Tmean = T (1 + this * (ln P0 - ln P))
+#define ZERO_C_Q4 4370  //273.15 K, Q8.4
+#define MPL3115A2_DEFAULT_REFERENCE_Q2 405304  //101326 Pa, until calibrated
+
+//Calibration states
+#define ALTIMETER_UNCALIBRATED 0
+#define ALTIMETER_CALIBRATING 1
+#define ALTIMETER_CALIBRATED 2
 
 /*=========================================================================
     I2C ADDRESS/BITS
@@ -65,6 +96,8 @@
 #define MPL3115A2_WHOAMI                        (0x0C)
 
 #define MPL3115A2_PT_DATA_CFG 0x13
+#define MPL3115A2_BAR_IN_MSB 0x14  //Sea level pressure for the altitude calculation, 2 Pa units
+#define MPL3115A2_BAR_IN_LSB 0x15
 #define MPL3115A2_PT_DATA_CFG_TDEFE 0x01
 #define MPL3115A2_PT_DATA_CFG_PDEFE 0x02
 #define MPL3115A2_PT_DATA_CFG_DREM 0x04
@@ -88,6 +121,7 @@
 #define MPL3115A2_CTRL_REG3                     (0x28)
 #define MPL3115A2_CTRL_REG4                     (0x29)
 #define MPL3115A2_CTRL_REG5                     (0x2A)
+#define MPL3115A2_OFF_H 0x2D  //Altitude offset, signed whole metres
 
 #define MPL3115A2_REGISTER_STARTCONVERSION      (0x12)
 /*=========================================================================*/
@@ -96,18 +130,35 @@ class Adafruit_MPL3115A2 {
   public:
     Adafruit_MPL3115A2();
     boolean begin(void);
-    void zero(void);
+    void startCalibration(void);  //Re-zero at the current altitude, in the background
+    uint8_t getCalibrationState(void) { return calibrationState; }
+    uint32_t getReferencePressure(void) { return referencePressure; }  //Q18.2 Pa, ie. the zero
+    void setReferencePressure(uint32_t);  //Restore a previous zero (warm restart). Marks the altimeter calibrated
+    void setQnh(float qnhPa, float fieldElevationM);  //Zero at the field without calibrating there. Marks the altimeter calibrated
     void setReadTimeout(int);
     float getPressure(void);
     float getAltitudeFt(boolean);
+    float getAltitudeFt(uint32_t pressure, int32_t temperature);  //From a raw sample read elsewhere (Q18.2 Pa, Q8.4 C) - bench replay
     float getTemperature(void);
+    float getLastTemperatureC(void) { return lastTemperatureC; }  //From the last getAltitudeFt, no extra conversion
+    float getStaticPressurePa(void) { return lastPressure * 0.25f; }  //From the last getAltitudeFt
 
     void write8(uint8_t a, uint8_t d);
 
   private:
     uint8_t read8(uint8_t a);
     uint8_t mode;
-    float zeroAltitudeFt;
+    uint32_t referencePressure = MPL3115A2_DEFAULT_REFERENCE_Q2;
+    int32_t lnReference = lnQ24(MPL3115A2_DEFAULT_REFERENCE_Q2);
+    uint8_t calibrationState = ALTIMETER_UNCALIBRATED;
+    int32_t calibrationSamples[MPL3115A2_CALIBRATION_SAMPLES];  //Q18.2 Pa
+    uint8_t calibrationCount;
+    uint64_t calibrationStart;
+    uint32_t lastPressure = MPL3115A2_DEFAULT_REFERENCE_Q2;
+    float lastTemperatureC = 15;
     int readTimeout;
 
-};
+    void addCalibrationSample(int32_t pressure);
+    void finishCalibration(void);
+
+};
@@ -0,0 +1,131 @@
+#include "AttitudeFilter.h"
+#include "Arduino.h"
+
+#define Q30_MUL(a, b) ((int32_t)(((int64_t)(a) * (b)) >> 30))
+#define GRAVITY_INV_Q16 6683  //65536 / 9.807
+
+AttitudeFilter::AttitudeFilter() {
+  reset();
+}
+
+void AttitudeFilter::reset() {
+  initialized = false;
+  q[0] = ONE_Q30;
+  q[1] = q[2] = q[3] = 0;
+  for (int i = 0; i < 3; i++) {
+    integral[i] = 0;
+    rate[i] = 0;
+  }
+  speedQ16 = 0;
+}
+
+void AttitudeFilter::setSpeed(float speedMPS) {
+  speedQ16 = speedMPS * 65536;
+}
+
+void AttitudeFilter::update(const int32_t accelGQ16[3], const int32_t gyroRadQ16[3], uint32_t dtMicros) {
+
+  if (!initialized) {
+    initializeFromAccel(accelGQ16);
+    return;
+  }
+
+  if (dtMicros > ATTITUDE_MAX_DT_US)
+    dtMicros = ATTITUDE_MAX_DT_US;
+
+  // Centripetal correction (V * w is m/s^2 -> g)
+  int32_t cy = (int32_t)(((int64_t)speedQ16 * gyroRadQ16[2]) >> 16);
+  int32_t cz = (int32_t)(((int64_t)speedQ16 * gyroRadQ16[1]) >> 16);
+  int32_t ax = accelGQ16[0] >> 4;  //Q12, so the sum of squares fits in 32 bits
+  int32_t ay = (accelGQ16[1] - (int32_t)(((int64_t)cy * GRAVITY_INV_Q16) >> 16)) >> 4;
+  int32_t az = (accelGQ16[2] + (int32_t)(((int64_t)cz * GRAVITY_INV_Q16) >> 16)) >> 4;
+
+  int32_t g[3] = {gyroRadQ16[0], gyroRadQ16[1], gyroRadQ16[2]};
+
+  boolean inRange = abs(ax) < ATTITUDE_ACCEL_MAX_G_Q12 && abs(ay) < ATTITUDE_ACCEL_MAX_G_Q12 && abs(az) < ATTITUDE_ACCEL_MAX_G_Q12;
+  uint32_t norm = inRange ? isqrt32((uint32_t)(ax * ax) + (uint32_t)(ay * ay) + (uint32_t)(az * az)) : 0;  //Q12 g
+  if (norm > ATTITUDE_ACCEL_MIN_G_Q12 && norm < ATTITUDE_ACCEL_MAX_G_Q12) {
+
+    // Measured up, as a Q30 unit vector (one divide)
+    int64_t recip = (1LL << 42) / norm;
+    int32_t ux = (int32_t)((ax * recip) >> 12);
+    int32_t uy = (int32_t)((ay * recip) >> 12);
+    int32_t uz = (int32_t)((az * recip) >> 12);
+
+    // Estimated up (third row of the rotation matrix)
+    int32_t vx = 2 * (Q30_MUL(q[1], q[3]) - Q30_MUL(q[0], q[2]));
+    int32_t vy = 2 * (Q30_MUL(q[0], q[1]) + Q30_MUL(q[2], q[3]));
+    int32_t vz = Q30_MUL(q[0], q[0]) - Q30_MUL(q[1], q[1]) - Q30_MUL(q[2], q[2]) + Q30_MUL(q[3], q[3]);
+
+    // Error = measured x estimated, Q30 -> Q16
+    int32_t e[3];
+    e[0] = (Q30_MUL(uy, vz) - Q30_MUL(uz, vy)) >> 14;
+    e[1] = (Q30_MUL(uz, vx) - Q30_MUL(ux, vz)) >> 14;
+    e[2] = (Q30_MUL(ux, vy) - Q30_MUL(uy, vx)) >> 14;
+
+    for (int i = 0; i < 3; i++) {
+      integral[i] += (int32_t)(((int64_t)e[i] * dtMicros) >> MAHONY_KI_SHIFT);
+      g[i] += MAHONY_KP * e[i];
+    }
+  }
+
+  for (int i = 0; i < 3; i++) {
+    g[i] += integral[i];
+    rate[i] = g[i];
+  }
+
+  // Half the rotation this step, Q30: rate (Q16) * dt (us) * 2^14 / 2e6, and 2^14 / 2e6 = 8590 / 2^20
+  int32_t h[3];
+  for (int i = 0; i < 3; i++) {
+    h[i] = (int32_t)(((int64_t)g[i] * dtMicros * 8590) >> 20);
+  }
+
+  // q += 1/2 q x (0, w) dt
+  int32_t q0 = q[0], q1 = q[1], q2 = q[2], q3 = q[3];
+  q[0] += -Q30_MUL(q1, h[0]) - Q30_MUL(q2, h[1]) - Q30_MUL(q3, h[2]);
+  q[1] += Q30_MUL(q0, h[0]) + Q30_MUL(q2, h[2]) - Q30_MUL(q3, h[1]);
+  q[2] += Q30_MUL(q0, h[1]) - Q30_MUL(q1, h[2]) + Q30_MUL(q3, h[0]);
+  q[3] += Q30_MUL(q0, h[2]) + Q30_MUL(q1, h[1]) - Q30_MUL(q2, h[0]);
+
+  // Renormalize. |q| stays within a hair of 1, so one Newton step of 1/sqrt(n) from 1 is enough: (3 - n) / 2
+  int32_t n = Q30_MUL(q[0], q[0]) + Q30_MUL(q[1], q[1]) + Q30_MUL(q[2], q[2]) + Q30_MUL(q[3], q[3]);
+  int32_t scale = (int32_t)((3LL * ONE_Q30 - n) / 2);
+  for (int i = 0; i < 4; i++) {
+    q[i] = Q30_MUL(q[i], scale);
+  }
+}
+
+// Start from the attitude the accelerometer gives (yaw = 0) rather than level, so there's no settling time
+void AttitudeFilter::initializeFromAccel(const int32_t accelGQ16[3]) {
+
+  int32_t ax = accelGQ16[0], ay = accelGQ16[1], az = accelGQ16[2];
+  if (ax == 0 && ay == 0 && az == 0)
+    return;
+
+  // Binary angles, halved for the quaternion
+  int32_t roll = atan2Angle(ay, az);
+  int32_t pitch = atan2Angle(-ax, isqrt64((int64_t)ay * ay + (int64_t)az * az));  //Sensor frame, ie. nose down +ve
+  int32_t cr = cosQ30(roll / 2), sr = sinQ30(roll / 2), cp = cosQ30(pitch / 2), sp = sinQ30(pitch / 2);
+
+  q[0] = Q30_MUL(cr, cp);
+  q[1] = Q30_MUL(sr, cp);
+  q[2] = Q30_MUL(cr, sp);
+  q[3] = -Q30_MUL(sr, sp);
+  initialized = true;
+}
+
+// Straight from the Q30 quaternion (the products are Q60, so >> 29 is Q30 times 2)
+float AttitudeFilter::getRollDeg() {
+  int32_t y = ((int64_t)q[0] * q[1] + (int64_t)q[2] * q[3]) >> 29;
+  int32_t x = ONE_Q30 - (int32_t)(((int64_t)q[1] * q[1] + (int64_t)q[2] * q[2]) >> 29);
+  return atan2Angle(y, x) * (float)ANGLE_TO_DEG;
+}
+
+float AttitudeFilter::getPitchDeg() {
+  int32_t s = ((int64_t)q[0] * q[2] - (int64_t)q[3] * q[1]) >> 29;
+  return -asinAngle(s) * (float)ANGLE_TO_DEG;
+}
+
+float AttitudeFilter::getRateDPS(int axis) {
+  return rate[axis] / 65536.0 * 180 / PI;
+}
@@ -0,0 +1,49 @@
+#ifndef _ATTITUDE_FILTER_H
+#define _ATTITUDE_FILTER_H
+
+#include "Arduino.h"
+#include "FastMath.h"
+
+/*
+  Mahony complementary filter for attitude, in fixed point (the Due has no FPU, and this runs at the IMU rate).
+
+  The quaternion is integrated from the gyro, and the accelerometer pulls its idea of "up" back towards the measured one through a
+  PI controller on the cross product error (the I term also tracks the gyro bias).
+  In a turn the accelerometer also sees the centripetal acceleration, which would drag the bank angle back towards level. That is
+  taken out with the speed: a_y -= V * wz, a_z += V * wy (as in DCM). Samples far from 1g (hard pull ups) skip the correction.
+
+  Formats: quaternion and unit vectors Q30, rates Q16 rad/s, accelerations Q16 g.
+  Axes are the sensor's (x forward, y left, z up). Outputs are aviation convention: roll right wing down +ve, pitch nose up +ve.
+*/
+
+#define MAHONY_KP 2  //Proportional gain (1/s)
+#define MAHONY_KI_SHIFT 24  //Integral gain = 1e6 / 2^shift (~0.06 /s, dt is in us)
+#define ATTITUDE_ACCEL_MIN_G_Q12 3072  //0.75g - outside this the accelerometer isn't used
+#define ATTITUDE_ACCEL_MAX_G_Q12 5120  //1.25g
+#define ATTITUDE_MAX_DT_US 50000  //Longer gaps than this are clamped (we'd rather be wrong briefly than integrate a huge step)
+
+class AttitudeFilter {
+
+  public:
+    AttitudeFilter();
+
+    void reset();
+    void setSpeed(float speedMPS);  //For the centripetal correction - airspeed if we have it, otherwise GPS speed
+    void update(const int32_t accelGQ16[3], const int32_t gyroRadQ16[3], uint32_t dtMicros);
+
+    boolean isInitialized() { return initialized; }
+    float getRollDeg();
+    float getPitchDeg();
+    float getRateDPS(int axis);  //Bias corrected body rates (sensor axes)
+
+  private:
+    boolean initialized;
+    int32_t q[4];
+    int32_t integral[3];  //Q16 rad/s
+    int32_t rate[3];  //Q16 rad/s, last corrected rates
+    int32_t speedQ16;  //m/s
+
+    void initializeFromAccel(const int32_t accelGQ16[3]);
+};
+
+#endif //_ATTITUDE_FILTER_H
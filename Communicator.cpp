@@ -17,11 +17,13 @@
 #include "Communicator.h"
 #include <Servo.h>
 #include "Targeter.h"
+#include "FastMath.h"
 
 // System variables
 boolean noFixLedIsOn = true;
 
 Adafruit_GPS GPS;
+GpsClock gpsClock;
 Targeter targeter;
 
 //Constructor
@@ -60,29 +62,92 @@ void Communicator::initialize() {
   altitudeAtDropFt = 0;
   timeAtDrop = 0;
   bufferIndex = 0;
+  paramBufferIndex = 0;
 
-  //Attach servo, init position to closed
-  dropServo.attach(DROP_PIN);
+  //Attach servos, init positions to closed
   dropBayServoPos = DROP_BAY_CLOSED;
-  dropServo.writeMicroseconds(dropBayServoPos);
+  attachReleaseServos(0);
 
   //Attach gimbal servos
   gimbalPan.attach(GIMBAL_PAN_PIN);
   gimbalPitch.attach(GIMBAL_PIT_PIN);
   gimbalPanPos = gimbalPitPos = GIMBAL_NEUTRAL;
-  gimbalPan.writeMicroseconds(gimbalPanPos);
-  gimbalPitch.writeMicroseconds(gimbalPitPos);
+  writtenPanPulse = writtenPitPulse = -1;
+  writeGimbal(gimbalPanPos, gimbalPitPos);
 
   int maxTries = 3, numTries = 0;
   while (!initXBee() && ++numTries < maxTries); //Keep trying to put into transparent mode until failure
 
   //Setup the GPS
+#ifdef Flight_Replay
+  initGPSReceivers();  //Receiver 0 is fed from the recording (setGPSReplay), nothing to configure
+#else
   setupGPS();
+#endif
 
   DEBUG_PRINTLN("Done Communicator Initialize (includes GPS)");
 
 }
 
+// Called in void setup() instead of initialize() after a warm restart (see WarmRestart.h)
+// The XBee and GPS were not reset along with us, so they are still in transparent mode / configured - only the serial ports need reopening
+void Communicator::warmInitialize(const WarmRestartState &state) {
+
+  DEBUG_PRINTLN("Warm Initializing Communicator");
+
+  altitudeFt = state.altitudeFt;
+  altitudeAtDropFt = state.altitudeAtDropFt;
+  timeAtDrop = systemMicros();  //if the bay was open, the close timeout restarts from now
+  bufferIndex = 0;
+  paramBufferIndex = 0;
+  autoDrop = state.autoDrop;
+  telemetryProtocol = state.mavlink ? TELEMETRY_MAVLINK : TELEMETRY_PROTOCOL;
+
+  //Attach servos in the checkpointed positions
+  dropBayServoPos = state.dropBayOpen ? DROP_BAY_OPEN : DROP_BAY_CLOSED;
+  attachReleaseServos(state.payloadsReleased);
+
+  //Gimbal goes back to neutral (not worth checkpointing)
+  gimbalPan.attach(GIMBAL_PAN_PIN);
+  gimbalPitch.attach(GIMBAL_PIT_PIN);
+  gimbalPanPos = gimbalPitPos = GIMBAL_NEUTRAL;
+  writtenPanPulse = writtenPitPulse = -1;
+  writeGimbal(gimbalPanPos, gimbalPitPos);
+
+  XBEE_SERIAL.begin(XBEE_BAUD);
+  while (!XBEE_SERIAL);
+
+  initGPSReceivers();
+  attachGPSPPS();
+
+  //Keep reporting the last known position until the next fix comes in (at most 200ms)
+  if (state.haveFix) {
+    GPS.latitudeDegrees = state.lastLatitudeDegrees;
+    GPS.longitudeDegrees = state.lastLongitudeDegrees;
+  }
+
+  targeter.setTargetUTM(state.targetEasting, state.targetNorthing);
+
+  DEBUG_PRINTLN("Done Communicator Warm Initialize");
+}
+
+void Communicator::fillWarmRestartState(WarmRestartState &state) {
+
+  state.altitudeAtDropFt = altitudeAtDropFt;
+  state.targetEasting = targeter.getTargetEasting();
+  state.targetNorthing = targeter.getTargetNorthing();
+  state.lastLatitudeDegrees = GPS.latitudeDegrees;
+  state.lastLongitudeDegrees = GPS.longitudeDegrees;
+  state.haveFix = GPS.fix;
+  state.autoDrop = autoDrop;
+  state.dropBayOpen = (dropBayServoPos == DROP_BAY_OPEN);
+  state.mavlink = (telemetryProtocol == TELEMETRY_MAVLINK);
+  state.payloadsReleased = 0;
+  for (int i = 0; i < NUM_PAYLOADS; i++) {
+    if (payloadReleased[i]) state.payloadsReleased |= 1 << i;
+  }
+}
+
 
 bool Communicator::initXBee()
 {
@@ -140,40 +205,81 @@ bool Communicator::sendCmdAndWaitForOK(String cmd, int timeout)
     return false;
 }
 
+//In stabilized mode gimbalPanPos/gimbalPitPos are the look direction relative to the horizon, and updateGimbal moves the servos
 void Communicator::gimbalPanLeft() {
   if(gimbalPanPos - GIMBAL_INC < GIMBAL_MIN) return;
   gimbalPanPos -= GIMBAL_INC;
-  gimbalPan.writeMicroseconds(gimbalPanPos);
+  if (!gimbalStabilized) writeGimbal(gimbalPanPos, gimbalPitPos);
   DEBUG_PRINTLN("LEFT");
 }
 void Communicator::gimbalPanRight() {
   if(gimbalPanPos + GIMBAL_INC > GIMBAL_MAX) return;
   gimbalPanPos += GIMBAL_INC;
-  gimbalPan.writeMicroseconds(gimbalPanPos);
+  if (!gimbalStabilized) writeGimbal(gimbalPanPos, gimbalPitPos);
   DEBUG_PRINTLN("RIGHT");
 }
 void Communicator::gimbalPitDown() {
   if(gimbalPitPos + GIMBAL_INC > GIMBAL_MAX) return;
   gimbalPitPos += GIMBAL_INC;
-  gimbalPitch.writeMicroseconds(gimbalPitPos);
+  if (!gimbalStabilized) writeGimbal(gimbalPanPos, gimbalPitPos);
   DEBUG_PRINTLN("UP");
 }
 void Communicator::gimbalPitUp() {
   if(gimbalPitPos - GIMBAL_INC < GIMBAL_MIN) return;
   gimbalPitPos -= GIMBAL_INC;
-  gimbalPitch.writeMicroseconds(gimbalPitPos);
+  if (!gimbalStabilized) writeGimbal(gimbalPanPos, gimbalPitPos);
   DEBUG_PRINTLN("DOWN");
 }
 void Communicator::gimbalReset() {
   gimbalPitPos = gimbalPanPos = GIMBAL_NEUTRAL;
-  gimbalPitch.writeMicroseconds(gimbalPitPos);
-  gimbalPan.writeMicroseconds(gimbalPanPos);
+  if (!gimbalStabilized) writeGimbal(gimbalPanPos, gimbalPitPos);
   DEBUG_PRINTLN("RESET");
 }
 
+void Communicator::setGimbalStabilized(boolean stabilized) {
+  gimbalStabilized = stabilized;
+  if (!gimbalStabilized) writeGimbal(gimbalPanPos, gimbalPitPos);
+  sendMessage(MESSAGE_GIM_STABILIZE, gimbalStabilized ? 1.0 : 0.0);
+}
+
+void Communicator::setGimbalAngles(float panDeg, float tiltDeg) {
+  gimbalPanPos = constrain(GIMBAL_NEUTRAL + (int)lround(panDeg * GIMBAL_US_PER_DEG), GIMBAL_MIN, GIMBAL_MAX);
+  gimbalPitPos = constrain(GIMBAL_NEUTRAL + (int)lround(tiltDeg * GIMBAL_US_PER_DEG), GIMBAL_MIN, GIMBAL_MAX);
+  if (!gimbalStabilized) writeGimbal(gimbalPanPos, gimbalPitPos);
+}
+
+//Called at GIMBAL_LOOP_TIME with the latest attitude. Does nothing unless stabilized
+void Communicator::updateGimbal(float rollDeg, float pitchDeg, float rollRateDPS, float pitchRateDPS, float yawRateDPS) {
+
+  if (!gimbalStabilized)
+    return;
+
+  float lookPanDeg = (gimbalPanPos - GIMBAL_NEUTRAL) / GIMBAL_US_PER_DEG;
+  float lookTiltDeg = (gimbalPitPos - GIMBAL_NEUTRAL) / GIMBAL_US_PER_DEG;
+  gimbalStabilizer.update(lookPanDeg, lookTiltDeg, rollDeg, pitchDeg, rollRateDPS, pitchRateDPS, yawRateDPS);
+  writeGimbal(gimbalStabilizer.getPanPulse(GIMBAL_NEUTRAL, GIMBAL_MIN, GIMBAL_MAX), gimbalStabilizer.getTiltPulse(GIMBAL_NEUTRAL, GIMBAL_MIN, GIMBAL_MAX));
+}
+
+//Only touch a servo when its pulse actually changes
+void Communicator::writeGimbal(int panPulse, int pitPulse) {
+  if (panPulse != writtenPanPulse) {
+    gimbalPan.writeMicroseconds(panPulse);
+    writtenPanPulse = panPulse;
+  }
+  if (pitPulse != writtenPitPulse) {
+    gimbalPitch.writeMicroseconds(pitPulse);
+    writtenPitPulse = pitPulse;
+  }
+}
+
 // Function that is called from main program to receive incoming serial commands from ground station
 // Commands are one byte long, represented as characters for easy reading
-void Communicator::recieveCommands(unsigned long curTime) {
+void Communicator::recieveCommands(uint64_t curTime) {
+
+#ifdef TELEMETRY_AUTO_SWITCH
+  // A frame left part way through since the last call
+  if (telemetryProtocol != TELEMETRY_MAVLINK && mavlink.expire(curTime)) handleAbortedMavlink(curTime);
+#endif
 
   // Look for new byte from serial buffer
   while (XBEE_SERIAL.available() > 0) {
@@ -182,127 +288,241 @@ void Communicator::recieveCommands(unsigned long curTime) {
     DEBUG_PRINT("Received a command: ");
     DEBUG_PRINTLN(incomingByte);
 
-    // If we are currently in the middle of receiving a new GPS target
-    if(bufferIndex > 0)
-    {
-      /*Serial.print(bufferIndex);
-      Serial.print(": ");
-      Serial.println((char)incomingByte);
-      */
-      // Note: If you want to notify the groundstation of a failed transmission, this check should move outside of the encapsualting if-statement
-      if((curTime - transmitStartTime) > 2000) {
-        // If it has been 2 seconds since the start character and we still aren't done,
-        // then there was probably a transmit error. Just give up.
-        // This is very unlikely, but I don't want to get stuck waiting for something that isn't coming
-        // and miss meaningful messages
+    // MAVLink frames. In legacy mode a frame can only start between legacy messages (STX isn't a command), and once started the
+    // rest of it goes to the parser too - its bytes must not be taken as commands
+    if (telemetryProtocol == TELEMETRY_MAVLINK) {
+      if (mavlink.parse(incomingByte, curTime)) handleMavlinkMessage();
+      continue;
+    }
+#ifdef TELEMETRY_AUTO_SWITCH
+    if (bufferIndex == 0 && paramBufferIndex == 0 && (incomingByte == MAVLINK_STX || !mavlink.isIdle())) {
+      if (mavlink.parse(incomingByte, curTime)) handleMavlinkMessage();
+      else handleAbortedMavlink(curTime);
+      continue;
+    }
+#endif
+
+    handleLegacyByte(incomingByte, curTime);
+  } // End while(XBEE_SERIAL.available() > 0) 
+} // End recieveCommands()
+
+#ifdef TELEMETRY_AUTO_SWITCH
+// Before the link has switched, a frame the parser gives up on (length out of range, or the bytes stopped part way) was most likely
+// a stray STX in the legacy stream - the bytes it took are legacy commands, so they go to the legacy handling rather than being lost
+void Communicator::handleAbortedMavlink(uint64_t curTime) {
+  const uint8_t *aborted = mavlink.getAborted();
+  for (int i = 0; i < mavlink.getAbortedLength(); i++) {
+    handleLegacyByte(aborted[i], curTime);
+  }
+}
+#endif
+
+// One byte of the legacy protocol: a single character command, or part of a target/parameter message
+void Communicator::handleLegacyByte(byte incomingByte, uint64_t curTime) {
+
+  // If we are currently in the middle of receiving a new GPS target
+  if(bufferIndex > 0)
+  {
+    /*Serial.print(bufferIndex);
+    Serial.print(": ");
+    Serial.println((char)incomingByte);
+    */
+    // Note: If you want to notify the groundstation of a failed transmission, this check should move outside of the encapsualting if-statement
+    if(microsBetween(transmitStartTime, curTime) > 2000 * MICROS_PER_MILLI) {
+      // If it has been 2 seconds since the start character and we still aren't done,
+      // then there was probably a transmit error. Just give up.
+      // This is very unlikely, but I don't want to get stuck waiting for something that isn't coming
+      // and miss meaningful messages
+      bufferIndex = 0;
+    }
+    if(bufferIndex < 9) {
+      targetLat[bufferIndex++ - 1] = incomingByte;
+      return; // Don't check if current byte matches a command - it might - but that's just a coincidence
+    } else if(bufferIndex == 9) {
+      if(incomingByte == '%') {
+        // We're on the right track
+        bufferIndex++;
+        return; // Don't check if current byte matches a command
+      } else {
+        // There was a transmission error
+        // Give up on this message
         bufferIndex = 0;
       }
-      if(bufferIndex < 9) {
-        targetLat[bufferIndex++ - 1] = incomingByte;
-        continue; // Don't check if current byte matches a command - it might - but that's just a coincidence
-      } else if(bufferIndex == 9) {
-        if(incomingByte == '%') {
-          // We're on the right track
-          bufferIndex++;
-          continue; // Don't check if current byte matches a command
+    } else if(bufferIndex > 9 && bufferIndex < 18) {
+      targetLon[bufferIndex++ - 10] = incomingByte;
+    } else if(bufferIndex == 18) {
+      if(incomingByte == 'e') {
+        // We succesfully received the new target
+        // Convert lat and lon to doubles
+        memcpy(&targetLatDoub, targetLat, 8);
+        memcpy(&targetLonDoub, targetLon, 8);
+        /*Serial.println("Longitude Double Bytes: ");
+        for(int i = 0; i < 8; i++)
+        {
+          Serial.print(i);
+          Serial.print(": ");
+          Serial.println(((char*)&targetLonDoub)[i]);
+        }*/
+        // Update targeter
+        // Note: Currently, it is assumed that the altitude is 0. This is wrong if the altimeter is reset at an altitude different than the target altitude
+        targeter.setTargetData(targetLatDoub, targetLonDoub, 0);
+        /*Serial.print("Latitude: ");
+        Serial.println(targetLatDoub);
+        Serial.print("Longitude: ");
+        Serial.println(targetLonDoub);
+        */
+        sendMessage('g');
+        bufferIndex = 0;
+        return; // Don't bother checking if the incomingByte matches any of the other codes - it doesn't
+      }
+      bufferIndex = 0; // Last byte didn't match - something got screwed up
+    } else {
+      // Should never get here
+      bufferIndex = 0;
+    }
+      
+  } // End if(bufferIndex > 0)
+
+  // In the middle of a parameter get/set: same timeout as the target message, then the byte is treated as a command
+  if (paramBufferIndex > 0) {
+    if (microsBetween(paramStartTime, curTime) > 2000 * MICROS_PER_MILLI) {
+      paramBufferIndex = 0;
+    } else {
+      paramBuffer[paramBufferIndex++ - 1] = incomingByte;
+      if (paramBufferIndex - 1 == paramMessageLength()) {
+        if (paramCommand == INCOME_POINT_ACK) {
+          uint16_t id;
+          memcpy(&id, paramBuffer, 2);
+          pointMarker.acknowledge(id);
         } else {
-          // There was a transmission error
-          // Give up on this message
-          bufferIndex = 0;
+          handleParamMessage();
         }
-      } else if(bufferIndex > 9 && bufferIndex < 18) {
-        targetLon[bufferIndex++ - 10] = incomingByte;
-      } else if(bufferIndex == 18) {
-        if(incomingByte == 'e') {
-          // We succesfully received the new target
-          // Convert lat and lon to doubles
-          memcpy(&targetLatDoub, targetLat, 8);
-          memcpy(&targetLonDoub, targetLon, 8);
-          /*Serial.println("Longitude Double Bytes: ");
-          for(int i = 0; i < 8; i++)
-          {
-            Serial.print(i);
-            Serial.print(": ");
-            Serial.println(((char*)&targetLonDoub)[i]);
-          }*/
-          // Update targeter
-          // Note: Currently, it is assumed that the altitude is 0. This is wrong if the altimeter is reset at an altitude different than the target altitude
-          targeter.setTargetData(targetLatDoub, targetLonDoub, 0);
-          /*Serial.print("Latitude: ");
-          Serial.println(targetLatDoub);
-          Serial.print("Longitude: ");
-          Serial.println(targetLonDoub);
-          */
-          sendMessage('g');
-          bufferIndex = 0;
-          continue; // Don't bother checking if the incomingByte matches any of the other codes - it doesn't
-        }
-        bufferIndex = 0; // Last byte didn't match - something got screwed up
-      } else {
-        // Should never get here
-        bufferIndex = 0;
+        paramBufferIndex = 0;
       }
-        
-    } // End if(bufferIndex > 0)
-
-    if (incomingByte == INCOME_DROP_OPEN) {
-      // Drop bay (Manual Drop)
-      setDropBayState(MANUAL_CMD, DROPBAY_OPEN);
-    } else if (incomingByte == INCOME_DROP_CLOSE) {
-      setDropBayState(MANUAL_CMD, DROPBAY_CLOSE);
-    } else if (incomingByte == INCOME_AUTO_ON) {
-      // Turn ON auto drop
-      autoDrop = true;
-      sendMessage(MESSAGE_AUTO_ON);
-    } else if (incomingByte == INCOME_AUTO_OFF) {
-      // Turn OFF auto drop
-      autoDrop = false;
-      sendMessage(MESSAGE_AUTO_OFF);
-    } else if (incomingByte == INCOME_RESET) {  //RESET FUNCTION.
-      // Reset (only sensors, not drop bay??)
-      sendData();  // Flush current data packets
-      reset = true;
-    } else if (incomingByte == INCOME_RESTART) {  //RESTART FUNCTION.
-      // Restart
-      sendData();  //Flush current data packets
-      restart = true;
-      setDropBayState(MANUAL_CMD, DROPBAY_CLOSE); //close drop bay
-    } else if (incomingByte == INCOME_DROP_ALT) {  //SEND ALTITUDE_AT_DROP
-      // Return Altitude at Drop
-      sendMessage(MESSAGE_ALT_AT_DROP, (float)altitudeAtDropFt);
-    } else if(incomingByte == INCOME_BATTERY_V){
-       // Send Battery Voltage
-       sendMessage(MESSAGE_BATTERY_V, (float)analogRead(BATTERY_VOLTAGE_PIN)*ANALOG_READ_CONV);
-    } else if(incomingByte == INCOME_NEW_TARGET_START){
-      // Start of a gps target position update message
-      bufferIndex = 1;
-      transmitStartTime = curTime;
-    } else if(incomingByte == INCOME_PAN_LEFT) {
-      gimbalPanLeft();
-    } else if(incomingByte == INCOME_PAN_RIGHT) {
-      gimbalPanRight();
-    } else if(incomingByte == INCOME_PIT_UP) {
-      gimbalPitUp();
-    } else if(incomingByte == INCOME_PIT_DOWN) {
-      gimbalPitDown();
-    } else if(incomingByte == INCOME_GIM_RESET) {
-      gimbalReset();
-    } else if(incomingByte == INCOME_POINT) {
-      markPoint();
+      return;
     }
+  }
 
-  } // End while(XBEE_SERIAL.available() > 0) 
-} // End recieveCommands()
+  if (incomingByte == INCOME_DROP_OPEN) {
+    // Drop bay (Manual Drop)
+    setDropBayState(MANUAL_CMD, DROPBAY_OPEN);
+  } else if (incomingByte == INCOME_DROP_CLOSE) {
+    setDropBayState(MANUAL_CMD, DROPBAY_CLOSE);
+  } else if (incomingByte == INCOME_AUTO_ON) {
+    // Turn ON auto drop
+    autoDrop = true;
+    sendMessage(MESSAGE_AUTO_ON);
+  } else if (incomingByte == INCOME_AUTO_OFF) {
+    // Turn OFF auto drop
+    autoDrop = false;
+    sendMessage(MESSAGE_AUTO_OFF);
+  } else if (incomingByte == INCOME_RESET) {  //RESET FUNCTION.
+    // Reset (only sensors, not drop bay??)
+    sendData();  // Flush current data packets
+    reset = true;
+  } else if (incomingByte == INCOME_RESTART) {  //RESTART FUNCTION.
+    // Restart
+    sendData();  //Flush current data packets
+    restart = true;
+    setDropBayState(MANUAL_CMD, DROPBAY_CLOSE); //close drop bay
+  } else if (incomingByte == INCOME_DROP_ALT) {  //SEND ALTITUDE_AT_DROP
+    // Return Altitude at Drop
+    sendMessage(MESSAGE_ALT_AT_DROP, (float)altitudeAtDropFt);
+  } else if(incomingByte == INCOME_BATTERY_V){
+     // Send Battery Voltage
+     sendMessage(MESSAGE_BATTERY_V, (float)analogRead(BATTERY_VOLTAGE_PIN)*ANALOG_READ_CONV);
+  } else if(incomingByte == INCOME_NEW_TARGET_START){
+    // Start of a gps target position update message
+    bufferIndex = 1;
+    transmitStartTime = curTime;
+  } else if(incomingByte == INCOME_PAN_LEFT) {
+    gimbalPanLeft();
+  } else if(incomingByte == INCOME_PAN_RIGHT) {
+    gimbalPanRight();
+  } else if(incomingByte == INCOME_PIT_UP) {
+    gimbalPitUp();
+  } else if(incomingByte == INCOME_PIT_DOWN) {
+    gimbalPitDown();
+  } else if(incomingByte == INCOME_GIM_RESET) {
+    gimbalReset();
+  } else if(incomingByte == INCOME_GIM_STABILIZE) {
+    setGimbalStabilized(!gimbalStabilized);
+  } else if(incomingByte == INCOME_POINT) {
+    markPoint(curTime, true);
+  } else if(incomingByte == INCOME_DROP_RECORDS) {
+    for (int i = 0; i < NUM_PAYLOADS; i++) {
+      if (dropRecords[i].valid) sendDropRecord(i);
+    }
+  } else if(incomingByte == INCOME_PARAM_GET || incomingByte == INCOME_PARAM_SET || incomingByte == INCOME_POINT_ACK) {
+    paramCommand = incomingByte;
+    paramBufferIndex = 1;
+    paramStartTime = curTime;
+  } else if(incomingByte == INCOME_PARAM_LIST) {
+    for (int i = 0; i < paramTable.getCount(); i++) sendParam(i);
+  } else if(incomingByte == INCOME_PARAM_SAVE) {
+    sendMessage(MESSAGE_PARAM_SAVED, paramTable.save() ? 1 : 0);
+  } else if(incomingByte == INCOME_PARAM_DEFAULTS) {
+    paramTable.setDefaults();
+    for (int i = 0; i < paramTable.getCount(); i++) sendParam(i);
+  }
+}
 
 
-void Communicator::markPoint() {
+unsigned int Communicator::paramMessageLength() {
+  if (paramCommand == INCOME_PARAM_SET) return 6;
+  if (paramCommand == INCOME_POINT_ACK) return 2;
+  return 1;
+}
+
+// The position is filled in from the fixes either side of the mark once the next one is in (PointMarker.h)
+void Communicator::markPoint(uint64_t time, boolean fromGround) {
+  uint8_t flags = (gpsClock.isLocked() ? 0 : POINT_CLOCK_UNLOCKED) | (fromGround ? POINT_FROM_GROUND : 0);
+  uint16_t id = pointMarker.mark(time, flags);
+  DEBUG_PRINT("Point marked, id ");
+  DEBUG_PRINTLN(id);
+}
+
+// One packet per call at most, so a backlog after a link drop goes out spread over the medium loops
+void Communicator::sendPoints(uint64_t now) {
+  pointMarker.update(now);
+  if (telemetryProtocol != TELEMETRY_LEGACY) return;
+
+  PointMark *m = pointMarker.nextToSend(now);
+  if (m != NULL) sendPoint(*m);
+}
+
+void Communicator::sendPointStatus() {
+  int waiting = pointMarker.getWaiting();
+  uint32_t dropped = pointMarker.getDropped();
+  if (waiting == 0 && dropped == 0) return;
+
+  sendMessage(MESSAGE_POINTS_WAITING, waiting);
+  sendMessage(MESSAGE_POINTS_DROPPED, dropped);
+}
+
+void Communicator::resetPoints() {
+  sendPointStatus();
+  pointMarker.reset();
+}
+
+// Format: *t + id (uint16) + flags (uint8, POINT_* in PointMarker.h) + UTC of the mark (float, s since midnight, -1 if the GPS
+// clock isn't locked) + altitude (float, ft) + lat + lon (int32, 1e-7 degrees) + GPS altitude (float, m) + course (float, degrees)
+// + ground speed (float, m/s) + ee
+void Communicator::sendPoint(const PointMark &m) {
+
+  float utcSeconds = gpsClock.isLocked() ? (float)((double)gpsClock.utcMicrosAt(m.time) / MICROS_PER_SECOND) : -1;
+
   XBEE_SERIAL.print("*");
   XBEE_SERIAL.print(POINT_PACKET);
-  sendFloat((float)altitudeFt);
-  sendFloat(GPS.latitudeDegrees);
-  sendFloat(GPS.longitudeDegrees);
-  sendFloat(GPS.altitudeMeters);
-  sendFloat(GPS.angle);
+  sendUint16_t(m.id);
+  sendUint8_t(m.flags);
+  sendFloat(utcSeconds);
+  sendFloat(m.altitudeFt);
+  sendInt(m.latitudeE7);
+  sendInt(m.longitudeE7);
+  sendFloat(m.gpsAltitudeM);
+  sendFloat(m.courseDeg);
+  sendFloat(m.speedMPS);
   XBEE_SERIAL.print("ee");
 }
 
@@ -326,6 +546,11 @@ void Communicator::sendData() {
     GPS.milliseconds = random(0,1000);
     GPS.seconds = random(0,60);  */
 
+  if (telemetryProtocol == TELEMETRY_MAVLINK) {
+    sendMavlinkTelemetry();
+    return;
+  }
+
   float battLevel = (float)analogRead(BATTERY_VOLTAGE_PIN)*ANALOG_READ_CONV;
   //Send to XBee
   XBEE_SERIAL.print("*");
@@ -335,7 +560,7 @@ void Communicator::sendData() {
   sendFloat(GPS.latitudeDegrees);
   sendFloat(GPS.longitudeDegrees);
   sendFloat(GPS.HDOP);
-  sendFloat((float)GPS.msSinceValidHDOP);
+  sendFloat(GPS.quality.getExpectedErrorM(systemMicros()));  //1 sigma position error (m) - see GpsQuality.h
   sendFloat(GPS.altitudeMeters);
   sendFloat(battLevel);
   sendFloat(GPS.angle);
@@ -363,7 +588,27 @@ void Communicator::sendData() {
 
 }
 
+// Wind estimate packet: *iAAAABBBBCCCCDDDDEee  AAAA = wind east (m/s, towards), BBBB = wind north, CCCC = airspeed (fit or sensor),
+// DDDD = RMS fit error (m/s), E = quality (uint8, 0 = none, 1 = head/tailwind only, 2 = full fit). Wind changes slowly, so this goes in
+// the long loop rather than every data packet
+void Communicator::sendWind() {
+
+  if (telemetryProtocol != TELEMETRY_LEGACY) return;
+
+  WindEstimator &wind = targeter.getWindEstimator();
+  XBEE_SERIAL.print("*");
+  XBEE_SERIAL.print(WIND_PACKET);
+  sendFloat(wind.getWindEast());
+  sendFloat(wind.getWindNorth());
+  sendFloat(wind.getAirspeed());
+  sendFloat(wind.getFitErrorMPS());
+  sendUint8_t(wind.getQuality());
+  XBEE_SERIAL.print("ee");
+}
+
 void Communicator::sendMessage(char message) {
+  if (telemetryProtocol != TELEMETRY_LEGACY) return;
+
   XBEE_SERIAL.print("*");
   XBEE_SERIAL.print(message);
   XBEE_SERIAL.print("ee");
@@ -372,6 +617,8 @@ void Communicator::sendMessage(char message) {
 
 void Communicator::sendMessage(char message, float value) // Messages with associated floats
 {
+  if (telemetryProtocol != TELEMETRY_LEGACY) return;
+
   XBEE_SERIAL.print("*");
   XBEE_SERIAL.print(message);
   sendFloat((float)value);
@@ -404,9 +651,27 @@ void Communicator::sendFloat(float toSend) {
 /*********************** TARGETING CONTROL  *********************/
 
 //This is called:
-//1) From medium loop (with false) to repeatedly check for drop condition
-//2) From in this class, once we parse a new GPS string
-//3) If testing the targeter, within slow loop, which simulates new data being received
+//1) From in this class, once we parse a new GPS string
+//2) If testing the targeter, within slow loop, which simulates new data being received
+//The targeter solves for the release time once per fix, and checkReleaseSchedule carries it out
+// Once the clock is disciplined, timestamp the data with when the fix was actually valid rather than when we finished parsing it
+uint64_t Communicator::gpsFixTimestamp() {
+  return gpsClock.isLocked() ? gpsClock.localMicrosAtEpoch() : systemMicros();
+}
+
+// UTC ms since midnight of the current fix. RMC and GGA of one epoch give the same
+uint32_t Communicator::gpsEpochMs() {
+  return ((GPS.hour * 60UL + GPS.minute) * 60 + GPS.seconds) * 1000 + GPS.milliseconds;
+}
+
+// Every position sentence, so the second of an epoch (the GPS object now holds both) replaces the first (PointMarker::addFix)
+void Communicator::addPointFix() {
+  if (GPS.fix) {
+    pointMarker.addFix(gpsFixTimestamp(), gpsEpochMs(), GPS.lat == 'S' ? -GPS.latitude_fixed : GPS.latitude_fixed,
+                       GPS.lon == 'W' ? -GPS.longitude_fixed : GPS.longitude_fixed, altitudeFt, GPS.altitudeMeters, GPS.speedMPS, GPS.angle);
+  }
+}
+
 void Communicator::recalculateTargettingNow(boolean withNewData) {
 
   bool isReadyToDrop = false;
@@ -423,7 +688,8 @@ void Communicator::recalculateTargettingNow(boolean withNewData) {
       currentTargeterDataPoint = 0;
     }
 
-    isReadyToDrop = targeter.setAndCheckCurrentData(GPSLatitudes[currentTargeterDataPoint], GPSLongitudes[currentTargeterDataPoint], altitudes[currentTargeterDataPoint], velocities[currentTargeterDataPoint], headings[currentTargeterDataPoint], millis(), true);  //HDOPOK = true for testing purposes
+    targeter.setTrueAirspeed(trueAirspeedMPS);
+    isReadyToDrop = targeter.setAndCheckCurrentData(GPSLatitudes[currentTargeterDataPoint], GPSLongitudes[currentTargeterDataPoint], altitudes[currentTargeterDataPoint], velocities[currentTargeterDataPoint], headings[currentTargeterDataPoint], systemMicros(), true, GPS_UERE_M);  //gpsOk = true for testing purposes
   }
   else {
 #ifndef Targeter_Debug_Print
@@ -438,7 +704,8 @@ void Communicator::recalculateTargettingNow(boolean withNewData) {
 #ifndef Targeter_Debug_Print
     TARGET_PRINTLN("\t Real GPS: Recalaculating Targeting with New Data \t");
 #endif
-    isReadyToDrop = targeter.setAndCheckCurrentData(GPS.latitude, -GPS.longitude, altitudeFt, GPS.speedMPS, GPS.angle, millis(), GPS.HDOP_OK);
+    targeter.setTrueAirspeed(trueAirspeedMPS);
+    isReadyToDrop = targeter.setAndCheckCurrentData(GPS.latitude, -GPS.longitude, altitudeFt, GPS.speedMPS, GPS.angle, gpsFixTimestamp(), GPS.quality.isOk(), GPS.quality.getExpectedErrorM());
 
   }
   else {
@@ -450,28 +717,93 @@ void Communicator::recalculateTargettingNow(boolean withNewData) {
 
 #endif
 
-  //Interpret result the same, regardless of if it was a testing run
+  //Interpret result the same, regardless of if it was a testing run. Each solution replaces the last
   if (!isReadyToDrop)  {
 #ifndef Targeter_Debug_Print
     TARGET_PRINTLN("\n NOT READY FOR DROP\n\n");
 #endif
   }
-  //Check if it's already open (ie. don't want to update/change altitudeAtDropFt)
-  else if (dropBayServoPos == DROP_BAY_OPEN) {
-    TARGET_PRINTLN("Dropbay already open (otherwise wanted to drop)");
+  for (int i = 0; i < NUM_PAYLOADS; i++) {
+    releaseScheduled[i] = isReadyToDrop && targeter.isPayloadReady(i);
+    if (releaseScheduled[i]) {
+      scheduledRelease[i] = targeter.getPayloadReleaseTimestamp(i);
+#ifndef Targeter_Debug_Print
+      TARGET_PRINT("\n Release of payload ");
+      TARGET_PRINT(i);
+      TARGET_PRINT(" scheduled in (ms): ");
+      TARGET_PRINTLN((double)microsBetween(systemMicros(), scheduledRelease[i]) / MICROS_PER_MILLI);
+#endif
+    }
   }
-  //Check if autoDrop is enabled
-  else if (!autoDrop) {
-    TARGET_PRINTLN("\n\n AUTODROP DISABLED PREVENTING A DROP\n\n\n\n");
-    //If reach here, targeter wants a drop, dropbay is closed, and autodrop is enabled. Therefore, we open the drop bay!
+
+  checkReleaseSchedule();
+}
+
+void Communicator::checkReleaseSchedule() {
+
+  // More than one can come due in the same loop - carry them out in order
+  while (true) {
+    uint64_t now = systemMicros();
+    int due = -1;
+    for (int i = 0; i < NUM_PAYLOADS; i++) {
+      if (releaseScheduled[i] && now >= scheduledRelease[i] && (due < 0 || scheduledRelease[i] < scheduledRelease[due]))
+        due = i;
+    }
+    if (due < 0)
+      return;
+
+    releaseScheduled[due] = false;
+
+    //The solution was planned from the last fix - if those have stopped coming, it can't be trusted
+    if (millisSince(targeter.getDataTimestamp()) > RELEASE_MAX_DATA_AGE) {
+      TARGET_PRINTLN("Data too old, cancelling scheduled release");
+    }
+    //The bank angle is checked again here since it can change a lot between the fix and the release
+    else if (!targeter.isAttitudeOkForDrop()) {
+      TARGET_PRINTLN("Banked too steeply, cancelling scheduled release");
+    }
+    //Check if it's already gone (ie. don't want to update/change its drop record)
+    else if (payloadReleased[due] || (due == 0 && dropBayServoPos == DROP_BAY_OPEN)) {
+      TARGET_PRINTLN("Payload already released (otherwise wanted to drop)");
+    }
+    //Check if autoDrop is enabled
+    else if (!autoDrop) {
+      TARGET_PRINTLN("\n\n AUTODROP DISABLED PREVENTING A DROP\n\n\n\n");
+      //If reach here, targeter wants a drop, the payload is still aboard, and autodrop is enabled. Therefore, we release it!
+    }
+    else {
+      releasePayload(due, AUTOMATIC_CMD);
+      TARGET_PRINT("\n\n ******************************* AUTOMATIC DROP ***************** payload ");
+      TARGET_PRINTLN(due);
+    }
   }
-  else {
-    setDropBayState(AUTOMATIC_CMD, DROPBAY_OPEN);
-    TARGET_PRINTLN("\n\n ******************************* AUTOMATIC DROP *****************\n\n\n\n");
+
+}
+
+boolean Communicator::isReleaseScheduled() {
+  for (int i = 0; i < NUM_PAYLOADS; i++) {
+    if (releaseScheduled[i])
+      return true;
   }
+  return false;
+}
+
+uint64_t Communicator::getScheduledRelease() {
+  uint64_t earliest = 0;
+  for (int i = 0; i < NUM_PAYLOADS; i++) {
+    if (releaseScheduled[i] && (earliest == 0 || scheduledRelease[i] < earliest))
+      earliest = scheduledRelease[i];
+  }
+  return earliest;
+}
 
 
+void Communicator::setAttitude(double rollDeg, double pitchDeg) {
+  targeter.setAttitude(rollDeg, pitchDeg);
+}
 
+float Communicator::getGroundSpeedMPS() {
+  return GPS.speedMPS;
 }
 
 
@@ -504,6 +836,11 @@ void Communicator::setDropBayState(int src, int state) {
     digitalWrite(STATUS_LED_PIN, LOW);
     dropBayServoPos = DROP_BAY_CLOSED;
     sendMessage(MESSAGE_DROP_CLOSE);
+
+    //Closing it by hand means it's been (or is about to be) reloaded
+    if (src == MANUAL_CMD) {
+      rearmPayloads();
+    }
   }
   else {
 #ifdef Targeter_Test
@@ -515,26 +852,287 @@ void Communicator::setDropBayState(int src, int state) {
 #endif
     digitalWrite(STATUS_LED_PIN, HIGH);
     dropBayServoPos = DROP_BAY_OPEN;
-    altitudeAtDropFt = altitudeFt;
-    timeAtDrop = millis();
+    timeAtDrop = systemMicros();
     sendMessage(MESSAGE_DROP_OPEN);
+    recordDrop(0, src);
   }
 
-  dropServo.writeMicroseconds(dropBayServoPos);
+  releaseServos[0].writeMicroseconds(dropBayServoPos);
+}
+
+void Communicator::attachReleaseServos(uint8_t releasedMask) {
+
+  const int pins[] = PAYLOAD_PINS;
+
+  targeter.setNumPayloads(NUM_PAYLOADS);
+
+  for (int i = 0; i < NUM_PAYLOADS; i++) {
+    payloadReleased[i] = releasedMask & (1 << i);
+    releaseScheduled[i] = false;
+    dropRecords[i].valid = false;
+    targeter.setPayloadReleased(i, payloadReleased[i]);
+
+    releaseServos[i].attach(pins[i]);
+    if (i == 0) {
+      releaseServos[i].writeMicroseconds(dropBayServoPos);  //The bay can be open/closed independently of its payload
+    }
+    else {
+      releaseServos[i].writeMicroseconds(payloadReleased[i] ? DROP_BAY_OPEN : DROP_BAY_CLOSED);
+    }
+  }
+}
+
+//Channel 0 goes through setDropBayState so the drop bay messages/LED/auto close all still work
+void Communicator::releasePayload(int channel, int src) {
+
+  if (channel == 0) {
+    setDropBayState(src, DROPBAY_OPEN);
+    return;
+  }
+
+  releaseServos[channel].writeMicroseconds(DROP_BAY_OPEN);
+  recordDrop(channel, src);
+}
+
+void Communicator::recordDrop(int channel, int src) {
+
+  DropRecord &r = dropRecords[channel];
+  r.valid = true;
+  r.src = src;
+  r.time = systemMicros();
+  r.altitudeFt = altitudeFt;
+  r.latitudeDegrees = GPS.latitudeDegrees;
+  r.longitudeDegrees = GPS.longitudeDegrees;
+  r.predictedMissM = src == AUTOMATIC_CMD ? targeter.getPayloadMissDistance(channel) : -1;
+  r.hitProbability = src == AUTOMATIC_CMD ? targeter.getPayloadHitProbability(channel) : 0;
+
+  altitudeAtDropFt = altitudeFt;  //Of the latest drop
+  payloadReleased[channel] = true;
+  releaseScheduled[channel] = false;
+  targeter.setPayloadReleased(channel, true);
+
+  if (gpsClock.isLocked()) {
+    DEBUG_PRINT("Drop at UTC (s since midnight): ");
+    DEBUG_PRINTLN((double)gpsClock.utcMicrosAt(r.time) / MICROS_PER_SECOND);
+  }
+
+  sendDropRecord(channel);
+}
+
+void Communicator::rearmPayloads() {
+
+  for (int i = 0; i < NUM_PAYLOADS; i++) {
+    payloadReleased[i] = false;
+    targeter.setPayloadReleased(i, false);
+    if (i > 0) {
+      releaseServos[i].writeMicroseconds(DROP_BAY_CLOSED);
+    }
+  }
+}
+
+void Communicator::handleParamMessage() {
+
+  int index = paramBuffer[0];
+  if (index >= paramTable.getCount()) {
+    sendMessage(MESSAGE_PARAM_REJECTED, index);
+    return;
+  }
+
+  if (paramCommand == INCOME_PARAM_SET) {
+    if (paramBuffer[5] != 'e')
+      return;  //Transmission error, the ground station will see no reply
+
+    float value;
+    memcpy(&value, &paramBuffer[1], 4);
+    if (!paramTable.set(index, value))
+      sendMessage(MESSAGE_PARAM_REJECTED, index);
+  }
+
+  sendParam(index);
+}
+
+// Format: *n + index (uint8) + count (uint8) + type (uint8) + value + min + max (float) + table version hash (uint32)
+// + name (PARAM_NAME_LENGTH bytes, 0 padded) + ee. Ints are sent as floats too
+void Communicator::sendParam(int index) {
+
+  if (telemetryProtocol != TELEMETRY_LEGACY) return;
+
+  const ParamDescriptor &d = paramTable.getDescriptor(index);
+  char name[PARAM_NAME_LENGTH] = {0};
+  strncpy(name, d.name, PARAM_NAME_LENGTH - 1);
+
+  XBEE_SERIAL.print("*");
+  XBEE_SERIAL.print(PARAM_PACKET);
+  sendUint8_t(index);
+  sendUint8_t(paramTable.getCount());
+  sendUint8_t(d.type);
+  sendFloat(paramTable.get(index));
+  sendFloat(d.minValue);
+  sendFloat(d.maxValue);
+  sendInt(paramTable.getVersionHash());
+  XBEE_SERIAL.write((const uint8_t *)name, PARAM_NAME_LENGTH);
+  XBEE_SERIAL.print("ee");
+}
+
+/********************  MAVLINK **********************/
+
+void Communicator::sendMavlink(uint32_t msgId, const void *payload) {
+  uint8_t frame[MAVLINK_MAX_FRAME_LEN];
+  int len = mavlink.encode(frame, msgId, payload);
+  XBEE_SERIAL.write(frame, len);
+}
+
+// Called instead of the legacy data packet, so at the same rate (SLOW_LOOP_TIME)
+void Communicator::sendMavlinkTelemetry() {
+
+  if (lastMavlinkHeartbeat == 0 || millisSince(lastMavlinkHeartbeat) >= MAVLINK_HEARTBEAT_MS) {
+    sendMavlinkHeartbeat();
+  }
+
+  float courseRad = GPS.angle / 180 * PI, sinCourse, cosCourse;
+  fastSinCos(courseRad, sinCourse, cosCourse);
+
+  MavlinkGlobalPositionInt pos;
+  pos.timeBootMs = systemMicros() / MICROS_PER_MILLI;
+  pos.lat = lround(GPS.latitudeDegrees * 1e7);
+  pos.lon = lround(GPS.longitudeDegrees * 1e7);
+  pos.alt = lround(GPS.altitudeMeters * 1000);
+  pos.relativeAlt = lround(altitudeFt * 304.8);  //Barometric, above where the altimeter was zeroed
+  pos.vx = lround(GPS.speedMPS * cosCourse * 100);
+  pos.vy = lround(GPS.speedMPS * sinCourse * 100);
+  pos.vz = 0;  //Not measured
+  pos.hdg = GPS.fix ? (uint16_t)lround(GPS.angle * 100) % 36000 : UINT16_MAX;
+  sendMavlink(MAVLINK_MSG_ID_GLOBAL_POSITION_INT, &pos);
+
+  MavlinkVfrHud hud;
+  hud.airspeed = trueAirspeedMPS;
+  hud.groundspeed = GPS.speedMPS;
+  hud.alt = GPS.altitudeMeters;
+  hud.climb = 0;
+  hud.heading = lround(GPS.angle) % 360;
+  hud.throttle = 0;
+  sendMavlink(MAVLINK_MSG_ID_VFR_HUD, &hud);
+}
+
+// Custom mode: bit 0 = auto drop enabled, bit 1 = gimbal stabilized
+void Communicator::sendMavlinkHeartbeat() {
+
+  lastMavlinkHeartbeat = systemMicros();
+
+  MavlinkHeartbeat hb;
+  hb.customMode = (autoDrop ? 1 : 0) | (gimbalStabilized ? 2 : 0);
+  hb.type = MAV_TYPE_FIXED_WING;
+  hb.autopilot = MAV_AUTOPILOT_GENERIC;
+  hb.baseMode = MAV_MODE_FLAG_CUSTOM_MODE_ENABLED;
+  hb.systemStatus = MAV_STATE_ACTIVE;
+  hb.mavlinkVersion = 3;
+  sendMavlink(MAVLINK_MSG_ID_HEARTBEAT, &hb);
+
+  uint32_t sensors = MAV_SYS_STATUS_SENSOR_3D_GYRO | MAV_SYS_STATUS_SENSOR_3D_ACCEL | MAV_SYS_STATUS_SENSOR_ABSOLUTE_PRESSURE |
+                     MAV_SYS_STATUS_SENSOR_DIFFERENTIAL_PRESSURE | MAV_SYS_STATUS_SENSOR_GPS;
+  MavlinkSysStatus status;
+  memset(&status, 0, sizeof(status));
+  status.sensorsPresent = status.sensorsEnabled = sensors;
+  status.sensorsHealth = sensors;
+  if (!GPS.fix) status.sensorsHealth &= ~MAV_SYS_STATUS_SENSOR_GPS;
+  if (trueAirspeedMPS <= 0) status.sensorsHealth &= ~MAV_SYS_STATUS_SENSOR_DIFFERENTIAL_PRESSURE;
+  status.voltageBattery = lround(analogRead(BATTERY_VOLTAGE_PIN) * ANALOG_READ_CONV * 1000);
+  status.currentBattery = -1;
+  status.errorsComm = mavlink.getErrorCount();
+  status.batteryRemaining = -1;
+  sendMavlink(MAVLINK_MSG_ID_SYS_STATUS, &status);
+}
+
+void Communicator::handleMavlinkMessage() {
+
+#ifdef TELEMETRY_AUTO_SWITCH
+  if (telemetryProtocol != TELEMETRY_MAVLINK) {
+    DEBUG_PRINTLN("MAVLink frame received, switching telemetry to MAVLink");
+    telemetryProtocol = TELEMETRY_MAVLINK;
+    sendMavlinkHeartbeat();
+  }
+#endif
+
+  if (mavlink.getMessageId() != MAVLINK_MSG_ID_COMMAND_LONG)
+    return;  //Ground station heartbeats etc. need nothing from us
+
+  MavlinkCommandLong cmd;
+  memcpy(&cmd, mavlink.getPayload(), sizeof(cmd));
+  if (cmd.targetSystem != MAVLINK_SYSTEM_ID && cmd.targetSystem != 0)
+    return;
+
+  MavlinkCommandAck ack;
+  ack.command = cmd.command;
+  ack.result = handleMavlinkCommand(cmd);
+  sendMavlink(MAVLINK_MSG_ID_COMMAND_ACK, &ack);
+}
+
+uint8_t Communicator::handleMavlinkCommand(const MavlinkCommandLong &cmd) {
+
+  if (cmd.command == MAV_CMD_DO_GRIPPER) {
+    // param1 = gripper instance (from 1, 0 taken as the drop bay), param2 = action
+    int channel = cmd.param[0] >= 1 ? (int)cmd.param[0] - 1 : 0;
+    if (channel >= NUM_PAYLOADS)
+      return MAV_RESULT_DENIED;
+
+    if ((int)cmd.param[1] == GRIPPER_ACTION_RELEASE) {
+      releasePayload(channel, MANUAL_CMD);
+    }
+    else {
+      setDropBayState(MANUAL_CMD, DROPBAY_CLOSE);  //Closes and rearms every channel, like the legacy close command
+    }
+    return MAV_RESULT_ACCEPTED;
+  }
+
+  if (cmd.command == MAV_CMD_DO_MOUNT_CONTROL) {
+    // param1 = pitch (+ve up), param3 = yaw (+ve right), param7 = mount mode
+    if ((int)cmd.param[6] == MAV_MOUNT_MODE_NEUTRAL) {
+      gimbalReset();
+    }
+    else {
+      setGimbalAngles(cmd.param[2], -cmd.param[0]);
+    }
+    return MAV_RESULT_ACCEPTED;
+  }
+
+  return MAV_RESULT_UNSUPPORTED;
+}
+
+// Format: *m + channel (uint8) + src (uint8) + UTC of the drop (float, s since midnight, -1 if the GPS clock isn't locked)
+// + altitude (float, ft) + lat + lon (float, degrees) + predicted miss (float, m, -1 if manual) + hit probability (float) + ee
+void Communicator::sendDropRecord(int channel) {
+
+  DropRecord &r = dropRecords[channel];
+  if (telemetryProtocol != TELEMETRY_LEGACY) return;
+
+  float utcSeconds = gpsClock.isLocked() ? (float)((double)gpsClock.utcMicrosAt(r.time) / MICROS_PER_SECOND) : -1;
+
+  XBEE_SERIAL.print("*");
+  XBEE_SERIAL.print(DROP_RECORD_PACKET);
+  sendUint8_t(channel);
+  sendUint8_t(r.src);
+  sendFloat(utcSeconds);
+  sendFloat(r.altitudeFt);
+  sendFloat(r.latitudeDegrees);
+  sendFloat(r.longitudeDegrees);
+  sendFloat(r.predictedMissM);
+  sendFloat(r.hitProbability);
+  XBEE_SERIAL.print("ee");
 }
 
 // Function called in slow loop. If the drop bay is currently open, checks if
-// 10 seconds has passed since it was opened. If so, closes it.
+// the close timeout has passed since it was opened. If so, closes it.
 void Communicator::checkToCloseDropBay() {
 
   if (dropBayServoPos == DROP_BAY_OPEN) {
 
-    unsigned long currentMillis = millis();
+    uint32_t msSinceDrop = millisSince(timeAtDrop);
+    uint32_t timeout = params.closeDropBayTimeoutMs;
 
-    if (currentMillis - timeAtDrop >= closeDropBayTimeout && currentMillis - timeAtDrop < closeDropBayTimeout + 10000) {
+    if (msSinceDrop >= timeout && msSinceDrop < timeout + 10000) {
 
       TARGET_PRINT("Auto closing bay door (time passed = ");
-      TARGET_PRINT((currentMillis - timeAtDrop));
+      TARGET_PRINT(msSinceDrop);
       TARGET_PRINTLN(")");
 
       //TEMPORARY / TODO - RE-ENABLE THIS
@@ -581,90 +1179,218 @@ void Communicator::setupGPS() {
 
   DEBUG_PRINTLN("GPS Initilization...");
 
-  // Initialize the variables in GPS class object
-  GPS.init();
+  // Initialize the GPS class objects and start the serial communication
+  initGPSReceivers();
+  attachGPSPPS();
 
-  // Start the serial communication
-  GPS_SERIAL.begin(GPS_BAUD);
-  DEBUG_PRINTLN("Begin Setting GPS:");
+  for (int i = 0; i < GPS_NUM_RECEIVERS; i++) {
+    DEBUG_PRINT("Begin Setting GPS ");
+    DEBUG_PRINTLN(i);
 
-  
-  //Settings should persist over power off, but safer to reset each time
-  // Commands to configure GPS: (each involves setting, flushing out previous data, then checking a correct return string received
-  if(!sendGPSConfigureCommands())
-  {
-    //Try again:
-    if(!sendGPSConfigureCommands())
+    //Settings should persist over power off, but safer to reset each time
+    // Commands to configure GPS: (each involves setting, flushing out previous data, then checking a correct return string received
+    if(!sendGPSConfigureCommands(*gpsReceivers[i].serial))
     {
-      //TODO setup message to tell ground station
-      
-    }    
+      //Try again:
+      if(!sendGPSConfigureCommands(*gpsReceivers[i].serial))
+      {
+        //TODO setup message to tell ground station
+        //A backup receiver that isn't there just never gets a fix, so it is never selected
+      }
+    }
   }
 
 }
 
+void Communicator::initGPSReceivers() {
+
+  gpsReceivers[0].serial = &GPS_SERIAL;
+#ifdef GPS2_SERIAL
+  gpsReceivers[1].serial = &GPS2_SERIAL;
+#endif
+
+  for (int i = 0; i < GPS_NUM_RECEIVERS; i++) {
+    gpsReceivers[i].gps.init();
+    gpsReceivers[i].nmeaBufInd = 0;
+    gpsReceivers[i].sentenceStart = 0;
+    gpsReceivers[i].serial->begin(GPS_BAUD);
+  }
+
+  // GPS is the fix stream everything else reads - a copy of the active receiver
+  GPS.init();
+  activeGPS = 0;
+  lastGPSSwitch = 0;
+}
+
+
+#ifdef GPS_PPS_PIN
+static void isr_gps_pps() {
+  gpsClock.ppsEdge(systemMicros());
+}
+#endif
+
+// The PPS output is optional (see GpsClock.h)
+void Communicator::attachGPSPPS() {
+#ifdef GPS_PPS_PIN
+  pinMode(GPS_PPS_PIN, INPUT);
+  attachInterrupt(GPS_PPS_PIN, isr_gps_pps, RISING);
+#endif
+}
+
 
 void Communicator::getSerialDataFromGPS() {
 
-  while (GPS_SERIAL.available()) {
+  // Each byte only goes through its own receiver's buffer, so a second receiver costs one more sentence parse per epoch, not per byte
+  for (int i = 0; i < (gpsReplay != NULL ? 1 : GPS_NUM_RECEIVERS); i++) {
+    readGPS(i);
+  }
+
+}
+
+void Communicator::readGPS(int index) {
+
+  GpsReceiver &r = gpsReceivers[index];
+  Stream *in = gpsReplay != NULL ? gpsReplay : r.serial;
+
+  while (in->available()) {
 
-    nmeaBuf[nmeaBufInd] = GPS_SERIAL.read();
+    r.nmeaBuf[r.nmeaBufInd] = in->read();
+
+    // Start of a sentence - note when it arrived for the GPS clock. Whatever is still waiting in the buffer came in after it,
+    // which corrects for how long the byte sat there before we got to it
+    if (r.nmeaBuf[r.nmeaBufInd] == '$') {
+      r.sentenceStart = systemMicros() - (in->available() + 1) * GPS_BYTE_TIME_US;
+    }
 
-    if (nmeaBuf[nmeaBufInd++] == '\n') { // Increment index after checking if current character signifies the end of a string
-      nmeaBuf[nmeaBufInd - 1] = '\0'; // Add null terminating character (note: -1 is because nmeaBufInd is incremented in if statement)
-      newParsedData = GPS.parse(nmeaBuf);   // This parses the string, and updates the values of GPS.lattitude, GPS.longitude etc.
-      nmeaBufInd = 0;  // Regardless of it parsing sucessful, we want to reset position back to zero
+    if (r.nmeaBuf[r.nmeaBufInd++] == '\n') { // Increment index after checking if current character signifies the end of a string
+      r.nmeaBuf[r.nmeaBufInd - 1] = '\0'; // Add null terminating character (note: -1 is because nmeaBufInd is incremented in if statement)
+      boolean parsed = r.gps.parse(r.nmeaBuf);   // This parses the string, and updates the values of gps.lattitude, gps.longitude etc.
+      r.nmeaBufInd = 0;  // Regardless of it parsing sucessful, we want to reset position back to zero
       //Potential flaw - the string length is used in parsing. By only setting index to 0, it may keep null terminating character, giving false future readings?
-    
-      if (noFixLedIsOn == GPS.fix) {
-        digitalWrite(NO_FIX_LED_PIN, !GPS.fix);
-        noFixLedIsOn = !GPS.fix;
+
+      if (parsed) {
+        selectGPS();
       }
 
+      // Only the active receiver feeds the fix stream and the clock (the receivers' output latencies differ)
+      if (index == activeGPS) {
+        newParsedData = parsed;
+        if (newParsedData) {
+          GPS = r.gps;
+          gpsClock.sentenceStarted(r.sentenceStart);
+          gpsClock.update(GPS.hour, GPS.minute, GPS.seconds, GPS.milliseconds);
+        }
+
+        if (noFixLedIsOn == GPS.fix) {
+          digitalWrite(NO_FIX_LED_PIN, !GPS.fix);
+          noFixLedIsOn = !GPS.fix;
+        }
+
 #ifndef Targeter_Test  //Otherwise may confuse real data and simulated data
-      recalculateTargettingNow(true);
+        // RMC and GGA both carry the epoch's position, so the filter takes each epoch once (the first of them). A failed parse
+        // only projects forward - taking the last fix again would fuse it twice. GSA doesn't carry a new position
+        if (newParsedData && GPS.positionSentence) {
+          addPointFix();
+          uint32_t epochMs = gpsEpochMs();
+          recalculateTargettingNow(epochMs != lastTargeterEpochMs);
+          lastTargeterEpochMs = epochMs;
+        }
+        else if (!newParsedData) {
+          recalculateTargettingNow(false);
+        }
 #endif
+      }
 
     }
 
-    if (nmeaBufInd >= MAXLINELENGTH) { // Should never happen. Means a corrupted packed and the newline was missed. Good to have just in case
-      nmeaBufInd = 0;  // Note the next packet will then have been corrupted as well. Can't really recover until the next-next packet
+    if (r.nmeaBufInd >= MAXLINELENGTH) { // Should never happen. Means a corrupted packed and the newline was missed. Good to have just in case
+      r.nmeaBufInd = 0;  // Note the next packet will then have been corrupted as well. Can't really recover until the next-next packet
     }
 
   }
 
 }
 
+// Zero without a recent fix, otherwise from the expected position error (see GpsQuality.h)
+float Communicator::gpsScore(int index) {
+
+  GpsReceiver &r = gpsReceivers[index];
+
+  if (!r.gps.fix)
+    return 0;
+
+  return r.gps.quality.getScore(systemMicros());
+}
+
+// Called after every parsed sentence from any receiver. The hysteresis stops two similar receivers trading places every epoch
+void Communicator::selectGPS() {
+
+  if (GPS_NUM_RECEIVERS < 2)
+    return;
+
+  float activeScore = gpsScore(activeGPS);
+  int best = activeGPS;
+  float bestScore = activeScore;
+  for (int i = 0; i < GPS_NUM_RECEIVERS; i++) {
+    float score = gpsScore(i);
+    if (score > bestScore) {
+      best = i;
+      bestScore = score;
+    }
+  }
+
+  if (best == activeGPS)
+    return;
+  if (activeScore > 0 && (bestScore < activeScore * GPS_SWITCH_RATIO || millisSince(lastGPSSwitch) < GPS_MIN_DWELL_MS))
+    return;
+
+  activeGPS = best;
+  lastGPSSwitch = systemMicros();
+  DEBUG_PRINT("Switched to GPS ");
+  DEBUG_PRINTLN(activeGPS);
+  sendMessage(MESSAGE_GPS_SWITCH, (float)activeGPS);
+}
+
+boolean Communicator::isGPSDataAvailable() {
+  if (gpsReplay != NULL)
+    return gpsReplay->available();
+  for (int i = 0; i < GPS_NUM_RECEIVERS; i++) {
+    if (gpsReceivers[i].serial->available())
+      return true;
+  }
+  return false;
+}
+
 
-bool Communicator::sendGPSConfigureCommands()
+bool Communicator::sendGPSConfigureCommands(HardwareSerial &port)
 {
   
   // Stop updates (before this, cannot accurately receive responses to commands
-  GPS_SERIAL.println(SET_SERIAL_UPDATE_RATE_0HZ);
+  port.println(SET_SERIAL_UPDATE_RATE_0HZ);
   delay(1000);
-  flushGPSSerial();
+  flushGPSSerial(port);
   int check = 2, errorLocation = 1;
   
   while(check) {
 	  // Repeat send the "stop update" command. Only this time, we should be able to check it was successfull
 	  if(errorLocation == 1) {
-		  GPS_SERIAL.println(SET_SERIAL_UPDATE_RATE_0HZ);
-		  if(!checkReturnString(SET_SERIAL_UPDATE_RATE_0HZ_COMMANDNUM)) {  
+		  port.println(SET_SERIAL_UPDATE_RATE_0HZ);
+		  if(!checkReturnString(port, SET_SERIAL_UPDATE_RATE_0HZ_COMMANDNUM)) {  
 			check--;
-			flushGPSSerial();
+			flushGPSSerial(port);
 			continue; 
 			} 
 			else {
 			check = 2;
 			errorLocation++; 
 			//delay(1000);
-			flushGPSSerial();}
+			flushGPSSerial(port);}
 	  }
 
-	  // Set the output to RMC and GGA
+	  // Set the output to RMC and GGA (and GSA once a second)
 	  if(errorLocation == 2) {
-		  GPS_SERIAL.println(PMTK_SET_NMEA_OUTPUT_RMCGGA);
-		  if(!checkReturnString(PMTK_SET_NMEA_OUTPUT_RMCGGA_COMMANDNUM)) {  
+		  port.println(PMTK_SET_NMEA_OUTPUT_RMCGGAGSA);
+		  if(!checkReturnString(port, PMTK_SET_NMEA_OUTPUT_RMCGGAGSA_COMMANDNUM)) {  
 			check--;
 			continue; } 
 			else {
@@ -673,8 +1399,8 @@ bool Communicator::sendGPSConfigureCommands()
 	  }
 	  // Increase rate GPS 'connects' and syncs with satellites
 	  if(errorLocation == 3)  {
-		  GPS_SERIAL.println(SET_FIX_RATE_5HZ);     
-		  if(!checkReturnString(SET_FIX_RATE_5HZ_COMMANDNUM)) {  
+		  port.println(SET_FIX_RATE_5HZ);     
+		  if(!checkReturnString(port, SET_FIX_RATE_5HZ_COMMANDNUM)) {  
 			check--;
 			continue; } 
 			else {
@@ -683,8 +1409,8 @@ bool Communicator::sendGPSConfigureCommands()
 	  }
 	  // Enable using a more accurate type of satellite
 	  if(errorLocation == 4) {
-		  GPS_SERIAL.println(ENABLE_SBAS_SATELLITES);       
-		  if(!checkReturnString(ENABLE_SBAS_SATELLITES_COMMANDNUM)) {  
+		  port.println(ENABLE_SBAS_SATELLITES);       
+		  if(!checkReturnString(port, ENABLE_SBAS_SATELLITES_COMMANDNUM)) {  
 			 check--;
 			 continue;} 
 			 else {
@@ -693,8 +1419,8 @@ bool Communicator::sendGPSConfigureCommands()
 	  }
 	  // Enable using the more accurate satellite to get a better fix
 	  if(errorLocation == 5) {
-		  GPS_SERIAL.println(ENABLE_USING_WAAS_WITH_SBAS_SATS);   
-		  if(!checkReturnString(ENABLE_USING_WAAS_WITH_SBAS_SATS_COMMANDNUM)) {  
+		  port.println(ENABLE_USING_WAAS_WITH_SBAS_SATS);   
+		  if(!checkReturnString(port, ENABLE_USING_WAAS_WITH_SBAS_SATS_COMMANDNUM)) {  
 			check--;
 			continue;} 
 			else {
@@ -703,8 +1429,8 @@ bool Communicator::sendGPSConfigureCommands()
 	  }	  
 	  // Increase rate strings sent over serial (was previously set to 0Hz)
 	  if(errorLocation == 6) {
-		  GPS_SERIAL.println(SET_SERIAL_UPDATE_RATE_5HZ);     
-		  if(!checkReturnString(SET_SERIAL_UPDATE_RATE_5HZ_COMMANDNUM)) {  
+		  port.println(SET_SERIAL_UPDATE_RATE_5HZ);     
+		  if(!checkReturnString(port, SET_SERIAL_UPDATE_RATE_5HZ_COMMANDNUM)) {  
 			check--;
 			continue;} 
 			else { break;}
@@ -720,22 +1446,22 @@ bool Communicator::sendGPSConfigureCommands()
 //$PMTK001,<commandNum>,<success?>*32<CR><LF> is format
 //Success -> 0 = Invalid Command/Packet,  1 = Unsupported Command/packet,  2 = Valid Command, action failed,  3 = Success
 //For this function, anything other than 3 is considered failure
-bool Communicator::checkReturnString(int commandNum)
+bool Communicator::checkReturnString(HardwareSerial &port, int commandNum)
 {
   //Get the return string
-  unsigned long startT = millis();
-  unsigned long maxT = 1000;  //1 second timeout
+  uint64_t startT = systemMicros();
+  uint32_t maxT = 1000;  //1 second timeout
   int receivedIndex = 0, maxLength = 25;  //typical is 18 I believe
   char returnString[maxLength];
   int newChar;
   bool gotPacket = false;
 
   
-  while((millis() - startT) < maxT && receivedIndex < maxLength)
+  while(millisSince(startT) < maxT && receivedIndex < maxLength)
   {   
-    if(GPS_SERIAL.available() > 0)
+    if(port.available() > 0)
     {
-      returnString[receivedIndex] = GPS_SERIAL.read();
+      returnString[receivedIndex] = port.read();
 
       //Check for end of string
       if (returnString[receivedIndex++] == '\n') // Increment index after checking if current character signifies the end of a string
@@ -814,15 +1540,15 @@ bool Communicator::checkReturnString(int commandNum)
   return true;  
 }
 
-void Communicator::flushGPSSerial()
+void Communicator::flushGPSSerial(HardwareSerial &port)
 {
   delay(200);
   char hold;
-  int numBytes = GPS_SERIAL.available();
+  int numBytes = port.available();
 
   //DEBUG_PRINT("Flushed Bytes: ");
   for(int i=0;i<numBytes;i++)  {
-    hold = (char)GPS_SERIAL.read();
+    hold = (char)port.read();
     //DEBUG_PRINT(hold);
   }
   
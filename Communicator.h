@@ -6,12 +6,19 @@
 #include "Adafruit_GPS.h"
 #include "plane.h"
 #include "Targeter.h"
+#include "WarmRestart.h"
+#include "SystemClock.h"
+#include "GpsClock.h"
+#include "GimbalStabilizer.h"
+#include "Parameters.h"
+#include "Mavlink.h"
+#include "PointMarker.h"
 
 // Drop Bay Servo Details.
 
 
 // MESSAGE CONSTANTS -- RECEIVE
-//Used characters: a,b,c,d,g,i,l,n,o,q,r,t,u
+//Used characters: a,b,c,d,e,g,h,i,j,k,l,m,n,o,p,q,r,t,u,v,w,x,y,z
 #define INCOME_AUTO_ON		 	 'a'
 #define INCOME_AUTO_OFF      'n'
 #define INCOME_RESET		     'r'
@@ -26,7 +33,16 @@
 #define INCOME_PIT_UP       'u'
 #define INCOME_PIT_DOWN     'd'
 #define INCOME_GIM_RESET    'x'
+#define INCOME_GIM_STABILIZE 'z'  //Toggles
 #define INCOME_POINT        'v'
+#define INCOME_POINT_ACK    'm'  //+ id (uint16) of a POINT_PACKET. Points are sent again until acknowledged
+#define INCOME_DROP_RECORDS 'k'  //Resend the drop record of every released payload
+// Parameters (see Parameters.h), by index. Each get/set is answered with a PARAM_PACKET carrying the value now in use
+#define INCOME_PARAM_LIST   'h'  //Every parameter
+#define INCOME_PARAM_GET    'j'  //+ index (uint8)
+#define INCOME_PARAM_SET    'p'  //+ index (uint8) + value (float) + 'e'
+#define INCOME_PARAM_SAVE   'w'  //Write the current values to flash
+#define INCOME_PARAM_DEFAULTS 'y'  //Back to the defaults (not saved), answered with the whole list
 
 // MESSAGE CONSTANTS -- SEND
 #define DATA_PACKET         'p'
@@ -43,6 +59,16 @@
 #define MESSAGE_AUTO_OFF	  'd'
 #define MESSAGE_BATTERY_V   'w'
 #define MESSAGE_ALT_AT_DROP 'a'
+#define MESSAGE_WARM_START  'h'
+#define WIND_PACKET         'i'
+#define MESSAGE_GIM_STABILIZE 'f'  //Float 1 = stabilized, 0 = not
+#define MESSAGE_GPS_SWITCH  'j'  //Float = index of the receiver now in use
+#define DROP_RECORD_PACKET  'm'
+#define PARAM_PACKET        'n'
+#define MESSAGE_PARAM_SAVED 'u'  //Float 1 = written to flash, 0 = failed
+#define MESSAGE_PARAM_REJECTED 'l'  //Float = index. Unknown index, or a set out of range
+#define MESSAGE_POINTS_WAITING 'v'  //Float = point marks not yet acknowledged
+#define MESSAGE_POINTS_DROPPED 'z'  //Float = point marks dropped from the full store since the last reset
 
 //Drop Bay Details
 #define DROP_PIN 10
@@ -52,6 +78,24 @@
 #define DROPBAY_CLOSE 0
 #define AUTOMATIC_CMD 1
 #define MANUAL_CMD 0
+#define RELEASE_MAX_DATA_AGE 1500  //ms - don't carry out a scheduled release planned from a fix older than this (lost GPS)
+
+//Release channels (NUM_PAYLOADS in plane.h). Each is a servo moved from DROP_BAY_CLOSED to DROP_BAY_OPEN to release its payload
+//The last two are only free while the control surfaces bypass the Arduino (see initializeServos in plane.ino)
+#define PAYLOAD_PINS {DROP_PIN, SPARE_OUT, TAIL_WHEEL_OUT, FLAPS_RIGHT_OUT}
+#if NUM_PAYLOADS > MAX_PAYLOADS
+#error "NUM_PAYLOADS is more than the targeter supports (MAX_PAYLOADS)"
+#endif
+
+struct DropRecord {
+  boolean valid;
+  uint8_t src;  //AUTOMATIC_CMD or MANUAL_CMD
+  uint64_t time;  //systemMicros()
+  float altitudeFt;
+  float latitudeDegrees, longitudeDegrees;
+  float predictedMissM;  //What the targeter expected, -1 for manual releases
+  float hitProbability;
+};
 
 //Gimbal details
 #define GIMBAL_PIT_PIN 5  //Marked right aileron on PCB
@@ -66,26 +110,81 @@
 #define XBEE_BAUD 115200
 #define XBEE_SERIAL Serial3
 
+//Telemetry protocol on the XBee link
+#define TELEMETRY_LEGACY 0  //Our ground station: the packets and single character commands above
+#define TELEMETRY_MAVLINK 1  //MAVLink v2 (Mavlink.h), for standard ground stations
+#define TELEMETRY_PROTOCOL TELEMETRY_LEGACY  //At boot
+#define TELEMETRY_AUTO_SWITCH  //The first good MAVLink frame received switches the link to MAVLink until reset. Comment out to fix the protocol
+#define MAVLINK_HEARTBEAT_MS 1000  //HEARTBEAT and SYS_STATUS. Position and HUD go with every data packet
+
 // GPS constants
 #define MAXLINELENGTH 120
 #define GPS_BAUD 9600
+#define GPS_BYTE_TIME_US (10 * MICROS_PER_SECOND / GPS_BAUD)  //8N1 -> 10 bits per byte
 #define GPS_SERIAL Serial1
+#define GPS2_SERIAL Serial2  //Second (backup) receiver. Comment out if only one is fitted
+
+#ifdef GPS2_SERIAL
+#define GPS_NUM_RECEIVERS 2
+#else
+#define GPS_NUM_RECEIVERS 1
+#endif
+
+// Receiver voting. Each receiver has its own parser and buffer, and only one (the active one) feeds the fix stream at a time.
+// Blending positions would average the receivers' different biases into steps whenever the weights change, so it is a switch instead
+#define GPS_SWITCH_RATIO 1.5  //The other receiver has to score this much better to take over...
+#define GPS_MIN_DWELL_MS 3000  //...and not sooner than this after the last switch (unless the active one loses its fix)
+
+struct GpsReceiver {
+  HardwareSerial *serial;
+  Adafruit_GPS gps;
+  char nmeaBuf[MAXLINELENGTH];
+  int nmeaBufInd;
+  uint64_t sentenceStart;  //systemMicros() the '$' of the current sentence arrived
+};
 
 class Communicator {
 
   private:
-    Servo dropServo, gimbalPan, gimbalPitch;
+    Servo releaseServos[NUM_PAYLOADS], gimbalPan, gimbalPitch;  //releaseServos[0] is the drop bay
+    GimbalStabilizer gimbalStabilizer;
+    boolean gimbalStabilized = false;
+    int writtenPanPulse = -1, writtenPitPulse = -1;
+    void writeGimbal(int panPulse, int pitPulse);
 
-    unsigned long timeAtDrop;
+    uint64_t timeAtDrop;
 
     // For receiving new GPS target
     byte targetLat[8];
     byte targetLon[8];
     double targetLatDoub;
     double targetLonDoub;
-    unsigned long transmitStartTime;
+    uint64_t transmitStartTime;
     unsigned int bufferIndex; // Current position in received Target GPS position update message
 
+    // For receiving parameter get/set and point ack messages
+    byte paramCommand;
+    byte paramBuffer[6];
+    unsigned int paramBufferIndex;  //As bufferIndex: 0 = not receiving, else 1 + bytes received
+    uint64_t paramStartTime;
+    unsigned int paramMessageLength();  //Bytes after the command character
+    void handleParamMessage();
+    void handleLegacyByte(byte incomingByte, uint64_t curTime);
+    void sendParam(int index);
+
+    // MAVLink. In MAVLink mode none of the legacy packets are sent (they would corrupt the stream)
+    int telemetryProtocol = TELEMETRY_PROTOCOL;
+    Mavlink mavlink;
+    uint64_t lastMavlinkHeartbeat = 0;
+    void sendMavlink(uint32_t msgId, const void *payload);
+    void sendMavlinkTelemetry();
+    void sendMavlinkHeartbeat();
+    void handleMavlinkMessage();
+#ifdef TELEMETRY_AUTO_SWITCH
+    void handleAbortedMavlink(uint64_t curTime);
+#endif
+    uint8_t handleMavlinkCommand(const MavlinkCommandLong &cmd);  //Returns a MAV_RESULT
+
     //Initialize XBee by starting communication and putting in transparent mode
     bool initXBee();
     bool sendCmdAndWaitForOK(String cmd, int timeout = 3000); //3 second as default timeout
@@ -99,12 +198,35 @@ class Communicator {
 
     //GPS and Autotargeting
     boolean autoDrop = true;  //TODO TEMPORARY
-    int nmeaBufInd = 0;
+    GpsReceiver gpsReceivers[GPS_NUM_RECEIVERS];
+    Stream *gpsReplay = NULL;  //Read as receiver 0 instead of the serial ports (bench replay, FlightReplay.h)
+    int activeGPS = 0;
+    uint64_t lastGPSSwitch = 0;
     boolean newParsedData = false;
+    boolean releaseScheduled[NUM_PAYLOADS] = {false};
+    uint64_t scheduledRelease[NUM_PAYLOADS];  //systemMicros() at which to release each payload
+    boolean payloadReleased[NUM_PAYLOADS] = {false};
+    DropRecord dropRecords[NUM_PAYLOADS];
+    void attachReleaseServos(uint8_t releasedMask);
+    void releasePayload(int channel, int src);
+    void recordDrop(int channel, int src);
+    void rearmPayloads();  //Close every channel and mark them all loaded again
+    void sendDropRecord(int channel);
+    PointMarker pointMarker;
+    void sendPoint(const PointMark &m);
     void setupGPS();
-    void flushGPSSerial();
-    bool checkReturnString(int commandNum);
-    bool sendGPSConfigureCommands();
+    void initGPSReceivers();
+    void attachGPSPPS();
+    void readGPS(int index);
+    float gpsScore(int index);
+    void selectGPS();
+    uint32_t lastTargeterEpochMs = 0xFFFFFFFF;  //UTC ms of the last fix the targeter took (0xFFFFFFFF = none yet)
+    uint64_t gpsFixTimestamp();
+    uint32_t gpsEpochMs();
+    void addPointFix();
+    void flushGPSSerial(HardwareSerial &port);
+    bool checkReturnString(HardwareSerial &port, int commandNum);
+    bool sendGPSConfigureCommands(HardwareSerial &port);
 
   public:
 
@@ -114,10 +236,13 @@ class Communicator {
     int tiltServoPos;
 
     double altitudeFt, altitudeAtDropFt;
+    double trueAirspeedMPS = 0;  //0 if there's no airspeed sensor (or it isn't working)
 
     Communicator();
     ~Communicator();
     void initialize();
+    void warmInitialize(const WarmRestartState &state);  //Fast path after a warm restart (skips XBee and GPS configuration)
+    void fillWarmRestartState(WarmRestartState &state);  //Copy the state we own into a checkpoint
     void setDropBayState(int src, int state);
     void moveCamera(char orientation);
 
@@ -131,18 +256,33 @@ class Communicator {
     void gimbalPitUp();
     void gimbalPitDown();
     void gimbalReset();
+    void setGimbalStabilized(boolean stabilized);
+    void setGimbalAngles(float panDeg, float tiltDeg);  //Pan right +ve, tilt down +ve
+    void updateGimbal(float rollDeg, float pitchDeg, float rollRateDPS, float pitchRateDPS, float yawRateDPS);
 
     //gps variables and functions
-    char nmeaBuf[MAXLINELENGTH];  //needs to be public so GPS class can access
     void getSerialDataFromGPS();  //needs to be public since called from plane
+    boolean isGPSDataAvailable();  //Bytes waiting from any receiver
+    void setGPSReplay(Stream *source) { gpsReplay = source; }  //Only receiver 0 is read, from source. NULL for the serial ports again
+    int getActiveGPS() { return activeGPS; }
+    int getTelemetryProtocol() { return telemetryProtocol; }
 
 
     // Functions called by main program each loop
-    void recieveCommands(unsigned long curTime);  // When drop command is received set altitude at drop
+    void recieveCommands(uint64_t curTime);  // When drop command is received set altitude at drop
     void sendData();  // Send current altitude, altitude at drop, roll, pitch, airspeed
-    void markPoint();
+    void sendWind();  // Send the wind estimate
+    void markPoint(uint64_t time, boolean fromGround = false);  //time = systemMicros() of the mark (see PointMarker.h)
+    void sendPoints(uint64_t now);  //Resolves marks and (re)sends one that's due. Called every medium loop
+    void sendPointStatus();  //Marks waiting and dropped, while there are any. Called every long loop
+    void resetPoints();  //Reset command: reports the marks it discards, then clears them
     void checkToCloseDropBay(void);  //Close drop bay after 10 seconds of being open
-    void recalculateTargettingNow(boolean withNewData);  //Check GPS data vs. target to see if we should drop
+    void recalculateTargettingNow(boolean withNewData);  //Check GPS data vs. target, and (re)schedule or cancel the release
+    void checkReleaseSchedule();  //Drop if a scheduled release is due. Called every loop
+    void setAttitude(double rollDeg, double pitchDeg);  //From the IMU, for the targeter's bank inhibit
+    float getGroundSpeedMPS();
+    boolean isReleaseScheduled();  //Any channel
+    uint64_t getScheduledRelease();  //Earliest scheduled release
 
     // Function to send standard message to ground station
     // examples: START, READY, RESET ACKNOLEGED
@@ -0,0 +1,145 @@
+#include "DropSolver.h"
+
+// As Arduino's constrain(), which the solver was first written with
+static inline double clampTime(double t, double low, double high) {
+  return t < low ? low : (t > high ? high : t);
+}
+
+/*
+   Time for the payload to fall from this height (negative heights - altimeter noise on the ground - fall for 0s).
+
+   *** Note: right now this picks a value for air resistance and is unrealistic.
+   Some thoughts on air resistance: terminal falling velocity 35-45 m/s ish, which would be reached at 4.1s or 82m / 270ft
+   It will accelerate slower once above low speeds
+   @ 10 m/s estimated air resistance acceleration would be -0.6 m/s^2. If fall time on the order of 3s, this would
+   only affect speed vi = 10, vf = 8.2, vavg = 9.1.  So not a lot, and is partially offset by reduced fall speed
+   Approximate Equations: m = 2kg, cd =1 CSA = 0.02m^2, rho = 1.25   a = 0.5*cd*rho*CSA*v^2/m = 0.00625*v^2
+   Overall approximation of 0.9 correction factor
+   See MATLAB script for more details
+
+   Wind: drag pulls the payload's horizontal velocity from the plane's ground velocity towards the wind velocity. The correction
+   factor is that lost fraction of the ground velocity, so the same fraction of the wind velocity is gained: drift = wind * t * (1 - CF)
+*/
+void dropFallTimes(double heightM, const DropModel &model, double &fallTime, double &windDriftTime) {
+
+  if (heightM < 0) {
+    heightM = 0;
+  }
+
+  double rawFallTime = fastSqrt(2 * heightM / GRAVITY_MPS2); // time in seconds
+  fallTime = rawFallTime * model.correctionFactor;
+  windDriftTime = rawFallTime * (1 - model.correctionFactor);
+}
+
+// Plane following a constant rate turn (straight if turnRate is ~0) from the state
+void dropLandingPoint(const DropState &s, const DropModel &model, double t, double aimEasting, double aimNorthing, double g[2], double g1[2], double g2[2]) {
+
+  double v = s.speed;
+  double u = t + model.servoOpenDelayMs / 1000.0;  //When the payload actually leaves
+  double theta = s.heading + s.turnRate * u;
+  double c, sn;
+  fastSinCos(theta, sn, c);
+
+  double e, n;
+  if (fabs(s.turnRate) < STRAIGHT_TURN_RATE) {
+    e = v * u * c;
+    n = v * u * sn;
+  }
+  else {
+    e = v / s.turnRate * (sn - s.headingSin);
+    n = v / s.turnRate * (s.headingCos - c);
+  }
+
+  // Payload continues with the release velocity for the fall time, and drifts with the wind (constant, so no derivative terms)
+  g[0] = s.easting - aimEasting + e + v * c * s.fallTime + s.windEast * s.windDriftTime;
+  g[1] = s.northing - aimNorthing + n + v * sn * s.fallTime + s.windNorth * s.windDriftTime;
+
+  // Plane velocity, plus the fall leg swinging round with the turn
+  g1[0] = v * c - s.turnRate * v * sn * s.fallTime;
+  g1[1] = v * sn + s.turnRate * v * c * s.fallTime;
+
+  g2[0] = -s.turnRate * v * sn - s.turnRate * s.turnRate * v * c * s.fallTime;
+  g2[1] = s.turnRate * v * c - s.turnRate * s.turnRate * v * sn * s.fallTime;
+}
+
+double dropReleaseTime(const DropState &s, const DropModel &model, double aimEasting, double aimNorthing) {
+
+  double now = s.now;
+  double g[2], g1[2], g2[2];
+
+  if (s.speed < TURN_RATE_MIN_SPEED_MPS)
+    return now;
+
+  // Straight line: g(t) = g(0) + v t  ->  t = -g(0).v / |v|^2
+  dropLandingPoint(s, model, 0, aimEasting, aimNorthing, g, g1, g2);
+  double t = -(g[0] * g1[0] + g[1] * g1[1]) / (s.speed * s.speed);
+
+  if (fabs(s.turnRate) >= STRAIGHT_TURN_RATE) {
+    // Half a turn ahead is as far as it makes sense to look - past that we're coming back around
+    double halfTurn = M_PI / fabs(s.turnRate);
+    double horizon = RELEASE_SOLVER_HORIZON_S < halfTurn ? RELEASE_SOLVER_HORIZON_S : halfTurn;
+    t = clampTime(t, now, now + horizon);
+
+    // The straight line answer can be a long way off in a tight turn, so start Newton from the best of a coarse scan
+    dropLandingPoint(s, model, t, aimEasting, aimNorthing, g, g1, g2);
+    double bestMissSq = g[0] * g[0] + g[1] * g[1];
+    for (int i = 0; i <= RELEASE_SOLVER_SCAN_POINTS; i++) {
+      double ts = now + horizon * i / RELEASE_SOLVER_SCAN_POINTS;
+      dropLandingPoint(s, model, ts, aimEasting, aimNorthing, g, g1, g2);
+      if (g[0] * g[0] + g[1] * g[1] < bestMissSq) {
+        bestMissSq = g[0] * g[0] + g[1] * g[1];
+        t = ts;
+      }
+    }
+
+    for (int i = 0; i < RELEASE_SOLVER_ITERATIONS; i++) {
+      dropLandingPoint(s, model, t, aimEasting, aimNorthing, g, g1, g2);
+      double f1 = g[0] * g1[0] + g[1] * g1[1];
+      double f2 = g1[0] * g1[0] + g1[1] * g1[1] + g[0] * g2[0] + g[1] * g2[1];
+      if (f2 <= 0)  //Not near a minimum - keep what we have
+        break;
+
+      double step = f1 / f2;
+      t = clampTime(t - step, now, now + horizon);
+      if (fabs(step) < RELEASE_SOLVER_TOLERANCE_S)
+        break;
+    }
+  }
+
+  return clampTime(t, now, now + RELEASE_SOLVER_HORIZON_S);
+}
+
+double dropMissDistance(const DropState &s, const DropModel &model, double t, double aimEasting, double aimNorthing) {
+  double g[2], g1[2], g2[2];
+  dropLandingPoint(s, model, t, aimEasting, aimNorthing, g, g1, g2);
+  return fastSqrt(g[0] * g[0] + g[1] * g[1]);
+}
+
+/*
+   The landing point is the filtered position projected forward to landing at the filtered velocity, so its covariance is
+   Ppos + T^2 Pvel + T (Ppv + Pvp), plus the fall model's own error. That is reduced to an equivalent circular sigma (half the trace).
+*/
+double dropSigmaSq(const DropState &s, const DropModel &model, double t) {
+
+  double T = t + model.servoOpenDelayMs / 1000.0 + s.fallTime;
+  double varEast = s.varEast + T * T * s.varVelEast + 2 * T * s.covEast;
+  double varNorth = s.varNorth + T * T * s.varVelNorth + 2 * T * s.covNorth;
+  double fallModelError = model.fallModelErrorFraction * (s.speed * s.fallTime);
+  return 0.5 * (varEast + varNorth) + fallModelError * fallModelError;
+}
+
+/*
+   Probability that a circular 2D gaussian (1 sigma = sqrt(sigmaSq)) centred missDistance from the target lands within the target radius.
+
+   The exact answer is a Marcum Q function, far too expensive for every tick. This closed form is exact when centred on the target,
+   has the right tail for small radii, and is within ~0.1 otherwise (worst for large radii with the miss near the ring edge).
+   It is strictly decreasing in missDistance, so the closest approach is also the most likely hit.
+*/
+double dropHitProbability(const DropModel &model, double missDistance, double sigmaSq) {
+
+  double radiusSq = (double)model.targetRadiusM * model.targetRadiusM;
+  if (sigmaSq <= 0)
+    return missDistance <= model.targetRadiusM ? 1 : 0;
+
+  return (1 - exp(-radiusSq / (2 * sigmaSq))) * exp(-(missDistance * missDistance) / (2 * sigmaSq + radiusSq));
+}
@@ -0,0 +1,57 @@
+#ifndef _DROP_SOLVER_H
+#define _DROP_SOLVER_H
+
+#include "FastMath.h"
+
+/*
+  Release solution for one payload from one plane state: when to release it so it lands closest to an aim point, how close that
+  is, and how likely it is to land within the target radius. The Targeter fills a DropState from its filtered fix each solve;
+  the host side batch version (tools/targeter_batch) takes arrays of the same fields and is checked against these functions.
+
+  Everything the solve depends on is in the state and the model, so it is a pure function of them. No Arduino dependencies.
+
+  Releasing at t, the payload leaves at t + servo delay with the plane's velocity then, and travels on for the fall time.
+  Minimize f(t) = |g(t)|^2 / 2, g = landing point - aim point, ie. solve f'(t) = g.g' = 0.
+  On a straight track that is linear in t (closed form). In a turn, a coarse scan and then Newton iterations.
+  The release can't be before now, so if the best time has passed the answer is now (f is convex around the minimum).
+*/
+
+#define RELEASE_SOLVER_ITERATIONS 6
+#define RELEASE_SOLVER_SCAN_POINTS 16  //In a turn, Newton starts from the best of this many evenly spaced release times
+#define RELEASE_SOLVER_TOLERANCE_S 0.001
+#define RELEASE_SOLVER_HORIZON_S 60.0  //Don't look further ahead than this for a release
+#define STRAIGHT_TURN_RATE 0.02  //rad/s (~1 deg/s) - below this the track is treated as straight (closed form)
+#define TURN_RATE_MIN_SPEED_MPS 2.0  //Heading is meaningless below this
+#define GRAVITY_MPS2 9.807
+
+// The tunable parameters the solve uses, as in Parameters.h
+struct DropModel {
+  float correctionFactor;
+  float servoOpenDelayMs;
+  float targetRadiusM;
+  float fallModelErrorFraction;
+};
+
+struct DropState {
+  double easting, northing;  //m, filtered
+  double speed;  //m/s, filtered ground speed
+  double heading;  //rad, math angle (E = 0, counter clockwise)
+  double headingCos, headingSin;  //fastSinCos(heading)
+  double turnRate;  //rad/s, counter clockwise positive
+  double fallTime;  //s, including the correction factor (dropFallTimes)
+  double windDriftTime;  //s - the payload moves windDriftTime * wind relative to the no wind landing point
+  double windEast, windNorth;  //m/s, 0 if not known
+  double now;  //s from the state's timestamp to now, the earliest release
+  double varEast, varNorth;  //Position variance (m^2)...
+  double varVelEast, varVelNorth;  //...velocity variance...
+  double covEast, covNorth;  //...and position/velocity covariance, from the position filter
+};
+
+void dropFallTimes(double heightM, const DropModel &model, double &fallTime, double &windDriftTime);  //Height above the aim point
+void dropLandingPoint(const DropState &s, const DropModel &model, double t, double aimEasting, double aimNorthing, double g[2], double g1[2], double g2[2]);  //Landing point relative to the aim point, and its 1st/2nd derivatives, for a release at t
+double dropReleaseTime(const DropState &s, const DropModel &model, double aimEasting, double aimNorthing);  //s after the state's timestamp
+double dropMissDistance(const DropState &s, const DropModel &model, double t, double aimEasting, double aimNorthing);
+double dropSigmaSq(const DropState &s, const DropModel &model, double t);  //Circular variance of the landing point (m^2) for a release at t
+double dropHitProbability(const DropModel &model, double missDistance, double sigmaSq);
+
+#endif //_DROP_SOLVER_H
@@ -0,0 +1,194 @@
+#include "FastMath.h"
+
+// sin(i / 256 * pi / 2), Q30. The extra entry is a guard so interpolating at exactly 90 degrees stays in bounds
+const int32_t sineTable[(1 << SINE_TABLE_BITS) + 2] = {
+  0, 6588356, 13176464, 19764076, 26350943, 32936819, 39521455, 46104602,
+  52686014, 59265442, 65842639, 72417357, 78989349, 85558366, 92124163, 98686491,
+  105245103, 111799753, 118350194, 124896179, 131437462, 137973796, 144504935, 151030634,
+  157550647, 164064728, 170572633, 177074115, 183568930, 190056834, 196537583, 203010932,
+  209476638, 215934457, 222384147, 228825464, 235258165, 241682010, 248096755, 254502159,
+  260897982, 267283981, 273659918, 280025552, 286380643, 292724951, 299058239, 305380268,
+  311690799, 317989595, 324276419, 330551034, 336813204, 343062693, 349299266, 355522689,
+  361732726, 367929144, 374111709, 380280190, 386434353, 392573967, 398698801, 404808624,
+  410903207, 416982319, 423045732, 429093217, 435124548, 441139496, 447137835, 453119340,
+  459083786, 465030947, 470960600, 476872522, 482766489, 488642281, 494499676, 500338453,
+  506158392, 511959275, 517740883, 523502998, 529245404, 534967884, 540670223, 546352205,
+  552013618, 557654248, 563273883, 568872310, 574449320, 580004702, 585538248, 591049748,
+  596538995, 602005783, 607449906, 612871159, 618269338, 623644239, 628995660, 634323400,
+  639627258, 644907034, 650162530, 655393548, 660599890, 665781362, 670937767, 676068911,
+  681174602, 686254647, 691308855, 696337036, 701339000, 706314559, 711263525, 716185713,
+  721080937, 725949013, 730789757, 735602987, 740388522, 745146182, 749875788, 754577161,
+  759250125, 763894504, 768510122, 773096806, 777654384, 782182683, 786681534, 791150767,
+  795590213, 799999706, 804379079, 808728167, 813046808, 817334838, 821592095, 825818421,
+  830013654, 834177638, 838310216, 842411232, 846480531, 850517961, 854523370, 858496606,
+  862437520, 866345964, 870221790, 874064853, 877875009, 881652112, 885396022, 889106597,
+  892783698, 896427186, 900036924, 903612776, 907154608, 910662286, 914135678, 917574653,
+  920979082, 924348837, 927683790, 930983817, 934248793, 937478595, 940673101, 943832191,
+  946955747, 950043650, 953095785, 956112036, 959092290, 962036435, 964944360, 967815955,
+  970651112, 973449725, 976211688, 978936898, 981625251, 984276646, 986890984, 989468165,
+  992008094, 994510675, 996975812, 999403415, 1001793390, 1004145648, 1006460100, 1008736660,
+  1010975242, 1013175761, 1015338134, 1017462281, 1019548121, 1021595575, 1023604567, 1025575020,
+  1027506862, 1029400018, 1031254418, 1033069992, 1034846671, 1036584389, 1038283080, 1039942680,
+  1041563127, 1043144360, 1044686319, 1046188946, 1047652185, 1049075980, 1050460278, 1051805027,
+  1053110176, 1054375676, 1055601479, 1056787540, 1057933813, 1059040255, 1060106826, 1061133483,
+  1062120190, 1063066909, 1063973603, 1064840240, 1065666786, 1066453210, 1067199483, 1067905576,
+  1068571464, 1069197120, 1069782521, 1070327646, 1070832474, 1071296985, 1071721163, 1072104991,
+  1072448455, 1072751542, 1073014240, 1073236540, 1073418433, 1073559913, 1073660973, 1073721611,
+  1073741824, 1073741824
+};
+
+// atan(2^-i) as binary angles
+static const int32_t cordicAngles[FAST_MATH_CORDIC_ITERATIONS] = {
+  536870912, 316933406, 167458907, 85004756, 42667331, 21354465, 10679838, 5340245,
+  2670163, 1335087, 667544, 333772, 166886, 83443, 41722, 20861,
+  10430, 5215, 2608, 1304, 652, 326, 163, 81
+};
+
+#define LN_TABLE_BITS 8
+#define LN_FRACTION_BITS (31 - LN_TABLE_BITS)
+#define LN2_Q30 744261118
+
+// ln(1 + i / 256), Q30
+static const int32_t lnTable[(1 << LN_TABLE_BITS) + 1] = {
+  0, 4186133, 8356010, 12509755, 16647494, 20769348, 24875440, 28965890,
+  33040817, 37100337, 41144567, 45173622, 49187615, 53186658, 57170862, 61140337,
+  65095192, 69035533, 72961468, 76873100, 80770534, 84653872, 88523216, 92378666,
+  96220323, 100048283, 103862646, 107663506, 111450959, 115225099, 118986020, 122733814,
+  126468572, 130190384, 133899340, 137595529, 141279038, 144949954, 148608363, 152254349,
+  155887996, 159509388, 163118608, 166715736, 170300854, 173874042, 177435378, 180984941,
+  184522808, 188049057, 191563764, 195067003, 198558849, 202039377, 205508659, 208966767,
+  212413774, 215849751, 219274768, 222688894, 226092199, 229484751, 232866618, 236237867,
+  239598564, 242948775, 246288566, 249618000, 252937143, 256246057, 259544806, 262833451,
+  266112055, 269380678, 272639381, 275888224, 279127266, 282356568, 285576186, 288786179,
+  291986604, 295177518, 298358977, 301531038, 304693756, 307847185, 310991380, 314126395,
+  317252283, 320369097, 323476891, 326575715, 329665621, 332746662, 335818887, 338882346,
+  341937090, 344983168, 348020629, 351049522, 354069895, 357081796, 360085271, 363080369,
+  366067135, 369045617, 372015859, 374977907, 377931807, 380877602, 383815338, 386745058,
+  389666807, 392580626, 395486560, 398384650, 401274940, 404157470, 407032282, 409899418,
+  412758919, 415610824, 418455175, 421292011, 424121372, 426943297, 429757825, 432564995,
+  435364845, 438157413, 440942737, 443720854, 446491803, 449255618, 452012338, 454761999,
+  457504636, 460240285, 462968983, 465690763, 468405662, 471113713, 473814952, 476509412,
+  479197128, 481878132, 484552460, 487220142, 489881214, 492535707, 495183654, 497825086,
+  500460037, 503088537, 505710618, 508326312, 510935650, 513538662, 516135378, 518725830,
+  521310048, 523888061, 526459898, 529025591, 531585167, 534138657, 536686088, 539227490,
+  541762891, 544292320, 546815803, 549333370, 551845048, 554350865, 556850847, 559345022,
+  561833416, 564316057, 566792972, 569264185, 571729724, 574189615, 576643883, 579092554,
+  581535654, 583973207, 586405240, 588831776, 591252841, 593668459, 596078655, 598483453,
+  600882877, 603276951, 605665699, 608049145, 610427311, 612800223, 615167901, 617530370,
+  619887653, 622239772, 624586750, 626928608, 629265371, 631597058, 633923694, 636245299,
+  638561895, 640873503, 643180146, 645481844, 647778619, 650070492, 652357483, 654639613,
+  656916903, 659189373, 661457044, 663719936, 665978069, 668231463, 670480138, 672724113,
+  674963409, 677198044, 679428038, 681653410, 683874180, 686090366, 688301988, 690509063,
+  692711611, 694909651, 697103200, 699292276, 701476899, 703657087, 705832856, 708004225,
+  710171213, 712333835, 714492111, 716646057, 718795691, 720941030, 723082092, 725218892,
+  727351448, 729479778, 731603897, 733723822, 735839570, 737951158, 740058601, 742161915,
+  744261118
+};
+
+int32_t sinQ30(uint32_t angle) {
+
+  // Fold into the first quarter: the second and fourth run backwards, the second half is negative
+  uint32_t x = angle & (ANGLE_QUARTER_TURN - 1);
+  if (angle & ANGLE_QUARTER_TURN)
+    x = ANGLE_QUARTER_TURN - x;
+
+  uint32_t i = x >> SINE_FRACTION_BITS;
+  int32_t fraction = x & ((1UL << SINE_FRACTION_BITS) - 1);
+  int32_t value = sineTable[i] + (int32_t)(((int64_t)(sineTable[i + 1] - sineTable[i]) * fraction) >> SINE_FRACTION_BITS);
+
+  return (angle & ANGLE_HALF_TURN) ? -value : value;
+}
+
+// CORDIC in vectoring mode: rotate (x, y) onto the x axis by +-atan(2^-i) steps, adding up the rotations
+int32_t atan2Angle(int32_t y, int32_t x) {
+
+  if (x == 0 && y == 0)
+    return 0;
+
+  // Normalize so the larger is in [2^28, 2^29) - enough bits for the small steps, and room for the CORDIC gain (1.65) and sqrt 2
+  uint32_t ax = x < 0 ? -(int64_t)x : x, ay = y < 0 ? -(int64_t)y : y;
+  int shift = __builtin_clz(ax > ay ? ax : ay) - 3;
+  if (shift > 0) {
+    x = (int32_t)((uint32_t)x << shift);
+    y = (int32_t)((uint32_t)y << shift);
+  }
+  else {
+    x >>= -shift;
+    y >>= -shift;
+  }
+
+  // Into the right half plane by a quarter turn, as the steps only add up to +-99 degrees
+  uint32_t angle = 0;
+  if (x < 0) {
+    int32_t t = x;
+    if (y >= 0) {
+      x = y;
+      y = -t;
+      angle = ANGLE_QUARTER_TURN;
+    }
+    else {
+      x = -y;
+      y = t;
+      angle = -ANGLE_QUARTER_TURN;
+    }
+  }
+
+  // Branch free: m is -1 below the axis, and (v ^ m) - m negates v then
+  for (int i = 0; i < FAST_MATH_CORDIC_ITERATIONS; i++) {
+    int32_t dx = y >> i, dy = x >> i, m = y >> 31;
+    x += (dx ^ m) - m;
+    y -= (dy ^ m) - m;
+    angle += (cordicAngles[i] ^ m) - m;
+  }
+  return (int32_t)angle;
+}
+
+int32_t asinAngle(int32_t sQ30) {
+  int64_t s = sQ30 > ONE_Q30 ? ONE_Q30 : sQ30 < -ONE_Q30 ? -ONE_Q30 : sQ30;
+  return atan2Angle((int32_t)s, (int32_t)isqrt64(((uint64_t)1 << 60) - (uint64_t)(s * s)));
+}
+
+// Bit by bit integer square root (branch free, so it's constant time for a given size of x)
+uint32_t isqrt32(uint32_t x) {
+  uint32_t result = 0;
+  uint32_t bit = 1UL << 30;
+  while (bit > x) {
+    bit >>= 2;
+  }
+  while (bit != 0) {
+    uint32_t t = result + bit, take = -(uint32_t)(x >= t);  //All ones if this bit is set
+    x -= t & take;
+    result = (result >> 1) + (bit & take);
+    bit >>= 2;
+  }
+  return result;
+}
+
+// The same, 64 bit
+uint32_t isqrt64(uint64_t x) {
+  uint64_t result = 0;
+  uint64_t bit = 1ULL << 62;
+  while (bit > x) {
+    bit >>= 2;
+  }
+  while (bit != 0) {
+    uint64_t t = result + bit, take = -(uint64_t)(x >= t);  //All ones if this bit is set
+    x -= t & take;
+    result = (result >> 1) + (bit & take);
+    bit >>= 2;
+  }
+  return (uint32_t)result;
+}
+
+// x = 2^e * m with m in [1, 2): ln x = e ln 2 + ln m
+int32_t lnQ24(uint32_t x) {
+
+  int e = 31 - __builtin_clz(x);
+  uint32_t m = (x << (31 - e)) & 0x7FFFFFFF;  //Fraction of the mantissa, 31 bits
+
+  uint32_t i = m >> LN_FRACTION_BITS;
+  int32_t fraction = m & ((1UL << LN_FRACTION_BITS) - 1);
+  int64_t value = lnTable[i] + (((int64_t)(lnTable[i + 1] - lnTable[i]) * fraction) >> LN_FRACTION_BITS);
+
+  return (int32_t)(((int64_t)e * LN2_Q30 + value) >> 6);
+}
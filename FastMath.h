@@ -0,0 +1,152 @@
+#ifndef _FAST_MATH_H
+#define _FAST_MATH_H
+
+#include <stdint.h>
+#include <math.h>
+
+/*
+  Fast trig and square roots, shared by everything that does geometry (the Due has no FPU, so libm's soft float sin/atan2 are
+  thousands of cycles each).
+
+  The kernels are integer:
+    Angles are binary angles - a full turn is 2^32, so they wrap for free. Signed, +-2^31 is +-pi.
+    sin/cos: quarter wave table of 256 steps, linearly interpolated. Result Q30. Max error 4.8e-6 (interpolation, h^2/8).
+    atan2: CORDIC, FAST_MATH_CORDIC_ITERATIONS rotations. Max error 2.4e-7 rad. Inputs any scale (normalized inside).
+    asin: atan2(s, sqrt(1 - s^2)), so the same error (near +-1 the input's own rounding dominates, as for any asin).
+    isqrt32/isqrt64: bit by bit, exact (floor).
+    lnQ24: natural log of an integer - the exponent, plus a table of ln(1 + i/256), linearly interpolated. Max error 1.9e-6, and
+      always low, so the difference of two logs is good to the same.
+
+  The templates take and return float, double or Fixed<FRAC> (radians for angles):
+    fastSin, fastCos, fastSinCos, fastAtan2, fastAsin - the kernels' error, plus the type's own rounding.
+    fastSqrt - float/double: reciprocal square root from the exponent trick plus Newton steps (no divide), relative error
+      5e-6 for float (2 steps), 2e-16 for double (4 steps). Returns 0 for x <= 0. Fixed: isqrt64, exact to the last bit.
+  Fixed point angles need FRAC <= 29 so that +-pi fits.
+
+  Measured error bounds and host timings: tools/fastmath_bench. No Arduino dependencies, so it builds there as is.
+*/
+
+#define ANGLE_HALF_TURN ((uint32_t)0x80000000)
+#define ANGLE_QUARTER_TURN ((uint32_t)0x40000000)
+#define ANGLE_TO_DEG (360.0 / 4294967296.0)
+#define ANGLE_TO_RAD (6.283185307179586 / 4294967296.0)
+#define RAD_TO_ANGLE (4294967296.0 / 6.283185307179586)
+#define ONE_Q30 (1L << 30)
+#define FAST_MATH_CORDIC_ITERATIONS 24
+#define SINE_TABLE_BITS 8  //256 steps per quarter turn
+#define SINE_FRACTION_BITS (30 - SINE_TABLE_BITS)
+
+extern const int32_t sineTable[(1 << SINE_TABLE_BITS) + 2];  //For vector versions of sinQ30 (tools/targeter_batch)
+
+int32_t sinQ30(uint32_t angle);
+inline int32_t cosQ30(uint32_t angle) { return sinQ30(angle + ANGLE_QUARTER_TURN); }
+int32_t atan2Angle(int32_t y, int32_t x);  //Binary angle of (x, y), 0 for (0, 0)
+int32_t asinAngle(int32_t sQ30);  //Clamped to +-1
+uint32_t isqrt32(uint32_t x);
+uint32_t isqrt64(uint64_t x);
+int32_t lnQ24(uint32_t x);  //x > 0
+
+template <int FRAC> struct Fixed {
+  int32_t raw;
+  static Fixed fromRaw(int32_t r) { Fixed f; f.raw = r; return f; }
+};
+
+typedef Fixed<16> FixedQ16;
+typedef Fixed<30> FixedQ30;
+
+// How each type gets in and out of the integer kernels
+template <class T> struct FastMathTraits;
+
+template <> struct FastMathTraits<float> {
+  static uint32_t toAngle(float x) { return (uint32_t)(int64_t)(x * (float)RAD_TO_ANGLE); }
+  static float fromAngle(int32_t a) { return a * (float)ANGLE_TO_RAD; }
+  static float fromQ30(int32_t v) { return v * (1.0f / ONE_Q30); }
+  static int32_t toQ30(float x) { return x >= 1 ? ONE_Q30 : x <= -1 ? -ONE_Q30 : (int32_t)(x * ONE_Q30); }
+  // Common power of two scale so the larger of the two is about 2^29
+  static void toCordic(float y, float x, int32_t &yi, int32_t &xi) {
+    int e;
+    frexpf(fabsf(x) > fabsf(y) ? x : y, &e);
+    yi = (int32_t)ldexpf(y, 29 - e);
+    xi = (int32_t)ldexpf(x, 29 - e);
+  }
+  static float sqrt(float x) {
+    if (!(x > 0))
+      return 0;
+    union { float f; uint32_t i; } u = { x };
+    u.i = 0x5f3759df - (u.i >> 1);
+    float y = u.f, half = 0.5f * x;
+    y *= 1.5f - half * y * y;
+    y *= 1.5f - half * y * y;
+    return x * y;
+  }
+};
+
+template <> struct FastMathTraits<double> {
+  static uint32_t toAngle(double x) { return (uint32_t)(int64_t)(x * RAD_TO_ANGLE); }
+  static double fromAngle(int32_t a) { return a * ANGLE_TO_RAD; }
+  static double fromQ30(int32_t v) { return v * (1.0 / ONE_Q30); }
+  static int32_t toQ30(double x) { return x >= 1 ? ONE_Q30 : x <= -1 ? -ONE_Q30 : (int32_t)(x * ONE_Q30); }
+  static void toCordic(double y, double x, int32_t &yi, int32_t &xi) {
+    int e;
+    frexp(fabs(x) > fabs(y) ? x : y, &e);
+    yi = (int32_t)ldexp(y, 29 - e);
+    xi = (int32_t)ldexp(x, 29 - e);
+  }
+  static double sqrt(double x) {
+    if (!(x > 0))
+      return 0;
+    union { double f; uint64_t i; } u = { x };
+    u.i = 0x5fe6eb50c7b537a9ULL - (u.i >> 1);
+    double y = u.f, half = 0.5 * x;
+    for (int i = 0; i < 4; i++)
+      y *= 1.5 - half * y * y;
+    return x * y;
+  }
+};
+
+template <int FRAC> struct FastMathTraits<Fixed<FRAC> > {
+  typedef Fixed<FRAC> T;
+  static uint32_t toAngle(T x) { return (uint32_t)(((int64_t)x.raw * 683565276LL) >> FRAC); }  //2^32 / 2pi
+  static T fromAngle(int32_t a) { return T::fromRaw((int32_t)(((int64_t)a * 1686629713LL) >> (60 - FRAC))); }  //2pi in Q28
+  static T fromQ30(int32_t v) { return T::fromRaw(v >> (30 - FRAC)); }
+  static int32_t toQ30(T x) {
+    int64_t v = (int64_t)x.raw << (30 - FRAC);
+    return v >= ONE_Q30 ? ONE_Q30 : v <= -ONE_Q30 ? -ONE_Q30 : (int32_t)v;
+  }
+  static void toCordic(T y, T x, int32_t &yi, int32_t &xi) {
+    yi = y.raw;
+    xi = x.raw;
+  }
+  static T sqrt(T x) { return T::fromRaw(x.raw > 0 ? (int32_t)isqrt64((uint64_t)x.raw << FRAC) : 0); }
+};
+
+template <class T> inline T fastSin(T x) {
+  return FastMathTraits<T>::fromQ30(sinQ30(FastMathTraits<T>::toAngle(x)));
+}
+
+template <class T> inline T fastCos(T x) {
+  return FastMathTraits<T>::fromQ30(cosQ30(FastMathTraits<T>::toAngle(x)));
+}
+
+// One angle conversion for both
+template <class T> inline void fastSinCos(T x, T &s, T &c) {
+  uint32_t a = FastMathTraits<T>::toAngle(x);
+  s = FastMathTraits<T>::fromQ30(sinQ30(a));
+  c = FastMathTraits<T>::fromQ30(cosQ30(a));
+}
+
+template <class T> inline T fastAtan2(T y, T x) {
+  int32_t yi, xi;
+  FastMathTraits<T>::toCordic(y, x, yi, xi);
+  return FastMathTraits<T>::fromAngle(atan2Angle(yi, xi));
+}
+
+template <class T> inline T fastAsin(T x) {
+  return FastMathTraits<T>::fromAngle(asinAngle(FastMathTraits<T>::toQ30(x)));
+}
+
+template <class T> inline T fastSqrt(T x) {
+  return FastMathTraits<T>::sqrt(x);
+}
+
+#endif //_FAST_MATH_H
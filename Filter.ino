@@ -1,7 +1,5 @@
 //public class KalmanFilter {
 
-  float Q = 0.000001;
-  float R = 0.0001;
   float P = 1, X = 0, K;
 
   //public KalmanFilter() {
@@ -11,6 +9,7 @@
   //}
 
   void measurementUpdate() {
+    float Q = params.altitudeFilterQ, R = params.altitudeFilterR;  //Tunable, see Parameters.h
     K = (P + Q) / (P + Q + R);
     P = R * (P + Q) / (R + P + Q);
   }
@@ -37,4 +36,9 @@
     return result;
   }
 
+  //Start the filter from a known altitude (warm restart) instead of converging up from 0
+  void seedAltitudeFtFilter(float altitude) {
+    X = altitude;
+  }
+
 //}
@@ -0,0 +1,103 @@
+#include "FlightReplay.h"
+
+FlightReplay::FlightReplay() {
+  playing = haveNext = false;
+  sentenceLength = sentenceArrived = 0;
+  rxHead = rxCount = 0;
+  newAltimeterSample = false;
+  overruns = 0;
+}
+
+boolean FlightReplay::begin(const uint8_t *data, uint32_t length, uint32_t _byteTimeUs) {
+
+  playing = decoder.begin(data, length);
+  if (!playing)
+    return false;
+
+  byteTimeUs = _byteTimeUs;
+  start = systemMicros();
+  sentenceLength = sentenceArrived = 0;
+  sentenceStart = start;
+  rxHead = rxCount = 0;
+  newAltimeterSample = false;
+  overruns = 0;
+  haveNext = decoder.next(next);
+  return true;
+}
+
+// Apply every event that is due, and take in the bytes that have arrived since the last call
+void FlightReplay::advance() {
+
+  if (!playing)
+    return;
+
+  uint64_t now = systemMicros();
+  while (haveNext && start + (uint64_t)next.timeMs * MICROS_PER_MILLI <= now) {
+    if (next.kind == REPLAY_EVENT_NMEA) {
+      receive(sentenceLength);  //The recording never starts a sentence before the last one is out
+      memcpy(sentence, next.sentence, next.length);
+      sentence[next.length] = '\r';
+      sentence[next.length + 1] = '\n';
+      sentenceLength = next.length + 2;
+      sentenceArrived = 0;
+      sentenceStart = start + (uint64_t)next.timeMs * MICROS_PER_MILLI;
+    }
+    else {
+      pressureQ2 = next.pressureQ2;
+      temperatureQ4 = next.temperatureQ4;
+      newAltimeterSample = true;
+    }
+    haveNext = decoder.next(next);
+  }
+
+  uint32_t arrived = microsBetween(sentenceStart, now) / byteTimeUs;
+  receive(arrived < sentenceLength ? arrived : sentenceLength);
+}
+
+void FlightReplay::receive(uint32_t upTo) {
+  for (; sentenceArrived < upTo; sentenceArrived++) {
+    if (rxCount == REPLAY_RX_BUFFER)
+      overruns++;
+    else
+      rx[(rxHead + rxCount++) % REPLAY_RX_BUFFER] = sentence[sentenceArrived];
+  }
+}
+
+int FlightReplay::available() {
+  advance();
+  return rxCount;
+}
+
+int FlightReplay::read() {
+  if (available() == 0)
+    return -1;
+  uint8_t c = rx[rxHead];
+  rxHead = (rxHead + 1) % REPLAY_RX_BUFFER;
+  rxCount--;
+  return c;
+}
+
+int FlightReplay::peek() {
+  if (available() == 0)
+    return -1;
+  return (uint8_t)rx[rxHead];
+}
+
+boolean FlightReplay::getAltimeterSample(uint32_t &pressure, int32_t &temperature) {
+  advance();
+  if (!newAltimeterSample)
+    return false;
+  newAltimeterSample = false;
+  pressure = pressureQ2;
+  temperature = temperatureQ4;
+  return true;
+}
+
+boolean FlightReplay::isFinished() {
+  advance();
+  return playing && !haveNext && sentenceArrived == sentenceLength && rxCount == 0;
+}
+
+uint32_t FlightReplay::getPositionMs() {
+  return playing ? millisSince(start) : 0;
+}
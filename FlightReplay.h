@@ -0,0 +1,67 @@
+#ifndef _FLIGHT_REPLAY_H
+#define _FLIGHT_REPLAY_H
+
+#include "Arduino.h"
+#include "SystemClock.h"
+#include "ReplayFormat.h"
+
+/*
+  Bench replay of a recorded flight (Flight_Replay in plane.h). The recording (ReplayFormat.h, made by tools/replay) is compiled
+  into flash as ReplayData.h, and played back through the same input paths the sensors use, at the recorded timing:
+    NMEA: this is a Stream that the Communicator reads in place of the GPS serial port (setGPSReplay). Each sentence's bytes arrive
+      one GPS byte time apart from its recorded start, into a receive buffer the size of the UART's, so the sentence timestamping,
+      parsing, GPS clock, targeting and everything downstream run exactly as in flight.
+    Altimeter: each recorded sample once, for Adafruit_MPL3115A2::getAltitudeFt(pressure, temperature) in place of the I2C read.
+      Between samples there is nothing to read, as getAltitudeFt(false) times out (-999) when the sensor has no new conversion -
+      so the altitude filter and the zeroing see each measurement once, as in flight.
+  The loop timing, CPU duty cycle and IMU (still live) are then as they would be in the air.
+
+  Bytes that arrive with the buffer full are lost and counted as overruns, as the UART would lose them - overruns mean the loop
+  can't keep up. Playback stops at the end of the recording.
+*/
+
+#define REPLAY_RX_BUFFER 128  //Bytes, as the Due core's serial receive buffer
+
+class FlightReplay : public Stream {
+
+  public:
+    FlightReplay();
+
+    boolean begin(const uint8_t *data, uint32_t length, uint32_t byteTimeUs);  //Starts playing now. False if the data isn't a recording
+
+    // Stream: the NMEA bytes
+    int available();
+    int read();
+    int peek();
+    void flush() {}
+    size_t write(uint8_t) { return 1; }  //Configuration commands have nowhere to go
+
+    boolean getAltimeterSample(uint32_t &pressureQ2, int32_t &temperatureQ4);  //A sample recorded since the last call, else false
+    boolean isPlaying() { return playing; }
+    boolean isFinished();
+    uint32_t getOverruns() { return overruns; }  //Bytes lost
+    uint32_t getPositionMs();  //Recording time now playing
+
+  private:
+    ReplayDecoder decoder;
+    ReplayEvent next;
+    boolean playing, haveNext;
+    uint64_t start;
+    uint32_t byteTimeUs;
+
+    char sentence[REPLAY_MAX_SENTENCE + 2];  //Arriving now, with the "\r\n"
+    uint8_t sentenceLength, sentenceArrived;
+    uint64_t sentenceStart;
+    char rx[REPLAY_RX_BUFFER];
+    uint16_t rxHead, rxCount;
+
+    boolean newAltimeterSample;  //Recorded and not read yet
+    uint32_t pressureQ2;
+    int32_t temperatureQ4;
+    uint32_t overruns;
+
+    void advance();
+    void receive(uint32_t upTo);  //Bytes of the sentence up to this one into the receive buffer
+};
+
+#endif //_FLIGHT_REPLAY_H
@@ -0,0 +1,56 @@
+#include "GimbalStabilizer.h"
+#include "Arduino.h"
+#include "FastMath.h"
+
+#define DEG_TO_RADIANS (PI / 180)
+
+GimbalStabilizer::GimbalStabilizer() {}
+
+void GimbalStabilizer::update(float lookPanDeg, float lookTiltDeg, float rollDeg, float pitchDeg, float rollRateDPS, float pitchRateDPS, float yawRateDPS) {
+
+  // Predict the attitude when the servos get there. Body rates -> Euler rates (pitch rate about y left is nose down)
+  float roll = rollDeg * DEG_TO_RADIANS, pitch = pitchDeg * DEG_TO_RADIANS;
+  float latency = GIMBAL_SERVO_LATENCY_MS / 1000.0;
+  float p = rollRateDPS * DEG_TO_RADIANS, q = pitchRateDPS * DEG_TO_RADIANS, r = yawRateDPS * DEG_TO_RADIANS;
+  float sr, cr, sp, cp;
+  fastSinCos(roll, sr, cr);
+  fastSinCos(pitch, sp, cp);
+  float pitchDot = -(q * cr - r * sr);
+  float rollDot = p - (q * sr + r * cr) * sp / cp;
+  roll += rollDot * latency;
+  pitch += pitchDot * latency;
+
+  // Look direction in the level frame (x forward along the nose's heading, y left, z up)
+  float pan = -lookPanDeg * DEG_TO_RADIANS, elevation = -lookTiltDeg * DEG_TO_RADIANS;
+  float se, ce, span, cpan;
+  fastSinCos(elevation, se, ce);
+  fastSinCos(pan, span, cpan);
+  float lx = ce * cpan;
+  float ly = ce * span;
+  float lz = se;
+
+  // Into the body frame: undo the pitch (about y), then the roll (about x)
+  fastSinCos(pitch, sp, cp);
+  float px = cp * lx + sp * lz;
+  float pz = -sp * lx + cp * lz;
+  fastSinCos(roll, sr, cr);
+  float bx = px;
+  float by = cr * ly + sr * pz;
+  float bz = -sr * ly + cr * pz;
+
+  bodyPanDeg = -fastAtan2(by, bx) / DEG_TO_RADIANS;
+  bodyTiltDeg = -fastAtan2(bz, fastSqrt(bx * bx + by * by)) / DEG_TO_RADIANS;
+}
+
+int GimbalStabilizer::getPanPulse(int neutral, int minPulse, int maxPulse) {
+  return toPulse(bodyPanDeg, neutral, minPulse, maxPulse);
+}
+
+int GimbalStabilizer::getTiltPulse(int neutral, int minPulse, int maxPulse) {
+  return toPulse(bodyTiltDeg, neutral, minPulse, maxPulse);
+}
+
+int GimbalStabilizer::toPulse(float deg, int neutral, int minPulse, int maxPulse) {
+  int pulse = neutral + (int)round(deg * GIMBAL_US_PER_DEG / GIMBAL_PULSE_QUANTUM_US) * GIMBAL_PULSE_QUANTUM_US;
+  return constrain(pulse, minPulse, maxPulse);
+}
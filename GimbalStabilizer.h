@@ -0,0 +1,43 @@
+#ifndef _GIMBAL_STABILIZER_H
+#define _GIMBAL_STABILIZER_H
+
+#include "Arduino.h"
+
+/*
+  Pan/tilt gimbal stabilization.
+
+  In stabilized mode the commanded pan/tilt is a look direction relative to the horizon (pan relative to the nose, so it still turns
+  with the plane), rather than relative to the airframe. Each update the look direction is rotated into the body frame by the roll
+  and pitch, and converted back to body pan/tilt angles for the servos.
+
+  The servos lag the command (pulse frame + travel), so the attitude used is predicted GIMBAL_SERVO_LATENCY_MS ahead from the IMU's
+  body rates. Pulses are quantized, and the caller only writes a servo when its quantized pulse changes.
+
+  A pan/tilt gimbal can't take out roll about the camera axis, only keep it pointed - the horizon still tilts in the picture.
+*/
+
+#define GIMBAL_US_PER_DEG 11.1  //~90 degrees over 1000us
+#define GIMBAL_SERVO_LATENCY_MS 40
+#define GIMBAL_PULSE_QUANTUM_US 4  //Smaller changes than this aren't worth a write (and are below the servo deadband anyway)
+
+class GimbalStabilizer {
+
+  public:
+    GimbalStabilizer();
+
+    // Look angles are relative to the horizon: pan right +ve, tilt down +ve. Attitude is aviation convention (roll right wing
+    // down +ve, pitch nose up +ve), rates are the IMU's body rates (x forward, y left, z up)
+    void update(float lookPanDeg, float lookTiltDeg, float rollDeg, float pitchDeg, float rollRateDPS, float pitchRateDPS, float yawRateDPS);
+
+    float getBodyPanDeg() { return bodyPanDeg; }  //Servo angles relative to the airframe, same signs as the look angles
+    float getBodyTiltDeg() { return bodyTiltDeg; }
+    int getPanPulse(int neutral, int minPulse, int maxPulse);
+    int getTiltPulse(int neutral, int minPulse, int maxPulse);
+
+  private:
+    float bodyPanDeg = 0, bodyTiltDeg = 0;
+
+    int toPulse(float deg, int neutral, int minPulse, int maxPulse);
+};
+
+#endif //_GIMBAL_STABILIZER_H
@@ -0,0 +1,101 @@
+#include "GpsClock.h"
+#include "Arduino.h"
+
+#define GPS_CLOCK_MAX_DRIFT 0.0005  //500 ppm, far more than any crystal - anything bigger is a bad sample
+#define GPS_CLOCK_MAX_REJECTS 5  //Outliers in a row before we give up and step
+
+GpsClock::GpsClock() {}
+
+void GpsClock::sentenceStarted(uint64_t localMicros) {
+  pendingSentenceLocal = localMicros;
+}
+
+void GpsClock::ppsEdge(uint64_t localMicros) {
+  lastPPSLocal = localMicros;
+}
+
+void GpsClock::update(uint8_t hour, uint8_t minute, uint8_t seconds, uint16_t milliseconds) {
+
+  int64_t utc = dayOffset + ((int64_t)((hour * 60UL + minute) * 60UL + seconds) * 1000 + milliseconds) * 1000;
+
+  // Unwrap midnight
+  if (lastEpochUtc >= 0 && utc < lastEpochUtc - (int64_t)(MICROS_PER_DAY / 2)) {
+    dayOffset += MICROS_PER_DAY;
+    utc += MICROS_PER_DAY;
+  }
+
+  // RMC and GGA both carry the time of the same epoch - only the first sentence of the epoch is a useful sample
+  if (utc == lastEpochUtc)
+    return;
+  lastEpochUtc = utc;
+
+  // 64 bit reads aren't atomic, and the PPS ISR writes this
+  noInterrupts();
+  uint64_t ppsLocal = lastPPSLocal;
+  interrupts();
+
+  // The PPS edge marks the top of the second exactly. Only trust it if it came in during the second before this sentence
+  boolean usingPPS = (milliseconds == 0 && ppsLocal != 0 && ppsLocal < pendingSentenceLocal && pendingSentenceLocal - ppsLocal < MICROS_PER_SECOND);
+  uint64_t sampleLocal = usingPPS ? ppsLocal : pendingSentenceLocal - GPS_SENTENCE_LATENCY_US;
+
+  if (!haveReference) {
+    step(sampleLocal, utc);
+    return;
+  }
+
+  int64_t predicted = utcMicrosAt(sampleLocal);
+  int64_t error = utc - predicted;
+  lastError = constrain(error, -0x7FFFFFFFLL, 0x7FFFFFFFLL);
+
+  if (llabs(error) > GPS_CLOCK_STEP_THRESHOLD_US) {
+    step(sampleLocal, utc);
+    return;
+  }
+
+  // Once locked, a sample this far off is much more likely a corrupted/late sentence than the clock moving
+  if (isLocked() && llabs(error) > 4 * GPS_CLOCK_LOCK_THRESHOLD_US) {
+    if (++rejectCount >= GPS_CLOCK_MAX_REJECTS) {
+      step(sampleLocal, utc);
+    }
+    return;
+  }
+  rejectCount = 0;
+
+  // Second order loop: correct part of the phase error now, and fold the error rate into the drift estimate
+  double gainPhase = usingPPS ? 0.5 : 0.1;
+  double gainFreq = usingPPS ? 0.05 : 0.01;
+  double intervalMicros = (double)(sampleLocal - refLocal);
+
+  refUtc = predicted + (int64_t)(gainPhase * error);
+  refLocal = sampleLocal;
+  if (intervalMicros > 0) {
+    drift = constrain(drift + gainFreq * error / intervalMicros, -GPS_CLOCK_MAX_DRIFT, GPS_CLOCK_MAX_DRIFT);
+  }
+
+  if (llabs(error) < GPS_CLOCK_LOCK_THRESHOLD_US) {
+    if (lockCount < GPS_CLOCK_LOCK_COUNT) lockCount++;
+  }
+  else {
+    lockCount = 0;
+  }
+}
+
+int64_t GpsClock::utcMicrosAt(uint64_t localMicros) {
+  int64_t localDiff = (int64_t)(localMicros - refLocal);
+  return refUtc + localDiff + (int64_t)(localDiff * drift);
+}
+
+uint64_t GpsClock::localMicrosAt(int64_t utcMicros) {
+  int64_t utcDiff = utcMicros - refUtc;
+  return refLocal + (int64_t)(utcDiff / (1.0 + drift));
+}
+
+//Start the loop over from this sample (first sample, or the error was too big to slew out)
+void GpsClock::step(uint64_t localMicros, int64_t utcMicros) {
+  haveReference = true;
+  refLocal = localMicros;
+  refUtc = utcMicros;
+  lockCount = 0;
+  rejectCount = 0;
+  lastError = 0;
+}
@@ -0,0 +1,66 @@
+#ifndef _GPS_CLOCK_H
+#define _GPS_CLOCK_H
+
+#include "Arduino.h"
+#include "SystemClock.h"
+
+/*
+  GPS disciplined clock.
+
+  Tracks the offset and drift between our local microsecond clock (systemMicros) and UTC as reported by the GPS. Each fix epoch gives
+  one sample: the local time the first sentence of the epoch started arriving, paired with the UTC time in the sentence. NMEA arrival
+  has a few ms of jitter and a roughly constant output latency after the epoch (GPS_SENTENCE_LATENCY_US), so samples go through a
+  second order loop (phase + frequency) rather than being used directly.
+  If the PPS output is wired up (GPS_PPS_PIN), the PPS edge is used instead for epochs on the top of a second - it is accurate to
+  well under a microsecond.
+
+  Once locked, any local timestamp can be converted to UTC and back, so samples (altimeter, fix, drop) can all be put on the same
+  timebase. In particular localMicrosAtEpoch() gives the local time the last fix was actually valid, instead of when we parsed it.
+*/
+
+//Optional PPS input. Comment out if the PPS pin of the GPS isn't connected
+//#define GPS_PPS_PIN 22
+
+#define GPS_SENTENCE_LATENCY_US 60000  //Time from fix epoch to the '$' of the first sentence (MTK3339 at 9600 baud, measured against PPS)
+#define GPS_CLOCK_STEP_THRESHOLD_US 100000  //Errors bigger than this reset the loop instead of slewing
+#define GPS_CLOCK_LOCK_THRESHOLD_US 5000  //Loop is considered locked once errors are below this...
+#define GPS_CLOCK_LOCK_COUNT 10  //...for this many epochs in a row
+#define MICROS_PER_DAY 86400000000ULL
+
+class GpsClock {
+
+  public:
+    GpsClock();
+
+    void sentenceStarted(uint64_t localMicros);  //Call when the '$' of a sentence arrives
+    void ppsEdge(uint64_t localMicros);  //Call from the PPS ISR
+    void update(uint8_t hour, uint8_t minute, uint8_t seconds, uint16_t milliseconds);  //Call after a sentence with a time has been parsed
+
+    boolean isLocked() { return lockCount >= GPS_CLOCK_LOCK_COUNT; }
+    int64_t utcMicrosAt(uint64_t localMicros);  //UTC in microseconds since midnight of the day we first locked (does not wrap at midnight)
+    uint64_t localMicrosAt(int64_t utcMicros);
+    uint64_t localMicrosAtEpoch() { return localMicrosAt(lastEpochUtc); }  //When the last fix was valid, on our clock
+
+    float getDriftPPM() { return drift * 1e6; }
+    int32_t getLastErrorMicros() { return lastError; }
+
+  private:
+    uint64_t pendingSentenceLocal = 0;  //Start of the sentence currently being received
+    volatile uint64_t lastPPSLocal = 0;
+
+    // Loop state: utc = refUtc + (local - refLocal) * (1 + drift)
+    boolean haveReference = false;
+    uint64_t refLocal = 0;
+    int64_t refUtc = 0;
+    double drift = 0;  //s/s
+
+    int64_t lastEpochUtc = -1;
+    int64_t dayOffset = 0;  //Added to the time of day to unwrap midnight
+    int32_t lastError = 0;
+    int lockCount = 0;
+    int rejectCount = 0;
+
+    void step(uint64_t localMicros, int64_t utcMicros);
+};
+
+#endif //_GPS_CLOCK_H
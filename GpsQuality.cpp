@@ -0,0 +1,74 @@
+#include "GpsQuality.h"
+#include "Arduino.h"
+
+GpsQuality::GpsQuality() {
+  reset();
+}
+
+void GpsQuality::reset() {
+  valid = false;
+  expectedError = GPS_NO_FIX_ERROR_M;
+  jumpVar = 0;
+  timestamp = 0;
+  havePrevious = false;
+}
+
+void GpsQuality::update(uint8_t fixQuality, uint8_t satellites, float hdop, uint8_t fixMode, float pdop, int32_t latitudeE7, int32_t longitudeE7,
+                        float speedMPS, float courseDeg, uint64_t _timestamp) {
+
+  if (fixQuality == 0 || fixMode == 1 || hdop <= 0) {
+    valid = false;
+    expectedError = GPS_NO_FIX_ERROR_M;
+    havePrevious = false;
+    timestamp = _timestamp;
+    return;
+  }
+
+  // Receiver's own error model: range error times the horizontal geometry
+  float error = (fixQuality == 2 ? GPS_UERE_DGPS_M : GPS_UERE_M) * hdop;
+  if (satellites < GPS_MIN_GOOD_SATS) {
+    error *= 1 + GPS_FEW_SATS_FACTOR * (GPS_MIN_GOOD_SATS - satellites);
+  }
+  if (fixMode == 2 || pdop > GPS_MAX_PDOP) {
+    error *= GPS_2D_FIX_FACTOR;
+  }
+
+  // Consistency with the last fix. Degrees are close enough to flat over a couple of seconds of flight
+  float courseRad = courseDeg / 180 * PI;
+  float sinCourse, cosCourse;
+  fastSinCos(courseRad, sinCourse, cosCourse);
+  float velEast = speedMPS * sinCourse, velNorth = speedMPS * cosCourse;
+  float dt = microsBetween(timestamp, _timestamp) / (float)MICROS_PER_SECOND;
+  if (havePrevious && dt > 0 && dt < GPS_JUMP_MAX_GAP_S) {
+    float metresPerE7East = M_PER_DEGREE_E7 * fastCos((float)(latitudeE7 * 1e-7 / 180 * PI));
+    float residualEast = (longitudeE7 - prevLongitudeE7) * metresPerE7East - prevVelEast * dt;
+    float residualNorth = (latitudeE7 - prevLatitudeE7) * M_PER_DEGREE_E7 - prevVelNorth * dt;
+    jumpVar += GPS_JUMP_SMOOTHING * (sq(residualEast) + sq(residualNorth) - jumpVar);
+  }
+
+  havePrevious = true;
+  prevLatitudeE7 = latitudeE7;
+  prevLongitudeE7 = longitudeE7;
+  prevVelEast = velEast;
+  prevVelNorth = velNorth;
+  timestamp = _timestamp;
+
+  valid = true;
+  expectedError = fastSqrt(sq(error) + jumpVar);
+}
+
+float GpsQuality::getExpectedErrorM(uint64_t now) {
+
+  if (!valid)
+    return GPS_NO_FIX_ERROR_M;
+
+  return expectedError + GPS_AGE_ERROR_MPS * microsBetween(timestamp, now) / (float)MICROS_PER_SECOND;
+}
+
+float GpsQuality::getScore(uint64_t now) {
+
+  if (!valid || microsBetween(timestamp, now) > GPS_STALE_MS * MICROS_PER_MILLI)
+    return 0;
+
+  return GPS_SCORE_REF_ERROR_M / (GPS_SCORE_REF_ERROR_M + getExpectedErrorM(now));
+}
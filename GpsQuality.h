@@ -0,0 +1,65 @@
+#ifndef _GPS_QUALITY_H
+#define _GPS_QUALITY_H
+
+#include "Arduino.h"
+#include "FastMath.h"
+#include "SystemClock.h"
+
+/*
+  GPS fix quality model. Turns what the receiver reports about a fix into an expected (1 sigma) horizontal position error in metres,
+  and a score from 0 to 1 for choosing between receivers.
+
+  The error starts from the user range error (smaller with a DGPS/WAAS fix) times HDOP, and is inflated for few satellites, a 2D fix
+  (altitude held, so its error leaks into the horizontal solution) or a very high PDOP. On top of that, each fix is checked against
+  where the last fix and its velocity said it should be. GPS errors change slowly, so consecutive fixes agree to well under a metre
+  normally - a multipath jump or a receiver losing its solution shows up as a big disagreement, whatever HDOP says. The squared
+  disagreement is smoothed and added to the variance, so a jump raises the expected error straight away and it settles over ~1s.
+
+  As a fix ages, the error grows by GPS_AGE_ERROR_MPS (we don't know what the plane did since).
+*/
+
+#define GPS_UERE_M 3.0  //1 sigma user range error (m) for an autonomous fix. Multiplied by HDOP
+#define GPS_UERE_DGPS_M 1.5  //With DGPS/WAAS corrections (fix quality 2)
+#define GPS_MIN_GOOD_SATS 6  //Fewer than this inflates the error...
+#define GPS_FEW_SATS_FACTOR 0.25  //...by this much per missing satellite
+#define GPS_2D_FIX_FACTOR 2.0
+#define GPS_MAX_PDOP 10.0  //A 3D fix with a PDOP above this is treated like a 2D one
+#define GPS_JUMP_SMOOTHING 0.2  //Weight of the newest fix to fix disagreement
+#define GPS_JUMP_MAX_GAP_S 2.0  //Fixes further apart than this aren't compared
+#define GPS_AGE_ERROR_MPS 10.0  //Growth of the expected error as the fix ages
+#define GPS_MAX_ERROR_M 9.0  //Fixes worse than this can't be dropped on (same as the old HDOP limit of 3)
+#define GPS_NO_FIX_ERROR_M 999.0  //Reported with no fix
+#define GPS_SCORE_REF_ERROR_M 3.0  //Score is 0.5 at this expected error
+#define GPS_STALE_MS 1000  //A fix this old scores zero
+
+#define M_PER_DEGREE_E7 0.0111320  //Metres per 1e-7 degree of latitude
+
+class GpsQuality {
+
+  public:
+    GpsQuality();
+
+    void reset();
+    // Once per fix (GGA). Signed positions in 1e-7 degrees, and the ground velocity from the latest RMC.
+    // fixMode is from GSA: 0 if unknown, 1 no fix, 2 2D, 3 3D. pdop 0 if unknown
+    void update(uint8_t fixQuality, uint8_t satellites, float hdop, uint8_t fixMode, float pdop, int32_t latitudeE7, int32_t longitudeE7,
+                float speedMPS, float courseDeg, uint64_t timestamp);
+
+    boolean isOk() { return valid && expectedError <= GPS_MAX_ERROR_M; }  //Good enough to drop on
+    float getExpectedErrorM() { return expectedError; }  //1 sigma, when the fix was taken
+    float getExpectedErrorM(uint64_t now);  //Including the age of the fix
+    float getScore(uint64_t now);  //0 = no usable fix
+    float getJumpRMSM() { return fastSqrt(jumpVar); }  //Smoothed fix to fix disagreement
+
+  private:
+    boolean valid;
+    float expectedError;
+    float jumpVar;  //m^2
+    uint64_t timestamp;
+
+    boolean havePrevious;
+    int32_t prevLatitudeE7, prevLongitudeE7;
+    float prevVelEast, prevVelNorth;
+};
+
+#endif //_GPS_QUALITY_H
@@ -0,0 +1,89 @@
+#include "MPU6050.h"
+#include "Arduino.h"
+
+MPU6050::MPU6050() {}
+
+boolean MPU6050::begin(boolean calibrate) {
+
+  DueWire.begin();
+
+  if (read8(MPU6050_WHO_AM_I) != MPU6050_ADDRESS)
+    return false;
+
+  write8(MPU6050_PWR_MGMT_1, 0x01);  //Wake up, clock from the X gyro PLL (more stable than the internal oscillator)
+  delay(10);
+  write8(MPU6050_SMPLRT_DIV, 1000 / IMU_SAMPLE_RATE_HZ - 1);
+  write8(MPU6050_CONFIG, IMU_DLPF_CFG);
+  write8(MPU6050_GYRO_CONFIG, IMU_GYRO_FS_SEL << 3);
+  write8(MPU6050_ACCEL_CONFIG, IMU_ACCEL_FS_SEL << 3);
+  write8(MPU6050_INT_PIN_CFG, 0x10);  //Active high push-pull pulse, cleared by any read
+  write8(MPU6050_INT_ENABLE, 0x01);  //Data ready
+
+  if (calibrate) {
+    int32_t sum[3] = {0, 0, 0};
+    int16_t a[3], g[3];
+    for (int i = 0; i < IMU_GYRO_CAL_SAMPLES; i++) {
+      delay(1000 / IMU_SAMPLE_RATE_HZ);
+      readRaw(a, g);
+      for (int j = 0; j < 3; j++) {
+        sum[j] += g[j];
+      }
+    }
+    for (int j = 0; j < 3; j++) {
+      gyroBias[j] = sum[j] / IMU_GYRO_CAL_SAMPLES;
+    }
+  }
+
+  return true;
+}
+
+void MPU6050::dataReadyISR() {
+  readyTimestamp = systemMicros();
+  dataReady = true;
+}
+
+boolean MPU6050::read() {
+
+  noInterrupts();
+  sampleTimestamp = readyTimestamp;
+  dataReady = false;
+  interrupts();
+
+  if (!readRaw(accel, gyro))
+    return false;
+
+  for (int j = 0; j < 3; j++) {
+    gyro[j] -= gyroBias[j];
+  }
+  return true;
+}
+
+// ACCEL_XOUT_H to GYRO_ZOUT_L in one transfer (temperature is in the middle), big endian
+boolean MPU6050::readRaw(int16_t a[3], int16_t g[3]) {
+
+  if (DueWire.requestFrom((uint8_t)MPU6050_ADDRESS, (uint8_t)14, (uint32_t)MPU6050_ACCEL_XOUT_H, (uint8_t)1) != 14)
+    return false;
+
+  uint8_t buf[14];
+  for (int i = 0; i < 14; i++) {
+    buf[i] = DueWire.read();
+  }
+
+  for (int j = 0; j < 3; j++) {
+    a[j] = (int16_t)((buf[2 * j] << 8) | buf[2 * j + 1]);
+    g[j] = (int16_t)((buf[8 + 2 * j] << 8) | buf[8 + 2 * j + 1]);
+  }
+  return true;
+}
+
+uint8_t MPU6050::read8(uint8_t reg) {
+  DueWire.requestFrom((uint8_t)MPU6050_ADDRESS, (uint8_t)1, (uint32_t)reg, (uint8_t)1);
+  return DueWire.read();
+}
+
+void MPU6050::write8(uint8_t reg, uint8_t value) {
+  DueWire.beginTransmission(MPU6050_ADDRESS);
+  DueWire.write(reg);
+  DueWire.write(value);
+  DueWire.endTransmission();
+}
@@ -0,0 +1,69 @@
+#ifndef _MPU6050_H
+#define _MPU6050_H
+
+#include "Arduino.h"
+#include "DueWire.h"
+#include "SystemClock.h"
+
+/*
+  Driver for the MPU-6050 accelerometer/gyro on the DueWire bus.
+
+  The sensor samples at IMU_SAMPLE_RATE_HZ and pulses its INT pin when a sample is ready. The ISR only sets a flag and timestamps the
+  sample - the bus can't be used from an ISR since the altimeter transfers are done from the main loop. The main loop polls
+  isDataReady() and calls read(). Samples missed while the loop is blocked (eg. the altimeter read) are fine, since the timestamps
+  give the real interval.
+
+  Axes are the sensor's own: x forward, y left, z up (mount it that way).
+*/
+
+#define IMU_INT_PIN 26
+#define MPU6050_ADDRESS 0x68
+
+#define MPU6050_SMPLRT_DIV 0x19
+#define MPU6050_CONFIG 0x1A
+#define MPU6050_GYRO_CONFIG 0x1B
+#define MPU6050_ACCEL_CONFIG 0x1C
+#define MPU6050_INT_PIN_CFG 0x37
+#define MPU6050_INT_ENABLE 0x38
+#define MPU6050_ACCEL_XOUT_H 0x3B
+#define MPU6050_PWR_MGMT_1 0x6B
+#define MPU6050_WHO_AM_I 0x75
+
+#define IMU_SAMPLE_RATE_HZ 200  //1kHz internal rate (with the DLPF on) / (1 + SMPLRT_DIV)
+#define IMU_DLPF_CFG 3  //44Hz accel/42Hz gyro bandwidth
+#define IMU_GYRO_FS_SEL 1  //+-500 deg/s -> 65.5 LSB/(deg/s)
+#define IMU_ACCEL_FS_SEL 1  //+-4g -> 8192 LSB/g
+#define IMU_ACCEL_LSB_PER_G 8192
+#define IMU_GYRO_CAL_SAMPLES 100  //Averaged for the gyro bias on a cold start (must be still)
+
+// Raw gyro -> rad/s in Q16: (pi / 180 / 65.5) * 65536 = 17.462 = 71525 / 4096
+#define IMU_GYRO_TO_RAD_Q16(raw) (((int32_t)(raw) * 71525) >> 12)
+// Raw accel -> g in Q16: 65536 / 8192 = 8
+#define IMU_ACCEL_TO_G_Q16(raw) ((int32_t)(raw) << 3)
+
+class MPU6050 {
+
+  public:
+    MPU6050();
+
+    boolean begin(boolean calibrate);  //calibrate = false on a warm restart (the attitude filter's integral term takes over)
+    void dataReadyISR();  //Call from the INT pin ISR
+
+    boolean isDataReady() { return dataReady; }
+    boolean read();  //Burst read of the latest sample. Clears the data ready flag
+
+    // Latest sample, gyro bias removed
+    int16_t accel[3], gyro[3];
+    uint64_t sampleTimestamp;
+
+  private:
+    volatile boolean dataReady = false;
+    volatile uint64_t readyTimestamp = 0;
+    int16_t gyroBias[3] = {0, 0, 0};
+
+    boolean readRaw(int16_t a[3], int16_t g[3]);
+    uint8_t read8(uint8_t reg);
+    void write8(uint8_t reg, uint8_t value);
+};
+
+#endif //_MPU6050_H
@@ -0,0 +1,133 @@
+#include "MS4525DO.h"
+#include "Arduino.h"
+#include "FastMath.h"
+
+MS4525DO::MS4525DO() {}
+
+boolean MS4525DO::begin(boolean zeroOffset) {
+
+  DueWire.begin();
+
+  offsetPa = 0;
+  haveOffset = false;
+  zeroSum = 0;
+  zeroSamplesLeft = zeroOffset ? AIRSPEED_ZERO_SAMPLES : 0;
+  haveReading = false;
+
+  // Check it's there by doing one full (blocking, this once) measurement
+  startConversion();
+  delayMicroseconds(MS4525DO_CONVERSION_US);
+  uint8_t data[4];
+  boolean found = readRaw(data);
+
+  startConversion();
+  return found;
+}
+
+void MS4525DO::setOffset(float pa) {
+  offsetPa = pa;
+  haveOffset = true;
+  zeroSamplesLeft = 0;
+}
+
+void MS4525DO::update() {
+
+  if (!conversionPending) {
+    startConversion();
+    return;
+  }
+
+  if (microsSince(conversionStart) < MS4525DO_CONVERSION_US)
+    return;
+
+  uint8_t data[4];
+  if (readRaw(data)) {
+    decode(data);
+  }
+  startConversion();
+}
+
+void MS4525DO::startConversion() {
+
+#ifndef Airspeed_Test
+  // A write to the address is the measurement request. DueWire always sends at least one data byte, which the sensor ignores
+  DueWire.beginTransmission(MS4525DO_ADDRESS);
+  DueWire.write((uint8_t)0);
+  DueWire.endTransmission();
+#endif
+
+  conversionPending = true;
+  conversionStart = systemMicros();
+}
+
+boolean MS4525DO::readRaw(uint8_t data[4]) {
+
+  conversionPending = false;
+
+#ifdef Airspeed_Test
+  float psi = 0.5 * SEA_LEVEL_DENSITY * sq(AIRSPEED_TEST_MPS) / PSI_TO_PA;
+  uint16_t pressureCounts = (psi - MS4525DO_P_MIN_PSI) * 0.8 * MS4525DO_COUNTS / (MS4525DO_P_MAX_PSI - MS4525DO_P_MIN_PSI) + 0.1 * MS4525DO_COUNTS;
+  uint16_t temperatureCounts = (20.0 + 50) * 2047 / 200;
+  data[0] = (MS4525DO_STATUS_NORMAL << 6) | (pressureCounts >> 8);
+  data[1] = pressureCounts & 0xFF;
+  data[2] = temperatureCounts >> 3;
+  data[3] = (temperatureCounts & 0x07) << 5;
+  return true;
+#else
+  if (DueWire.requestFrom((uint8_t)MS4525DO_ADDRESS, (uint8_t)4) != 4)
+    return false;
+
+  for (int i = 0; i < 4; i++) {
+    data[i] = DueWire.read();
+  }
+  return true;
+#endif
+}
+
+void MS4525DO::decode(const uint8_t data[4]) {
+
+  uint8_t status = data[0] >> 6;
+  if (status != MS4525DO_STATUS_NORMAL)  //Stale = we read too soon, fault = sensor problem. Either way nothing new
+    return;
+
+  uint16_t pressureCounts = ((data[0] & 0x3F) << 8) | data[1];
+  uint16_t temperatureCounts = (data[2] << 3) | (data[3] >> 5);
+
+  float psi = (pressureCounts - 0.1 * MS4525DO_COUNTS) * (MS4525DO_P_MAX_PSI - MS4525DO_P_MIN_PSI) / (0.8 * MS4525DO_COUNTS) + MS4525DO_P_MIN_PSI;
+  float pa = psi * PSI_TO_PA;
+  temperatureC = temperatureCounts * 200.0 / 2047 - 50;
+
+  if (zeroSamplesLeft > 0) {
+    zeroSum += pa;
+    if (--zeroSamplesLeft == 0) {
+      offsetPa = zeroSum / AIRSPEED_ZERO_SAMPLES;
+      haveOffset = true;
+    }
+    return;
+  }
+  if (!haveOffset)
+    return;
+
+  pa -= offsetPa;
+  differentialPressurePa = haveReading ? differentialPressurePa + AIRSPEED_SMOOTHING * (pa - differentialPressurePa) : pa;
+  haveReading = true;
+  lastGoodReading = systemMicros();
+}
+
+boolean MS4525DO::isValid() {
+  return haveReading && millisSince(lastGoodReading) < AIRSPEED_TIMEOUT_MS;
+}
+
+float MS4525DO::getIndicatedAirspeed() {
+  return fastSqrt(2 * max(differentialPressurePa, 0.0f) / SEA_LEVEL_DENSITY);
+}
+
+// Density from the ideal gas law, dp = 1/2 rho v^2
+float MS4525DO::getTrueAirspeed(float staticPressurePa, float airTemperatureC) {
+
+  float density = staticPressurePa / (AIR_GAS_CONSTANT * (airTemperatureC + 273.15));
+  if (density <= 0)
+    return getIndicatedAirspeed();
+
+  return fastSqrt(2 * max(differentialPressurePa, 0.0f) / density);
+}
@@ -0,0 +1,81 @@
+#ifndef _MS4525DO_H
+#define _MS4525DO_H
+
+#include "Arduino.h"
+#include "DueWire.h"
+#include "SystemClock.h"
+#include "plane.h"
+
+/*
+  Driver for the MS4525DO differential pressure sensor (pitot-static airspeed), on the same DueWire bus as the altimeter.
+
+  The sensor converts on request: a write to its address starts a measurement, and a 4 byte read some time later returns it.
+  update() never waits for a conversion - each call collects the measurement started by the previous call (if it has had
+  time to finish) and starts the next one. Called from the medium loop that is one short transfer every 30ms.
+
+  With Airspeed_Test defined (plane.h) there is no bus traffic and the raw bytes are synthesized for a constant airspeed, so the
+  rest of the chain (decoding, zeroing, true airspeed, wind) can be run on the bench.
+
+  Defaults are for the MS4525DO-DS5AI001DP: +-1 psi, output type A (10% to 90% of counts).
+*/
+
+#define MS4525DO_ADDRESS 0x28
+#define MS4525DO_CONVERSION_US 10000  //Measurement request to data ready
+#define MS4525DO_P_MIN_PSI -1.0
+#define MS4525DO_P_MAX_PSI 1.0
+#define MS4525DO_COUNTS 16383.0  //14 bit pressure
+#define PSI_TO_PA 6894.757
+
+//Status bits (top two bits of the first byte)
+#define MS4525DO_STATUS_NORMAL 0
+#define MS4525DO_STATUS_STALE 2
+#define MS4525DO_STATUS_FAULT 3
+
+#define AIRSPEED_ZERO_SAMPLES 32  //Averaged on a cold start (on the ground, no wind over the pitot please) for the offset
+#define AIRSPEED_SMOOTHING 0.3  //Low pass on the differential pressure
+#define AIRSPEED_TIMEOUT_MS 500  //No good reading for this long -> not valid
+#define AIR_GAS_CONSTANT 287.05  //J/(kg K), dry air
+#define SEA_LEVEL_DENSITY 1.225  //kg/m^3
+
+#ifdef Airspeed_Test
+  #define AIRSPEED_TEST_MPS 15.0  //Indicated airspeed the simulated sensor reports
+#endif
+
+class MS4525DO {
+
+  public:
+    MS4525DO();
+
+    // zeroOffset = false on a warm restart (we're probably flying, so zeroing would be wrong): then there are no readings until the
+    // checkpointed offset is given with setOffset() - without a zero, tens of Pa of error would be several m/s of false airspeed
+    boolean begin(boolean zeroOffset);
+    void setOffset(float pa);
+    float getOffset() { return haveOffset ? offsetPa : NAN; }  //NAN until zeroed
+    void update();  //Non blocking, call periodically
+
+    boolean isValid();
+    float getDifferentialPressurePa() { return differentialPressurePa; }
+    float getTemperatureC() { return temperatureC; }  //Of the sensor die - the altimeter is a better air temperature
+    float getIndicatedAirspeed();
+    float getTrueAirspeed(float staticPressurePa, float airTemperatureC);  //From the altimeter's pressure and temperature
+
+  private:
+    boolean conversionPending = false;
+    uint64_t conversionStart = 0;
+    uint64_t lastGoodReading = 0;
+    boolean haveReading = false;
+
+    float offsetPa = 0;
+    boolean haveOffset = false;
+    int zeroSamplesLeft = 0;
+    float zeroSum = 0;
+
+    float differentialPressurePa = 0;
+    float temperatureC = 0;
+
+    void startConversion();
+    boolean readRaw(uint8_t data[4]);
+    void decode(const uint8_t data[4]);
+};
+
+#endif //_MS4525DO_H
@@ -0,0 +1,158 @@
+#include "Mavlink.h"
+#include "Arduino.h"
+#include "SystemClock.h"
+
+// Lengths and CRC_EXTRA from the common message definitions (v1 payload, no extension fields)
+static const MavlinkMessageInfo messageTable[] = {
+  {MAVLINK_MSG_ID_HEARTBEAT,           9,  50},
+  {MAVLINK_MSG_ID_SYS_STATUS,          31, 124},
+  {MAVLINK_MSG_ID_GLOBAL_POSITION_INT, 28, 104},
+  {MAVLINK_MSG_ID_VFR_HUD,             20, 20},
+  {MAVLINK_MSG_ID_COMMAND_LONG,        33, 152},
+  {MAVLINK_MSG_ID_COMMAND_ACK,         3,  143},
+};
+
+Mavlink::Mavlink() {
+}
+
+const MavlinkMessageInfo *Mavlink::findMessage(uint32_t msgId) {
+  for (unsigned int i = 0; i < sizeof(messageTable) / sizeof(messageTable[0]); i++) {
+    if (messageTable[i].id == msgId)
+      return &messageTable[i];
+  }
+  return NULL;
+}
+
+// CRC-16/MCRF4XX (what MAVLink calls X.25), initial value 0xFFFF
+void Mavlink::crcAccumulate(uint8_t c, uint16_t &crc) {
+  uint8_t tmp = c ^ (uint8_t)(crc & 0xFF);
+  tmp ^= (uint8_t)(tmp << 4);
+  crc = (crc >> 8) ^ ((uint16_t)tmp << 8) ^ ((uint16_t)tmp << 3) ^ (tmp >> 4);
+}
+
+int Mavlink::encode(uint8_t *frame, uint32_t msgId, const void *payload) {
+
+  const MavlinkMessageInfo *info = findMessage(msgId);
+  if (info == NULL)
+    return 0;
+
+  // v2 sends the payload without its trailing zeros (but at least one byte)
+  const uint8_t *bytes = (const uint8_t *)payload;
+  uint8_t len = info->length;
+  while (len > 1 && bytes[len - 1] == 0) len--;
+
+  frame[0] = MAVLINK_STX;
+  frame[1] = len;
+  frame[2] = 0;  //Incompat flags (not signed)
+  frame[3] = 0;  //Compat flags
+  frame[4] = txSeq++;
+  frame[5] = MAVLINK_SYSTEM_ID;
+  frame[6] = MAVLINK_COMPONENT_ID;
+  frame[7] = msgId & 0xFF;
+  frame[8] = (msgId >> 8) & 0xFF;
+  frame[9] = (msgId >> 16) & 0xFF;
+  memcpy(&frame[MAVLINK_HEADER_LEN], bytes, len);
+
+  uint16_t frameCrc = 0xFFFF;
+  for (int i = 1; i < MAVLINK_HEADER_LEN + len; i++) {
+    crcAccumulate(frame[i], frameCrc);
+  }
+  crcAccumulate(info->crcExtra, frameCrc);
+
+  frame[MAVLINK_HEADER_LEN + len] = frameCrc & 0xFF;
+  frame[MAVLINK_HEADER_LEN + len + 1] = frameCrc >> 8;
+  return MAVLINK_HEADER_LEN + len + MAVLINK_CRC_LEN;
+}
+
+void Mavlink::abort() {
+  abortedLen = rawLen;
+  state = STATE_IDLE;
+}
+
+boolean Mavlink::expire(uint64_t now) {
+  abortedLen = 0;
+  if (state == STATE_IDLE || microsBetween(lastByteTime, now) <= MAVLINK_BYTE_TIMEOUT_MS * MICROS_PER_MILLI)
+    return false;
+  abort();
+  return true;
+}
+
+boolean Mavlink::parse(uint8_t c, uint64_t now) {
+
+  expire(now);
+  lastByteTime = now;
+  if (state != STATE_IDLE && rawLen < sizeof(rxRaw))
+    rxRaw[rawLen++] = c;
+
+  switch (state) {
+
+    case STATE_IDLE:
+      if (c == MAVLINK_STX) {
+        headerInd = 0;
+        rawLen = 0;
+        state = STATE_HEADER;
+      }
+      return false;
+
+    case STATE_HEADER: {
+      header[headerInd++] = c;
+      // Longer than anything we could check: most likely not a frame at all
+      if (headerInd == 1 && c > MAVLINK_MAX_PAYLOAD_LEN) {
+        abort();
+        return false;
+      }
+      if (headerInd < MAVLINK_HEADER_LEN - 1)
+        return false;
+
+      payloadLen = header[0];
+      uint8_t incompatFlags = header[1];
+      rxSysId = header[4];
+      rxMsgId = header[6] | ((uint32_t)header[7] << 8) | ((uint32_t)header[8] << 16);
+      rxInfo = findMessage(rxMsgId);
+
+      // Can't check (or don't understand) this frame: skip the rest of it
+      if (rxInfo == NULL || incompatFlags != 0 || payloadLen > rxInfo->length) {
+        skipRemaining = payloadLen + MAVLINK_CRC_LEN + ((incompatFlags & MAVLINK_IFLAG_SIGNED) ? MAVLINK_SIGNATURE_LEN : 0);
+        state = STATE_SKIP;
+        return false;
+      }
+
+      crc = 0xFFFF;
+      for (int i = 0; i < MAVLINK_HEADER_LEN - 1; i++) {
+        crcAccumulate(header[i], crc);
+      }
+      memset(rxPayload, 0, sizeof(rxPayload));
+      payloadInd = 0;
+      crcInd = 0;
+      state = payloadLen > 0 ? STATE_PAYLOAD : STATE_CRC;
+      return false;
+    }
+
+    case STATE_PAYLOAD:
+      rxPayload[payloadInd++] = c;
+      crcAccumulate(c, crc);
+      if (payloadInd == payloadLen)
+        state = STATE_CRC;
+      return false;
+
+    case STATE_CRC:
+      rxCrc[crcInd++] = c;
+      if (crcInd < MAVLINK_CRC_LEN)
+        return false;
+
+      state = STATE_IDLE;
+      crcAccumulate(rxInfo->crcExtra, crc);
+      if (rxCrc[0] == (crc & 0xFF) && rxCrc[1] == (crc >> 8))
+        return true;
+      errorCount++;
+      return false;
+
+    case STATE_SKIP:
+      if (--skipRemaining == 0)
+        state = STATE_IDLE;
+      return false;
+  }
+
+  state = STATE_IDLE;
+  return false;
+}
@@ -0,0 +1,166 @@
+#ifndef _MAVLINK_H
+#define _MAVLINK_H
+
+#include "Arduino.h"
+
+/*
+  Minimal MAVLink v2 framing for the few messages we exchange with standard ground stations (QGroundControl, Mission Planner).
+
+  Frame: STX (0xFD), payload length, incompat flags, compat flags, sequence, system id, component id, message id (24 bit), payload,
+  X.25 CRC (over everything after STX plus the message's CRC_EXTRA byte). v2 drops trailing zero bytes of the payload on send and the
+  receiver zero fills them, so payload structs below are the full v1 layout (fields ordered by size, as on the wire) and
+  encode()/the parser take care of the truncation.
+
+  The message table (id, length, CRC_EXTRA) is static and only covers the messages below - frames of any other message can't be checked,
+  so they are skipped. Signed frames are skipped too. Nothing is allocated: encode() writes into a caller's buffer and the parser keeps
+  a single payload buffer.
+
+  On a link that also carries the legacy protocol a stray STX must not swallow what follows, so the parser gives a frame up - and
+  keeps its bytes for the caller to hand back - as soon as its length is more than any message in the table, or when the bytes stop
+  part way through it. Longer frames (which would be skipped anyway) are given up the same way, and the parser hunts for the next STX.
+*/
+
+#define MAVLINK_STX 0xFD
+#define MAVLINK_HEADER_LEN 10  //Including STX
+#define MAVLINK_CRC_LEN 2
+#define MAVLINK_SIGNATURE_LEN 13
+#define MAVLINK_IFLAG_SIGNED 0x01
+#define MAVLINK_MAX_PAYLOAD_LEN 33  //Largest in the table
+#define MAVLINK_MAX_FRAME_LEN (MAVLINK_HEADER_LEN + MAVLINK_MAX_PAYLOAD_LEN + MAVLINK_CRC_LEN)
+#define MAVLINK_BYTE_TIMEOUT_MS 20  //A frame arrives in one go (~4ms at 115200) - this also allows for a slow loop pass between reads
+
+#define MAVLINK_SYSTEM_ID 1
+#define MAVLINK_COMPONENT_ID 1  //MAV_COMP_ID_AUTOPILOT1
+
+//Message ids
+#define MAVLINK_MSG_ID_HEARTBEAT 0
+#define MAVLINK_MSG_ID_SYS_STATUS 1
+#define MAVLINK_MSG_ID_GLOBAL_POSITION_INT 33
+#define MAVLINK_MSG_ID_VFR_HUD 74
+#define MAVLINK_MSG_ID_COMMAND_LONG 76
+#define MAVLINK_MSG_ID_COMMAND_ACK 77
+
+//Enum values used
+#define MAV_TYPE_FIXED_WING 1
+#define MAV_AUTOPILOT_GENERIC 0
+#define MAV_MODE_FLAG_CUSTOM_MODE_ENABLED 1
+#define MAV_STATE_ACTIVE 4
+#define MAV_SYS_STATUS_SENSOR_3D_GYRO 0x01
+#define MAV_SYS_STATUS_SENSOR_3D_ACCEL 0x02
+#define MAV_SYS_STATUS_SENSOR_ABSOLUTE_PRESSURE 0x08
+#define MAV_SYS_STATUS_SENSOR_DIFFERENTIAL_PRESSURE 0x10
+#define MAV_SYS_STATUS_SENSOR_GPS 0x20
+#define MAV_CMD_DO_MOUNT_CONTROL 205
+#define MAV_CMD_DO_GRIPPER 211
+#define MAV_MOUNT_MODE_NEUTRAL 1
+#define GRIPPER_ACTION_RELEASE 0
+#define GRIPPER_ACTION_GRAB 1
+#define MAV_RESULT_ACCEPTED 0
+#define MAV_RESULT_DENIED 2
+#define MAV_RESULT_UNSUPPORTED 3
+#define MAV_RESULT_FAILED 4
+
+struct __attribute__((packed)) MavlinkHeartbeat {
+  uint32_t customMode;
+  uint8_t type;
+  uint8_t autopilot;
+  uint8_t baseMode;
+  uint8_t systemStatus;
+  uint8_t mavlinkVersion;
+};
+
+struct __attribute__((packed)) MavlinkSysStatus {
+  uint32_t sensorsPresent, sensorsEnabled, sensorsHealth;
+  uint16_t load;  //0.1%
+  uint16_t voltageBattery;  //mV
+  int16_t currentBattery;  //cA, -1 = not measured
+  uint16_t dropRateComm, errorsComm;
+  uint16_t errorsCount[4];
+  int8_t batteryRemaining;  //%, -1 = not measured
+};
+
+struct __attribute__((packed)) MavlinkGlobalPositionInt {
+  uint32_t timeBootMs;
+  int32_t lat, lon;  //1e-7 degrees
+  int32_t alt;  //mm MSL
+  int32_t relativeAlt;  //mm above home (our altimeter zero)
+  int16_t vx, vy, vz;  //cm/s north, east, down
+  uint16_t hdg;  //cdeg, UINT16_MAX if unknown
+};
+
+struct __attribute__((packed)) MavlinkVfrHud {
+  float airspeed, groundspeed;  //m/s
+  float alt;  //m MSL
+  float climb;  //m/s
+  int16_t heading;  //degrees
+  uint16_t throttle;  //%
+};
+
+struct __attribute__((packed)) MavlinkCommandLong {
+  float param[7];
+  uint16_t command;
+  uint8_t targetSystem, targetComponent;
+  uint8_t confirmation;
+};
+
+struct __attribute__((packed)) MavlinkCommandAck {
+  uint16_t command;
+  uint8_t result;
+};
+
+struct MavlinkMessageInfo {
+  uint32_t id;
+  uint8_t length;
+  uint8_t crcExtra;
+};
+
+class Mavlink {
+
+  public:
+    Mavlink();
+
+    // Builds a frame for a message in the table into frame (MAVLINK_MAX_FRAME_LEN bytes). Returns its length, 0 if the id is unknown
+    int encode(uint8_t *frame, uint32_t msgId, const void *payload);
+
+    // Feed received bytes one at a time, with the time they were read. True when a whole frame of a known message has arrived with a
+    // good CRC, which can then be read with the getters until the next byte is fed
+    boolean parse(uint8_t c, uint64_t now);
+    // Gives up a frame that has had no bytes for MAVLINK_BYTE_TIMEOUT_MS (parse() does this too, before taking its byte). True if it did
+    boolean expire(uint64_t now);
+    boolean isIdle() { return state == STATE_IDLE; }  //Not part way through a frame
+    // The bytes after STX of a frame the last parse()/expire() gave up on (0 if it didn't), which may not have been MAVLink at all
+    const uint8_t *getAborted() { return rxRaw; }
+    uint8_t getAbortedLength() { return abortedLen; }
+    uint32_t getMessageId() { return rxMsgId; }
+    uint8_t getSystemId() { return rxSysId; }
+    const void *getPayload() { return rxPayload; }  //Zero filled to the message's full length
+    uint16_t getErrorCount() { return errorCount; }  //Frames with a bad CRC
+
+    static const MavlinkMessageInfo *findMessage(uint32_t msgId);
+
+  private:
+    enum { STATE_IDLE, STATE_HEADER, STATE_PAYLOAD, STATE_CRC, STATE_SKIP };
+
+    uint8_t txSeq = 0;
+
+    uint8_t state = STATE_IDLE;
+    uint64_t lastByteTime = 0;
+    uint8_t rxRaw[MAVLINK_HEADER_LEN - 1 + MAVLINK_MAX_PAYLOAD_LEN + MAVLINK_CRC_LEN + MAVLINK_SIGNATURE_LEN];  //Everything after STX
+    uint8_t rawLen, abortedLen = 0;
+    uint8_t header[MAVLINK_HEADER_LEN - 1];  //After STX
+    uint8_t headerInd;
+    uint8_t payloadLen, payloadInd;
+    uint16_t skipRemaining;
+    uint8_t rxCrc[MAVLINK_CRC_LEN], crcInd;
+    uint16_t crc;
+    const MavlinkMessageInfo *rxInfo;
+    uint32_t rxMsgId;
+    uint8_t rxSysId;
+    uint8_t rxPayload[MAVLINK_MAX_PAYLOAD_LEN];
+    uint16_t errorCount = 0;
+
+    void abort();
+    static void crcAccumulate(uint8_t c, uint16_t &crc);
+};
+
+#endif //_MAVLINK_H
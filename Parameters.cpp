@@ -0,0 +1,169 @@
+#include "Parameters.h"
+#include "Arduino.h"
+#include "plane.h"
+#include <stddef.h>
+
+Parameters params;
+ParameterTable paramTable;
+
+// Defaults are the compile time constants these used to be
+static const ParamDescriptor descriptors[] = {
+  {"CORR_FACTOR",     PARAM_FLOAT, offsetof(Parameters, correctionFactor),       0.9,      0.5,  1.0,    false},
+  {"SERVO_DELAY_MS",  PARAM_FLOAT, offsetof(Parameters, servoOpenDelayMs),       250,      0,    1000,   false},
+  {"TARGET_RADIUS_M", PARAM_FLOAT, offsetof(Parameters, targetRadiusM),          20,       1,    100,    false},
+  {"HIT_PROB_MIN",    PARAM_FLOAT, offsetof(Parameters, hitProbabilityMin),      0.5,      0,    1,      false},
+  {"FALL_ERR_FRAC",   PARAM_FLOAT, offsetof(Parameters, fallModelErrorFraction), 0.1,      0,    1,      false},
+  {"MAX_BANK_DEG",    PARAM_FLOAT, offsetof(Parameters, maxDropBankDeg),         20,       0,    90,     false},
+  {"TRAIN_SPACING_M", PARAM_FLOAT, offsetof(Parameters, dropTrainSpacingM),      0,        0,    200,    false},
+  {"ALT_KF_Q",        PARAM_FLOAT, offsetof(Parameters, altitudeFilterQ),        0.000001, 1e-9, 1,      false},
+  {"ALT_KF_R",        PARAM_FLOAT, offsetof(Parameters, altitudeFilterR),        0.0001,   1e-6, 1,      false},
+  {"BAY_CLOSE_MS",    PARAM_INT,   offsetof(Parameters, closeDropBayTimeoutMs),  10000,    0,    600000, false},
+  {"ALT_QNH_HPA",     PARAM_FLOAT, offsetof(Parameters, altimeterQnhHpa),        0,        850,  1090,   true},
+  {"FIELD_ELEV_M",    PARAM_FLOAT, offsetof(Parameters, fieldElevationM),        0,        -500, 5000,   false},
+};
+
+#define NUM_PARAMS (int)(sizeof(descriptors) / sizeof(descriptors[0]))
+
+struct ParamFlashPage {
+  uint32_t magic;
+  uint32_t versionHash;
+  uint32_t checksum;
+  Parameters values;
+};
+
+ParameterTable::ParameterTable() {
+  versionHash = computeVersionHash();
+  setDefaults();
+}
+
+void ParameterTable::setDefaults() {
+  for (int i = 0; i < NUM_PARAMS; i++) {
+    set(i, descriptors[i].defaultValue);
+  }
+}
+
+int ParameterTable::getCount() {
+  return NUM_PARAMS;
+}
+
+const ParamDescriptor &ParameterTable::getDescriptor(int index) {
+  return descriptors[index];
+}
+
+float ParameterTable::get(int index) {
+
+  const ParamDescriptor &d = descriptors[index];
+  uint8_t *field = (uint8_t *)&params + d.offset;
+
+  if (d.type == PARAM_INT)
+    return *(int32_t *)field;
+  return *(float *)field;
+}
+
+boolean ParameterTable::set(int index, float value) {
+
+  const ParamDescriptor &d = descriptors[index];
+  uint8_t *field = (uint8_t *)&params + d.offset;
+
+  if (!(value >= d.minValue && value <= d.maxValue) && !(d.zeroIsOff && value == 0))  //Also rejects NaN
+    return false;
+
+  if (d.type == PARAM_INT) {
+    *(int32_t *)field = lround(value);
+  }
+  else {
+    *(float *)field = value;
+  }
+  return true;
+}
+
+boolean ParameterTable::load() {
+
+  setDefaults();
+
+  const ParamFlashPage *page = (const ParamFlashPage *)PARAM_FLASH_ADDRESS;
+  if (page->magic != PARAM_FLASH_MAGIC || page->versionHash != versionHash || page->checksum != checksum(page->values)) {
+    DEBUG_PRINTLN("No saved parameters, using defaults");
+    return false;
+  }
+
+  // Through set() so each value is range checked against this build's table
+  Parameters saved = page->values;
+  for (int i = 0; i < NUM_PARAMS; i++) {
+    const ParamDescriptor &d = descriptors[i];
+    uint8_t *field = (uint8_t *)&saved + d.offset;
+    set(i, d.type == PARAM_INT ? *(int32_t *)field : *(float *)field);
+  }
+
+  DEBUG_PRINTLN("Loaded saved parameters");
+  return true;
+}
+
+// The page is filled through its own address (that goes into the latch buffer), then erased and written by one EFC command
+boolean ParameterTable::save() {
+
+  uint32_t words[IFLASH1_PAGE_SIZE / 4];
+  memset(words, 0xFF, sizeof(words));
+
+  ParamFlashPage page;
+  page.magic = PARAM_FLASH_MAGIC;
+  page.versionHash = versionHash;
+  page.values = params;
+  page.checksum = checksum(params);
+  memcpy(words, &page, sizeof(page));
+
+  volatile uint32_t *latch = (volatile uint32_t *)PARAM_FLASH_ADDRESS;
+  for (unsigned int i = 0; i < IFLASH1_PAGE_SIZE / 4; i++) {
+    latch[i] = words[i];
+  }
+
+  EFC1->EEFC_FCR = EEFC_FCR_FKEY(0x5A) | EEFC_FCR_FARG(PARAM_FLASH_PAGE) | EEFC_FCR_FCMD(EFC_FCMD_EWP);
+  uint32_t status;
+  while (!((status = EFC1->EEFC_FSR) & EEFC_FSR_FRDY));
+
+  if (status & (EEFC_FSR_FCMDE | EEFC_FSR_FLOCKE))
+    return false;
+
+  return memcmp((const void *)PARAM_FLASH_ADDRESS, &page, sizeof(page)) == 0;
+}
+
+// FNV-1a over what the saved bytes mean: each name, type and offset, and the struct size
+uint32_t ParameterTable::computeVersionHash() {
+
+  uint32_t hash = 2166136261UL;
+  uint16_t size = sizeof(Parameters);
+
+  for (int i = 0; i <= NUM_PARAMS; i++) {
+    const uint8_t *bytes;
+    uint8_t fields[3];
+    if (i < NUM_PARAMS) {
+      for (const char *c = descriptors[i].name; *c; c++) {
+        hash = (hash ^ (uint8_t)*c) * 16777619UL;
+      }
+      fields[0] = descriptors[i].type;
+      fields[1] = descriptors[i].offset & 0xFF;
+      fields[2] = descriptors[i].offset >> 8;
+    }
+    else {
+      fields[0] = 0;
+      fields[1] = size & 0xFF;
+      fields[2] = size >> 8;
+    }
+    bytes = fields;
+    for (int j = 0; j < 3; j++) {
+      hash = (hash ^ bytes[j]) * 16777619UL;
+    }
+  }
+
+  return hash;
+}
+
+uint32_t ParameterTable::checksum(const Parameters &values) {
+
+  uint32_t hash = 2166136261UL;
+  const uint8_t *bytes = (const uint8_t *)&values;
+  for (unsigned int i = 0; i < sizeof(Parameters); i++) {
+    hash = (hash ^ bytes[i]) * 16777619UL;
+  }
+  return hash;
+}
@@ -0,0 +1,76 @@
+#ifndef _PARAMETERS_H
+#define _PARAMETERS_H
+
+#include "Arduino.h"
+
+/*
+  Tunable parameters.
+
+  The values live in one plain struct (params) that the targeting and filter code read directly - a field access, the same cost as
+  the constants they replace. The descriptor table in Parameters.cpp gives each field a name, type, default and allowed range, and is
+  what the uplink commands (get/set/list by index, see Communicator.h) and the flash copy go through.
+
+  Saved values are kept in the last page of the second flash bank (the sketch runs from the first, so it can be written while
+  running). The page carries a hash of the table layout (names, types and offsets): values saved by a build with a different table
+  are ignored rather than loaded into the wrong fields. Uploading a sketch normally erases the whole flash, saved values included.
+*/
+
+#define PARAM_FLOAT 0
+#define PARAM_INT 1
+#define PARAM_NAME_LENGTH 16  //Including the terminating 0
+
+#define PARAM_FLASH_MAGIC 0x50524D31  //"PRM1"
+#define PARAM_FLASH_PAGE (IFLASH1_SIZE / IFLASH1_PAGE_SIZE - 1)
+#define PARAM_FLASH_ADDRESS (IFLASH1_ADDR + PARAM_FLASH_PAGE * IFLASH1_PAGE_SIZE)
+#define EFC_FCMD_EWP 0x03  //Erase page and write page
+
+struct Parameters {
+  float correctionFactor;  //Fall time correction for air resistance
+  float servoOpenDelayMs;
+  float targetRadiusM;
+  float hitProbabilityMin;  //Don't drop unless at least this likely to land in the target radius
+  float fallModelErrorFraction;  //1 sigma error of the fall model, as a fraction of the distance travelled during the fall
+  float maxDropBankDeg;
+  float dropTrainSpacingM;  //Payloads without their own target are spread along track this far apart. 0 = all aimed at the target
+  float altitudeFilterQ;  //Altitude Kalman filter (Filter.ino) process noise...
+  float altitudeFilterR;  //...and measurement noise. Both > 0: with either at 0 the gain can be 0/0, and Q = 0 stops the filter following
+  int32_t closeDropBayTimeoutMs;
+  float altimeterQnhHpa;  //Zero the altimeter from the field's QNH instead of calibrating on the ground. 0 = calibrate (at the next reset)
+  float fieldElevationM;  //With the QNH - the altitude is above this
+};
+
+struct ParamDescriptor {
+  const char *name;
+  uint8_t type;
+  uint16_t offset;  //Of the field in Parameters
+  float defaultValue, minValue, maxValue;
+  boolean zeroIsOff;  //0 is accepted too, outside the range, meaning the feature is off
+};
+
+extern Parameters params;
+
+class ParameterTable {
+
+  public:
+    ParameterTable();
+
+    void setDefaults();
+    boolean load();  //From flash. False (and defaults) if nothing valid was saved by this table layout
+    boolean save();  //Blocks for the page write (a few ms)
+
+    int getCount();
+    const ParamDescriptor &getDescriptor(int index);
+    float get(int index);
+    boolean set(int index, float value);  //False (and unchanged) if out of range
+    uint32_t getVersionHash() { return versionHash; }
+
+  private:
+    uint32_t versionHash;
+
+    uint32_t computeVersionHash();
+    uint32_t checksum(const Parameters &values);
+};
+
+extern ParameterTable paramTable;
+
+#endif //_PARAMETERS_H
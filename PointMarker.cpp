@@ -0,0 +1,175 @@
+#include "PointMarker.h"
+#include "GpsQuality.h"
+
+PointMarker::PointMarker() {
+  nextId = 1;
+  reset();
+}
+
+// Ids carry on, so a mark from before the reset can't be confused with a new one
+void PointMarker::reset() {
+  historyCount = 0;
+  dropped = 0;
+  for (int i = 0; i < POINT_STORE_SIZE; i++) {
+    store[i].state = POINT_FREE;
+  }
+}
+
+void PointMarker::addFix(uint64_t time, uint32_t epochMs, int32_t latitudeE7, int32_t longitudeE7, float altitudeFt, float gpsAltitudeM,
+                         float speedMPS, float courseDeg) {
+
+  // Second sentence of the same epoch: the GPS object now holds both, so it replaces the first
+  if (historyCount == 0 || history[historyCount - 1].epochMs != epochMs) {
+    if (historyCount == POINT_HISTORY) {
+      memmove(&history[0], &history[1], (POINT_HISTORY - 1) * sizeof(PointFix));
+      historyCount--;
+    }
+    historyCount++;
+  }
+
+  PointFix &f = history[historyCount - 1];
+  f.time = time;
+  f.epochMs = epochMs;
+  f.latitudeE7 = latitudeE7;
+  f.longitudeE7 = longitudeE7;
+  f.altitudeFt = altitudeFt;
+  f.gpsAltitudeM = gpsAltitudeM;
+  float sinCourse, cosCourse;
+  fastSinCos(courseDeg / 180 * (float)PI, sinCourse, cosCourse);
+  f.velEast = speedMPS * sinCourse;
+  f.velNorth = speedMPS * cosCourse;
+}
+
+uint16_t PointMarker::mark(uint64_t time, uint8_t flags) {
+
+  // A free slot, or else the oldest mark gives way
+  int slot = 0;
+  for (int i = 0; i < POINT_STORE_SIZE; i++) {
+    if (store[i].state == POINT_FREE) {
+      slot = i;
+      break;
+    }
+    if (store[i].time < store[slot].time) slot = i;
+  }
+  if (store[slot].state != POINT_FREE) dropped++;
+
+  PointMark &m = store[slot];
+  m.state = POINT_PENDING;
+  m.flags = flags;
+  m.id = nextId++;
+  if (nextId == 0) nextId = 1;
+  m.time = time;
+  m.lastSent = 0;
+  return m.id;
+}
+
+void PointMarker::update(uint64_t now) {
+  for (int i = 0; i < POINT_STORE_SIZE; i++) {
+    if (store[i].state == POINT_PENDING && resolve(store[i], now)) {
+      store[i].state = POINT_UNACKED;
+    }
+  }
+}
+
+boolean PointMarker::resolve(PointMark &m, uint64_t now) {
+
+  // First fix after the mark
+  int after = 0;
+  while (after < historyCount && history[after].time <= m.time) after++;
+
+  if (after < historyCount && after > 0) {
+    interpolate(m, history[after - 1], history[after]);
+    if (microsBetween(history[after - 1].time, history[after].time) > POINT_MAX_GAP_MS * MICROS_PER_MILLI) {
+      m.flags |= POINT_FIX_GAP;
+    }
+    return true;
+  }
+  if (after == historyCount && microsBetween(m.time, now) < POINT_MAX_WAIT_MS * MICROS_PER_MILLI) {
+    return false;  //Give the next fix a chance
+  }
+
+  if (historyCount == 0) {
+    m.flags |= POINT_NO_FIX;
+    m.latitudeE7 = m.longitudeE7 = 0;
+    m.altitudeFt = m.gpsAltitudeM = m.courseDeg = m.speedMPS = 0;
+    return true;
+  }
+  // Older than the history (after = 0), or nothing since it (after = historyCount)
+  extrapolate(m, history[after == 0 ? 0 : historyCount - 1]);
+  m.flags |= POINT_EXTRAPOLATED;
+  return true;
+}
+
+// Cubic Hermite in metres from a. s is the fraction of the way from a to b, h the time between them
+void PointMarker::interpolate(PointMark &m, const PointFix &a, const PointFix &b) {
+
+  float h = microsBetween(a.time, b.time) / (float)MICROS_PER_SECOND;
+  float s = microsBetween(a.time, m.time) / (float)MICROS_PER_SECOND / h;
+  float s2 = s * s, s3 = s2 * s;
+  float h01 = -2 * s3 + 3 * s2, h10 = (s3 - 2 * s2 + s) * h, h11 = (s3 - s2) * h;
+  float d01 = (-6 * s2 + 6 * s) / h, d10 = 3 * s2 - 4 * s + 1, d11 = 3 * s2 - 2 * s;  //Derivatives, per second
+
+  float metresPerE7East = M_PER_DEGREE_E7 * fastCos((float)(a.latitudeE7 * 1e-7 / 180 * PI));
+  float dEast = (b.longitudeE7 - a.longitudeE7) * metresPerE7East;
+  float dNorth = (b.latitudeE7 - a.latitudeE7) * M_PER_DEGREE_E7;
+
+  float east = h10 * a.velEast + h01 * dEast + h11 * b.velEast;
+  float north = h10 * a.velNorth + h01 * dNorth + h11 * b.velNorth;
+  float velEast = d10 * a.velEast + d01 * dEast + d11 * b.velEast;
+  float velNorth = d10 * a.velNorth + d01 * dNorth + d11 * b.velNorth;
+
+  m.latitudeE7 = a.latitudeE7 + (int32_t)lroundf(north / (float)M_PER_DEGREE_E7);
+  m.longitudeE7 = a.longitudeE7 + (int32_t)lroundf(east / metresPerE7East);
+  m.altitudeFt = a.altitudeFt + s * (b.altitudeFt - a.altitudeFt);
+  m.gpsAltitudeM = a.gpsAltitudeM + s * (b.gpsAltitudeM - a.gpsAltitudeM);
+  m.speedMPS = fastSqrt(sq(velEast) + sq(velNorth));
+  m.courseDeg = fastAtan2(velEast, velNorth) * (180 / (float)PI);
+  if (m.courseDeg < 0) m.courseDeg += 360;
+}
+
+// Straight on (or back) from f at its velocity
+void PointMarker::extrapolate(PointMark &m, const PointFix &f) {
+
+  float dt = m.time >= f.time ? microsBetween(f.time, m.time) / (float)MICROS_PER_SECOND
+                              : -(microsBetween(m.time, f.time) / (float)MICROS_PER_SECOND);
+  float metresPerE7East = M_PER_DEGREE_E7 * fastCos((float)(f.latitudeE7 * 1e-7 / 180 * PI));
+
+  m.latitudeE7 = f.latitudeE7 + (int32_t)lroundf(f.velNorth * dt / (float)M_PER_DEGREE_E7);
+  m.longitudeE7 = f.longitudeE7 + (int32_t)lroundf(f.velEast * dt / metresPerE7East);
+  m.altitudeFt = f.altitudeFt;
+  m.gpsAltitudeM = f.gpsAltitudeM;
+  m.speedMPS = fastSqrt(sq(f.velEast) + sq(f.velNorth));
+  m.courseDeg = fastAtan2(f.velEast, f.velNorth) * (180 / (float)PI);
+  if (m.courseDeg < 0) m.courseDeg += 360;
+}
+
+PointMark *PointMarker::nextToSend(uint64_t now) {
+
+  PointMark *next = NULL;
+  for (int i = 0; i < POINT_STORE_SIZE; i++) {
+    PointMark &m = store[i];
+    if (m.state != POINT_UNACKED) continue;
+    if (m.lastSent != 0 && microsBetween(m.lastSent, now) < POINT_RETRANSMIT_MS * MICROS_PER_MILLI) continue;
+    if (next == NULL || m.lastSent < next->lastSent) next = &m;
+  }
+  if (next != NULL) next->lastSent = now;
+  return next;
+}
+
+boolean PointMarker::acknowledge(uint16_t id) {
+  for (int i = 0; i < POINT_STORE_SIZE; i++) {
+    if (store[i].state == POINT_UNACKED && store[i].id == id) {
+      store[i].state = POINT_FREE;
+      return true;
+    }
+  }
+  return false;
+}
+
+int PointMarker::getWaiting() {
+  int n = 0;
+  for (int i = 0; i < POINT_STORE_SIZE; i++) {
+    if (store[i].state != POINT_FREE) n++;
+  }
+  return n;
+}
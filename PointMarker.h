@@ -0,0 +1,94 @@
+#ifndef _POINT_MARKER_H
+#define _POINT_MARKER_H
+
+#include "Arduino.h"
+#include "FastMath.h"
+#include "SystemClock.h"
+
+/*
+  Geotagged point marks (pushbutton or ground command), placed where the plane was at the moment of the mark rather than at the
+  last fix the loop happened to have.
+
+  The mark time is taken when the mark happens (in the pushbutton ISR). Recent fixes are kept with the local time each was valid,
+  and once the first fix after the mark is in, the position is interpolated between the two fixes either side of it. The
+  interpolation is a cubic Hermite on the position and the GPS velocity at both ends, so a mark taken mid turn between 5Hz fixes
+  is still on the flown path - at 20 m/s a plain "last fix" is up to 4 m behind, a straight line between the fixes cuts the corner.
+  Positions stay in 1e-7 degrees (floats alone are ~0.5 m at our latitude), only the offsets from the earlier fix are floats.
+
+  If no fix comes in for POINT_MAX_WAIT_MS after the mark (lost GPS), the mark is dead reckoned from the latest fix instead, and
+  flagged. Likewise a mark older than the whole history.
+
+  Resolved marks wait in a bounded store until the ground acknowledges their id, and are sent again every POINT_RETRANSMIT_MS
+  until then, so marks taken while the link is down come through once it is back. When the store is full the oldest mark is
+  dropped to make room (and counted). The same mark can arrive more than once (a lost ack) - the ground keys on the id.
+  Ids count up from 1 from boot.
+*/
+
+#define POINT_HISTORY 8  //Fixes kept (1.6s at 5Hz)
+#define POINT_STORE_SIZE 16  //Marks waiting for a fix or an ack
+#define POINT_MAX_WAIT_MS 1000  //For the fix after the mark, then it is extrapolated
+#define POINT_MAX_GAP_MS 1500  //Fixes either side of the mark further apart than this - still interpolated, but flagged
+#define POINT_RETRANSMIT_MS 1000
+#define POINT_DEBOUNCE_MS 1000  //Pushbutton presses closer together than this are bounce
+
+//Mark flags
+#define POINT_EXTRAPOLATED 0x01  //Dead reckoned from a single fix, not interpolated
+#define POINT_FIX_GAP 0x02  //Interpolated across a gap of more than POINT_MAX_GAP_MS
+#define POINT_NO_FIX 0x04  //No fix at all - position is 0
+#define POINT_CLOCK_UNLOCKED 0x08  //Fix times are parse times, not epochs (late by the sentence latency)
+#define POINT_FROM_GROUND 0x10  //Marked by the ground station command (timed when the command arrived)
+
+//Mark states
+#define POINT_FREE 0
+#define POINT_PENDING 1  //Waiting for the fix after it
+#define POINT_UNACKED 2
+
+struct PointFix {
+  uint64_t time;  //systemMicros() the fix was valid
+  uint32_t epochMs;  //UTC ms since midnight from the sentence. RMC and GGA of the same epoch update one entry
+  int32_t latitudeE7, longitudeE7;
+  float altitudeFt, gpsAltitudeM;
+  float velEast, velNorth;
+};
+
+struct PointMark {
+  uint8_t state;
+  uint8_t flags;
+  uint16_t id;
+  uint64_t time;  //systemMicros() of the mark
+  uint64_t lastSent;  //0 = not yet
+  int32_t latitudeE7, longitudeE7;
+  float altitudeFt, gpsAltitudeM;
+  float courseDeg, speedMPS;
+};
+
+class PointMarker {
+
+  public:
+    PointMarker();
+
+    void reset();
+    // Every fix. Signed positions in 1e-7 degrees
+    void addFix(uint64_t time, uint32_t epochMs, int32_t latitudeE7, int32_t longitudeE7, float altitudeFt, float gpsAltitudeM,
+                float speedMPS, float courseDeg);
+    uint16_t mark(uint64_t time, uint8_t flags);  //Returns the id
+    void update(uint64_t now);  //Resolves the pending marks that can be
+    PointMark *nextToSend(uint64_t now);  //Resolved, unacknowledged and due (the one sent longest ago), NULL if none. Marked as sent now
+    boolean acknowledge(uint16_t id);  //False if it isn't waiting for one (already acknowledged, or dropped)
+
+    int getWaiting();  //Pending or unacknowledged
+    uint32_t getDropped() { return dropped; }
+
+  private:
+    PointFix history[POINT_HISTORY];  //Oldest first
+    int historyCount;
+    PointMark store[POINT_STORE_SIZE];
+    uint16_t nextId;
+    uint32_t dropped;
+
+    boolean resolve(PointMark &m, uint64_t now);
+    void interpolate(PointMark &m, const PointFix &a, const PointFix &b);
+    void extrapolate(PointMark &m, const PointFix &f);
+};
+
+#endif //_POINT_MARKER_H
@@ -0,0 +1,151 @@
+#include "PositionFilter.h"
+#include "Arduino.h"
+
+PositionFilter::PositionFilter() {
+  reset();
+}
+
+void PositionFilter::reset() {
+  initialized = false;
+  consecutiveRejects = 0;
+  lastNIS = 0;
+}
+
+boolean PositionFilter::update(double easting, double northing, float velEast, float velNorth, float positionSigma, uint64_t _timestamp) {
+
+  float positionVar = sq(positionSigma);
+
+  // First fix, or we've been rejecting everything for a while (ie. the filter has diverged) - start over from this fix
+  if (!initialized || consecutiveRejects >= KF_MAX_REJECTS) {
+    initialize(easting, northing, velEast, velNorth, positionVar, _timestamp);
+    return true;
+  }
+
+  // Not after the last one: the same epoch again, or the clock discipline stepped back. Fusing it at dt = 0 would count it twice
+  if (_timestamp <= timestamp)
+    return false;
+
+  float dt = microsBetween(timestamp, _timestamp) / (float)MICROS_PER_SECOND;
+  predict(dt);
+  timestamp = _timestamp;
+
+  // Position first, gated. Velocity only if the position agreed - a multipath jump corrupts both
+  if (!measure(0, (float)(easting - originEasting), (float)(northing - originNorthing), positionVar, true)) {
+    consecutiveRejects++;
+    return false;
+  }
+  consecutiveRejects = 0;
+
+  measure(2, velEast, velNorth, sq(KF_VELOCITY_NOISE_MPS), false);
+  return true;
+}
+
+void PositionFilter::initialize(double easting, double northing, float velEast, float velNorth, float positionVar, uint64_t _timestamp) {
+
+  originEasting = easting;
+  originNorthing = northing;
+  timestamp = _timestamp;
+
+  x[0] = x[1] = 0;
+  x[2] = velEast;
+  x[3] = velNorth;
+
+  for (int i = 0; i < 4; i++) {
+    for (int j = 0; j < 4; j++) {
+      P[i][j] = 0;
+    }
+  }
+  P[0][0] = P[1][1] = positionVar;
+  P[2][2] = P[3][3] = KF_INITIAL_VELOCITY_VAR;
+
+  initialized = true;
+  consecutiveRejects = 0;
+}
+
+// x = F x,  P = F P F' + Q  with F = [I dt*I; 0 I]. Written out since F is mostly identity
+void PositionFilter::predict(float dt) {
+
+  if (dt <= 0)
+    return;
+
+  x[0] += x[2] * dt;
+  x[1] += x[3] * dt;
+
+  // P = F P F' (E/vE and N/vN blocks are independent of each other)
+  for (int axis = 0; axis < 2; axis++) {
+    int p = axis, v = axis + 2;
+    for (int j = 0; j < 4; j++) {  //Rows: F P
+      P[p][j] += dt * P[v][j];
+    }
+    for (int i = 0; i < 4; i++) {  //Columns: (F P) F'
+      P[i][p] += dt * P[i][v];
+    }
+  }
+
+  // Q for white noise acceleration
+  float dt2 = dt * dt;
+  float q = KF_ACCEL_NOISE;
+  P[0][0] += q * dt2 * dt / 3;
+  P[1][1] += q * dt2 * dt / 3;
+  P[0][2] += q * dt2 / 2;
+  P[2][0] += q * dt2 / 2;
+  P[1][3] += q * dt2 / 2;
+  P[3][1] += q * dt2 / 2;
+  P[2][2] += q * dt;
+  P[3][3] += q * dt;
+}
+
+// Measurement of states (offset, offset + 1) with noise r on each. H just selects those two states, so S is a 2x2 block of P
+boolean PositionFilter::measure(int offset, float z0, float z1, float r, boolean gate) {
+
+  int a = offset, b = offset + 1;
+
+  float y0 = z0 - x[a];
+  float y1 = z1 - x[b];
+
+  float s00 = P[a][a] + r, s01 = P[a][b], s11 = P[b][b] + r;
+  float det = s00 * s11 - s01 * s01;
+  if (det <= 0)
+    return false;
+
+  float i00 = s11 / det, i01 = -s01 / det, i11 = s00 / det;  //S^-1
+
+  float nis = y0 * (i00 * y0 + i01 * y1) + y1 * (i01 * y0 + i11 * y1);
+  if (gate) {
+    lastNIS = nis;
+    if (nis > KF_GATE_CHI2)
+      return false;
+  }
+
+  // K = P H' S^-1 (4x2)
+  float K[4][2];
+  for (int i = 0; i < 4; i++) {
+    K[i][0] = P[i][a] * i00 + P[i][b] * i01;
+    K[i][1] = P[i][a] * i01 + P[i][b] * i11;
+  }
+
+  for (int i = 0; i < 4; i++) {
+    x[i] += K[i][0] * y0 + K[i][1] * y1;
+  }
+
+  // P = (I - K H) P, using a copy of the two rows H P reads
+  float Pa[4], Pb[4];
+  for (int j = 0; j < 4; j++) {
+    Pa[j] = P[a][j];
+    Pb[j] = P[b][j];
+  }
+  for (int i = 0; i < 4; i++) {
+    for (int j = 0; j < 4; j++) {
+      P[i][j] -= K[i][0] * Pa[j] + K[i][1] * Pb[j];
+    }
+  }
+
+  // Keep it symmetric against rounding
+  for (int i = 0; i < 4; i++) {
+    for (int j = i + 1; j < 4; j++) {
+      P[i][j] = P[j][i] = 0.5 * (P[i][j] + P[j][i]);
+    }
+  }
+
+  return true;
+}
@@ -0,0 +1,60 @@
+#ifndef _POSITION_FILTER_H
+#define _POSITION_FILTER_H
+
+#include "Arduino.h"
+#include "SystemClock.h"
+
+/*
+  Constant velocity Kalman filter on the GPS position, in UTM (east/north) coordinates.
+
+  State is (E, N, vE, vN). To keep everything in single precision fixed size arrays, positions are stored relative to an origin
+  (the first fix, kept as a double) - UTM northings are ~5,000,000m which a float can only resolve to ~0.5m.
+
+  Position measurement noise is the expected error from the GPS quality model (GpsQuality.h). Each measurement is checked against the predicted state before it is used: if its
+  normalized innovation squared is above the chi-square gate it is rejected as an outlier (multipath jump etc.) and the prediction is
+  kept. Too many rejections in a row means the filter is the one that is wrong, so it restarts from the next fix.
+*/
+
+#define KF_VELOCITY_NOISE_MPS 0.5  //1 sigma of GPS velocity (m/s)
+#define KF_ACCEL_NOISE 2.0  //Process noise - white acceleration spectral density (m^2/s^3). How hard we think the plane manoeuvres
+#define KF_GATE_CHI2 9.21  //Chi-square 2 DOF, 99%
+#define KF_MAX_REJECTS 5  //1s of fixes at 5Hz
+#define KF_INITIAL_VELOCITY_VAR 25.0  //(m/s)^2
+
+class PositionFilter {
+
+  public:
+    PositionFilter();
+
+    void reset();
+    //Returns false if the position was rejected as an outlier (the filter still predicts forward to the timestamp), or isn't after
+    //the last one taken (then it is ignored)
+    boolean update(double easting, double northing, float velEast, float velNorth, float positionSigma, uint64_t timestamp);  //positionSigma in m
+
+    boolean isInitialized() { return initialized; }
+    double getEasting() { return originEasting + x[0]; }
+    double getNorthing() { return originNorthing + x[1]; }
+    float getVelEast() { return x[2]; }
+    float getVelNorth() { return x[3]; }
+    float getCovariance(int row, int col) { return P[row][col]; }  //Order: E, N, vE, vN
+    uint64_t getTimestamp() { return timestamp; }
+    float getLastNIS() { return lastNIS; }
+    int getConsecutiveRejects() { return consecutiveRejects; }
+
+  private:
+    boolean initialized = false;
+    double originEasting = 0, originNorthing = 0;
+    uint64_t timestamp = 0;
+
+    float x[4];
+    float P[4][4];
+
+    float lastNIS = 0;
+    int consecutiveRejects = 0;
+
+    void initialize(double easting, double northing, float velEast, float velNorth, float positionVar, uint64_t _timestamp);
+    void predict(float dt);
+    boolean measure(int offset, float z0, float z1, float r, boolean gate);  //2D measurement of state (offset, offset+1)
+};
+
+#endif //_POSITION_FILTER_H
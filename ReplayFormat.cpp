@@ -0,0 +1,91 @@
+#include "ReplayFormat.h"
+#include <string.h>
+
+bool ReplayDecoder::begin(const uint8_t *_data, uint32_t _length) {
+
+  data = _data;
+  length = _length;
+  if (length < REPLAY_HEADER_SIZE || readUint32(0) != REPLAY_MAGIC) {
+    length = 0;
+    return false;
+  }
+  durationMs = readUint32(4);
+  sentences = readUint32(8);
+  altimeterSamples = readUint32(12);
+  rewind();
+  return true;
+}
+
+void ReplayDecoder::rewind() {
+  pos = REPLAY_HEADER_SIZE;
+  timeMs = 0;
+  memset(previousLength, 0, sizeof(previousLength));
+  pressure = 0;
+  temperature = 0;
+}
+
+bool ReplayDecoder::next(ReplayEvent &e) {
+
+  uint32_t dt;
+  if (pos >= length || !readVarint(dt) || pos >= length)
+    return false;
+  timeMs += dt;
+  e.timeMs = timeMs;
+  uint8_t kind = data[pos++];
+
+  if (kind == REPLAY_EVENT_ALTIMETER) {
+    uint32_t dp, dtemp;
+    if (!readVarint(dp) || !readVarint(dtemp))
+      return false;
+    pressure += zigzagDecode(dp);
+    temperature += zigzagDecode(dtemp);
+    e.kind = REPLAY_EVENT_ALTIMETER;
+    e.pressureQ2 = pressure;
+    e.temperatureQ4 = temperature;
+    return true;
+  }
+
+  uint8_t slot = kind & 0x0F;
+  if ((kind & 0xF0) != REPLAY_EVENT_NMEA || slot >= REPLAY_SLOTS || pos >= length)
+    return false;
+  // Copies are from the same place, so the last sentence is just overwritten where it differs
+  char *s = previous[slot];
+  uint8_t sentenceLength = data[pos++];
+  if (sentenceLength > REPLAY_MAX_SENTENCE)
+    return false;
+  uint8_t at = 0;
+  while (at < sentenceLength) {
+    if (pos >= length)
+      return false;
+    uint8_t run = data[pos] & 0x7F;
+    bool copy = data[pos++] & 0x80;
+    if (run == 0 || at + run > sentenceLength || (copy && at + run > previousLength[slot]) || (!copy && length - pos < run))
+      return false;
+    if (!copy) {
+      memcpy(&s[at], &data[pos], run);
+      pos += run;
+    }
+    at += run;
+  }
+  previousLength[slot] = sentenceLength;
+
+  e.kind = REPLAY_EVENT_NMEA;
+  e.sentence = previous[slot];
+  e.length = previousLength[slot];
+  return true;
+}
+
+bool ReplayDecoder::readVarint(uint32_t &v) {
+  v = 0;
+  for (int shift = 0; shift < 32 && pos < length; shift += 7) {
+    uint8_t b = data[pos++];
+    v |= (uint32_t)(b & 0x7F) << shift;
+    if (!(b & 0x80))
+      return true;
+  }
+  return false;
+}
+
+uint32_t ReplayDecoder::readUint32(uint32_t at) {
+  return data[at] | ((uint32_t)data[at + 1] << 8) | ((uint32_t)data[at + 2] << 16) | ((uint32_t)data[at + 3] << 24);
+}
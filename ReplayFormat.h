@@ -0,0 +1,67 @@
+#ifndef _REPLAY_FORMAT_H
+#define _REPLAY_FORMAT_H
+
+#include <stdint.h>
+
+/*
+  Packed recording of a flight's sensor input, for bench replay (FlightReplay.h). Made by tools/replay, which builds this
+  decoder too to check its output. No Arduino dependencies.
+
+  Header (little endian): magic, duration (ms), number of sentences, number of altimeter samples - 4 x uint32.
+  Then events in time order, each: time since the previous event (ms, varint), a kind byte, and its body:
+    REPLAY_EVENT_NMEA | slot: one NMEA sentence from the '$' to before the "\r\n", coded against the last sentence of the same
+      slot (one slot per sentence type): its length (uint8), then runs that make it up - a byte with the top bit set copies that
+      many characters from the same place in the last sentence, otherwise that many characters follow. Consecutive GGAs or RMCs
+      keep their fields where they were and mostly differ in the last digits of the time and position, so they pack ~3x.
+    REPLAY_EVENT_ALTIMETER: pressure (Q18.2 Pa) and temperature (Q8.4 C) as they come out of the MPL3115A2, each as the zigzag
+      varint difference from the previous sample (1-2 bytes per sample).
+  Varints are 7 bits per byte, least significant first, top bit set on all but the last byte.
+*/
+
+#define REPLAY_MAGIC 0x314C5052  //"RPL1"
+#define REPLAY_HEADER_SIZE 16
+#define REPLAY_SLOTS 8
+#define REPLAY_MAX_SENTENCE 96  //NMEA allows 82 with the "\r\n"
+
+//Event kinds
+#define REPLAY_EVENT_NMEA 0x00  //| slot
+#define REPLAY_EVENT_ALTIMETER 0x10
+
+struct ReplayEvent {
+  uint32_t timeMs;  //From the start of the recording
+  uint8_t kind;  //REPLAY_EVENT_NMEA or REPLAY_EVENT_ALTIMETER (without the slot)
+  const char *sentence;  //NMEA: not terminated, valid until the next event of the same slot
+  uint8_t length;
+  uint32_t pressureQ2;  //Altimeter
+  int32_t temperatureQ4;
+};
+
+class ReplayDecoder {
+
+  public:
+    bool begin(const uint8_t *data, uint32_t length);  //False if it isn't a recording
+    bool next(ReplayEvent &e);  //False at the end, or at a corrupt event
+    void rewind();
+
+    uint32_t getDurationMs() { return durationMs; }
+    uint32_t getSentences() { return sentences; }
+    uint32_t getAltimeterSamples() { return altimeterSamples; }
+
+  private:
+    const uint8_t *data;
+    uint32_t length, pos;
+    uint32_t durationMs, sentences, altimeterSamples;
+    uint32_t timeMs;
+    char previous[REPLAY_SLOTS][REPLAY_MAX_SENTENCE];
+    uint8_t previousLength[REPLAY_SLOTS];
+    uint32_t pressure;
+    int32_t temperature;
+
+    bool readVarint(uint32_t &v);
+    uint32_t readUint32(uint32_t at);
+};
+
+inline uint32_t zigzagEncode(int32_t v) { return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31); }
+inline int32_t zigzagDecode(uint32_t v) { return (int32_t)(v >> 1) ^ -(int32_t)(v & 1); }
+
+#endif //_REPLAY_FORMAT_H
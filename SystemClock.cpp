@@ -0,0 +1,23 @@
+#include "SystemClock.h"
+#include "Arduino.h"
+
+static uint32_t lastLowMicros = 0;
+static uint32_t highMicros = 0;  //Number of times micros() has wrapped
+
+uint64_t systemMicros() {
+
+  // Interrupts off so an ISR calling this in the middle can't count the same wrap twice. Restore the previous state rather than
+  // blindly enabling, so this is also safe from inside an ISR
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+
+  uint32_t lowMicros = micros();
+  if (lowMicros < lastLowMicros) {
+    highMicros++;
+  }
+  lastLowMicros = lowMicros;
+  uint64_t now = ((uint64_t)highMicros << 32) | lowMicros;
+
+  __set_PRIMASK(primask);
+  return now;
+}
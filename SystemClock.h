@@ -0,0 +1,54 @@
+#ifndef _SYSTEM_CLOCK_H
+#define _SYSTEM_CLOCK_H
+
+#include "Arduino.h"
+
+/*
+  Single timebase for every module: a monotonic 64 bit microsecond clock.
+
+  micros() is derived from the 1ms SysTick and wraps every ~71 minutes as an unsigned long (millis() truncated into an int wraps much
+  sooner). systemMicros() extends it to 64 bits by counting wraps, so it never wraps in practice (584 thousand years). The only
+  requirement is that it is called at least once per wrap period, which the main loop does thousands of times a second.
+  It is safe to call from ISRs.
+
+  Timestamps should be stored as uint64_t. Intervals are then taken with the 32 bit helpers below, which are exact for intervals up to
+  ~71 minutes and saturate (rather than wrap) beyond that, so a latency computation can never come out negative or tiny.
+*/
+
+#define MICROS_PER_MILLI 1000UL
+#define MICROS_PER_SECOND 1000000UL
+
+uint64_t systemMicros();
+
+// Interval between two timestamps in microseconds. Returns 0 if 'later' is actually earlier, and saturates at 0xFFFFFFFF
+inline uint32_t microsBetween(uint64_t earlier, uint64_t later) {
+  if (later <= earlier)
+    return 0;
+  uint64_t diff = later - earlier;
+  return diff > 0xFFFFFFFFULL ? 0xFFFFFFFFUL : (uint32_t)diff;
+}
+
+inline uint32_t microsSince(uint64_t earlier) {
+  return microsBetween(earlier, systemMicros());
+}
+
+inline uint32_t millisSince(uint64_t earlier) {
+  return microsSince(earlier) / MICROS_PER_MILLI;
+}
+
+inline double secondsSince(uint64_t earlier) {
+  return microsSince(earlier) / (double)MICROS_PER_SECOND;
+}
+
+// DWT cycle counter (84MHz core clock, wraps every ~51s) - for measuring how long short pieces of code take
+inline void enableCycleCounter() {
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CYCCNT = 0;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+inline uint32_t cycleCount() {
+  return DWT->CYCCNT;
+}
+
+#endif //_SYSTEM_CLOCK_H
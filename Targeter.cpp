@@ -1,6 +1,9 @@
 #include "Targeter.h"
 #include "Arduino.h"
 #include "plane.h"
+#include "Parameters.h"
+#include "FastMath.h"
+#include "DropSolver.h"
 
 
 Targeter::Targeter() {
@@ -27,7 +30,7 @@ boolean Targeter::recalculate() {
 }
 
 //Update the position with new data
-boolean Targeter::setAndCheckCurrentData(double _currentLatitude, double _currentLongitude, double _currentAltitudeFt, double _currentVelocityMPS, double _currentHeading, double _currentDataTimestamp, boolean _hdopOk) {
+boolean Targeter::setAndCheckCurrentData(double _currentLatitude, double _currentLongitude, double _currentAltitudeFt, double _currentVelocityMPS, double _currentHeading, uint64_t _currentDataTimestamp, boolean _gpsOk, double _gpsErrorM) {
 
   haveAPosition = true;
 
@@ -37,11 +40,53 @@ boolean Targeter::setAndCheckCurrentData(double _currentLatitude, double _curren
   currentVelocityMPS = _currentVelocityMPS;
   currentHeading = _currentHeading;
   currentDataTimestamp = _currentDataTimestamp;
-  HDOP_OK = _hdopOk; 
+  gpsOk = _gpsOk;
 
   // Get current coordinates (saved in currentEasting/currentNorthing)
   convertDeg2UTM(convertDecimalDegMinToDegree(currentLatitude), convertDecimalDegMinToDegree(currentLongitude), currentEasting, currentNorthing);
 
+  // Smooth the raw fix. If it was rejected as an outlier we carry on with the filter's prediction, so a single jump can't trigger or cancel a drop
+  double sinHeading, cosHeading;
+  fastSinCos(currentHeading / 180 * PI, sinHeading, cosHeading);
+  boolean accepted = positionFilter.update(currentEasting, currentNorthing, currentVelocityMPS * sinHeading, currentVelocityMPS * cosHeading, _gpsErrorM, currentDataTimestamp);
+
+  #ifndef Targeter_Debug_Print
+    if (!accepted) {
+      TARGET_PRINT("Fix rejected by filter, NIS = ");  TARGET_PRINTLN(positionFilter.getLastNIS());
+    }
+  #endif
+
+  currentEasting = positionFilter.getEasting();
+  currentNorthing = positionFilter.getNorthing();
+  currentVelocityMPS = fastSqrt(sq(positionFilter.getVelEast()) + sq(positionFilter.getVelNorth()));
+  currentHeading = fastAtan2(positionFilter.getVelEast(), positionFilter.getVelNorth()) * 180 / PI;  //Compass heading, ie. from north towards east
+  if (currentHeading < 0) {
+    currentHeading += 360;
+  }
+  fastSinCos(convertHeadingToMathAngle(currentHeading) / 180 * PI, headingSin, headingCos);
+  currentDataTimestamp = positionFilter.getTimestamp();
+
+  // Turn rate from fix to fix, for projecting the track through a turn
+  double dt = microsBetween(previousDataTimestamp, currentDataTimestamp) / (double)MICROS_PER_SECOND;
+  if (previousDataTimestamp != 0 && dt > 0 && dt < TURN_RATE_MAX_GAP_S && currentVelocityMPS > TURN_RATE_MIN_SPEED_MPS) {
+    double headingChange = currentHeading - previousHeading;
+    if (headingChange > 180) headingChange -= 360;
+    if (headingChange < -180) headingChange += 360;
+    double rate = -headingChange / 180 * PI / dt;  //Compass headings turn clockwise, math angles counter clockwise
+    turnRate += TURN_RATE_SMOOTHING * (rate - turnRate);
+  }
+  else if (dt > 0) {
+    turnRate = 0;
+  }
+  previousHeading = currentHeading;
+  previousDataTimestamp = currentDataTimestamp;
+
+  if (dt > 0) {  //Not when the filter ignored a repeat of the last fix
+    windEstimator.addSample(positionFilter.getVelEast(), positionFilter.getVelNorth(), trueAirspeedMPS);
+  }
+  windEast = windEstimator.isValid() ? windEstimator.getWindEast() : 0;
+  windNorth = windEstimator.isValid() ? windEstimator.getWindNorth() : 0;
+
   #ifndef Targeter_Debug_Print
     TARGET_PRINTLN("New Data Results: \n");
   #endif
@@ -61,11 +106,33 @@ void Targeter::setTargetData(double _targetLatitude, double _targetLongitude, do
 
 }
 
+void Targeter::setTargetUTM(double _targetEasting, double _targetNorthing) {
+
+  targetEasting = _targetEasting;
+  targetNorthing = _targetNorthing;
+
+}
+
+void Targeter::setPayloadTarget(int i, double easting, double northing) {
+  payloadTargetEasting[i] = easting;
+  payloadTargetNorthing[i] = northing;
+  payloadHasTarget[i] = true;
+}
+
+void Targeter::clearPayloadTarget(int i) {
+  payloadHasTarget[i] = false;
+}
+
+// After a warm restart the gyro bias starts from 0 (it isn't checkpointed, WarmRestart.h), so the roll can be a few degrees off until
+// the attitude filter's integral term has taken it out - tens of seconds
+boolean Targeter::isAttitudeOkForDrop() {
+  return abs(currentRollDeg) <= params.maxDropBankDeg;
+}
 
 
 // ------------------------------------ PHYSICAL CALCULATIONS ------------------------------------
 
-//The calls the 6 steps in correct order, then evaluates the results
+//The calls the 7 steps in correct order, then evaluates the results
 bool Targeter::performTargetCalcsAndEvaluateResults()
 {
   /*****Update all variables (by calling FN's in order) *****/
@@ -73,8 +140,9 @@ bool Targeter::performTargetCalcsAndEvaluateResults()
   calculateDirectDistanceToTarget();
   calculateDistAlongPathToMinLateralErr();
   calculateHorizDistance(); 
-  calculateTimeTillDrop();
   calculateDistFromEstDropPosToTarget();
+  solveReleaseTimes();
+  calculateHitProbabilities();
   
 
   /*****DEBUGGING - print results *****/
@@ -87,19 +155,26 @@ bool Targeter::performTargetCalcsAndEvaluateResults()
     TARGET_PRINT("Alt (M) = ");  TARGET_PRINT(currentAltitudeM );
     TARGET_PRINT("\t\tVel = ");  TARGET_PRINT(currentVelocityMPS);
     TARGET_PRINT("\t\tHeading = ");  TARGET_PRINT(currentHeading);
-    TARGET_PRINT("\t\tTimestamp = ");  TARGET_PRINTLN(currentDataTimestamp);
+    TARGET_PRINT("\t\tTurn rate = ");  TARGET_PRINT(turnRate);
+    TARGET_PRINT("\t\tWind E/N = ");  TARGET_PRINT(windEast);  TARGET_PRINT(" / ");  TARGET_PRINT(windNorth);
+    TARGET_PRINT("\t\tTimestamp = ");  TARGET_PRINTLN((double)currentDataTimestamp);
   
     TARGET_PRINT("Lateral error = ");  TARGET_PRINTLN(lateralError);
     TARGET_PRINT("Direct Dist to Target = "); TARGET_PRINTLN(directDistanceToTarget);
     TARGET_PRINT("Distance to min lateral err = ");  TARGET_PRINTLN(distAlongPathToMinLateralErr);
     TARGET_PRINT("Horizontal dist from drop, dataAge, dropDelay = "); TARGET_PRINTLN(horizDistance);
+    TARGET_PRINT("Dist from drop (now) loc to target = ");  TARGET_PRINTLN(distFromEstDropPosToTarget);
+    TARGET_PRINT("Next payload = ");  TARGET_PRINTLN(nextPayload);
     TARGET_PRINT("Time until drop = ");  TARGET_PRINTLN(timeTillDrop);
-    TARGET_PRINT("Dist from drop loc to target = ");  TARGET_PRINTLN(distFromEstDropPosToTarget);
-    TARGET_PRINT("Target radius = ");  TARGET_PRINTLN(TARGET_RADIUS);
+    TARGET_PRINT("Miss distance at drop = ");  TARGET_PRINTLN(releaseMissDistance);
+    TARGET_PRINT("Target radius = ");  TARGET_PRINTLN(params.targetRadiusM);
+    TARGET_PRINT("Impact sigma = ");  TARGET_PRINTLN(impactSigma);
+    TARGET_PRINT("Hit probability = ");  TARGET_PRINTLN(hitProbability);
   #else
     TARGET_PRINT("DD = "); TARGET_PRINT(directDistanceToTarget);
     TARGET_PRINT("\tT = ");  TARGET_PRINT(timeTillDrop);
-    TARGET_PRINT("\tTD = ");  TARGET_PRINTLN(distFromEstDropPosToTarget);
+    TARGET_PRINT("\tTD = ");  TARGET_PRINT(releaseMissDistance);
+    TARGET_PRINT("\tP = ");  TARGET_PRINTLN(hitProbability);
   #endif
 
   /***** Evaluate Results ******/
@@ -110,25 +185,26 @@ bool Targeter::performTargetCalcsAndEvaluateResults()
   //  return false;
   //else...
   
+  for (int i = 0; i < MAX_PAYLOADS; i++) {
+    payloadReady[i] = false;
+  }
+
   // We need to have sufficient accuracy to drop
-  if (!HDOP_OK)
+  if (!gpsOk)
 	  return false;
-  
-  //If we are within 5m, drop regardless of other conditions
-  if(distFromEstDropPosToTarget < 5)
-    return true;
-  //else...
-  
-  // 1. We update every 50ms, so if much higher than that we want to wait to drop closer to center
-  if (timeTillDrop > 0.2) //200 ms * 15 m/s = 3 m, not really a worry of dropping early
-    return false;
 
-  // 2. We NEED be in the rings at the drop point
-  if (distFromEstDropPosToTarget > TARGET_RADIUS)
+  // Not in a steep bank
+  if (!isAttitudeOkForDrop())
     return false;
+  
+  // Each payload has to be likely enough to land in the rings at all. If so, release it at its release time (its closest approach)
+  boolean anyReady = false;
+  for (int i = 0; i < numPayloads; i++) {
+    payloadReady[i] = !payloadReleased[i] && payloadHitProbability[i] >= params.hitProbabilityMin;
+    anyReady |= payloadReady[i];
+  }
 
-  // We are now close enough to be in rings, and if under 0.2 we want to drop
-  return true; 
+  return anyReady;
 }
 
 
@@ -146,9 +222,8 @@ void Targeter::calculateLateralError() {
 
   // P1:
   // Generate an arbitrary point to define the line (far enough away to avoid rounding errors)
-  double currentHeadingMathAngle = convertHeadingToMathAngle(currentHeading);
-  double x1 = currentEasting + cos(currentHeadingMathAngle / 180 * PI) * 2000;
-  double y1 = currentNorthing + sin(currentHeadingMathAngle / 180 * PI) * 2000;
+  double x1 = currentEasting + headingCos * 2000;
+  double y1 = currentNorthing + headingSin * 2000;
 
   // P2:
   double x2 = currentEasting;
@@ -166,9 +241,9 @@ void Targeter::calculateLateralError() {
   numerator = abs(numerator);
 
   // Calculate denominator in equation:
-  double denominator = pow(y2 - y1, 2.0);
-  denominator += pow(x2 - x1, 2.0);
-  denominator = sqrt(denominator);
+  double denominator = sq(y2 - y1);
+  denominator += sq(x2 - x1);
+  denominator = fastSqrt(denominator);
 
   lateralError = numerator / denominator;
 }
@@ -181,7 +256,7 @@ void Targeter::calculateLateralError() {
 void Targeter::calculateDirectDistanceToTarget() {
 
   // Use pythagorean theorem to calculate distance between curPos and targetPos:
-  directDistanceToTarget =  sqrt(pow((targetEasting - currentEasting), 2) + pow((targetNorthing - currentNorthing), 2));
+  directDistanceToTarget = fastSqrt(sq(targetEasting - currentEasting) + sq(targetNorthing - currentNorthing));
 }
 
 
@@ -192,7 +267,7 @@ void Targeter::calculateDirectDistanceToTarget() {
 */
 
 void Targeter::calculateDistAlongPathToMinLateralErr() {
-  distAlongPathToMinLateralErr = sqrt(pow(directDistanceToTarget, 2) - pow(lateralError, 2));
+  distAlongPathToMinLateralErr = fastSqrt(sq(directDistanceToTarget) - sq(lateralError));  //0 rather than NaN if rounding makes it -ve
 }
 
 
@@ -201,34 +276,23 @@ void Targeter::calculateDistAlongPathToMinLateralErr() {
    Calculates how early (distance in m before being above the target) the
    package must be dropped based on current speed, altitude, DataTimestamp and servo opening delay.
    Note - this accounts for data age AND a delay for the servo opening
-
-
-   *** Note: right now this picks a value for air resistance and is unrealistic.
-   Some thoughts on air resistance: terminal falling velocity 35-45 m/s ish, which would be reached at 4.1s or 82m / 270ft
-   It will accelerate slower once above low speeds
-   @ 10 m/s estimated air resistance acceleration would be -0.6 m/s^2. If fall time on the order of 3s, this would
-   only affect speed vi = 10, vf = 8.2, vavg = 9.1.  So not a lot, and is partially offset by reduced fall speed
-   Approximate Equations: m = 2kg, cd =1 CSA = 0.02m^2, rho = 1.25   a = 0.5*cd*rho*CSA*v^2/m = 0.00625*v^2
-   Overall approximation of 0.9 correction factor
-   See MATLAB script for more details
+   The fall time (and its air resistance correction and wind drift) is worked out by dropFallTimes (DropSolver.cpp)
 */
 
 void Targeter::calculateHorizDistance() {
 
-  // targetPos.getAltitude() will probably be 0, but I included it just in case:
-  double heightm = (currentAltitudeM - targetAltitudeM);
+  dropModel.correctionFactor = params.correctionFactor;
+  dropModel.servoOpenDelayMs = params.servoOpenDelayMs;
+  dropModel.targetRadiusM = params.targetRadiusM;
+  dropModel.fallModelErrorFraction = params.fallModelErrorFraction;
 
-  // Calculate time for payload to fall:
-  if (heightm < 0) {
-    heightm = 0;  //prevent NaN from sqrt (altimeter noise may make it less than 0 often on the ground)
-  }
-
-  double fallTime = sqrt(2 * heightm / 9.807); // time in seconds
+  // targetPos.getAltitude() will probably be 0, but I included it just in case:
+  dropFallTimes(currentAltitudeM - targetAltitudeM, dropModel, drop.fallTime, drop.windDriftTime);
 
   // Calculate horizontal distance that payload will travel in this time:
-  double distanceDuringFall = currentVelocityMPS * fallTime * CORRECTION_FACTOR;
-  double distanceFromDataAge = currentVelocityMPS*(millis() - currentDataTimestamp)/1000.0;
-  double distanceFromServoOpenDelay = currentVelocityMPS*SERVO_OPEN_DELAY/1000.0;
+  distanceDuringFall = currentVelocityMPS * drop.fallTime;
+  double distanceFromDataAge = currentVelocityMPS*secondsSince(currentDataTimestamp);
+  double distanceFromServoOpenDelay = currentVelocityMPS*params.servoOpenDelayMs/1000.0;
   horizDistance = distanceDuringFall  + distanceFromDataAge  + distanceFromServoOpenDelay;
 }
 
@@ -240,36 +304,145 @@ void Targeter::calculateHorizDistance() {
  
  void Targeter::calculateDistFromEstDropPosToTarget() {
 
-  double currentHeadingMathAngle = convertHeadingToMathAngle(currentHeading);
-  estDropEasting = currentEasting + cos(currentHeadingMathAngle / 180 * PI) * horizDistance;
-  estDropNorthing = currentNorthing + sin(currentHeadingMathAngle / 180 * PI) * horizDistance;
+  estDropEasting = currentEasting + headingCos * horizDistance;
+  estDropNorthing = currentNorthing + headingSin * horizDistance;
+  estDropEasting += windEast * drop.windDriftTime;
+  estDropNorthing += windNorth * drop.windDriftTime;
 
-  distFromEstDropPosToTarget = sqrt(pow(targetNorthing - estDropNorthing, 2) + pow(targetEasting - estDropEasting, 2));
+  distFromEstDropPosToTarget = fastSqrt(sq(targetNorthing - estDropNorthing) + sq(targetEasting - estDropEasting));
 
 }
 
 /*
    Step 6
-   Calculates time until optimal drop location.
+   Solves for the release time (after the data timestamp) of every payload still aboard, in one batch from the same state
+   (dropReleaseTime, DropSolver.cpp). Releases are then put in order and pushed apart where two would be too close together.
 */
-void Targeter::calculateTimeTillDrop() {
+void Targeter::solveReleaseTimes() {
+
+  setDropState();
+  for (int i = 0; i < numPayloads; i++) {
+    if (payloadReleased[i])
+      continue;
+    aimPointFor(i, payloadAimEasting[i], payloadAimNorthing[i]);
+    payloadReleaseTime[i] = dropReleaseTime(drop, dropModel, payloadAimEasting[i], payloadAimNorthing[i]);
+    payloadMissDistance[i] = dropMissDistance(drop, dropModel, payloadReleaseTime[i], payloadAimEasting[i], payloadAimNorthing[i]);
+  }
+
+  staggerReleases();
+
+  nextPayload = -1;
+  for (int i = 0; i < numPayloads; i++) {
+    if (!payloadReleased[i] && (nextPayload < 0 || payloadReleaseTime[i] < payloadReleaseTime[nextPayload]))
+      nextPayload = i;
+  }
+
+  if (nextPayload < 0) {
+    releaseTime = secondsSince(currentDataTimestamp);
+    releaseMissDistance = 0;
+    timeTillDrop = 0;
+    return;
+  }
+  releaseTime = payloadReleaseTime[nextPayload];
+  releaseMissDistance = payloadMissDistance[nextPayload];
+  timeTillDrop = releaseTime - secondsSince(currentDataTimestamp);
+}
+
+// The filtered state, as the solver takes it (the fall times are already set, at step 4)
+void Targeter::setDropState() {
+
+  PositionFilter &f = positionFilter;
+  drop.easting = currentEasting;
+  drop.northing = currentNorthing;
+  drop.speed = currentVelocityMPS;
+  drop.heading = convertHeadingToMathAngle(currentHeading) / 180 * PI;
+  drop.headingCos = headingCos;
+  drop.headingSin = headingSin;
+  drop.turnRate = turnRate;
+  drop.windEast = windEast;
+  drop.windNorth = windNorth;
+  drop.now = secondsSince(currentDataTimestamp);
+  drop.varEast = f.getCovariance(0, 0);
+  drop.varNorth = f.getCovariance(1, 1);
+  drop.varVelEast = f.getCovariance(2, 2);
+  drop.varVelNorth = f.getCovariance(3, 3);
+  drop.covEast = f.getCovariance(0, 2);
+  drop.covNorth = f.getCovariance(1, 3);
+}
+
+// Payloads with their own target aim at it. The rest are spaced params.dropTrainSpacingM apart along the current track, centred on the target
+void Targeter::aimPointFor(int i, double &easting, double &northing) {
+
+  if (payloadHasTarget[i]) {
+    easting = payloadTargetEasting[i];
+    northing = payloadTargetNorthing[i];
+    return;
+  }
 
-  //Need to handle case where moving away from target (PLANE is past target) and moving towards.
-  //Note - you do not need to hangle the case where plane is before target and drop location is after - this falls under 
-  //'moving towards' and can be handled the same way.
+  int trainSize = 0, trainIndex = 0;
+  for (int j = 0; j < numPayloads; j++) {
+    if (payloadHasTarget[j])
+      continue;
+    if (j < i)
+      trainIndex++;
+    trainSize++;
+  }
+
+  double offset = (trainIndex - (trainSize - 1) / 2.0) * params.dropTrainSpacingM;
+  easting = targetEasting + offset * headingCos;
+  northing = targetNorthing + offset * headingSin;
+}
 
-    //Moving away from target
-    if(distFromEstDropPosToTarget > directDistanceToTarget)
-    {
-        timeTillDrop = (-distAlongPathToMinLateralErr - horizDistance) / currentVelocityMPS;   //distAlongPathToMinLateralErr is a negative
+// Insertion sort of the payloads still aboard by release time (there are only a few), then push each one back far enough from the last
+void Targeter::staggerReleases() {
+
+  int order[MAX_PAYLOADS];
+  int count = 0;
+  for (int i = 0; i < numPayloads; i++) {
+    if (payloadReleased[i])
+      continue;
+    int k = count++;
+    while (k > 0 && payloadReleaseTime[order[k - 1]] > payloadReleaseTime[i]) {
+      order[k] = order[k - 1];
+      k--;
     }
-    else
-    {
-        timeTillDrop = (distAlongPathToMinLateralErr - horizDistance) / currentVelocityMPS;
+    order[k] = i;
+  }
+
+  for (int k = 1; k < count; k++) {
+    int i = order[k], previous = order[k - 1];
+    if (payloadReleaseTime[i] < payloadReleaseTime[previous] + PAYLOAD_MIN_SPACING_S) {
+      payloadReleaseTime[i] = payloadReleaseTime[previous] + PAYLOAD_MIN_SPACING_S;
+      payloadMissDistance[i] = dropMissDistance(drop, dropModel, payloadReleaseTime[i], payloadAimEasting[i], payloadAimNorthing[i]);
     }
+  }
 }
 
+/*
+   Step 7
+   Probability of each payload landing inside the target radius of its aim point if released at its release time
+   (dropSigmaSq and dropHitProbability, DropSolver.cpp).
+*/
+void Targeter::calculateHitProbabilities() {
 
+  hitProbability = 0;
+  impactSigma = 0;
+
+  for (int i = 0; i < numPayloads; i++) {
+    if (payloadReleased[i]) {
+      payloadHitProbability[i] = 0;
+      continue;
+    }
+
+    double sigmaSq = dropSigmaSq(drop, dropModel, payloadReleaseTime[i]);
+    payloadHitProbability[i] = dropHitProbability(dropModel, payloadMissDistance[i], sigmaSq);
+
+    if (i == nextPayload) {
+      impactSigma = fastSqrt(sigmaSq);
+      hitProbability = payloadHitProbability[i];
+    }
+  }
+}
 
 
 
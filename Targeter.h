@@ -2,22 +2,52 @@
 #define _TARGETER_H
 
 #include "Arduino.h"
+#include "SystemClock.h"
+#include "PositionFilter.h"
+#include "WindEstimator.h"
+#include "DropSolver.h"
 
 #define FT_TO_METERS 0.3048
+#define MAX_PAYLOADS 4
 
 class Targeter {
   
   public:
     Targeter();
     boolean recalculate();
-    boolean setAndCheckCurrentData(double _currentLatitude, double _currentLongitude, double _currentAltitudeFt, double _currentVelocityMPS, double _currentHeading, double _currentDataTimestamp, boolean _hdopOk);
+    boolean setAndCheckCurrentData(double _currentLatitude, double _currentLongitude, double _currentAltitudeFt, double _currentVelocityMPS, double _currentHeading, uint64_t _currentDataTimestamp, boolean _gpsOk, double _gpsErrorM);
     void setTargetData(double _targetLatitude, double _targetLongitude, double _targetAltitudeM);
+    void setTargetUTM(double _targetEasting, double _targetNorthing);  //Used when restoring a checkpointed target on a warm restart
+    void setTrueAirspeed(double _trueAirspeedMPS) { trueAirspeedMPS = _trueAirspeedMPS; }  //Latest airspeed, used with the next fix (0 = none)
+    void setAttitude(double _rollDeg, double _pitchDeg) { currentRollDeg = _rollDeg; currentPitchDeg = _pitchDeg; }
+    boolean isAttitudeOkForDrop();
+    double getTargetEasting() { return targetEasting; }
+    double getTargetNorthing() { return targetNorthing; }
+    PositionFilter &getPositionFilter() { return positionFilter; }  //Smoothed position/velocity and covariance
+    WindEstimator &getWindEstimator() { return windEstimator; }
+    uint64_t getDataTimestamp() { return currentDataTimestamp; }
+    uint64_t getReleaseTimestamp() { return currentDataTimestamp + (uint64_t)(releaseTime * MICROS_PER_SECOND); }  //Of the next payload due
+    double getReleaseMissDistance() { return releaseMissDistance; }
+    double getHitProbability() { return hitProbability; }
+
+    //Multiple payloads. Each is aimed at its own target if it has one, otherwise they make a drop train along track through the target
+    void setNumPayloads(int n) { numPayloads = constrain(n, 1, MAX_PAYLOADS); }
+    void setPayloadTarget(int i, double easting, double northing);
+    void clearPayloadTarget(int i);  //Back into the drop train
+    void setPayloadReleased(int i, boolean released) { payloadReleased[i] = released; }  //Released payloads are left out of the solve
+    boolean isPayloadReady(int i) { return payloadReady[i]; }  //Solved, and likely enough to hit to schedule
+    uint64_t getPayloadReleaseTimestamp(int i) { return currentDataTimestamp + (uint64_t)(payloadReleaseTime[i] * MICROS_PER_SECOND); }  //When to command the release (systemMicros)
+    double getPayloadMissDistance(int i) { return payloadMissDistance[i]; }
+    double getPayloadHitProbability(int i) { return payloadHitProbability[i]; }
 
   private:
 
-    //Correct factors (these are not tuned/tested!!)
-    #define CORRECTION_FACTOR 0.9  //for air resistance
-    #define SERVO_OPEN_DELAY 250 //ms
+    //The correction factor, servo delay, target radius and drop decision limits are tunable in flight: params (Parameters.h)
+
+    //Turn rate (the release time solver's constants are in DropSolver.h)
+    #define TURN_RATE_SMOOTHING 0.5  //Low pass on the fix to fix turn rate
+    #define TURN_RATE_MAX_GAP_S 2.0  //Fixes further apart than this don't give a turn rate
+    #define PAYLOAD_MIN_SPACING_S 0.3  //Releases closer together than this are pushed apart, so the payloads clear each other
 
     // ------------------------------------ CURRENT POSITION ------------------------------------
 
@@ -26,13 +56,26 @@ class Targeter {
     double currentLatitude = 0;
     double currentLongitude = 0;
     double currentAltitudeM = 0; // m
-    double currentDataTimestamp = 0; // millis
+    uint64_t currentDataTimestamp = 0; // systemMicros()
     double currentVelocityMPS = 0;  //m/s
     double currentHeading = 0; // In degrees (E = 0, N = 90, W = 180, S = 270)
+    double headingCos = 1, headingSin = 0;  //Of currentHeading as a math angle - worked out once per fix, every step uses them
     double currentEasting = 0, currentNorthing = 0;
     double estDropEasting = 0, estDropNorthing = 0;
+    double turnRate = 0;  //rad/s, counter clockwise (math angle) positive
+    double previousHeading = 0;
+    uint64_t previousDataTimestamp = 0;
+
+    boolean gpsOk; //Is the GPS accuracy OK? (see GpsQuality.h)
+
+    // Raw fixes go through this, and the smoothed position/velocity is what the calculations below use
+    PositionFilter positionFilter;
 
-    boolean HDOP_OK; //Is the GPS accuracy OK?
+    // Fit from the filtered ground velocities. Once valid, the payload's drift with the wind is added to the landing point
+    WindEstimator windEstimator;
+    double windEast = 0, windNorth = 0;  //m/s, zero until the estimate is valid
+    double trueAirspeedMPS = 0;
+    double currentRollDeg = 0, currentPitchDeg = 0;  //From the IMU, stays level if there isn't one
 
     // ------------------------------------ TARGET POSITION ------------------------------------
 
@@ -42,10 +85,20 @@ class Targeter {
     double targetAltitudeM; // m
     double targetEasting = -10000000, targetNorthing = -10000000;  //MAKE different than initial currentEast/North, or it may autodrop on startup
 
+    // ------------------------------------ PAYLOADS ------------------------------------
+
+    int numPayloads = 1;
+    boolean payloadReleased[MAX_PAYLOADS] = {false};
+    boolean payloadHasTarget[MAX_PAYLOADS] = {false};
+    double payloadTargetEasting[MAX_PAYLOADS], payloadTargetNorthing[MAX_PAYLOADS];
+    double payloadAimEasting[MAX_PAYLOADS], payloadAimNorthing[MAX_PAYLOADS];  //This solution's aim points
+    boolean payloadReady[MAX_PAYLOADS] = {false};
+    int nextPayload = 0;  //Earliest release still aboard, -1 if none. The single payload results (releaseTime etc.) are for this one
+
 
     // ------------------------------------ PHYSICAL CALCULATIONS ------------------------------------
 
-    //ENCOMPASSING: call this to call 6 functions in order, evaluate results, and return true (ie. drop) or false (not yet)
+    //ENCOMPASSING: call this to call 7 functions in order, evaluate results, and return true (ie. at least one release is scheduled) or false (no release)
     bool performTargetCalcsAndEvaluateResults();  //Call the following functions (in correct order) to update all targeting variables
 
     //None of the following should be called outside the above function
@@ -64,14 +117,30 @@ class Targeter {
     //Step 4:
     void calculateHorizDistance();  //horizontal distance travelled from data age, servo open delay, and during the fall
     double horizDistance;
+    double distanceDuringFall;
 
     //Step 5:
-    void calculateDistFromEstDropPosToTarget();  //distance from where we are estimated to drop (currently) to the target. MUST be <ringRadius if we want to drop 
+    void calculateDistFromEstDropPosToTarget();  //distance from where we are estimated to drop (if we dropped now) to the target
     double distFromEstDropPosToTarget;
                                 
     //Step 6:
-    void calculateTimeTillDrop();   //How long until we should drop
-    double timeTillDrop;
+    void solveReleaseTimes();  //Batch: for each payload still aboard, when to release it to land closest to its aim point
+    void setDropState();  //The filtered state as the solver (DropSolver.h) takes it
+    void aimPointFor(int i, double &easting, double &northing);
+    void staggerReleases();  //Keep releases PAYLOAD_MIN_SPACING_S apart, in order
+    double payloadReleaseTime[MAX_PAYLOADS];  //s after currentDataTimestamp
+    double payloadMissDistance[MAX_PAYLOADS];  //m, closest the payload lands if released at its release time
+    double releaseTime;
+    double releaseMissDistance;
+    double timeTillDrop;  //s from now
+    DropModel dropModel;  //From params, at step 4
+    DropState drop;  //Fall times from step 4, the rest at step 6
+
+    //Step 7:
+    void calculateHitProbabilities();  //Probability of each payload landing within the target radius of its aim point
+    double payloadHitProbability[MAX_PAYLOADS];
+    double hitProbability;
+    double impactSigma;  //m, equivalent circular 1 sigma error of the next payload's landing point
 
 
 
@@ -0,0 +1,105 @@
+#include "WarmRestart.h"
+#include "Arduino.h"
+#include "plane.h"
+
+WarmRestart::WarmRestart() {}
+
+uint8_t WarmRestart::getResetType() {
+  return (RSTC->RSTC_SR & RSTC_SR_RSTTYP_Msk) >> RSTC_SR_RSTTYP_Pos;
+}
+
+boolean WarmRestart::load(WarmRestartState &state) {
+
+  // A user reset (NRST/reset button) is normally done on the ground on purpose, so always treat it as a cold boot.
+  // A general reset means the backup domain was just powered up (registers are 0), the magic check below catches that too
+  if (getResetType() == RESET_TYPE_USER || getResetType() == RESET_TYPE_GENERAL)
+    return false;
+
+  uint32_t regs[WARM_RESTART_NUM_REGS];
+  for (int i = 0; i < WARM_RESTART_NUM_REGS; i++) {
+    regs[i] = GPBR->SYS_GPBR[i];
+  }
+
+  uint8_t magic = regs[0] >> 24;
+  uint8_t flags = (regs[0] >> 16) & 0xFF;
+  uint16_t crc = regs[0] & 0xFFFF;
+
+  if (magic != WARM_RESTART_MAGIC || crc != crc16(regs, flags)) {
+    DEBUG_PRINTLN("No valid warm restart checkpoint");
+    return false;
+  }
+
+  int32_t easting, northing;
+  int16_t altitudeAtDrop = regs[3] >> 16, airspeedOffset = regs[3] & 0xFFFF;
+  state.altimeterReference = regs[1];
+  memcpy(&state.altitudeFt, &regs[2], 4);
+  state.altitudeAtDropFt = altitudeAtDrop * 0.5;
+  state.airspeedOffsetPa = airspeedOffset == WARM_NO_AIRSPEED_OFFSET ? NAN : airspeedOffset * 0.1;
+  memcpy(&easting, &regs[4], 4);
+  memcpy(&northing, &regs[5], 4);
+  memcpy(&state.lastLatitudeDegrees, &regs[6], 4);
+  memcpy(&state.lastLongitudeDegrees, &regs[7], 4);
+
+  state.targetEasting = easting * 0.01;
+  state.targetNorthing = northing * 0.01;
+  state.autoDrop = flags & WARM_FLAG_AUTO_DROP;
+  state.dropBayOpen = flags & WARM_FLAG_DROPBAY_OPEN;
+  state.haveFix = flags & WARM_FLAG_HAVE_FIX;
+  state.payloadsReleased = (flags >> WARM_FLAG_PAYLOADS_SHIFT) & WARM_FLAG_PAYLOADS_MASK;
+  state.mavlink = flags & WARM_FLAG_MAVLINK;
+
+  return true;
+}
+
+void WarmRestart::save(const WarmRestartState &state) {
+
+  uint32_t regs[WARM_RESTART_NUM_REGS];
+  int32_t easting = round(state.targetEasting * 100);
+  int32_t northing = round(state.targetNorthing * 100);
+  int16_t altitudeAtDrop = constrain(round(state.altitudeAtDropFt * 2), -32767, 32767);
+  int16_t airspeedOffset = isnan(state.airspeedOffsetPa) ? WARM_NO_AIRSPEED_OFFSET : constrain(round(state.airspeedOffsetPa * 10), -32767, 32767);
+
+  regs[1] = state.altimeterReference;
+  memcpy(&regs[2], &state.altitudeFt, 4);
+  regs[3] = ((uint32_t)(uint16_t)altitudeAtDrop << 16) | (uint16_t)airspeedOffset;
+  memcpy(&regs[4], &easting, 4);
+  memcpy(&regs[5], &northing, 4);
+  memcpy(&regs[6], &state.lastLatitudeDegrees, 4);
+  memcpy(&regs[7], &state.lastLongitudeDegrees, 4);
+
+  uint8_t flags = 0;
+  if (state.autoDrop) flags |= WARM_FLAG_AUTO_DROP;
+  if (state.dropBayOpen) flags |= WARM_FLAG_DROPBAY_OPEN;
+  if (state.haveFix) flags |= WARM_FLAG_HAVE_FIX;
+  flags |= (state.payloadsReleased & WARM_FLAG_PAYLOADS_MASK) << WARM_FLAG_PAYLOADS_SHIFT;
+  if (state.mavlink) flags |= WARM_FLAG_MAVLINK;
+
+  regs[0] = ((uint32_t)WARM_RESTART_MAGIC << 24) | ((uint32_t)flags << 16) | crc16(regs, flags);
+
+  // Invalidate first and write the header last, so a reset in the middle of saving can never leave a checkpoint with a good CRC and mixed data
+  GPBR->SYS_GPBR[0] = 0;
+  for (int i = 1; i < WARM_RESTART_NUM_REGS; i++) {
+    GPBR->SYS_GPBR[i] = regs[i];
+  }
+  GPBR->SYS_GPBR[0] = regs[0];
+}
+
+void WarmRestart::invalidate() {
+  GPBR->SYS_GPBR[0] = 0;
+}
+
+//CRC-16/CCITT over registers 1-7 and the flags byte
+uint16_t WarmRestart::crc16(const uint32_t *regs, uint8_t flags) {
+
+  uint16_t crc = 0xFFFF;
+  const uint8_t *data = (const uint8_t*)&regs[1];
+  int numBytes = (WARM_RESTART_NUM_REGS - 1) * 4 + 1;
+
+  for (int i = 0; i < numBytes; i++) {
+    crc ^= (uint16_t)(i < numBytes - 1 ? data[i] : flags) << 8;
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+  }
+  return crc;
+}
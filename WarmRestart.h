@@ -0,0 +1,76 @@
+#ifndef _WARM_RESTART_H
+#define _WARM_RESTART_H
+
+#include "Arduino.h"
+
+/*
+  Warm restart support.
+
+  The SAM3X has 8 general purpose backup registers (GPBR) that live in the backup power domain. They survive a watchdog, software or
+  brown-out reset and are only cleared when the backup domain loses power. We keep a CRC protected checkpoint of the critical flight state
+  in them, so that if the processor resets mid-flight setup() can skip the slow path (XBee/GPS configuration, the 3s XBee delay and the
+  altimeter re-zero at whatever altitude we are at) and resume targeting almost immediately.
+
+  The gyro bias isn't kept (there's no room): after a warm restart it starts from 0 and the attitude filter's integral term takes it
+  out over the next tens of seconds.
+
+  Register layout (32 bits each):
+    0: magic (8 bits) | flags (8 bits) | CRC16 of registers 1-7 and the flags (16 bits)
+    1: altimeter zero reference (uint32, pressure Q18.2 Pa)
+    2: filtered altitude (float, ft)
+    3: altitude at drop (int16, 0.5 ft) | airspeed sensor zero offset (int16, 0.1 Pa, WARM_NO_AIRSPEED_OFFSET = not zeroed)
+    4: target easting (int32, cm)
+    5: target northing (int32, cm)
+    6: last fix latitude (float, degrees)
+    7: last fix longitude (float, degrees)
+*/
+
+#define WARM_RESTART_MAGIC 0xA8  //Changed with the layout, so an old checkpoint isn't misread
+#define WARM_RESTART_NUM_REGS 8
+#define WARM_NO_AIRSPEED_OFFSET INT16_MIN
+
+//Flags
+#define WARM_FLAG_AUTO_DROP 0x01
+#define WARM_FLAG_DROPBAY_OPEN 0x02
+#define WARM_FLAG_HAVE_FIX 0x04
+#define WARM_FLAG_PAYLOADS_SHIFT 3  //Bits 3-6: which payload channels have been released
+#define WARM_FLAG_PAYLOADS_MASK 0x0F
+#define WARM_FLAG_MAVLINK 0x80  //Telemetry had switched to MAVLink
+
+//Reset types as reported in RSTC_SR.RSTTYP
+#define RESET_TYPE_GENERAL 0
+#define RESET_TYPE_BACKUP 1
+#define RESET_TYPE_WATCHDOG 2
+#define RESET_TYPE_SOFTWARE 3
+#define RESET_TYPE_USER 4
+
+struct WarmRestartState {
+  uint32_t altimeterReference;
+  float altitudeFt;
+  float altitudeAtDropFt;
+  float airspeedOffsetPa;  //NAN if the airspeed sensor hadn't been zeroed
+  double targetEasting, targetNorthing;  //m (saved with cm resolution, which is what convertDeg2UTM rounds to anyway)
+  float lastLatitudeDegrees, lastLongitudeDegrees;
+  boolean autoDrop;
+  boolean dropBayOpen;
+  boolean haveFix;
+  uint8_t payloadsReleased;  //Bit per release channel
+  boolean mavlink;
+};
+
+class WarmRestart {
+
+  public:
+    WarmRestart();
+
+    boolean load(WarmRestartState &state);  //True if a valid checkpoint exists and the reset type allows a warm boot
+    void save(const WarmRestartState &state);  //Cheap (8 register writes), safe to call every slow loop
+    void invalidate();  //Forces the next boot to be a cold one
+    uint8_t getResetType();
+
+  private:
+    uint16_t crc16(const uint32_t *regs, uint8_t flags);
+
+};
+
+#endif //_WARM_RESTART_H
@@ -0,0 +1,120 @@
+#include "WindEstimator.h"
+#include "Arduino.h"
+#include "FastMath.h"
+
+WindEstimator::WindEstimator() {
+  reset();
+}
+
+void WindEstimator::reset() {
+  sw = sx = sy = sxx = sxy = syy = sxz = syz = sz = szz = 0;
+  sux = suy = 0;
+  usingAirspeed = false;
+  airspeedDropouts = 0;
+  quality = WIND_NONE;
+  windEast = windNorth = airspeed = fitError = 0;
+}
+
+void WindEstimator::addSample(float velEast, float velNorth, float trueAirspeed) {
+
+  double x = velEast, y = velNorth;
+  double speed = fastSqrt(x * x + y * y);
+  if (speed < WIND_MIN_SPEED_MPS)
+    return;
+
+  // Ride out short airspeed dropouts on the last estimate, rather than throwing the airspeed fit away
+  boolean haveAirspeed = trueAirspeed > WIND_MIN_AIRSPEED_MPS;
+  if (usingAirspeed && !haveAirspeed && ++airspeedDropouts < WIND_AIRSPEED_DROPOUT_SAMPLES)
+    return;
+  if (haveAirspeed != usingAirspeed) {
+    reset();
+    usingAirspeed = haveAirspeed;
+  }
+  if (haveAirspeed) {
+    airspeed = trueAirspeed;
+    airspeedDropouts = 0;
+  }
+  double z = x * x + y * y - (haveAirspeed ? sq((double)trueAirspeed) : 0);
+
+  double f = WIND_FORGETTING;
+  sw = f * sw + 1;
+  sx = f * sx + x;
+  sy = f * sy + y;
+  sxx = f * sxx + x * x;
+  sxy = f * sxy + x * y;
+  syy = f * syy + y * y;
+  sxz = f * sxz + x * z;
+  syz = f * syz + y * z;
+  sz = f * sz + z;
+  szz = f * szz + z * z;
+  sux = f * sux + x / speed;
+  suy = f * suy + y / speed;
+
+  if (solve()) {
+    quality = WIND_FIT;
+  }
+  else if (haveAirspeed) {
+    // Along track only: assumes the crab angle is small, so the airspeed is along the ground track too
+    double alongTrack = speed - trueAirspeed;
+    windEast = alongTrack * x / speed;
+    windNorth = alongTrack * y / speed;
+    fitError = 0;
+    quality = WIND_ALONG_TRACK;
+  }
+  else {
+    quality = WIND_NONE;
+  }
+}
+
+// Least squares for p = (2a, 2b, c) in z = p0 x + p1 y + p2:  A p = h, solved with Cramer's rule. Returns false if there is no good fit
+boolean WindEstimator::solve() {
+
+  if (sw < WIND_MIN_WEIGHT)
+    return false;
+
+  // Not enough of the circle to fit (the normal equations are near singular too)
+  if (fastSqrt(sq(sux) + sq(suy)) / sw > WIND_MAX_HEADING_CONCENTRATION)
+    return false;
+
+  double a00 = sxx, a01 = sxy, a02 = sx;
+  double a11 = syy, a12 = sy;
+  double a22 = sw;
+  double h0 = sxz, h1 = syz, h2 = sz;
+
+  double c00 = a11 * a22 - a12 * a12;
+  double c01 = a02 * a12 - a01 * a22;
+  double c02 = a01 * a12 - a02 * a11;
+  double det = a00 * c00 + a01 * c01 + a02 * c02;
+  if (det <= 0)
+    return false;
+
+  double p0 = (c00 * h0 + c01 * h1 + c02 * h2) / det;
+  double p1 = (c01 * h0 + (a00 * a22 - a02 * a02) * h1 + (a02 * a01 - a00 * a12) * h2) / det;
+  double p2 = (c02 * h0 + (a02 * a01 - a00 * a12) * h1 + (a00 * a11 - a01 * a01) * h2) / det;
+
+  double a = p0 / 2, b = p1 / 2;
+
+  // Without airspeed c = r^2 - |w|^2. With it c = -|w|^2 and the radius is the (latest) measured airspeed
+  double radius;
+  if (usingAirspeed) {
+    radius = airspeed;
+  }
+  else {
+    double radiusSq = p2 + a * a + b * b;
+    if (radiusSq <= 0)
+      return false;
+    radius = fastSqrt(radiusSq);
+  }
+
+  // Residual sum of squares, from the same sums: |z - A p|^2 = szz - 2 p.h + p.A.p  (and p.A.p = p.h at the solution)
+  double rss = szz - (p0 * h0 + p1 * h1 + p2 * h2);
+
+  if (fastSqrt(a * a + b * b) > WIND_MAX_MPS || radius < WIND_MIN_AIRSPEED_MPS)
+    return false;
+
+  windEast = a;
+  windNorth = b;
+  airspeed = radius;
+  fitError = fastSqrt(max(rss, 0.0) / sw) / (2 * radius);  //z error of e is a radial error of ~e / 2r
+  return true;
+}
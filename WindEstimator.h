@@ -0,0 +1,63 @@
+#ifndef _WIND_ESTIMATOR_H
+#define _WIND_ESTIMATOR_H
+
+#include "Arduino.h"
+
+/*
+  Wind estimate from GPS ground velocity alone.
+
+  Flying at a roughly constant airspeed, ground velocity = air velocity + wind. As the plane turns the air velocity swings round a
+  circle of radius airspeed, so the ground velocities (the hodograph) lie on a circle centred on the wind vector.
+  The circle is fit with the algebraic (Kasa) fit: x^2 + y^2 = 2a x + 2b y + c is linear in (2a, 2b, c), so it only needs running sums.
+  The sums decay by WIND_FORGETTING each sample so the fit follows a changing wind, and each sample is O(1).
+
+  A straight track only gives one point on the circle, so the estimate is only valid once the samples cover enough headings.
+
+  With an airspeed sensor the radius of each sample is known (|ground velocity - wind| = true airspeed), so the fit is of
+  x^2 + y^2 - tas^2 = 2a x + 2b y + c with c = -|wind|^2, which holds even as the airspeed changes (slow flight vs. headwind).
+  Until the turns are there for a full fit, the difference between ground speed and airspeed still gives the along track
+  (head/tail) component every fix.
+*/
+
+#define WIND_FORGETTING 0.995  //Per sample (5Hz fixes -> ~40s memory)
+#define WIND_MIN_SPEED_MPS 5.0  //Ignore samples slower than this (on the ground)
+#define WIND_MIN_WEIGHT 25.0  //Effective number of samples before the fit is trusted
+#define WIND_MAX_HEADING_CONCENTRATION 0.8  //Mean resultant length of the headings - 1 is a straight line, 0.8 is ~125 degrees of turn
+#define WIND_MAX_MPS 20.0  //Anything bigger is a bad fit
+#define WIND_MIN_AIRSPEED_MPS 5.0
+#define WIND_AIRSPEED_DROPOUT_SAMPLES 25  //Fixes without airspeed before going back to the GPS only fit
+
+//Estimate quality
+#define WIND_NONE 0
+#define WIND_ALONG_TRACK 1  //Head/tailwind only (needs airspeed)
+#define WIND_FIT 2  //Full vector from the circle fit
+
+class WindEstimator {
+
+  public:
+    WindEstimator();
+
+    void reset();
+    void addSample(float velEast, float velNorth, float trueAirspeed);  //Ground velocity (m/s) once per fix. Airspeed <= 0 if not known
+
+    boolean isValid() { return quality != WIND_NONE; }
+    uint8_t getQuality() { return quality; }
+    float getWindEast() { return windEast; }  //m/s, direction the air is moving towards
+    float getWindNorth() { return windNorth; }
+    float getAirspeed() { return airspeed; }  //Radius of the fitted circle, or the measured airspeed
+    float getFitErrorMPS() { return fitError; }  //RMS distance of the samples from the circle
+
+  private:
+    // Weighted sums of x = vE, y = vN, z = x^2 + y^2, and unit heading vectors
+    double sw, sx, sy, sxx, sxy, syy, sxz, syz, sz, szz;
+    double sux, suy;
+
+    boolean usingAirspeed;  //Which form the sums are in - they're reset if that changes
+    int airspeedDropouts;
+    uint8_t quality;
+    float windEast, windNorth, airspeed, fitError;
+
+    boolean solve();
+};
+
+#endif //_WIND_ESTIMATOR_H
@@ -40,11 +40,20 @@
 #define ANALOG_READ_CONV 3.3/4095.0 * 4.01204819  //last value: 1 / 332K /(332K + 1000K) -> voltage divider used to lower battery voltage to readable range
 //TODO - test battery voltage in charger, then check this returns correct value (resistors may be off?)
 
-// System timing variables in microseconds
+// System timing variables in milliseconds
 #define SLOW_LOOP_TIME  250  //250    //Xbee send packets of data 
 #define MEDIUM_LOOP_TIME 30  //50   // Servo updating
-#define FAST_LOOP_TIME 1  	  // MPU updating, if PID's then compute new servo values
+#define FAST_LOOP_TIME 1  	  // If PID's then compute new servo values (the IMU is updated from its data ready interrupt instead)
 #define LONG_LOOP_TIME 2000 	  // LED blinking
+#define GIMBAL_LOOP_TIME 20  // Gimbal stabilization - the servo frame rate, faster updates can't reach the servos anyway
+
+// Sleep (WFI) between loop deadlines when there is nothing to do. SysTick wakes the core every 1ms regardless, and any interrupt
+// (UART RX, TWI, pushbuttons, PWM inputs) wakes it early, so worst case latency added to incoming data is ~1ms
+#define IDLE_SLEEP
+
+// IMU mounting offsets (deg) - what the IMU reads when the plane is level. Subtracted to give current_pitch/current_roll
+#define IMU_MOUNT_PITCH_DEG 0
+#define IMU_MOUNT_ROLL_DEG 0
 
 // Hardware declerations
 #define HEARTBEAT_LED_PIN A11
@@ -53,7 +62,10 @@
 
 // ------------------------------------ DROP BAY ------------------------------------
 
-const int closeDropBayTimeout = 10000;
+// How long the bay stays open after a drop, target radius, targeting constants etc. are tunable parameters (Parameters.cpp)
+
+// Release channels fitted (pins in Communicator.h). Channel 0 is the drop bay
+#define NUM_PAYLOADS 1
 
 // ------------------------------------ TARGETING ------------------------------------
 
@@ -63,7 +75,6 @@ const int closeDropBayTimeout = 10000;
 #define TARGET_LATT 4413.5906
 #define TARGET_LONG -7629.3796
 #define TARGET_ALTITUDE_M 0 // feet
-#define TARGET_RADIUS 20 //meters
 #define MINIMUM_DROP_ALTITUDE_M 30.48 // feet
 
 // -------------------------------------------- DEBUG --------------------------------------------
@@ -90,6 +101,11 @@ const int closeDropBayTimeout = 10000;
 
 // Tests the targeting system with pre-defined GPS datapoints
 //#define Targeter_Test
+// Plays a recorded flight (ReplayData.h, made by tools/replay) into the GPS and altimeter inputs at its original timing, in place
+// of the sensors, to run and profile the whole pipeline on the bench (see FlightReplay.h)
+//#define Flight_Replay
+// Simulates the airspeed sensor (constant AIRSPEED_TEST_MPS, see MS4525DO.h) so the airspeed/wind code can run without one
+//#define Airspeed_Test
 //#define Targeter_Debug_Print  //ONLY WANT MINIMUM STUFF
 //same thing with targeting debugging (Note - includes 'drop' and 'closeDropBay' functions
 #if defined(Targeter_Test) || defined(Targeter_Debug_Print)
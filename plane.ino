@@ -6,10 +6,20 @@
 
 // #Includes
 #include "Servo.h"
+#ifdef Flight_Replay
+#include "FlightReplay.h"
+#include "ReplayData.h"
+#endif
 
 //Hardware #Includes
 #include "Communicator.h"
 #include "Adafruit_MPL3115A2.h"
+#include "MS4525DO.h"
+#include "MPU6050.h"
+#include "AttitudeFilter.h"
+#include "WarmRestart.h"
+#include "SystemClock.h"
+#include "Parameters.h"
 
 double current_pitch, current_roll;
 double base_pitch, base_roll;
@@ -17,19 +27,24 @@ double base_pitch, base_roll;
 // Altitude
 double altitudeFt;
 boolean didGetZeroAltitudeLevel = false;
+boolean reseedAltitudeFilter = false;  //The zero moved under the filter (new QNH) - restart it from the next reading
+float appliedQnhHpa = 0, appliedFieldElevationM = 0;  //What the altimeter zero was last set from (see rezeroAltimeter)
 //KalmanFilter altitudeFtFilter = new KalmanFilter();
 
 // System variables
 byte blinkState;
-long pointTime = 0;
-bool inProgress = false;
+#ifdef Flight_Replay
+FlightReplay flightReplay;
+#endif
+volatile uint64_t pointMarkTime = 0;  //Set by the pushbutton ISR
+volatile bool pointMarkPending = false;
 
 // Servo declarations
 Servo wheel_servo, l_aileron_servo, r_aileron_servo, l_Vtail_servo, r_Vtail_servo, l_flaps_servo, r_flaps_servo;
 
 volatile int pw_l_vtail= 0, pw_r_vtail= 0, pw_l_aileron= 0, pw_r_aileron= 0, pw_flaps= 0;
-volatile unsigned long pwm_l_vtail_start = 0, pwm_r_vtail_start = 0, pwm_l_aileron_start = 0, pwm_r_aileron_start = 0, pwm_flaps_start = 0;
-volatile unsigned long pwm_l_vtail_end = 0, pwm_r_vtail_end = 0, pwm_l_aileron_end = 0, 
+volatile uint64_t pwm_l_vtail_start = 0, pwm_r_vtail_start = 0, pwm_l_aileron_start = 0, pwm_r_aileron_start = 0, pwm_flaps_start = 0;
+volatile uint64_t pwm_l_vtail_end = 0, pwm_r_vtail_end = 0, pwm_l_aileron_end = 0, 
                        pwm_r_aileron_end = 0, pwm_flaps_end = 0;
 
 
@@ -47,9 +62,25 @@ Communicator comm;
 
 // Sensor declerations
 Adafruit_MPL3115A2 altimeter = Adafruit_MPL3115A2();
-
-unsigned long current_time;
-unsigned long prev_slow_time, prev_medium_time, prev_long_time;
+MS4525DO airspeedSensor;
+boolean haveAirspeedSensor = false;
+MPU6050 imu;
+AttitudeFilter attitude;
+boolean haveIMU = false;
+uint64_t lastIMUSampleTime = 0;
+uint32_t imuUpdateCount = 0, imuCyclesTotal = 0, imuCyclesMax = 0;  //Cost of the attitude filter update, reset every long loop
+
+// Checkpoint of critical state kept in the backup registers (see WarmRestart.h)
+WarmRestart warmRestart;
+WarmRestartState warmState;
+boolean isWarmBoot = false;
+
+// All in microseconds from systemMicros()
+uint64_t current_time;
+uint64_t prev_slow_time, prev_medium_time, prev_long_time, prev_gimbal_time;
+
+// CPU duty cycle measurement (time spent sleeping vs. total, reset every long loop)
+uint64_t sleepMicros = 0, dutyCycleStartMicros = 0;
 
 void setup() {
 
@@ -58,6 +89,19 @@ void setup() {
 
   DEBUG_PRINTLN("\nStarting");
 
+  // Check this before anything else - a valid checkpoint means we reset mid-flight and can skip the slow setup below
+  isWarmBoot = warmRestart.load(warmState);
+  if (isWarmBoot) {
+    DEBUG_PRINT("Warm restart, reset type = ");
+    DEBUG_PRINTLN(warmRestart.getResetType());
+  }
+  else {
+    warmRestart.invalidate();  // Don't let an old checkpoint be picked up by a reset before we have checkpointed this session
+  }
+
+  // Saved tuning (or the defaults), before anything that uses it
+  paramTable.load();
+
   // Do this first so servos are hopefully good regardless if below fails/times out/gets 'stuck'
   initializeServos();
 
@@ -87,10 +131,16 @@ void setup() {
   
 
   // Start up serial communicator
-  delay(3000);  // Give the XBee some time to start - SUPPOSEDLY IT CAN CAUSE ERRORS IF SENT DATA BEFORE XBEE READY
+  if (isWarmBoot) {
+    comm.warmInitialize(warmState);  // XBee and GPS kept their configuration, no need to wait for them
+    comm.sendMessage(MESSAGE_WARM_START);
+  }
+  else {
+    delay(3000);  // Give the XBee some time to start - SUPPOSEDLY IT CAN CAUSE ERRORS IF SENT DATA BEFORE XBEE READY
 
-  comm.initialize();
-  comm.sendMessage(MESSAGE_START);
+    comm.initialize();
+    comm.sendMessage(MESSAGE_START);
+  }
 
   // Initialize Data Acquisition System (which also preforms a DAS reset)
   initializeDAS();
@@ -107,14 +157,34 @@ void setup() {
   digitalWrite(NO_FIX_LED_PIN, HIGH);
 
   // Start system time
-  prev_medium_time = millis();
+  prev_medium_time = systemMicros();
   prev_slow_time = prev_medium_time;
   prev_long_time = prev_medium_time;
+  prev_gimbal_time = prev_medium_time;
+  dutyCycleStartMicros = prev_medium_time;
+
+  // Make sure WFI uses sleep mode (peripherals and their interrupts keep running), not wait/backup mode
+  SCB->SCR &= ~SCB_SCR_SLEEPDEEP_Msk;
+
+  enableCycleCounter();
+  if (haveIMU) {
+    attachInterrupt(IMU_INT_PIN, isr_imu_data_ready, RISING);
+  }
 
   //Setup interrupts for pushbuttons
   attachInterrupt(DROP_PUSHBUTTON_PIN,isr_drop_pushbutton, RISING);
   attachInterrupt(RESET_PUSHBUTTON_PIN,isr_reset_pushbutton, RISING);
 
+#ifdef Flight_Replay
+  // Last, so the recording's timing starts with the loop
+  if (flightReplay.begin(replayData, REPLAY_DATA_LENGTH, GPS_BYTE_TIME_US)) {
+    comm.setGPSReplay(&flightReplay);
+  }
+  else {
+    DEBUG_PRINTLN("ReplayData.h isn't a recording");
+  }
+#endif
+
   // Send message to ground station saying everything is ready
   comm.sendMessage(MESSAGE_READY);
 
@@ -123,52 +193,138 @@ void setup() {
 
 void loop() {
 
-  current_time = millis();
+  current_time = systemMicros();
 
-  unsigned long medium_time_diff = current_time - prev_medium_time;
-  unsigned long slow_time_diff = current_time - prev_slow_time;
-  unsigned long long_time_diff = current_time - prev_long_time;
+  uint32_t medium_time_diff = microsBetween(prev_medium_time, current_time);
+  uint32_t slow_time_diff = microsBetween(prev_slow_time, current_time);
+  uint32_t long_time_diff = microsBetween(prev_long_time, current_time);
+  uint32_t gimbal_time_diff = microsBetween(prev_gimbal_time, current_time);
 
   // Call loop functions in slow->fast order
   // this way, new commands are received in slow loop and implemented in faster loops
-  if (long_time_diff > LONG_LOOP_TIME) {
+  if (long_time_diff > LONG_LOOP_TIME * MICROS_PER_MILLI) {
     prev_long_time = current_time;
     longLoop();
   }
-  if (slow_time_diff > SLOW_LOOP_TIME) {
+  if (slow_time_diff > SLOW_LOOP_TIME * MICROS_PER_MILLI) {
     prev_slow_time = current_time;
     slowLoop();
   }
-  if (medium_time_diff > MEDIUM_LOOP_TIME ) {
+  if (medium_time_diff > MEDIUM_LOOP_TIME * MICROS_PER_MILLI) {
     prev_medium_time = current_time;
     mediumLoop();
   }
+  if (gimbal_time_diff > GIMBAL_LOOP_TIME * MICROS_PER_MILLI) {
+    prev_gimbal_time = current_time;
+    gimbalLoop();
+  }
 
   // Check if commands received. This function executes quickly even if a command is received
   comm.recieveCommands(current_time);
 
-  // Check if incoming data from GPS. If a full string is received, this function automatically parses it. Shouldn't take >1ms even when parsing required (which is 5x per second)
+  // Check if incoming data from the GPS receivers. If a full string is received, this function automatically parses it. Shouldn't take >1ms even when parsing required (which is 5x per second)
   comm.getSerialDataFromGPS();
 
+  // Release time is solved once per fix - this just opens the bay when it comes up
+  comm.checkReleaseSchedule();
+
+  // New IMU sample (the data ready interrupt also wakes us from the idle sleep)
+  if (haveIMU && imu.isDataReady()) {
+    updateAttitude();
+  }
+
+#ifdef IDLE_SLEEP
+  idleUntilNextDeadline();
+#endif
 }
 
+// Sleep until the next loop is due or an interrupt arrives (see IDLE_SLEEP in plane.h)
+void idleUntilNextDeadline() {
+
+  uint64_t now = systemMicros();
+
+  // Loops run once the difference is strictly greater than their period
+  uint64_t deadline = prev_medium_time + MEDIUM_LOOP_TIME * MICROS_PER_MILLI;
+  deadline = min(deadline, prev_slow_time + SLOW_LOOP_TIME * MICROS_PER_MILLI);
+  deadline = min(deadline, prev_long_time + LONG_LOOP_TIME * MICROS_PER_MILLI);
+  deadline = min(deadline, prev_gimbal_time + GIMBAL_LOOP_TIME * MICROS_PER_MILLI);
+  if (comm.isReleaseScheduled())
+    deadline = min(deadline, comm.getScheduledRelease());
+
+  if (deadline <= now)
+    return;
+
+  // Bytes (or an IMU sample) may have arrived while we were busy - those interrupts already fired, so they won't wake us
+  if (XBEE_SERIAL.available() || comm.isGPSDataAvailable() || imu.isDataReady())
+    return;
+
+  __WFI();  // Wakes on the next interrupt - at the latest the 1ms SysTick
+  sleepMicros += microsSince(now);
+}
+
+
+
+// Read the IMU and run the attitude filter. Only the filter update itself is counted in the cycle cost (the I2C read is mostly waiting)
+void updateAttitude() {
+
+  if (!imu.read())
+    return;
+
+  int32_t accelGQ16[3], gyroRadQ16[3];
+  for (int i = 0; i < 3; i++) {
+    accelGQ16[i] = IMU_ACCEL_TO_G_Q16(imu.accel[i]);
+    gyroRadQ16[i] = IMU_GYRO_TO_RAD_Q16(imu.gyro[i]);
+  }
+
+  uint32_t dt = lastIMUSampleTime == 0 ? MICROS_PER_SECOND / IMU_SAMPLE_RATE_HZ : microsBetween(lastIMUSampleTime, imu.sampleTimestamp);
+  lastIMUSampleTime = imu.sampleTimestamp;
+
+  uint32_t startCycles = cycleCount();
+  attitude.update(accelGQ16, gyroRadQ16, dt);
+  uint32_t cycles = cycleCount() - startCycles;
+
+  imuUpdateCount++;
+  imuCyclesTotal += cycles;
+  imuCyclesMax = max(imuCyclesMax, cycles);
+}
 
+// Stabilize the gimbal against the current attitude (level/no rates if there's no IMU, ie. the same as not stabilized)
+void gimbalLoop() {
+
+  if (haveIMU && attitude.isInitialized()) {
+    comm.updateGimbal(attitude.getRollDeg() - base_roll, attitude.getPitchDeg() - base_pitch, attitude.getRateDPS(0), attitude.getRateDPS(1), attitude.getRateDPS(2));
+  }
+  else {
+    comm.updateGimbal(0, 0, 0, 0, 0);
+  }
+}
 
 // TODO: possibly flaps swtiching (if down is +ve on one and -ve on other), and find optimal position
 //TODO: Tail wheel demixing
 void mediumLoop() {
-  if(inProgress) {
-    int delt = millis() - pointTime;
-    DEBUG_PRINT("Drop Pushbutton Pressed - ");
-    DEBUG_PRINTLN(delt);
-    if(delt > 1000) {
-      DEBUG_PRINTLN("In method");
-      pointTime = millis();
-      comm.markPoint();
-    }
-    inProgress = false;
+
+  // Collect the last airspeed conversion and start the next one
+  if (haveAirspeedSensor) {
+    airspeedSensor.update();
+  }
+
+  // Attitude (the filter runs at the IMU rate, the float conversion only needs to happen this often)
+  if (haveIMU && attitude.isInitialized()) {
+    current_roll = attitude.getRollDeg() - base_roll;
+    current_pitch = attitude.getPitchDeg() - base_pitch;
+    comm.setAttitude(current_roll, current_pitch);
   }
 
+  // Point mark from the pushbutton, at the time the ISR saw it
+  if (pointMarkPending) {
+    noInterrupts();  //64 bit reads aren't atomic
+    uint64_t markTime = pointMarkTime;
+    pointMarkPending = false;
+    interrupts();
+    comm.markPoint(markTime);
+  }
+  comm.sendPoints(current_time);
+
 
 /*
   Serial.print("LAil: "); Serial.print(pw_l_aileron); 
@@ -177,9 +333,6 @@ void mediumLoop() {
   Serial.print("\tRVTtail: "); Serial.print(pw_r_vtail);  //nothing/not needed
 */
 
-  //Recalculate targeting
-  comm.recalculateTargettingNow(false); //(with non-new data - projects forward with time since received GPS data
-
   //L aileron output
   /*
   if(pw_l_aileron != 0)
@@ -224,8 +377,26 @@ void mediumLoop() {
 // slow loop was timed to take between 1.3 and 1.7ms.
 void slowLoop() {
 
+  // QNH parameters changed from the ground
+  if (params.altimeterQnhHpa != appliedQnhHpa || params.fieldElevationM != appliedFieldElevationM) {
+    if (params.altimeterQnhHpa > 0) {
+      rezeroAltimeter();
+    }
+    else {
+      // Cleared: we may be in the air, so keep the zero the QNH gave. The ground calibration waits for the next reset/restart
+      appliedQnhHpa = params.altimeterQnhHpa;
+      appliedFieldElevationM = params.fieldElevationM;
+    }
+  }
+
   // Get latest altitude data
+#ifdef Flight_Replay
+  uint32_t replayPressure;
+  int32_t replayTemperature;
+  double altitudeReadInFt = flightReplay.getAltimeterSample(replayPressure, replayTemperature) ? altimeter.getAltitudeFt(replayPressure, replayTemperature) : -999;
+#else
   double altitudeReadInFt = altimeter.getAltitudeFt(false);
+#endif
 
   // Altitude = -999 means a timeout occured
   if (altitudeReadInFt > -990) {
@@ -234,10 +405,20 @@ void slowLoop() {
     //DEBUG_PRINTLN(altitudeReadIn);
 
     if (!didGetZeroAltitudeLevel) {
-      didGetZeroAltitudeLevel = true;
-      altimeter.zero();
+      // Zeroing averages several samples in the background (see Adafruit_MPL3115A2.h) - report 0 until it's done
       altitudeFt = 0;
-      //altitudeFt = altimeter.getAltitudeFt(false);  //now get a correctly zerod altitude
+      if (altimeter.getCalibrationState() == ALTIMETER_UNCALIBRATED) {
+        altimeter.startCalibration();  //First time, or the last attempt failed
+      }
+      else if (altimeter.getCalibrationState() == ALTIMETER_CALIBRATED) {
+        didGetZeroAltitudeLevel = true;
+        seedAltitudeFtFilter(0);
+      }
+    }
+    else if (reseedAltitudeFilter) {
+      reseedAltitudeFilter = false;
+      altitudeFt = altitudeReadInFt;
+      seedAltitudeFtFilter(altitudeFt);
     }
     else {
       //altitudeFt = altitudeReadInFt;
@@ -253,6 +434,8 @@ void slowLoop() {
 
   // Pass new data to serial communicator
   comm.altitudeFt = altitudeFt;
+  comm.trueAirspeedMPS = (haveAirspeedSensor && airspeedSensor.isValid()) ? airspeedSensor.getTrueAirspeed(altimeter.getStaticPressurePa(), altimeter.getLastTemperatureC()) : 0;
+  attitude.setSpeed(comm.trueAirspeedMPS > 0 ? comm.trueAirspeedMPS : comm.getGroundSpeedMPS());
 
   // Send data to XBee
   comm.sendData();
@@ -264,7 +447,8 @@ void slowLoop() {
     comm.reset = false;
     resetDAS();
     comm.sendMessage(MESSAGE_RESET_AKN);
-    didGetZeroAltitudeLevel = false; //re-zero
+    comm.resetPoints();
+    rezeroAltimeter();
     comm.altitudeAtDropFt = -1;  //also reset the altitude at drop
 
   }
@@ -274,13 +458,73 @@ void slowLoop() {
     comm.restart = false;
     resetDAS();
     comm.sendMessage(MESSAGE_RESTART_AKN);
-    didGetZeroAltitudeLevel = false; //re-zero
+    rezeroAltimeter();
+  }
+
+  // Checkpoint for a warm restart. Only once we have a zero reference, otherwise there is nothing worth resuming
+  if (didGetZeroAltitudeLevel) {
+    saveWarmRestartState();
+  }
+}
+
+// From the field's QNH if one is set (parameters), which works in the air too. Otherwise by calibrating here, in the background
+void rezeroAltimeter() {
+  if (params.altimeterQnhHpa > 0) {
+    altimeter.setQnh(params.altimeterQnhHpa * 100, params.fieldElevationM);
+    didGetZeroAltitudeLevel = true;
+    reseedAltitudeFilter = true;
   }
+  else {
+    altimeter.startCalibration();
+    didGetZeroAltitudeLevel = false;
+  }
+  appliedQnhHpa = params.altimeterQnhHpa;
+  appliedFieldElevationM = params.fieldElevationM;
+}
+
+void saveWarmRestartState() {
+  warmState.altimeterReference = altimeter.getReferencePressure();
+  warmState.altitudeFt = altitudeFt;
+  warmState.airspeedOffsetPa = airspeedSensor.getOffset();
+  comm.fillWarmRestartState(warmState);
+  warmRestart.save(warmState);
 }
 
 void longLoop() {
   blinkState = !blinkState;
   digitalWrite(HEARTBEAT_LED_PIN, blinkState);
+
+  // Report CPU duty cycle over the last long loop (100% when IDLE_SLEEP is disabled)
+  // Current draw scales roughly linearly between the datasheet's run and sleep mode currents with this number
+  uint64_t nowMicros = systemMicros();
+  float dutyCyclePercent = 100.0 * (1.0 - (float)sleepMicros / (float)microsBetween(dutyCycleStartMicros, nowMicros));
+  sleepMicros = 0;
+  dutyCycleStartMicros = nowMicros;
+
+  DEBUG_PRINT("CPU duty cycle (%): ");
+  DEBUG_PRINTLN(dutyCyclePercent);
+
+  // Attitude filter rate and cost per update (84 cycles = 1us)
+  if (haveIMU && imuUpdateCount > 0) {
+    DEBUG_PRINT("IMU updates (Hz): ");
+    DEBUG_PRINT(imuUpdateCount * 1000.0 / LONG_LOOP_TIME);
+    DEBUG_PRINT("  cycles avg/max: ");
+    DEBUG_PRINT(imuCyclesTotal / imuUpdateCount);
+    DEBUG_PRINT(" / ");
+    DEBUG_PRINTLN(imuCyclesMax);
+  }
+  imuUpdateCount = imuCyclesTotal = imuCyclesMax = 0;
+
+#ifdef Flight_Replay
+  DEBUG_PRINT("Replay (s): ");
+  DEBUG_PRINT(flightReplay.getPositionMs() / 1000.0);
+  DEBUG_PRINT(flightReplay.isFinished() ? "  finished" : "");
+  DEBUG_PRINT("  NMEA overruns: ");
+  DEBUG_PRINTLN(flightReplay.getOverruns());
+#endif
+
+  comm.sendWind();
+  comm.sendPointStatus();
 }
 
 // Initialize servo locations
@@ -330,6 +574,23 @@ void initializeDAS() {
   // Initialize sensors
   altimeter.begin();
   altimeter.setReadTimeout(10);
+  haveAirspeedSensor = airspeedSensor.begin(!isWarmBoot);  //Zeroes on a cold start, so the pitot must be out of the wind then
+  haveIMU = imu.begin(!isWarmBoot);  //Gyro bias calibration on a cold start, so keep the plane still. Not kept on a warm one (WarmRestart.h)
+  base_pitch = IMU_MOUNT_PITCH_DEG;
+  base_roll = IMU_MOUNT_ROLL_DEG;
+
+  // On a warm restart keep the zero from before the reset - we are probably in the air, so re-zeroing here would be wrong
+  if (isWarmBoot) {
+    altimeter.setReferencePressure(warmState.altimeterReference);
+    if (!isnan(warmState.airspeedOffsetPa)) {
+      airspeedSensor.setOffset(warmState.airspeedOffsetPa);  //Otherwise no airspeed (the wind estimate goes without) until a cold boot
+    }
+    appliedQnhHpa = params.altimeterQnhHpa;  //Whatever it came from, the zero is already right
+    appliedFieldElevationM = params.fieldElevationM;
+    altitudeFt = warmState.altitudeFt;
+    seedAltitudeFtFilter(altitudeFt);
+    didGetZeroAltitudeLevel = true;
+  }
 
   // Preform DAS reset
   resetDAS();
@@ -369,6 +630,11 @@ int tail_wheel_demixing(int leftSignal, int rightSignal) {
 
 /************ ISR's *****************/
 
+//IMU sample ready - just flag it, the main loop does the I2C read
+void isr_imu_data_ready() {
+  imu.dataReadyISR();
+}
+
 //Pusbuttons
 void isr_drop_pushbutton() {
   /*
@@ -385,9 +651,13 @@ void isr_drop_pushbutton() {
   */
   //TODO - ensure doesn't become active on first push
   //TODO - decide on altitude filtering
-  //TODO - debouncing (only accept trigger if >5s after previous push
-  if(inProgress) return;
-  inProgress = true;
+  // Timestamp the mark here - the loop only gets to it up to a medium loop later
+  static uint64_t lastPress = 0;
+  uint64_t now = systemMicros();
+  if (pointMarkPending || microsBetween(lastPress, now) < POINT_DEBOUNCE_MS * MICROS_PER_MILLI) return;
+  lastPress = now;
+  pointMarkTime = now;
+  pointMarkPending = true;
 }
 
 void isr_reset_pushbutton()
@@ -409,10 +679,10 @@ void isr_reset_pushbutton()
 void isr_rising_r_vtail()
 {
   // Find current time in microseconds
-  pwm_r_vtail_start = micros();
+  pwm_r_vtail_start = systemMicros();
 
   // Find difference between this rising edge and last falling edge
-  int low_time = pwm_r_vtail_start - pwm_r_vtail_end;
+  uint32_t low_time = microsBetween(pwm_r_vtail_end, pwm_r_vtail_start);
 
   // If it's been long enough since last falling edge (ie. isn't just debouncing) then attach falling interrupt
   if (low_time > 1000) {
@@ -427,10 +697,10 @@ void isr_rising_r_vtail()
 void isr_rising_l_vtail()
 {
   // Find current time in microseconds
-  pwm_l_vtail_start = micros();
+  pwm_l_vtail_start = systemMicros();
 
   // Find difference between this rising edge and last falling edge
-  int low_time = pwm_l_vtail_start - pwm_l_vtail_end;
+  uint32_t low_time = microsBetween(pwm_l_vtail_end, pwm_l_vtail_start);
 
   // If it's been long enough since last falling edge (ie. isn't just debouncing) then attach falling interrupt
   if (low_time > 1000) {
@@ -445,10 +715,10 @@ void isr_rising_l_vtail()
 void isr_rising_r_aileron()
 {
   // Find current time in microseconds
-  pwm_r_aileron_start = micros();
+  pwm_r_aileron_start = systemMicros();
 
   // Find difference between this rising edge and last falling edge
-  int low_time = pwm_r_aileron_start - pwm_r_aileron_end;
+  uint32_t low_time = microsBetween(pwm_r_aileron_end, pwm_r_aileron_start);
 
   // If it's been long enough since last falling edge (ie. isn't just debouncing) then attach falling interrupt
   if (low_time > 1000) {
@@ -462,10 +732,10 @@ void isr_rising_r_aileron()
 void isr_rising_l_aileron()
 {
   // Find current time in microseconds
-  pwm_l_aileron_start = micros();
+  pwm_l_aileron_start = systemMicros();
 
   // Find difference between this rising edge and last falling edge
-  int low_time = pwm_l_aileron_start - pwm_l_aileron_end;
+  uint32_t low_time = microsBetween(pwm_l_aileron_end, pwm_l_aileron_start);
 
   // If it's been long enough since last falling edge (ie. isn't just debouncing) then attach falling interrupt
   if (low_time > 1000) {
@@ -478,10 +748,10 @@ void isr_rising_l_aileron()
 void isr_rising_flaps()
 {
   // Find current time in microseconds
-  pwm_flaps_start = micros();
+  pwm_flaps_start = systemMicros();
 
   // Find difference between this rising edge and last falling edge
-  int low_time = pwm_flaps_start - pwm_flaps_end;
+  uint32_t low_time = microsBetween(pwm_flaps_end, pwm_flaps_start);
 
   // If it's been long enough since last falling edge (ie. isn't just debouncing) then attach falling interrupt
   if (low_time > 1000) {
@@ -497,10 +767,10 @@ void isr_rising_flaps()
 void isr_falling_r_vtail()
 {
   // Find current time in microseconds
-  pwm_r_vtail_end = micros();
+  pwm_r_vtail_end = systemMicros();
 
   // Find difference between this rising edge and last falling edge
-  int high_time = pwm_r_vtail_end - pwm_r_vtail_start;
+  uint32_t high_time = microsBetween(pwm_r_vtail_start, pwm_r_vtail_end);
 
   // If it's been long enough since last falling edge (ie. isn't just debouncing) then attach falling interrupt
   if (high_time > 800 && high_time < 2200) {
@@ -519,10 +789,10 @@ void isr_falling_l_vtail()
 {
 
     // Find current time in microseconds
-  pwm_l_vtail_end = micros();
+  pwm_l_vtail_end = systemMicros();
 
   // Find difference between this rising edge and last falling edge
-  int high_time = pwm_l_vtail_end - pwm_l_vtail_start;
+  uint32_t high_time = microsBetween(pwm_l_vtail_start, pwm_l_vtail_end);
 
   // If it's been long enough since last falling edge (ie. isn't just debouncing) then attach falling interrupt
   if (high_time > 800 && high_time < 2200) {
@@ -540,10 +810,10 @@ void isr_falling_r_aileron()
 {
 
     // Find current time in microseconds
-  pwm_r_aileron_end = micros();
+  pwm_r_aileron_end = systemMicros();
 
   // Find difference between this rising edge and last falling edge
-  int high_time = pwm_r_aileron_end - pwm_r_aileron_start;
+  uint32_t high_time = microsBetween(pwm_r_aileron_start, pwm_r_aileron_end);
 
   // If it's been long enough since last falling edge (ie. isn't just debouncing) then attach falling interrupt
   if (high_time > 800 && high_time < 2200) {
@@ -558,10 +828,10 @@ void isr_falling_r_aileron()
 void isr_falling_l_aileron()
 {
     // Find current time in microseconds
-  pwm_l_aileron_end = micros();
+  pwm_l_aileron_end = systemMicros();
 
   // Find difference between this rising edge and last falling edge
-  int high_time = pwm_l_aileron_end - pwm_l_aileron_start;
+  uint32_t high_time = microsBetween(pwm_l_aileron_start, pwm_l_aileron_end);
 
   // If it's been long enough since last falling edge (ie. isn't just debouncing) then attach falling interrupt
   if (high_time > 800 && high_time < 2200) {
@@ -577,10 +847,10 @@ void isr_falling_flaps()
 {
 
     // Find current time in microseconds
-  pwm_flaps_end = micros();
+  pwm_flaps_end = systemMicros();
 
   // Find difference between this rising edge and last falling edge
-  int high_time = pwm_flaps_end - pwm_flaps_start;
+  uint32_t high_time = microsBetween(pwm_flaps_start, pwm_flaps_end);
 
   // If it's been long enough since last falling edge (ie. isn't just debouncing) then attach falling interrupt
   if (high_time > 800 && high_time < 2200) {
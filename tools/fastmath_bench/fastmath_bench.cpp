@@ -0,0 +1,167 @@
+/*
+  FastMath accuracy and speed benchmark (host side).
+
+  Builds the sketch's FastMath.cpp as is, and for each function and type:
+    - the max error against libm in double over a sweep (absolute for trig, in radians for angles; relative for sqrt), which is
+      where the bounds in FastMath.h come from
+    - ns per call, next to libm's float and double versions
+
+  The timings are the host's, with an FPU. On the Due everything float/double is soft float, so libm's trig is much slower there
+  relative to the integer kernels than it is here - the ratios are a floor, not the real speedup. Accuracy carries over exactly.
+
+  Build:  g++ -std=c++11 -O2 -I../.. -o fastmath_bench fastmath_bench.cpp ../../FastMath.cpp
+  Run:    ./fastmath_bench [samples]
+*/
+
+#include "FastMath.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+static int samples = 1000000;
+static volatile double sink;
+
+struct Row {
+  const char *name;
+  double maxError;  //-1 for the libm references
+  double ns;
+};
+
+static std::vector<Row> rows;
+
+template <class F> static double timeNs(F f) {
+  auto start = std::chrono::steady_clock::now();
+  double acc = 0;
+  for (int i = 0; i < samples; i++) acc += f(i);
+  sink = acc;
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / samples;
+}
+
+static void add(const char *name, double maxError, double ns) {
+  rows.push_back({name, maxError, ns});
+}
+
+static double angleError(double a, double b) {
+  return std::fabs(std::remainder(a - b, 2 * M_PI));
+}
+
+int main(int argc, char **argv) {
+
+  if (argc > 1) samples = atoi(argv[1]);
+
+  std::mt19937_64 rng(1);
+  std::uniform_real_distribution<double> angle(-M_PI, M_PI), unit(-1, 1), exponent(-20, 20);
+  std::vector<float> af(samples), yf(samples), xf(samples), sf(samples), pf(samples);
+  std::vector<double> ad(samples), yd(samples), xd(samples), pd(samples);
+  std::vector<FixedQ16> aq(samples), yq(samples), xq(samples), pq(samples);
+  for (int i = 0; i < samples; i++) {
+    ad[i] = angle(rng);
+    af[i] = (float)ad[i];
+    aq[i] = FixedQ16::fromRaw(lround(ad[i] * 65536));
+    double scale = std::pow(2.0, exponent(rng));
+    yd[i] = unit(rng) * scale;
+    xd[i] = unit(rng) * scale;
+    yf[i] = (float)yd[i];
+    xf[i] = (float)xd[i];
+    yq[i] = FixedQ16::fromRaw(lround(unit(rng) * 65536 * 1000));
+    xq[i] = FixedQ16::fromRaw(lround(unit(rng) * 65536 * 1000));
+    sf[i] = (float)unit(rng);
+    pd[i] = std::pow(2.0, exponent(rng) * 3) * (1 + unit(rng) * 0.5);
+    pf[i] = (float)pd[i];
+    pq[i] = FixedQ16::fromRaw(rng() & 0x7fffffff);
+  }
+
+  // Every binary angle step of the table is covered by the sweep below too, so the interpolation worst case is found
+  double e = 0;
+  for (int64_t a = 0; a < (1LL << 32); a += 4099) {
+    e = std::max(e, std::fabs(sinQ30((uint32_t)a) / (double)ONE_Q30 - std::sin(a * ANGLE_TO_RAD)));
+  }
+  add("sinQ30 (kernel)", e, timeNs([&](int i) { return (double)sinQ30((uint32_t)(i * 2654435761u)); }));
+
+  e = 0;
+  for (int i = 0; i < samples; i++) e = std::max(e, std::fabs(fastSin(af[i]) - std::sin((double)af[i])));
+  add("fastSin float", e, timeNs([&](int i) { return fastSin(af[i]); }));
+  add("sinf (libm)", -1, timeNs([&](int i) { return sinf(af[i]); }));
+
+  e = 0;
+  for (int i = 0; i < samples; i++) e = std::max(e, std::fabs(fastSin(ad[i]) - std::sin(ad[i])));
+  add("fastSin double", e, timeNs([&](int i) { return fastSin(ad[i]); }));
+  add("sin (libm)", -1, timeNs([&](int i) { return std::sin(ad[i]); }));
+
+  e = 0;
+  for (int i = 0; i < samples; i++) {
+    float s, c;
+    fastSinCos(af[i], s, c);
+    e = std::max(e, std::max(std::fabs(s - std::sin((double)af[i])), std::fabs(c - std::cos((double)af[i]))));
+  }
+  add("fastSinCos float", e, timeNs([&](int i) { float s, c; fastSinCos(af[i], s, c); return s + c; }));
+
+  e = 0;
+  for (int i = 0; i < samples; i++) e = std::max(e, std::fabs(fastSin(aq[i]).raw / 65536.0 - std::sin(aq[i].raw / 65536.0)));
+  add("fastSin Q16", e, timeNs([&](int i) { return (double)fastSin(aq[i]).raw; }));
+
+  e = 0;
+  for (int i = 0; i < samples; i++) e = std::max(e, angleError(atan2Angle(yq[i].raw, xq[i].raw) * ANGLE_TO_RAD, std::atan2((double)yq[i].raw, (double)xq[i].raw)));
+  add("atan2Angle (kernel)", e, timeNs([&](int i) { return (double)atan2Angle(yq[i].raw, xq[i].raw); }));
+
+  e = 0;
+  for (int i = 0; i < samples; i++) e = std::max(e, angleError(fastAtan2(yf[i], xf[i]), std::atan2((double)yf[i], (double)xf[i])));
+  add("fastAtan2 float", e, timeNs([&](int i) { return fastAtan2(yf[i], xf[i]); }));
+  add("atan2f (libm)", -1, timeNs([&](int i) { return atan2f(yf[i], xf[i]); }));
+
+  e = 0;
+  for (int i = 0; i < samples; i++) e = std::max(e, angleError(fastAtan2(yd[i], xd[i]), std::atan2(yd[i], xd[i])));
+  add("fastAtan2 double", e, timeNs([&](int i) { return fastAtan2(yd[i], xd[i]); }));
+  add("atan2 (libm)", -1, timeNs([&](int i) { return std::atan2(yd[i], xd[i]); }));
+
+  e = 0;
+  for (int i = 0; i < samples; i++) e = std::max(e, angleError(fastAtan2(yq[i], xq[i]).raw / 65536.0, std::atan2((double)yq[i].raw, (double)xq[i].raw)));
+  add("fastAtan2 Q16", e, timeNs([&](int i) { return (double)fastAtan2(yq[i], xq[i]).raw; }));
+
+  e = 0;
+  for (int i = 0; i < samples; i++) e = std::max(e, std::fabs(fastAsin(sf[i]) - std::asin((double)sf[i])));
+  add("fastAsin float", e, timeNs([&](int i) { return fastAsin(sf[i]); }));
+  add("asinf (libm)", -1, timeNs([&](int i) { return asinf(sf[i]); }));
+
+  e = 0;
+  for (int i = 0; i < samples; i++) e = std::max(e, std::fabs(fastSqrt(pf[i]) / std::sqrt((double)pf[i]) - 1));
+  add("fastSqrt float (rel)", e, timeNs([&](int i) { return fastSqrt(pf[i]); }));
+  add("sqrtf (libm)", -1, timeNs([&](int i) { return sqrtf(pf[i]); }));
+
+  e = 0;
+  for (int i = 0; i < samples; i++) e = std::max(e, std::fabs(fastSqrt(pd[i]) / std::sqrt(pd[i]) - 1));
+  add("fastSqrt double (rel)", e, timeNs([&](int i) { return fastSqrt(pd[i]); }));
+  add("sqrt (libm)", -1, timeNs([&](int i) { return std::sqrt(pd[i]); }));
+
+  e = 0;
+  for (int i = 0; i < samples; i++) e = std::max(e, std::fabs(fastSqrt(pq[i]).raw - std::floor(std::sqrt(pq[i].raw * 65536.0))));
+  add("fastSqrt Q16 (LSB)", e, timeNs([&](int i) { return (double)fastSqrt(pq[i]).raw; }));
+
+  e = 0;
+  for (int i = 0; i < samples; i++) {
+    uint32_t x = (uint32_t)rng();
+    e = std::max(e, std::fabs(isqrt32(x) - std::floor(std::sqrt((double)x))));
+  }
+  add("isqrt32 (LSB)", e, timeNs([&](int i) { return (double)isqrt32((uint32_t)(i * 2654435761u)); }));
+
+  e = 0;
+  for (int i = 0; i < samples; i++) {
+    uint32_t x = (uint32_t)rng() | 1;
+    e = std::max(e, std::fabs(lnQ24(x) / 16777216.0 - std::log((double)x)));
+  }
+  add("lnQ24", e, timeNs([&](int i) { return (double)lnQ24((uint32_t)(i * 2654435761u) | 1); }));
+  add("logf (libm)", -1, timeNs([&](int i) { return logf(pf[i]); }));
+
+  printf("%-24s %14s %10s\n", "function", "max error", "ns/call");
+  for (const Row &r : rows) {
+    if (r.maxError >= 0)
+      printf("%-24s %14.3g %10.1f\n", r.name, r.maxError, r.ns);
+    else
+      printf("%-24s %14s %10.1f\n", r.name, "-", r.ns);
+  }
+  return 0;
+}
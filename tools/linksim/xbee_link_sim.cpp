@@ -0,0 +1,431 @@
+/*
+  XBee link simulator (host side, Linux/macOS).
+
+  Opens two pseudo terminals - the plane end and the ground end - and passes bytes between them the way a pair of XBees in transparent
+  mode would, so telemetry/uplink changes can be tried on a desk. Connect the plane end to whatever stands in for XBEE_SERIAL (a host
+  build of the sketch, or a script replaying a log) and the ground station to the ground end.
+
+  Each direction models:
+    - the UART into the sending XBee (bytes can't arrive faster than the baud rate)
+    - the XBee's serial input buffer (no flow control, so bytes arriving with it full are lost, like on the plane)
+    - packetization: an RF packet goes out when the buffer holds a full payload, or the UART has been idle for RO character times
+    - the air data rate plus per packet overhead (PHY/MAC headers, the ack and turnaround)
+    - packet loss with bursts (Gilbert-Elliott: a good state with --loss, and a bad state that loses everything, entered with
+      probability --burst-enter per transmission and lasting --burst-len transmissions on average), with MAC retries
+    - fixed latency plus jitter (delivery stays in order)
+
+  Every --report seconds (and on exit) it prints, per direction, the offered load, goodput, buffer overflow losses, RF packets
+  sent/retried/lost, and message latency - first byte in to last byte out - with messages delimited by --framing:
+    legacy   *<type> ... ee packets, and single characters for the uplink (best effort - binary fields can contain "ee")
+    mavlink  MAVLink v2 frames
+    none     each RF packet is a message
+
+  Build:  g++ -std=c++11 -O2 -o xbee_link_sim xbee_link_sim.cpp -lutil
+  Run:    ./xbee_link_sim --plane-link /tmp/plane_xbee --ground-link /tmp/ground_xbee --loss 0.02 --burst-enter 0.01
+*/
+
+#include <cerrno>
+#include <cmath>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <random>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#if defined(__APPLE__)
+#include <util.h>
+#else
+#include <pty.h>
+#endif
+
+struct Config {
+  double baud = 115200;  //UART at both ends
+  double airRate = 250000;  //bits/s over the air
+  int rfPayload = 100;  //Max bytes per RF packet
+  int rfOverhead = 30;  //Bytes of air time per packet on top of the payload
+  int inputBuffer = 202;  //XBee serial input buffer
+  double roChars = 3;  //Packetization timeout, in character times
+  double loss = 0;  //Per transmission, good state
+  double burstEnter = 0;
+  double burstLen = 5;
+  int retries = 3;
+  double latencyMs = 2;
+  double jitterMs = 1;
+  double reportS = 5;
+  std::string framing = "legacy";
+  std::string planeLink, groundLink;
+  unsigned int seed = 1;
+};
+
+static Config cfg;
+static std::mt19937 rng;
+static volatile sig_atomic_t quit = 0;
+
+static double nowS() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double uniform() {
+  return std::uniform_real_distribution<double>(0, 1)(rng);
+}
+
+// Splits a byte stream into messages for latency measurement
+class Framer {
+
+  public:
+    explicit Framer(const std::string &mode) : mode(mode) {}
+
+    // True if c is the last byte of a message
+    bool push(uint8_t c) {
+      if (mode == "mavlink") {
+        if (ind == 0 && c != 0xFD) return false;  //Between frames
+        if (ind == 1) need = 12 + c;  //Header + payload + CRC (a signed frame's signature is skipped as noise)
+        if (++ind < 2 || ind < need) return false;
+        ind = 0;
+        return true;
+      }
+      if (mode == "legacy") {
+        if (ind == 0) {
+          if (c != '*') return true;  //Single character command
+          ind = 1;
+          return false;
+        }
+        bool end = (prev == 'e' && c == 'e' && ind > 2);
+        prev = c;
+        ind++;
+        if (end) ind = 0, prev = 0;
+        return end;
+      }
+      return false;  //"none": the caller ends a message per packet
+    }
+
+  private:
+    std::string mode;
+    int ind = 0, need = 0;
+    uint8_t prev = 0;
+};
+
+struct TimedByte {
+  uint8_t c;
+  double in;  //When it entered the sending XBee (s)
+};
+
+struct RfPacket {
+  std::vector<TimedByte> bytes;
+  double deliverAt;
+};
+
+struct Stats {
+  uint64_t offered = 0, delivered = 0, overflow = 0;
+  uint64_t packets = 0, retries = 0, lost = 0;
+  std::vector<double> latencies;  //s, per message
+
+  void reset() { *this = Stats(); }
+};
+
+class Direction {
+
+  public:
+    Direction(const char *name, int from, int to) : name(name), from(from), to(to), framer(cfg.framing) {}
+
+    const char *name;
+    int from, to;
+    Stats interval, total;
+
+    void read(double now) {
+      uint8_t buf[512];
+      ssize_t n;
+      while ((n = ::read(from, buf, sizeof(buf))) > 0) {
+        for (ssize_t i = 0; i < n; i++) {
+          uartTime = std::max(now, uartTime) + 10 / cfg.baud;  //8N1
+          uart.push_back({buf[i], uartTime});
+          interval.offered++;
+        }
+      }
+    }
+
+    void step(double now) {
+
+      // UART -> input buffer
+      while (!uart.empty() && uart.front().in <= now) {
+        if ((int)input.size() >= cfg.inputBuffer) {
+          interval.overflow++;
+        }
+        else {
+          input.push_back(uart.front());
+          lastInput = uart.front().in;
+        }
+        uart.pop_front();
+      }
+
+      // Input buffer -> air
+      bool idle = now - lastInput >= cfg.roChars * 10 / cfg.baud;
+      while (now >= radioFree && !input.empty() && ((int)input.size() >= cfg.rfPayload || idle)) {
+        send(std::max(now, radioFree));
+      }
+
+      // Air -> other end
+      while (!air.empty() && air.front().deliverAt <= now) {
+        deliver(air.front(), now);
+        air.pop_front();
+      }
+    }
+
+    double nextEvent() {
+      double t = 1e300;
+      if (!uart.empty()) t = std::min(t, uart.front().in);
+      if (!input.empty()) t = std::min(t, std::max(radioFree, lastInput + cfg.roChars * 10 / cfg.baud));
+      if (!air.empty()) t = std::min(t, air.front().deliverAt);
+      return t;
+    }
+
+  private:
+    Framer framer;
+    std::deque<TimedByte> uart, input;
+    std::deque<RfPacket> air;
+    double uartTime = 0, lastInput = 0, radioFree = 0, lastDelivery = 0;
+    bool burst = false;
+    double messageStart = -1;
+
+    // One transmission attempt: true if it got through
+    bool attempt() {
+      if (burst) {
+        if (uniform() < 1 / cfg.burstLen) burst = false;
+      }
+      else if (uniform() < cfg.burstEnter) {
+        burst = true;
+      }
+      return !burst && uniform() >= cfg.loss;
+    }
+
+    void send(double start) {
+
+      RfPacket p;
+      int n = std::min((int)input.size(), cfg.rfPayload);
+      p.bytes.assign(input.begin(), input.begin() + n);
+      input.erase(input.begin(), input.begin() + n);
+
+      double airTime = (n + cfg.rfOverhead) * 8 / cfg.airRate;
+      double t = start;
+      bool ok = false;
+      interval.packets++;
+      for (int a = 0; a <= cfg.retries && !ok; a++) {
+        if (a > 0) {
+          interval.retries++;
+          t += uniform() * 0.002;  //Random backoff before the retry
+        }
+        t += airTime;
+        ok = attempt();
+      }
+      radioFree = t;
+
+      if (!ok) {
+        interval.lost++;
+        messageStart = -1;  //Whatever message this was part of is broken
+        return;
+      }
+
+      double jitter = cfg.jitterMs > 0 ? uniform() * cfg.jitterMs / 1000 : 0;
+      p.deliverAt = std::max(t + cfg.latencyMs / 1000 + jitter, lastDelivery);
+      lastDelivery = p.deliverAt;
+      air.push_back(p);
+    }
+
+    void deliver(const RfPacket &p, double now) {
+
+      std::vector<uint8_t> out;
+      for (const TimedByte &b : p.bytes) {
+        out.push_back(b.c);
+        if (messageStart < 0) messageStart = b.in;
+        if (framer.push(b.c)) {
+          interval.latencies.push_back(now - messageStart);
+          messageStart = -1;
+        }
+      }
+      if (cfg.framing == "none" && !p.bytes.empty()) {
+        interval.latencies.push_back(now - p.bytes.front().in);
+        messageStart = -1;
+      }
+
+      // The ground station or firmware may not be reading yet - drop rather than block the other direction
+      ssize_t written = ::write(to, out.data(), out.size());
+      if (written > 0) interval.delivered += written;
+    }
+};
+
+static void accumulate(Stats &total, const Stats &s) {
+  total.offered += s.offered;
+  total.delivered += s.delivered;
+  total.overflow += s.overflow;
+  total.packets += s.packets;
+  total.retries += s.retries;
+  total.lost += s.lost;
+  total.latencies.insert(total.latencies.end(), s.latencies.begin(), s.latencies.end());
+}
+
+static double percentile(std::vector<double> v, double p) {
+  if (v.empty()) return 0;
+  std::sort(v.begin(), v.end());
+  return v[std::min(v.size() - 1, (size_t)(p * v.size()))];
+}
+
+static void report(const char *name, const Stats &s, double seconds) {
+  double mean = 0;
+  for (double l : s.latencies) mean += l;
+  if (!s.latencies.empty()) mean /= s.latencies.size();
+
+  printf("%-13s offered %7.0f B/s  goodput %7.0f B/s  overflow %llu B  rf %llu pkts, %llu retries, %llu lost  "
+         "msgs %zu  latency ms mean %.1f p50 %.1f p95 %.1f max %.1f\n",
+         name, s.offered / seconds, s.delivered / seconds, (unsigned long long)s.overflow, (unsigned long long)s.packets,
+         (unsigned long long)s.retries, (unsigned long long)s.lost, s.latencies.size(), mean * 1000,
+         percentile(s.latencies, 0.5) * 1000, percentile(s.latencies, 0.95) * 1000, percentile(s.latencies, 1.0) * 1000);
+  fflush(stdout);
+}
+
+static int openEnd(const char *label, const std::string &link) {
+
+  int master, slave;
+  char name[256];
+  if (openpty(&master, &slave, name, NULL, NULL) < 0) {
+    perror("openpty");
+    exit(1);
+  }
+
+  termios t;
+  tcgetattr(slave, &t);
+  cfmakeraw(&t);
+  tcsetattr(slave, TCSANOW, &t);
+  fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+  // The slave stays open so the master doesn't see a hangup while the other process isn't connected
+
+  if (!link.empty()) {
+    unlink(link.c_str());
+    if (symlink(name, link.c_str()) < 0) {
+      perror("symlink");
+      exit(1);
+    }
+  }
+  printf("%s end: %s%s%s\n", label, name, link.empty() ? "" : " -> ", link.c_str());
+  return master;
+}
+
+static void usage() {
+  fprintf(stderr,
+          "usage: xbee_link_sim [options]\n"
+          "  --plane-link PATH     symlink to the plane end's pty\n"
+          "  --ground-link PATH    symlink to the ground end's pty\n"
+          "  --baud N              UART baud at both ends (%.0f)\n"
+          "  --air-rate N          air data rate, bits/s (%.0f)\n"
+          "  --rf-payload N        max bytes per RF packet (%d)\n"
+          "  --rf-overhead N       extra bytes of air time per packet (%d)\n"
+          "  --input-buffer N      XBee serial input buffer, bytes (%d)\n"
+          "  --ro N                packetization timeout, character times (%.0f)\n"
+          "  --loss P              loss probability per transmission (%.2f)\n"
+          "  --burst-enter P       probability of starting a loss burst per transmission (%.2f)\n"
+          "  --burst-len N         mean burst length, transmissions (%.0f)\n"
+          "  --retries N           MAC retries (%d)\n"
+          "  --latency MS          fixed latency (%.1f)\n"
+          "  --jitter MS           uniform extra latency (%.1f)\n"
+          "  --framing MODE        legacy | mavlink | none (%s)\n"
+          "  --report S            report interval (%.0f)\n"
+          "  --seed N              random seed (%u)\n",
+          cfg.baud, cfg.airRate, cfg.rfPayload, cfg.rfOverhead, cfg.inputBuffer, cfg.roChars, cfg.loss, cfg.burstEnter,
+          cfg.burstLen, cfg.retries, cfg.latencyMs, cfg.jitterMs, cfg.framing.c_str(), cfg.reportS, cfg.seed);
+  exit(2);
+}
+
+static void parseArgs(int argc, char **argv) {
+  for (int i = 1; i < argc; i++) {
+    std::string a = argv[i];
+    if (i + 1 >= argc) usage();
+    const char *v = argv[++i];
+    if (a == "--plane-link") cfg.planeLink = v;
+    else if (a == "--ground-link") cfg.groundLink = v;
+    else if (a == "--baud") cfg.baud = atof(v);
+    else if (a == "--air-rate") cfg.airRate = atof(v);
+    else if (a == "--rf-payload") cfg.rfPayload = atoi(v);
+    else if (a == "--rf-overhead") cfg.rfOverhead = atoi(v);
+    else if (a == "--input-buffer") cfg.inputBuffer = atoi(v);
+    else if (a == "--ro") cfg.roChars = atof(v);
+    else if (a == "--loss") cfg.loss = atof(v);
+    else if (a == "--burst-enter") cfg.burstEnter = atof(v);
+    else if (a == "--burst-len") cfg.burstLen = std::max(1.0, atof(v));
+    else if (a == "--retries") cfg.retries = atoi(v);
+    else if (a == "--latency") cfg.latencyMs = atof(v);
+    else if (a == "--jitter") cfg.jitterMs = atof(v);
+    else if (a == "--framing") cfg.framing = v;
+    else if (a == "--report") cfg.reportS = atof(v);
+    else if (a == "--seed") cfg.seed = atoi(v);
+    else usage();
+  }
+  if (cfg.framing != "legacy" && cfg.framing != "mavlink" && cfg.framing != "none") usage();
+  if (cfg.rfPayload < 1 || cfg.inputBuffer < 1 || cfg.baud <= 0 || cfg.airRate <= 0) usage();
+}
+
+int main(int argc, char **argv) {
+
+  parseArgs(argc, argv);
+  rng.seed(cfg.seed);
+  signal(SIGINT, [](int) { quit = 1; });
+  signal(SIGTERM, [](int) { quit = 1; });
+
+  int plane = openEnd("plane", cfg.planeLink);
+  int ground = openEnd("ground", cfg.groundLink);
+
+  Direction down("plane->ground", plane, ground), up("ground->plane", ground, plane);
+  Direction *dirs[] = {&down, &up};
+
+  double start = nowS(), lastReport = start;
+
+  while (!quit) {
+
+    double now = nowS();
+    double next = std::min(down.nextEvent(), up.nextEvent());
+    int timeoutMs = next > now + 0.1 ? 100 : std::max(0, (int)ceil((next - now) * 1000));
+    timeoutMs = std::min(timeoutMs, std::max(0, (int)ceil((lastReport + cfg.reportS - now) * 1000)));
+
+    pollfd fds[2] = {{plane, POLLIN, 0}, {ground, POLLIN, 0}};
+    if (poll(fds, 2, timeoutMs) < 0 && errno != EINTR) {
+      perror("poll");
+      break;
+    }
+
+    now = nowS();
+    for (Direction *d : dirs) {
+      d->read(now);
+      d->step(now);
+    }
+
+    if (now - lastReport >= cfg.reportS) {
+      for (Direction *d : dirs) {
+        report(d->name, d->interval, now - lastReport);
+        accumulate(d->total, d->interval);
+        d->interval.reset();
+      }
+      lastReport = now;
+    }
+  }
+
+  double now = nowS();
+  printf("\nTotal over %.1f s\n", now - start);
+  for (Direction *d : dirs) {
+    accumulate(d->total, d->interval);
+    report(d->name, d->total, now - start);
+  }
+
+  if (!cfg.planeLink.empty()) unlink(cfg.planeLink.c_str());
+  if (!cfg.groundLink.empty()) unlink(cfg.groundLink.c_str());
+  return 0;
+}
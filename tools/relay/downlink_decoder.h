@@ -0,0 +1,128 @@
+#ifndef _DOWNLINK_DECODER_H
+#define _DOWNLINK_DECODER_H
+
+/*
+  Decoder for the legacy Communicator downlink (*<type><body>ee packets) into TelemetryRecords. Shared by the relay and the
+  flight store's raw capture import.
+
+  Packets are framed by the body length of their type, then checked for the "ee" terminator; anything that doesn't fit is dropped
+  and the decoder resyncs on the next '*'. Bytes of unknown packet types are counted and skipped the same way.
+*/
+
+#include "telemetry_ring.h"
+
+#include <functional>
+
+struct DownlinkStats {
+  uint64_t bytes = 0, records = 0, badFrames = 0, unknownType = 0;
+};
+
+// Body length (between type and "ee") of each downlink packet, -1 if unknown. Keep in step with Communicator.h
+inline int downlinkBodyLength(char type) {
+  switch (type) {
+    case TELEMETRY_DATA: return sizeof(TelemetryData);
+    case TELEMETRY_POINT: return sizeof(TelemetryPoint);
+    case TELEMETRY_WIND: return sizeof(TelemetryWind);
+    case TELEMETRY_DROP_RECORD: return sizeof(TelemetryDropRecord);
+    case TELEMETRY_PARAM: return sizeof(TelemetryParam);
+    // Messages with a float
+    case 'a': case 'w': case 'f': case 'j': case 'u': case 'l': case 'v': case 'z': return 4;
+    // Messages without
+    case 's': case 'r': case 'o': case 'c': case 'k': case 'q': case 'x': case 'y': case 'b': case 'd': case 'h': case 'g': return 0;
+    default: return -1;
+  }
+}
+
+class DownlinkDecoder {
+
+  public:
+    // Called for every complete packet. receivedUs is left 0 for the callback to fill in
+    typedef std::function<void(TelemetryRecord &)> Handler;
+
+    explicit DownlinkDecoder(Handler handler) : handler(handler) {}
+
+    DownlinkStats stats;
+
+    void push(uint8_t c) {
+
+      stats.bytes++;
+
+      if (state == WAIT_START) {
+        if (c == '*') state = WAIT_TYPE;
+        return;
+      }
+
+      if (state == WAIT_TYPE) {
+        type = c;
+        need = downlinkBodyLength(type);
+        if (need < 0) {
+          stats.unknownType++;
+          state = WAIT_START;
+          return;
+        }
+        len = 0;
+        state = need > 0 ? BODY : END1;
+        return;
+      }
+
+      if (state == BODY) {
+        body[len++] = c;
+        if (len == need) state = END1;
+        return;
+      }
+
+      if (state == END1) {
+        if (c == 'e') {
+          state = END2;
+        }
+        else {
+          bad(c);
+        }
+        return;
+      }
+
+      // END2
+      if (c == 'e') {
+        emit();
+        state = WAIT_START;
+      }
+      else {
+        bad(c);
+      }
+    }
+
+  private:
+    enum { WAIT_START, WAIT_TYPE, BODY, END1, END2 } state = WAIT_START;
+    Handler handler;
+    char type;
+    int need, len;
+    uint8_t body[64];
+
+    void bad(uint8_t c) {
+      stats.badFrames++;
+      state = c == '*' ? WAIT_TYPE : WAIT_START;
+    }
+
+    void emit() {
+
+      TelemetryRecord r;
+      memset(&r, 0, sizeof(r));
+
+      if (type == TELEMETRY_DATA || type == TELEMETRY_POINT || type == TELEMETRY_WIND || type == TELEMETRY_DROP_RECORD ||
+          type == TELEMETRY_PARAM) {
+        r.type = type;
+        memcpy((void *)&r.data, body, need);  //All union members start at the same place
+      }
+      else {
+        r.type = TELEMETRY_MESSAGE;
+        r.message.code = type;
+        r.message.hasValue = need == 4;
+        if (need == 4) memcpy(&r.message.value, body, 4);
+      }
+
+      stats.records++;
+      handler(r);
+    }
+};
+
+#endif //_DOWNLINK_DECODER_H
@@ -0,0 +1,171 @@
+/*
+  Ground telemetry relay (host side, Linux/macOS).
+
+  Holds the XBee serial port, decodes the Communicator downlink (*<type><body>ee packets, legacy protocol) once and publishes each
+  packet as a typed record in the shared memory ring (telemetry_ring.h) for any number of readers. Every --report seconds it prints
+  the attached readers with their lag (records behind the relay) and overruns.
+
+  Packet framing and resync are in downlink_decoder.h.
+
+  Anything on stdin is written to the port, so the uplink can still be driven (e.g. by piping the ground station's commands in).
+  Every point packet is acknowledged (INCOME_POINT_ACK + id) as it is published, so the plane stops resending it. Each ack is
+  written whole between stdin chunks.
+
+  Build:  g++ -std=c++11 -O2 -o telemetry_relay telemetry_relay.cpp -lrt   (no -lrt on macOS)
+  Run:    ./telemetry_relay /dev/ttyUSB0 [--baud 115200] [--report 5]
+          (or the ground end of tools/linksim/xbee_link_sim)
+*/
+
+#include "telemetry_ring.h"
+#include "downlink_decoder.h"
+
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+
+#include <poll.h>
+#include <termios.h>
+
+static volatile sig_atomic_t quit = 0;
+
+static uint64_t realtimeUs() {
+  timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static speed_t baudConstant(int baud) {
+  switch (baud) {
+    case 9600: return B9600;
+    case 19200: return B19200;
+    case 38400: return B38400;
+    case 57600: return B57600;
+    case 115200: return B115200;
+    case 230400: return B230400;
+    default:
+      fprintf(stderr, "unsupported baud %d\n", baud);
+      exit(2);
+  }
+}
+
+static int openPort(const char *path, int baud) {
+
+  int fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK);
+  if (fd < 0) {
+    perror(path);
+    exit(1);
+  }
+
+  termios t;
+  if (tcgetattr(fd, &t) == 0) {
+    cfmakeraw(&t);
+    cfsetispeed(&t, baudConstant(baud));
+    cfsetospeed(&t, baudConstant(baud));
+    t.c_cflag |= CLOCAL | CREAD;
+    tcsetattr(fd, TCSANOW, &t);
+  }
+  return fd;
+}
+
+// Lag of every attached reader. Readers whose process has gone are freed
+static void report(TelemetryRing *ring, const DownlinkStats &stats, double seconds) {
+
+  uint64_t write = ring->header.writeSeq.load();
+  printf("relay: %.0f B/s, %llu records, %llu bad frames, %llu unknown types\n", stats.bytes / seconds,
+         (unsigned long long)stats.records, (unsigned long long)stats.badFrames, (unsigned long long)stats.unknownType);
+
+  for (int i = 0; i < TELEMETRY_MAX_READERS; i++) {
+    TelemetryReaderSlot &r = ring->header.readers[i];
+    uint32_t pid = r.pid.load();
+    if (pid == 0) continue;
+
+    if (kill(pid, 0) < 0 && errno == ESRCH) {
+      printf("  reader %-20s pid %u gone, detaching\n", r.name, pid);
+      r.pid.compare_exchange_strong(pid, 0);
+      continue;
+    }
+
+    uint64_t cursor = r.cursor.load();
+    printf("  reader %-20s pid %-7u lag %6llu records  overruns %llu\n", r.name, pid,
+           (unsigned long long)(write > cursor ? write - cursor : 0), (unsigned long long)r.overruns.load());
+  }
+  fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+
+  if (argc < 2) {
+    fprintf(stderr, "usage: telemetry_relay PORT [--baud N] [--report S]\n");
+    return 2;
+  }
+  const char *port = argv[1];
+  int baud = 115200;
+  double reportS = 5;
+  for (int i = 2; i + 1 < argc; i += 2) {
+    if (!strcmp(argv[i], "--baud")) baud = atoi(argv[i + 1]);
+    else if (!strcmp(argv[i], "--report")) reportS = atof(argv[i + 1]);
+  }
+
+  signal(SIGINT, [](int) { quit = 1; });
+  signal(SIGTERM, [](int) { quit = 1; });
+
+  int fd = openPort(port, baud);
+  TelemetryRing *ring = mapTelemetryRing(true);
+  if (ring == NULL) {
+    perror("shared memory " TELEMETRY_SHM_NAME);
+    return 1;
+  }
+
+  DownlinkDecoder decoder([ring, fd](TelemetryRecord &r) {
+    r.receivedUs = realtimeUs();
+    publishTelemetryRecord(ring, r);
+    if (r.type == TELEMETRY_POINT) {
+      uint8_t ack[3] = {'m'};
+      memcpy(&ack[1], &r.point.id, 2);
+      if (write(fd, ack, sizeof(ack)) < 0) perror("point ack");
+    }
+  });
+  DownlinkStats &stats = decoder.stats;
+  uint64_t lastReport = realtimeUs();
+  ring->header.relayAliveUs.store(lastReport);
+  printf("relaying %s into " TELEMETRY_SHM_NAME "\n", port);
+
+  bool haveStdin = true;
+  while (!quit) {
+
+    pollfd fds[2] = {{fd, POLLIN, 0}, {STDIN_FILENO, (short)(haveStdin ? POLLIN : 0), 0}};
+    if (poll(fds, 2, 200) < 0 && errno != EINTR) {
+      perror("poll");
+      break;
+    }
+
+    uint8_t buf[1024];
+    ssize_t n;
+    while ((n = read(fd, buf, sizeof(buf))) > 0) {
+      for (ssize_t i = 0; i < n; i++) decoder.push(buf[i]);
+    }
+
+    if (haveStdin && (fds[1].revents & (POLLIN | POLLHUP))) {
+      n = read(STDIN_FILENO, buf, sizeof(buf));
+      if (n > 0) {
+        if (write(fd, buf, n) < 0) perror("uplink");
+      }
+      else {
+        haveStdin = false;
+      }
+    }
+
+    uint64_t now = realtimeUs();
+    if (now - lastReport >= reportS * 1e6) {
+      ring->header.relayAliveUs.store(now);
+      report(ring, stats, (now - lastReport) / 1e6);
+      stats.bytes = 0;
+      lastReport = now;
+    }
+  }
+
+  shm_unlink(TELEMETRY_SHM_NAME);  //Attached readers keep their mapping, new ones can't attach until the next relay
+  return 0;
+}
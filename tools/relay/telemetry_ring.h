@@ -0,0 +1,271 @@
+#ifndef _TELEMETRY_RING_H
+#define _TELEMETRY_RING_H
+
+/*
+  Shared memory ring of decoded downlink records (host side, Linux/macOS).
+
+  telemetry_relay owns the XBee port, decodes each Communicator packet once and appends it here as a fixed size typed record. Any
+  number of consumers (map display, logger, analytics) attach with TelemetryReader and walk the ring at their own pace. There is one
+  writer and no locks: each slot carries the sequence number of the record in it, written last (release) by the relay, so a reader
+  sees a record only once it is complete, and can tell when the relay has lapped it (the slot's sequence has moved past the one it
+  wanted). A slow reader loses the oldest records (counted as overruns) rather than slowing the relay or the other readers.
+
+  peek() hands out a pointer into the ring, no copy. The relay may overwrite the slot while it is being read, so check with
+  stillValid() after using it (read() does the copy and the check in one go).
+
+  Readers register in a fixed table in the header (name, pid, cursor), which is how the relay reports their lag. A reader that dies
+  without detaching is cleared out by the relay.
+*/
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define TELEMETRY_SHM_NAME "/plane_telemetry"
+#define TELEMETRY_RING_MAGIC 0x544C4D31  //"TLM1"
+#define TELEMETRY_RING_VERSION 2
+#define TELEMETRY_RING_CAPACITY 4096  //Records, power of 2 (~17 minutes of data packets at 4Hz)
+#define TELEMETRY_MAX_READERS 16
+#define TELEMETRY_READER_NAME_LENGTH 32
+#define TELEMETRY_SEQ_WRITING UINT64_MAX
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "the ring needs lock free 64 bit atomics (they live in shared memory)");
+
+// Record types are the downlink packet characters (Communicator.h)
+#define TELEMETRY_DATA 'p'
+#define TELEMETRY_POINT 't'
+#define TELEMETRY_WIND 'i'
+#define TELEMETRY_DROP_RECORD 'm'
+#define TELEMETRY_PARAM 'n'
+#define TELEMETRY_MESSAGE 0  //Every single character message, with or without a value
+
+#pragma pack(push, 1)
+// Field order and types as sent, so the relay can copy the packet body straight in
+struct TelemetryData {
+  float altitudeFt, speedMPS, latitudeDegrees, longitudeDegrees, hdop, expectedErrorM, gpsAltitudeM, batteryV, courseDeg;
+  uint8_t fixQuality, satellites;
+};
+
+struct TelemetryPoint {
+  uint16_t id;  //Sent again until acknowledged, so the same id can come more than once
+  uint8_t flags;  //POINT_* in PointMarker.h
+  float utcSeconds, altitudeFt;
+  int32_t latitudeE7, longitudeE7;
+  float gpsAltitudeM, courseDeg, speedMPS;
+};
+
+struct TelemetryWind {
+  float windEast, windNorth, airspeed, fitErrorMPS;
+  uint8_t quality;
+};
+
+struct TelemetryDropRecord {
+  uint8_t channel, src;
+  float utcSeconds, altitudeFt, latitudeDegrees, longitudeDegrees, predictedMissM, hitProbability;
+};
+
+struct TelemetryParam {
+  uint8_t index, count, type;
+  float value, minValue, maxValue;
+  uint32_t versionHash;
+  char name[16];
+};
+
+struct TelemetryMessage {
+  char code;
+  uint8_t hasValue;
+  float value;
+};
+#pragma pack(pop)
+
+struct TelemetryRecord {
+  uint64_t seq;  //1 for the first record the relay wrote
+  uint64_t receivedUs;  //Relay's CLOCK_REALTIME when the packet's last byte arrived
+  char type;
+  union {
+    TelemetryData data;
+    TelemetryPoint point;
+    TelemetryWind wind;
+    TelemetryDropRecord dropRecord;
+    TelemetryParam param;
+    TelemetryMessage message;
+  };
+};
+
+struct TelemetrySlot {
+  std::atomic<uint64_t> seq;  //Of the record in it, TELEMETRY_SEQ_WRITING while the relay is writing it, 0 if never written
+  TelemetryRecord record;
+};
+
+struct TelemetryReaderSlot {
+  std::atomic<uint32_t> pid;  //0 = free
+  char name[TELEMETRY_READER_NAME_LENGTH];
+  std::atomic<uint64_t> cursor;  //Next seq the reader wants
+  std::atomic<uint64_t> overruns;  //Records lost to being lapped
+};
+
+struct TelemetryRingHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t capacity;
+  uint32_t recordSize;
+  std::atomic<uint64_t> writeSeq;  //Seq of the next record to be written
+  std::atomic<uint64_t> relayAliveUs;  //Updated by the relay every report, so readers can tell it has gone
+  TelemetryReaderSlot readers[TELEMETRY_MAX_READERS];
+};
+
+struct TelemetryRing {
+  TelemetryRingHeader header;
+  TelemetrySlot slots[TELEMETRY_RING_CAPACITY];
+};
+
+// Maps the ring. The relay creates (and initializes) it, readers only open an existing one
+inline TelemetryRing *mapTelemetryRing(bool create, const char *name = TELEMETRY_SHM_NAME) {
+
+  int fd = shm_open(name, create ? O_RDWR | O_CREAT : O_RDWR, 0666);
+  if (fd < 0) return NULL;
+  if (create && ftruncate(fd, sizeof(TelemetryRing)) < 0) {
+    close(fd);
+    return NULL;
+  }
+
+  void *p = mmap(NULL, sizeof(TelemetryRing), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED) return NULL;
+
+  TelemetryRing *ring = (TelemetryRing *)p;
+  if (create) {
+    memset((void *)ring, 0, sizeof(TelemetryRing));  //Any readers of a previous relay see writeSeq go back and re-attach
+    ring->header.capacity = TELEMETRY_RING_CAPACITY;
+    ring->header.recordSize = sizeof(TelemetryRecord);
+    ring->header.version = TELEMETRY_RING_VERSION;
+    ring->header.writeSeq.store(1);
+    std::atomic_thread_fence(std::memory_order_release);
+    ring->header.magic = TELEMETRY_RING_MAGIC;
+  }
+  else if (ring->header.magic != TELEMETRY_RING_MAGIC || ring->header.version != TELEMETRY_RING_VERSION ||
+           ring->header.recordSize != sizeof(TelemetryRecord)) {
+    munmap(p, sizeof(TelemetryRing));
+    return NULL;
+  }
+  return ring;
+}
+
+// Relay side
+inline void publishTelemetryRecord(TelemetryRing *ring, TelemetryRecord &record) {
+
+  uint64_t seq = ring->header.writeSeq.load(std::memory_order_relaxed);
+  TelemetrySlot &slot = ring->slots[seq & (TELEMETRY_RING_CAPACITY - 1)];
+
+  record.seq = seq;
+  slot.seq.store(TELEMETRY_SEQ_WRITING, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  memcpy((void *)&slot.record, &record, sizeof(record));
+  slot.seq.store(seq, std::memory_order_release);
+  ring->header.writeSeq.store(seq + 1, std::memory_order_release);
+}
+
+class TelemetryReader {
+
+  public:
+    ~TelemetryReader() { detach(); }
+
+    // fromOldest: start at the oldest record still in the ring rather than the next new one
+    bool attach(const char *name, bool fromOldest = false) {
+
+      ring = mapTelemetryRing(false);
+      if (ring == NULL) return false;
+
+      uint32_t pid = getpid();
+      for (int i = 0; i < TELEMETRY_MAX_READERS; i++) {
+        uint32_t expected = 0;
+        if (ring->header.readers[i].pid.compare_exchange_strong(expected, pid)) {
+          slot = &ring->header.readers[i];
+          strncpy(slot->name, name, TELEMETRY_READER_NAME_LENGTH - 1);
+          slot->name[TELEMETRY_READER_NAME_LENGTH - 1] = 0;
+          slot->overruns.store(0);
+          uint64_t write = ring->header.writeSeq.load(std::memory_order_acquire);
+          uint64_t oldest = write > TELEMETRY_RING_CAPACITY - 1 ? write - (TELEMETRY_RING_CAPACITY - 1) : 1;
+          cursor = fromOldest ? oldest : write;
+          slot->cursor.store(cursor);
+          return true;
+        }
+      }
+      munmap(ring, sizeof(TelemetryRing));
+      ring = NULL;
+      return false;  //Reader table full
+    }
+
+    void detach() {
+      if (slot) slot->pid.store(0);
+      if (ring) munmap(ring, sizeof(TelemetryRing));
+      slot = NULL;
+      ring = NULL;
+    }
+
+    // Next record, or NULL if there isn't one yet. Skips ahead (counting overruns) if the relay has lapped us
+    const TelemetryRecord *peek() {
+
+      for (;;) {
+        uint64_t write = ring->header.writeSeq.load(std::memory_order_acquire);
+        if (write < cursor) cursor = write;  //Relay restarted
+        if (cursor == write) return NULL;
+
+        if (write - cursor > TELEMETRY_RING_CAPACITY - 1) {
+          uint64_t skipTo = write - (TELEMETRY_RING_CAPACITY - 1);
+          slot->overruns.fetch_add(skipTo - cursor, std::memory_order_relaxed);
+          cursor = skipTo;
+        }
+
+        current = &ring->slots[cursor & (TELEMETRY_RING_CAPACITY - 1)];
+        uint64_t seq = current->seq.load(std::memory_order_acquire);
+        if (seq == cursor) return &current->record;
+        if (seq != TELEMETRY_SEQ_WRITING && seq < cursor) return NULL;  //Not written yet
+
+        //Overwritten (or being overwritten) since we read writeSeq - go round again
+        slot->overruns.fetch_add(1, std::memory_order_relaxed);
+        cursor++;
+      }
+    }
+
+    // After using what peek() returned: false if the relay overwrote it meanwhile (throw away anything derived from it)
+    bool stillValid() {
+      std::atomic_thread_fence(std::memory_order_acquire);
+      return current->seq.load(std::memory_order_relaxed) == cursor;
+    }
+
+    // Done with the current record
+    void advance() {
+      cursor++;
+      slot->cursor.store(cursor, std::memory_order_relaxed);
+    }
+
+    // Copying read: true with the next record in out
+    bool read(TelemetryRecord &out) {
+      while (const TelemetryRecord *r = peek()) {
+        memcpy(&out, (const void *)r, sizeof(out));
+        bool ok = stillValid();
+        if (!ok) slot->overruns.fetch_add(1, std::memory_order_relaxed);
+        advance();
+        if (ok) return true;
+      }
+      return false;
+    }
+
+    uint64_t getOverruns() { return slot ? slot->overruns.load() : 0; }
+    uint64_t getRelayAliveUs() { return ring ? ring->header.relayAliveUs.load() : 0; }
+
+  private:
+    TelemetryRing *ring = NULL;
+    TelemetryReaderSlot *slot = NULL;
+    TelemetrySlot *current = NULL;
+    uint64_t cursor = 0;
+};
+
+#endif //_TELEMETRY_RING_H
@@ -0,0 +1,79 @@
+/*
+  Example ring consumer: attaches to the relay's ring and prints every record, like tail -f.
+
+  Build:  g++ -std=c++11 -O2 -o telemetry_tail telemetry_tail.cpp -lrt
+  Run:    ./telemetry_tail [name] [--oldest]
+*/
+
+#include "telemetry_ring.h"
+
+#include <csignal>
+#include <cstdio>
+
+static volatile sig_atomic_t quit = 0;
+
+static void print(const TelemetryRecord &r) {
+
+  printf("%llu ", (unsigned long long)r.seq);
+  switch (r.type) {
+    case TELEMETRY_DATA:
+      printf("data alt %.1f ft  spd %.1f  %.6f %.6f  err %.1f m  batt %.2f V  fix %u sats %u\n", r.data.altitudeFt,
+             r.data.speedMPS, r.data.latitudeDegrees, r.data.longitudeDegrees, r.data.expectedErrorM, r.data.batteryV,
+             r.data.fixQuality, r.data.satellites);
+      break;
+    case TELEMETRY_POINT:
+      printf("point %u flags 0x%02x  utc %.3f  alt %.1f ft  %.7f %.7f  course %.0f  spd %.1f\n", r.point.id, r.point.flags,
+             r.point.utcSeconds, r.point.altitudeFt, r.point.latitudeE7 * 1e-7, r.point.longitudeE7 * 1e-7, r.point.courseDeg,
+             r.point.speedMPS);
+      break;
+    case TELEMETRY_WIND:
+      printf("wind %.1f E %.1f N  airspeed %.1f  quality %u\n", r.wind.windEast, r.wind.windNorth, r.wind.airspeed, r.wind.quality);
+      break;
+    case TELEMETRY_DROP_RECORD:
+      printf("drop channel %u src %u  utc %.2f  alt %.1f ft  miss %.1f m  p %.2f\n", r.dropRecord.channel, r.dropRecord.src,
+             r.dropRecord.utcSeconds, r.dropRecord.altitudeFt, r.dropRecord.predictedMissM, r.dropRecord.hitProbability);
+      break;
+    case TELEMETRY_PARAM:
+      printf("param %u/%u %.16s = %g [%g, %g]\n", r.param.index, r.param.count, r.param.name, r.param.value, r.param.minValue,
+             r.param.maxValue);
+      break;
+    default:
+      if (r.message.hasValue)
+        printf("message %c %g\n", r.message.code, r.message.value);
+      else
+        printf("message %c\n", r.message.code);
+  }
+}
+
+int main(int argc, char **argv) {
+
+  const char *name = "tail";
+  bool oldest = false;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--oldest")) oldest = true;
+    else name = argv[i];
+  }
+
+  signal(SIGINT, [](int) { quit = 1; });
+
+  TelemetryReader reader;
+  if (!reader.attach(name, oldest)) {
+    fprintf(stderr, "can't attach (relay not running, or reader table full)\n");
+    return 1;
+  }
+
+  while (!quit) {
+    // Zero copy: use the record in place, then make sure the relay didn't overwrite it meanwhile
+    const TelemetryRecord *r = reader.peek();
+    if (r == NULL) {
+      usleep(10000);
+      continue;
+    }
+    TelemetryRecord snapshot = *r;  //Printing takes a while, so take a copy first
+    if (reader.stillValid()) print(snapshot);
+    reader.advance();
+  }
+
+  printf("overruns: %llu\n", (unsigned long long)reader.getOverruns());
+  return 0;
+}
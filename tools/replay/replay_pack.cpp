@@ -0,0 +1,312 @@
+/*
+  Packs a recorded flight into ReplayData.h for bench replay (Flight_Replay in plane.h, FlightReplay.h). Host side.
+
+  Input is an NMEA log - one sentence per line, as the receiver sent them. Lines may start with a timestamp in ms (anything before
+  the '$' that parses as a number, e.g. "123456 $GPGGA,..." from a logging terminal); without one the timing comes from the UTC time
+  in the sentences. Either way a sentence can't start before the one before it has finished at --baud, as on the wire. Lines with a
+  bad checksum are skipped.
+
+  Altimeter samples come from --baro, a CSV of time_ms,pressure_pa,temperature_c on the same clock as the log's timestamps (or in
+  ms from the first sentence if it has none). Without it they are made up from the GGA altitudes at --baro-rate-hz with the standard
+  atmosphere - enough for the altitude path to do its work, though without the real sensor's noise.
+
+  The packed data (ReplayFormat.h) is decoded again with the sketch's own decoder and checked against the input before it is
+  written. It goes into the Due's flash along with the sketch (512 KB between them), so the tool warns above --max-bytes.
+
+  Build:  g++ -std=c++11 -O2 -I../.. -o replay_pack replay_pack.cpp ../../ReplayFormat.cpp
+  Run:    ./replay_pack flight.nmea [--baro baro.csv] [--baro-rate-hz 2] [--baud 9600] [--max-bytes 262144] [-o ../../ReplayData.h]
+*/
+
+#include "ReplayFormat.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+struct Sentence {
+  uint32_t timeMs;
+  std::string text;  //'$' up to the checksum, no "\r\n"
+  int slot;
+};
+
+struct BaroSample {
+  uint32_t timeMs;
+  uint32_t pressureQ2;
+  int32_t temperatureQ4;
+};
+
+static bool checksumOk(const std::string &s) {
+  size_t star = s.find('*');
+  if (s.size() < 2 || s[0] != '$' || star == std::string::npos || star + 3 > s.size())
+    return false;
+  uint8_t sum = 0;
+  for (size_t i = 1; i < star; i++) sum ^= (uint8_t)s[i];
+  return strtoul(s.substr(star + 1, 2).c_str(), NULL, 16) == sum;
+}
+
+static std::string field(const std::string &s, int n) {
+  size_t start = 0;
+  for (int i = 0; i < n; i++) {
+    start = s.find(',', start);
+    if (start == std::string::npos) return "";
+    start++;
+  }
+  size_t end = s.find_first_of(",*", start);
+  return s.substr(start, end == std::string::npos ? std::string::npos : end - start);
+}
+
+// UTC ms since midnight from the time field, -1 if the sentence type has none (or it's empty)
+static int64_t sentenceUtcMs(const std::string &s) {
+  std::string type = s.substr(3, 3);
+  int n = type == "GLL" ? 5 : type == "GGA" || type == "RMC" || type == "ZDA" ? 1 : -1;
+  if (n < 0) return -1;
+  std::string t = field(s, n);
+  if (t.size() < 6) return -1;
+  return ((atoi(t.substr(0, 2).c_str()) * 60 + atoi(t.substr(2, 2).c_str())) * 60) * 1000LL + lround(atof(t.substr(4).c_str()) * 1000);
+}
+
+// Runs against the previous sentence in the slot (ReplayFormat.h). Copies of fewer than 2 characters cost more than they save
+static void encodeSentence(std::vector<uint8_t> &out, const std::string &s, const std::string &prev) {
+  out.push_back((uint8_t)s.size());
+  size_t i = 0;
+  std::string literal;
+  auto flush = [&]() {
+    for (size_t k = 0; k < literal.size(); k += 127) {
+      size_t n = std::min<size_t>(127, literal.size() - k);
+      out.push_back((uint8_t)n);
+      out.insert(out.end(), literal.begin() + k, literal.begin() + k + n);
+    }
+    literal.clear();
+  };
+  while (i < s.size()) {
+    size_t run = 0;
+    while (i + run < s.size() && i + run < prev.size() && s[i + run] == prev[i + run]) run++;
+    if (run >= 2) {
+      flush();
+      for (size_t k = 0; k < run; k += 127) out.push_back((uint8_t)(0x80 | std::min<size_t>(127, run - k)));
+      i += run;
+    }
+    else {
+      literal += s[i++];
+    }
+  }
+  flush();
+}
+
+static void putVarint(std::vector<uint8_t> &out, uint32_t v) {
+  while (v >= 0x80) {
+    out.push_back((uint8_t)(v | 0x80));
+    v >>= 7;
+  }
+  out.push_back((uint8_t)v);
+}
+
+static void putUint32(std::vector<uint8_t> &out, size_t at, uint32_t v) {
+  for (int i = 0; i < 4; i++) out[at + i] = (uint8_t)(v >> (8 * i));
+}
+
+static void usage() {
+  fprintf(stderr, "usage: replay_pack NMEA_LOG [--baro CSV] [--baro-rate-hz 2] [--baud 9600] [--max-bytes 262144] [-o ReplayData.h]\n");
+  exit(2);
+}
+
+int main(int argc, char **argv) {
+
+  if (argc < 2) usage();
+  const char *logPath = argv[1], *baroPath = NULL, *outPath = "ReplayData.h";
+  double baroRateHz = 2, baud = 9600;
+  long maxBytes = 262144;
+  for (int i = 2; i < argc; i++) {
+    std::string a = argv[i];
+    if (i + 1 >= argc) usage();
+    const char *v = argv[++i];
+    if (a == "--baro") baroPath = v;
+    else if (a == "--baro-rate-hz") baroRateHz = atof(v);
+    else if (a == "--baud") baud = atof(v);
+    else if (a == "--max-bytes") maxBytes = atol(v);
+    else if (a == "-o") outPath = v;
+    else usage();
+  }
+  double byteTimeMs = 10 * 1000.0 / baud;  //8N1
+
+  // Sentences and their times
+  FILE *f = fopen(logPath, "r");
+  if (f == NULL) {
+    perror(logPath);
+    return 1;
+  }
+  std::vector<Sentence> sentences;
+  std::map<std::string, int> slots;
+  char line[512];
+  long badLines = 0, nmeaBytes = 0;
+  bool timestamped = false;
+  int64_t firstStamp = 0, firstUtc = -1, lastUtc = -1, utcWraps = 0;
+  double wireFree = 0;  //When the previous sentence's last byte is out
+  while (fgets(line, sizeof(line), f)) {
+    std::string s = line;
+    while (!s.empty() && (s.back() == '\n' || s.back() == '\r')) s.pop_back();
+    size_t dollar = s.find('$');
+    if (dollar == std::string::npos) continue;
+    std::string prefix = s.substr(0, dollar);
+    s = s.substr(dollar);
+    if (!checksumOk(s) || s.size() + 2 > REPLAY_MAX_SENTENCE) {
+      badLines++;
+      continue;
+    }
+
+    double t;
+    char *end;
+    double stamp = strtod(prefix.c_str(), &end);
+    if (end != prefix.c_str()) {
+      if (sentences.empty()) {
+        timestamped = true;
+        firstStamp = (int64_t)stamp;
+      }
+      t = stamp - firstStamp;
+    }
+    else {
+      // Each new epoch starts at its UTC time, the rest of the epoch follows on the wire
+      int64_t utc = sentenceUtcMs(s);
+      t = wireFree;
+      if (utc >= 0 && utc != lastUtc) {
+        if (lastUtc >= 0 && utc < lastUtc - 43200000) utcWraps++;  //Midnight
+        lastUtc = utc;
+        utc += utcWraps * 86400000;
+        if (firstUtc < 0) firstUtc = utc;
+        t = std::max<double>(t, utc - firstUtc);
+      }
+    }
+    t = ceil(std::max(t, wireFree));
+    wireFree = t + (s.size() + 2) * byteTimeMs;
+
+    std::string type = s.substr(3, 3);
+    if (!slots.count(type)) {
+      int slot = std::min<int>(slots.size(), REPLAY_SLOTS - 1);
+      slots[type] = slot;
+    }
+    sentences.push_back({(uint32_t)t, s, slots[type]});
+    nmeaBytes += s.size() + 2;
+  }
+  fclose(f);
+  if (sentences.empty()) {
+    fprintf(stderr, "%s: no NMEA sentences\n", logPath);
+    return 1;
+  }
+  uint32_t endMs = sentences.back().timeMs;
+
+  // Altimeter samples
+  std::vector<BaroSample> baro;
+  if (baroPath != NULL) {
+    FILE *b = fopen(baroPath, "r");
+    if (b == NULL) {
+      perror(baroPath);
+      return 1;
+    }
+    while (fgets(line, sizeof(line), b)) {
+      double t, p, c;
+      if (sscanf(line, "%lf,%lf,%lf", &t, &p, &c) != 3) continue;  //Header
+      t -= timestamped ? firstStamp : 0;
+      if (t < 0) continue;
+      baro.push_back({(uint32_t)lround(t), (uint32_t)lround(p * 4), (int32_t)lround(c * 16)});
+    }
+    fclose(b);
+    std::stable_sort(baro.begin(), baro.end(), [](const BaroSample &x, const BaroSample &y) { return x.timeMs < y.timeMs; });
+  }
+  else {
+    std::vector<std::pair<uint32_t, double> > altitudes;  //GGA MSL altitude, m
+    for (const Sentence &s : sentences) {
+      std::string alt = field(s.text, 9);
+      if (s.text.compare(3, 3, "GGA") == 0 && !alt.empty()) altitudes.push_back({s.timeMs, atof(alt.c_str())});
+    }
+    if (altitudes.empty()) fprintf(stderr, "no GGA altitudes - the replay has no altimeter samples\n");
+    size_t k = 0;
+    for (double t = 0; !altitudes.empty() && t <= endMs; t += 1000 / baroRateHz) {
+      while (k + 1 < altitudes.size() && altitudes[k + 1].first <= t) k++;
+      double h = altitudes[k].second;
+      if (k + 1 < altitudes.size() && t > altitudes[k].first) {
+        double w = (t - altitudes[k].first) / (altitudes[k + 1].first - altitudes[k].first);
+        h += w * (altitudes[k + 1].second - h);
+      }
+      double p = 101325 * pow(1 - 2.25577e-5 * h, 5.25588);
+      baro.push_back({(uint32_t)lround(t), (uint32_t)lround(p * 4), (int32_t)lround((15 - 0.0065 * h) * 16)});
+    }
+  }
+
+  // Pack, in time order (a sentence before a sample at the same ms)
+  std::vector<uint8_t> out(REPLAY_HEADER_SIZE);
+  std::vector<std::string> previous(REPLAY_SLOTS);
+  uint32_t lastTime = 0, lastPressure = 0;
+  int32_t lastTemperature = 0;
+  size_t si = 0, bi = 0;
+  while (si < sentences.size() || bi < baro.size()) {
+    bool nmea = bi == baro.size() || (si < sentences.size() && sentences[si].timeMs <= baro[bi].timeMs);
+    uint32_t t = nmea ? sentences[si].timeMs : baro[bi].timeMs;
+    putVarint(out, t - lastTime);
+    lastTime = t;
+    if (nmea) {
+      const Sentence &s = sentences[si++];
+      out.push_back(REPLAY_EVENT_NMEA | s.slot);
+      encodeSentence(out, s.text, previous[s.slot]);
+      previous[s.slot] = s.text;
+    }
+    else {
+      const BaroSample &b = baro[bi++];
+      out.push_back(REPLAY_EVENT_ALTIMETER);
+      putVarint(out, zigzagEncode((int32_t)(b.pressureQ2 - lastPressure)));
+      putVarint(out, zigzagEncode(b.temperatureQ4 - lastTemperature));
+      lastPressure = b.pressureQ2;
+      lastTemperature = b.temperatureQ4;
+    }
+  }
+  putUint32(out, 0, REPLAY_MAGIC);
+  putUint32(out, 4, lastTime);
+  putUint32(out, 8, sentences.size());
+  putUint32(out, 12, baro.size());
+
+  // Check it decodes back to the input
+  ReplayDecoder decoder;
+  ReplayEvent e;
+  si = bi = 0;
+  bool ok = decoder.begin(out.data(), out.size());
+  while (ok && decoder.next(e)) {
+    if (e.kind == REPLAY_EVENT_NMEA) {
+      ok = si < sentences.size() && e.timeMs == sentences[si].timeMs && std::string(e.sentence, e.length) == sentences[si].text;
+      si++;
+    }
+    else {
+      ok = bi < baro.size() && e.timeMs == baro[bi].timeMs && e.pressureQ2 == baro[bi].pressureQ2 && e.temperatureQ4 == baro[bi].temperatureQ4;
+      bi++;
+    }
+  }
+  if (!ok || si != sentences.size() || bi != baro.size()) {
+    fprintf(stderr, "packed data doesn't decode back to the input (event %zu)\n", si + bi);
+    return 1;
+  }
+
+  FILE *o = fopen(outPath, "w");
+  if (o == NULL) {
+    perror(outPath);
+    return 1;
+  }
+  fprintf(o, "// Recorded flight for Flight_Replay (plane.h), made by tools/replay/replay_pack from %s - do not edit\n", logPath);
+  fprintf(o, "// %.1f s, %zu sentences, %zu altimeter samples%s\n", lastTime / 1000.0, sentences.size(), baro.size(),
+          baroPath != NULL ? "" : " (from the GGA altitudes)");
+  fprintf(o, "#define REPLAY_DATA_LENGTH %zu\n", out.size());
+  fprintf(o, "const uint8_t replayData[REPLAY_DATA_LENGTH] = {");
+  for (size_t i = 0; i < out.size(); i++) fprintf(o, "%s0x%02x,", i % 16 ? " " : "\n  ", out[i]);
+  fprintf(o, "\n};\n");
+  fclose(o);
+
+  printf("%s: %.1f s, %zu sentences (%ld bad lines skipped, %d slots), %zu altimeter samples\n", outPath, lastTime / 1000.0,
+         sentences.size(), badLines, (int)slots.size(), baro.size());
+  printf("%zu bytes packed, NMEA %ld bytes raw (%.1fx overall), timing from %s\n", out.size(), nmeaBytes,
+         (double)nmeaBytes / out.size(), timestamped ? "the log's timestamps" : "the sentences' UTC");
+  if ((long)out.size() > maxBytes)
+    fprintf(stderr, "warning: %zu bytes is more than --max-bytes %ld - it may not fit in flash with the sketch\n", out.size(), maxBytes);
+  return 0;
+}
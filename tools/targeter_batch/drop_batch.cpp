@@ -0,0 +1,388 @@
+#include "drop_batch.h"
+
+#include <string.h>
+
+typedef double VecD __attribute__((vector_size(8 * DROP_BATCH_LANES)));
+typedef int64_t VecI __attribute__((vector_size(8 * DROP_BATCH_LANES)));  //Also what comparisons of VecD give: all ones or 0
+typedef uint64_t VecU __attribute__((vector_size(8 * DROP_BATCH_LANES)));
+
+// ------------------------------------ LANE HELPERS ------------------------------------
+
+static inline VecD splat(double x) {
+  VecD v = {};
+  return v + x;
+}
+
+static inline VecD select(VecI mask, VecD a, VecD b) {
+  return (VecD)((mask & (VecI)a) | (~mask & (VecI)b));
+}
+
+static inline VecI select(VecI mask, VecI a, VecI b) {
+  return (mask & a) | (~mask & b);
+}
+
+static inline bool any(VecI mask) {
+  for (int k = 0; k < DROP_BATCH_LANES; k++) {
+    if (mask[k])
+      return true;
+  }
+  return false;
+}
+
+static inline VecD vabs(VecD x) {
+  return (VecD)((VecU)x & 0x7FFFFFFFFFFFFFFFULL);
+}
+
+// As clampTime in DropSolver.cpp
+static inline VecD vclamp(VecD t, VecD low, VecD high) {
+  return select(t < low, low, select(t > high, high, t));
+}
+
+// The states solved side by side: their indexes, with a short block padded with copies of its last state (solved and thrown away)
+struct Block {
+  size_t index[DROP_BATCH_LANES];
+  size_t n;
+  bool contiguous;
+};
+
+static inline Block rangeBlock(size_t first, size_t count) {
+  Block b;
+  b.n = count - first < DROP_BATCH_LANES ? count - first : DROP_BATCH_LANES;
+  for (size_t k = 0; k < DROP_BATCH_LANES; k++)
+    b.index[k] = first + (k < b.n ? k : b.n - 1);
+  b.contiguous = b.n == DROP_BATCH_LANES;
+  return b;
+}
+
+static inline Block listBlock(const size_t *list, size_t n) {
+  Block b;
+  b.n = n < DROP_BATCH_LANES ? n : DROP_BATCH_LANES;
+  for (size_t k = 0; k < DROP_BATCH_LANES; k++)
+    b.index[k] = list[k < b.n ? k : b.n - 1];
+  b.contiguous = false;
+  return b;
+}
+
+static inline VecD load(const double *p, const Block &b) {
+  VecD v;
+  if (b.contiguous) {
+    memcpy(&v, p + b.index[0], sizeof(v));
+    return v;
+  }
+  for (size_t k = 0; k < DROP_BATCH_LANES; k++)
+    v[k] = p[b.index[k]];
+  return v;
+}
+
+static inline void store(double *p, const Block &b, VecD v) {
+  if (b.contiguous) {
+    memcpy(p + b.index[0], &v, sizeof(v));
+    return;
+  }
+  for (size_t k = 0; k < b.n; k++)
+    p[b.index[k]] = v[k];
+}
+
+// ------------------------------------ FASTMATH, LANE BY LANE ------------------------------------
+
+// AVX2 has no conversions between doubles and 64 bit integers, so these are done exactly with the 1.5 * 2^52 trick: adding it
+// rounds to an integer, and leaves that integer in the low bits. Good for |x| < 2^51
+#define ROUNDING_MAGIC 6755399441055744.0
+
+static inline VecD toDouble(VecI v) {
+  return (VecD)(v + (VecI)splat(ROUNDING_MAGIC)) - ROUNDING_MAGIC;
+}
+
+// Towards 0, as a C cast
+static inline VecI truncate(VecD x) {
+  VecD r = x + ROUNDING_MAGIC;
+  VecD nearest = r - ROUNDING_MAGIC;
+  VecI v = (VecI)r - (VecI)splat(ROUNDING_MAGIC);
+  v += (x >= 0) & (nearest > x);  //Masks are -1
+  v -= (x < 0) & (nearest < x);
+  return v;
+}
+
+static inline VecD floorPositive(VecD x) {
+  VecD nearest = (x + ROUNDING_MAGIC) - ROUNDING_MAGIC;
+  return select(nearest > x, nearest - 1, nearest);
+}
+
+// FastMathTraits<double>::sqrt
+static inline VecD vsqrt(VecD x) {
+  VecU u = 0x5fe6eb50c7b537a9ULL - ((VecU)x >> 1);
+  VecD y = (VecD)u, half = 0.5 * x;
+  for (int i = 0; i < 4; i++)
+    y *= 1.5 - half * y * y;
+  return select(x > 0, x * y, splat(0));
+}
+
+// sineTable as doubles (exact), so the lookups go straight into double lanes. Filled before main, so threads can share it
+static struct SineTableDouble {
+  double value[(1 << SINE_TABLE_BITS) + 2];
+  SineTableDouble() {
+    for (int i = 0; i < (1 << SINE_TABLE_BITS) + 2; i++)
+      value[i] = sineTable[i];
+  }
+} sineTableDouble;
+
+// sinQ30 as a double (still Q30), on binary angles held in the low 32 bits of each lane. The integer interpolation is done in
+// doubles, where every step is exact: the step times the fraction is under 2^45. The lookups are the only part done a lane at a time
+static inline __attribute__((always_inline)) VecD vsinQ30(VecI angle) {
+
+  VecI x = angle & (ANGLE_QUARTER_TURN - 1);
+  x = select((angle & ANGLE_QUARTER_TURN) != 0, ANGLE_QUARTER_TURN - x, x);
+
+  VecI i = x >> SINE_FRACTION_BITS;
+  VecD fraction = toDouble(x & ((1LL << SINE_FRACTION_BITS) - 1));
+  VecD low, high;
+  for (int k = 0; k < DROP_BATCH_LANES; k++) {
+    low[k] = sineTableDouble.value[i[k]];
+    high[k] = sineTableDouble.value[i[k] + 1];
+  }
+  VecD value = low + floorPositive((high - low) * fraction * (1.0 / (1 << SINE_FRACTION_BITS)));
+
+  return select((angle & ANGLE_HALF_TURN) != 0, -value, value);
+}
+
+// fastSinCos<double>
+static inline __attribute__((always_inline)) void vsinCos(VecD x, VecD &s, VecD &c) {
+  VecI a = truncate(x * RAD_TO_ANGLE) & 0xFFFFFFFFLL;
+  s = vsinQ30(a) * (1.0 / ONE_Q30);
+  c = vsinQ30((a + ANGLE_QUARTER_TURN) & 0xFFFFFFFFLL) * (1.0 / ONE_Q30);
+}
+
+// ------------------------------------ THE SOLVE ------------------------------------
+
+// The model, as the solve uses it
+struct DropConstants {
+  double servoOpenDelayS;
+  double correctionFactor;
+  double driftFraction;
+  double fallModelErrorFraction;
+};
+
+// DROP_BATCH_LANES states, as DropState
+struct DropLanes {
+  VecD easting, northing, speed, heading, headingCos, headingSin, turnRate, fallTime, windDriftTime, windEast, windNorth, now;
+  VecD aimEasting, aimNorthing;
+  VecI straight, slow;
+
+  // The parts of dropLandingPoint that don't depend on t. Each is a leading subexpression there, so it rounds the same
+  VecD offsetEast, offsetNorth;  //Position - aim point
+  VecD windOffsetEast, windOffsetNorth;
+  VecD turnRadius;  //speed / turnRate
+  VecD turnSpeed, turnSqSpeed;  //turnRate * speed, turnRate^2 * speed
+
+  void load(const DropBatchInput &in, const DropConstants &k, const Block &b);
+};
+
+void DropLanes::load(const DropBatchInput &in, const DropConstants &k, const Block &b) {
+
+  easting = ::load(in.easting, b);
+  northing = ::load(in.northing, b);
+  speed = ::load(in.speed, b);
+  heading = ::load(in.heading, b);
+  vsinCos(heading, headingSin, headingCos);
+  turnRate = ::load(in.turnRate, b);
+  straight = vabs(turnRate) < STRAIGHT_TURN_RATE;
+  slow = speed < TURN_RATE_MIN_SPEED_MPS;
+  windEast = ::load(in.windEast, b);
+  windNorth = ::load(in.windNorth, b);
+  now = ::load(in.now, b);
+  aimEasting = ::load(in.aimEasting, b);
+  aimNorthing = ::load(in.aimNorthing, b);
+
+  // dropFallTimes
+  VecD heightM = ::load(in.heightM, b);
+  heightM = select(heightM < 0, splat(0), heightM);
+  VecD rawFallTime = vsqrt(2 * heightM / GRAVITY_MPS2);
+  fallTime = rawFallTime * k.correctionFactor;
+  windDriftTime = rawFallTime * k.driftFraction;
+
+  offsetEast = easting - aimEasting;
+  offsetNorth = northing - aimNorthing;
+  windOffsetEast = windEast * windDriftTime;
+  windOffsetNorth = windNorth * windDriftTime;
+  turnRadius = speed / turnRate;
+  turnSpeed = turnRate * speed;
+  turnSqSpeed = turnRate * turnRate * speed;
+}
+
+// dropLandingPoint. Both the straight and the turning form are worked out, and each lane takes its own
+static inline __attribute__((always_inline)) void landingPoint(const DropLanes &s, double servoOpenDelayS, VecD t, VecD g[2], VecD g1[2], VecD g2[2]) {
+
+  VecD v = s.speed;
+  VecD u = t + servoOpenDelayS;
+  VecD theta = s.heading + s.turnRate * u;
+  VecD c, sn;
+  vsinCos(theta, sn, c);
+
+  VecD e = select(s.straight, v * u * c, s.turnRadius * (sn - s.headingSin));
+  VecD n = select(s.straight, v * u * sn, s.turnRadius * (s.headingCos - c));
+
+  g[0] = s.offsetEast + e + v * c * s.fallTime + s.windOffsetEast;
+  g[1] = s.offsetNorth + n + v * sn * s.fallTime + s.windOffsetNorth;
+
+  g1[0] = v * c - s.turnSpeed * sn * s.fallTime;
+  g1[1] = v * sn + s.turnSpeed * c * s.fallTime;
+
+  g2[0] = -s.turnSpeed * sn - s.turnSqSpeed * c * s.fallTime;
+  g2[1] = s.turnSpeed * c - s.turnSqSpeed * sn * s.fallTime;
+}
+
+// dropReleaseTime, up to the straight line answer
+static inline VecD straightReleaseTime(const DropLanes &s, double servoOpenDelayS) {
+  VecD g[2], g1[2], g2[2];
+  landingPoint(s, servoOpenDelayS, splat(0), g, g1, g2);
+  return -(g[0] * g1[0] + g[1] * g1[1]) / (s.speed * s.speed);
+}
+
+// The rest of dropReleaseTime for states in a turn, from the straight line answer
+static inline VecD turnReleaseTime(const DropLanes &s, double servoOpenDelayS, VecD t) {
+
+  VecD g[2], g1[2], g2[2];
+  VecD halfTurn = M_PI / vabs(s.turnRate);
+  VecD horizon = select(RELEASE_SOLVER_HORIZON_S < halfTurn, splat(RELEASE_SOLVER_HORIZON_S), halfTurn);
+  VecD latest = s.now + horizon;
+  t = vclamp(t, s.now, latest);
+
+  landingPoint(s, servoOpenDelayS, t, g, g1, g2);
+  VecD bestMissSq = g[0] * g[0] + g[1] * g[1];
+  for (int i = 0; i <= RELEASE_SOLVER_SCAN_POINTS; i++) {
+    VecD ts = s.now + horizon * (double)i / RELEASE_SOLVER_SCAN_POINTS;
+    landingPoint(s, servoOpenDelayS, ts, g, g1, g2);
+    VecD missSq = g[0] * g[0] + g[1] * g[1];
+    VecI better = missSq < bestMissSq;
+    bestMissSq = select(better, missSq, bestMissSq);
+    t = select(better, ts, t);
+  }
+
+  // A lane stops where the scalar loop would break, and keeps its t from then on
+  VecI active = ~(VecI){};
+  for (int i = 0; i < RELEASE_SOLVER_ITERATIONS && any(active); i++) {
+    landingPoint(s, servoOpenDelayS, t, g, g1, g2);
+    VecD f1 = g[0] * g1[0] + g[1] * g1[1];
+    VecD f2 = g1[0] * g1[0] + g1[1] * g1[1] + g[0] * g2[0] + g[1] * g2[1];
+    active &= ~(f2 <= 0);
+
+    VecD step = f1 / f2;
+    t = select(active, vclamp(t - step, s.now, latest), t);
+    active &= ~(vabs(step) < RELEASE_SOLVER_TOLERANCE_S);
+  }
+  return t;
+}
+
+/*
+  Three passes, so that the scan and Newton iterations (nearly all the work) only run with every lane in a turn - a block of
+  mixed states would carry its straight and slow lanes through them for nothing:
+    1. The straight line answer for every state, and a list of the ones in a turn
+    2. The turns, packed DROP_BATCH_LANES at a time from the list
+    3. The limits on the release time, and the miss distance and hit probability there
+  The release times are kept in the output between passes.
+*/
+void dropSolveBatch(const DropModel &model, const DropBatchInput &in, const DropBatchOutput &out, size_t count) {
+
+  DropConstants k;
+  k.servoOpenDelayS = model.servoOpenDelayMs / 1000.0;
+  k.correctionFactor = model.correctionFactor;
+  k.driftFraction = 1 - model.correctionFactor;  //In float, as dropFallTimes does
+  k.fallModelErrorFraction = model.fallModelErrorFraction;
+
+  std::vector<size_t> turning;
+  DropLanes s;
+
+  for (size_t i = 0; i < count; i += DROP_BATCH_LANES) {
+    Block b = rangeBlock(i, count);
+    s.load(in, k, b);
+    store(out.releaseTime, b, straightReleaseTime(s, k.servoOpenDelayS));
+    VecI turn = ~s.straight & ~s.slow;
+    for (size_t j = 0; j < b.n; j++) {
+      if (turn[j])
+        turning.push_back(i + j);
+    }
+  }
+
+  for (size_t i = 0; i < turning.size(); i += DROP_BATCH_LANES) {
+    Block b = listBlock(&turning[i], turning.size() - i);
+    s.load(in, k, b);
+    store(out.releaseTime, b, turnReleaseTime(s, k.servoOpenDelayS, load(out.releaseTime, b)));
+  }
+
+  for (size_t i = 0; i < count; i += DROP_BATCH_LANES) {
+    Block b = rangeBlock(i, count);
+    s.load(in, k, b);
+    VecD t = load(out.releaseTime, b);
+    t = select(s.slow, s.now, vclamp(t, s.now, s.now + RELEASE_SOLVER_HORIZON_S));
+
+    VecD g[2], g1[2], g2[2];
+    landingPoint(s, k.servoOpenDelayS, t, g, g1, g2);
+    VecD missDistance = vsqrt(g[0] * g[0] + g[1] * g[1]);
+
+    // dropSigmaSq
+    VecD T = t + k.servoOpenDelayS + s.fallTime;
+    VecD varEast = load(in.varEast, b) + T * T * load(in.varVelEast, b) + 2 * T * load(in.covEast, b);
+    VecD varNorth = load(in.varNorth, b) + T * T * load(in.varVelNorth, b) + 2 * T * load(in.covNorth, b);
+    VecD fallModelError = k.fallModelErrorFraction * (s.speed * s.fallTime);
+    VecD sigmaSq = 0.5 * (varEast + varNorth) + fallModelError * fallModelError;
+
+    store(out.releaseTime, b, t);
+    store(out.missDistance, b, missDistance);
+    store(out.impactSigma, b, vsqrt(sigmaSq));
+    // Two libm exp()s, once per state - not worth a vector exp that would no longer match
+    for (size_t j = 0; j < b.n; j++)
+      out.hitProbability[i + j] = dropHitProbability(model, missDistance[j], sigmaSq[j]);
+  }
+}
+
+void dropSolveScalar(const DropModel &model, const DropBatchInput &in, const DropBatchOutput &out, size_t count) {
+
+  for (size_t i = 0; i < count; i++) {
+    DropState s;
+    s.easting = in.easting[i];
+    s.northing = in.northing[i];
+    s.speed = in.speed[i];
+    s.heading = in.heading[i];
+    fastSinCos(s.heading, s.headingSin, s.headingCos);
+    s.turnRate = in.turnRate[i];
+    dropFallTimes(in.heightM[i], model, s.fallTime, s.windDriftTime);
+    s.windEast = in.windEast[i];
+    s.windNorth = in.windNorth[i];
+    s.now = in.now[i];
+    s.varEast = in.varEast[i];
+    s.varNorth = in.varNorth[i];
+    s.varVelEast = in.varVelEast[i];
+    s.varVelNorth = in.varVelNorth[i];
+    s.covEast = in.covEast[i];
+    s.covNorth = in.covNorth[i];
+
+    double t = dropReleaseTime(s, model, in.aimEasting[i], in.aimNorthing[i]);
+    double sigmaSq = dropSigmaSq(s, model, t);
+    out.releaseTime[i] = t;
+    out.missDistance[i] = dropMissDistance(s, model, t, in.aimEasting[i], in.aimNorthing[i]);
+    out.impactSigma[i] = fastSqrt(sigmaSq);
+    out.hitProbability[i] = dropHitProbability(model, out.missDistance[i], sigmaSq);
+  }
+}
+
+// ------------------------------------ STORAGE ------------------------------------
+
+void DropBatchArrays::resize(size_t count) {
+  std::vector<double> *fields[] = { &easting, &northing, &speed, &heading, &turnRate, &heightM, &windEast, &windNorth, &now,
+                                    &aimEasting, &aimNorthing, &varEast, &varNorth, &varVelEast, &varVelNorth, &covEast, &covNorth,
+                                    &releaseTime, &missDistance, &impactSigma, &hitProbability };
+  for (std::vector<double> *f : fields)
+    f->assign(count, 0);
+}
+
+DropBatchInput DropBatchArrays::input() {
+  DropBatchInput in = { easting.data(), northing.data(), speed.data(), heading.data(), turnRate.data(), heightM.data(),
+                        windEast.data(), windNorth.data(), now.data(), aimEasting.data(), aimNorthing.data(),
+                        varEast.data(), varNorth.data(), varVelEast.data(), varVelNorth.data(), covEast.data(), covNorth.data() };
+  return in;
+}
+
+DropBatchOutput DropBatchArrays::output() {
+  DropBatchOutput out = { releaseTime.data(), missDistance.data(), impactSigma.data(), hitProbability.data() };
+  return out;
+}
@@ -0,0 +1,61 @@
+#ifndef _DROP_BATCH_H
+#define _DROP_BATCH_H
+
+#include "DropSolver.h"
+
+#include <stddef.h>
+#include <vector>
+
+/*
+  Batch release solutions for host side analysis (Monte Carlo runs, parameter sweeps): the Targeter's solve (DropSolver.h) for
+  many plane states at once, from arrays of each field (struct of arrays).
+
+  dropSolveBatch runs DROP_BATCH_LANES states side by side in GCC/Clang vector types, which compile to AVX2 on x86 (-mavx2) and
+  NEON on ARM without any intrinsics (on x86 without AVX2 it is slower than the scalar path). The states in a turn are packed
+  together first, and the turn solve's data dependent loops are done with lane masks: Newton runs until every lane has stopped,
+  and each lane keeps its own result - so every lane takes exactly the steps the scalar solver would. The trig is the same table
+  kernel (sinQ30, a lookup per lane), so built with -ffp-contract=off the results are bit for bit the scalar ones.
+  dropSolveScalar is that scalar reference, state by state. Both keep no state between calls, so a Monte Carlo run can split its
+  states across threads. Accuracy and states/s: drop_batch_bench.cpp.
+
+  The fields are as in DropState, except that the height above the aim point (m) is given instead of the fall times, and the
+  heading's cos/sin are worked out here. The aim point is per state. Outputs are per state.
+*/
+
+#ifndef DROP_BATCH_LANES
+#define DROP_BATCH_LANES 4  //Doubles per vector: one AVX2 register, two NEON ones
+#endif
+
+struct DropBatchInput {
+  const double *easting, *northing;
+  const double *speed, *heading, *turnRate;
+  const double *heightM;
+  const double *windEast, *windNorth;
+  const double *now;
+  const double *aimEasting, *aimNorthing;
+  const double *varEast, *varNorth, *varVelEast, *varVelNorth, *covEast, *covNorth;
+};
+
+struct DropBatchOutput {
+  double *releaseTime;  //s after the state's timestamp
+  double *missDistance;  //m
+  double *impactSigma;  //m, equivalent circular 1 sigma of the landing point
+  double *hitProbability;
+};
+
+void dropSolveBatch(const DropModel &model, const DropBatchInput &in, const DropBatchOutput &out, size_t count);
+void dropSolveScalar(const DropModel &model, const DropBatchInput &in, const DropBatchOutput &out, size_t count);
+
+// Storage for a batch, for callers that don't already have their states in arrays
+struct DropBatchArrays {
+  std::vector<double> easting, northing, speed, heading, turnRate, heightM, windEast, windNorth, now, aimEasting, aimNorthing;
+  std::vector<double> varEast, varNorth, varVelEast, varVelNorth, covEast, covNorth;
+  std::vector<double> releaseTime, missDistance, impactSigma, hitProbability;
+
+  void resize(size_t count);  //Inputs are zeroed
+  size_t size() { return easting.size(); }
+  DropBatchInput input();
+  DropBatchOutput output();
+};
+
+#endif //_DROP_BATCH_H
@@ -0,0 +1,97 @@
+/*
+  Batch release solver check and benchmark (host side).
+
+  Solves the same random plane states with the vector batch (dropSolveBatch) and the scalar solver the Targeter runs
+  (dropSolveScalar, which is DropSolver.cpp as is), then:
+    - counts outputs that differ at all, and the largest difference of each. With -ffp-contract=off there should be none; if
+      the compiler is allowed to fuse multiply-adds it does so differently in the two, and the differences are rounding sized
+    - states per second for each (single thread, best of a few runs)
+
+  The states are a mix like a sweep would make: mostly turning (the expensive case - scan and Newton), some straight, a few too
+  slow to have a heading, aim points up to ~1km away and heights from below the target to 400m.
+
+  Build (x86):  g++ -std=c++11 -O2 -mavx2 -ffp-contract=off -I../.. -I. -o drop_batch_bench drop_batch_bench.cpp drop_batch.cpp \
+                  ../../DropSolver.cpp ../../FastMath.cpp
+  Build (ARM):  the same without -mavx2 (NEON is always there on AArch64)
+  Run:          ./drop_batch_bench [states]
+*/
+
+#include "drop_batch.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+
+#define BENCH_RUNS 3
+
+static double bestSeconds(void (*solve)(const DropModel &, const DropBatchInput &, const DropBatchOutput &, size_t),
+                          const DropModel &model, DropBatchArrays &a) {
+  double best = 1e9;
+  for (int run = 0; run < BENCH_RUNS; run++) {
+    auto start = std::chrono::steady_clock::now();
+    solve(model, a.input(), a.output(), a.size());
+    double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (s < best) best = s;
+  }
+  return best;
+}
+
+static void compare(const char *name, const std::vector<double> &scalar, const std::vector<double> &batch) {
+  size_t differ = 0;
+  double maxDiff = 0;
+  for (size_t i = 0; i < scalar.size(); i++) {
+    if (scalar[i] == batch[i] || (std::isnan(scalar[i]) && std::isnan(batch[i])))
+      continue;
+    differ++;
+    maxDiff = std::fmax(maxDiff, std::fabs(scalar[i] - batch[i]));
+  }
+  printf("  %-15s %10zu differ   max difference %.3g\n", name, differ, maxDiff);
+}
+
+int main(int argc, char **argv) {
+
+  size_t count = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+
+  DropModel model = { 0.9f, 250.0f, 20.0f, 0.1f };  //The defaults in Parameters.cpp
+
+  std::mt19937_64 rng(1);
+  std::uniform_real_distribution<double> unit(0, 1), centred(-1, 1);
+  DropBatchArrays a;
+  a.resize(count);
+  for (size_t i = 0; i < count; i++) {
+    double kind = unit(rng);
+    a.easting[i] = 500000 + centred(rng) * 1000;
+    a.northing[i] = 5000000 + centred(rng) * 1000;
+    a.speed[i] = kind < 0.05 ? unit(rng) * TURN_RATE_MIN_SPEED_MPS : 10 + unit(rng) * 20;
+    a.heading[i] = unit(rng) * 2 * M_PI;
+    a.turnRate[i] = kind < 0.25 ? centred(rng) * STRAIGHT_TURN_RATE : centred(rng) * 0.5;
+    a.heightM[i] = -10 + unit(rng) * 410;
+    a.windEast[i] = centred(rng) * 10;
+    a.windNorth[i] = centred(rng) * 10;
+    a.now[i] = unit(rng) * 0.2;
+    a.aimEasting[i] = a.easting[i] + centred(rng) * 700;
+    a.aimNorthing[i] = a.northing[i] + centred(rng) * 700;
+    a.varEast[i] = 1 + unit(rng) * 10;
+    a.varNorth[i] = 1 + unit(rng) * 10;
+    a.varVelEast[i] = 0.1 + unit(rng);
+    a.varVelNorth[i] = 0.1 + unit(rng);
+    a.covEast[i] = centred(rng) * 0.3 * std::sqrt(a.varEast[i] * a.varVelEast[i]);
+    a.covNorth[i] = centred(rng) * 0.3 * std::sqrt(a.varNorth[i] * a.varVelNorth[i]);
+  }
+
+  double scalarSeconds = bestSeconds(dropSolveScalar, model, a);
+  DropBatchArrays scalar = a;
+  double batchSeconds = bestSeconds(dropSolveBatch, model, a);
+
+  printf("%zu states, %d lanes\n", count, DROP_BATCH_LANES);
+  compare("release time", scalar.releaseTime, a.releaseTime);
+  compare("miss distance", scalar.missDistance, a.missDistance);
+  compare("impact sigma", scalar.impactSigma, a.impactSigma);
+  compare("hit probability", scalar.hitProbability, a.hitProbability);
+
+  printf("  scalar  %12.0f states/s\n", count / scalarSeconds);
+  printf("  batch   %12.0f states/s   (%.2fx)\n", count / batchSeconds, scalarSeconds / batchSeconds);
+  return 0;
+}
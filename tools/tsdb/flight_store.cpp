@@ -0,0 +1,424 @@
+/*
+  Flight store command line tool (host side, Linux/macOS). See flight_store.h for the file format.
+
+  flight_store record DIR FLIGHT [--target LAT,LON]
+      Attach to the relay's ring (tools/relay) and append everything it publishes to DIR/FLIGHT.fts until interrupted
+  flight_store import DIR FLIGHT CAPTURE [--target LAT,LON] [--start-us T] [--rate-hz 4]
+      Decode a raw downlink capture (bytes as received from the XBee). Captures carry no times, so data packets are spaced at the
+      data packet rate from --start-us, and other packets take the time of the data packet before them
+  flight_store query DIR [--near LAT,LON,M | --near-target M] [--phase NAME] [--from US] [--to US] [--quiet]
+      Fixes matching every condition given, as CSV, with how many flights/blocks the indexes let it skip
+  flight_store events DIR [--from US] [--to US]
+  flight_store info DIR
+
+  Example: every fix within 50 m of the target during approach, over all flights:
+      flight_store query flights --near-target 50 --phase approach
+
+  Fixes are tagged with a flight phase as they are stored: ground (slow and low), approach (airborne, within APPROACH_RADIUS_M of the
+  target and heading for it), post_drop (airborne after the first drop) or cruise. The target is the one given with --target
+  (plane.h's by default) - a target moved in flight from the ground station isn't in the downlink.
+
+  Build:  g++ -std=c++11 -O2 -o flight_store flight_store.cpp -lrt
+*/
+
+#include "flight_store.h"
+#include "../relay/downlink_decoder.h"
+
+#include <csignal>
+#include <cstdlib>
+#include <ctime>
+#include <map>
+
+#include <dirent.h>
+
+#define DEFAULT_TARGET_LAT 44.226510  //plane.h TARGET_LATT/TARGET_LONG, converted from ddmm.mmmm
+#define DEFAULT_TARGET_LON -76.489660
+#define GROUND_SPEED_MPS 5.0
+#define GROUND_ALTITUDE_FT 15.0
+#define APPROACH_RADIUS_M 400.0
+#define APPROACH_MAX_ANGLE_DEG 60.0  //Between the course and the bearing to the target
+#define POINT_RESEND_WINDOW_US 30000000LL  //A point is resent every second until acknowledged - copies further apart are new marks
+
+static volatile sig_atomic_t quit = 0;
+
+class PhaseClassifier {
+
+  public:
+    PhaseClassifier(double targetLat, double targetLon) : targetLat(targetLat), targetLon(targetLon) {}
+
+    uint8_t classify(const TelemetryData &d) {
+
+      if (d.speedMPS < GROUND_SPEED_MPS && d.altitudeFt < GROUND_ALTITUDE_FT) {
+        dropped = false;  //Landed (and will be reloaded)
+        return PHASE_GROUND;
+      }
+      if (dropped)
+        return PHASE_POST_DROP;
+
+      double east = (targetLon - d.longitudeDegrees) * M_PER_DEGREE_LAT * cos(targetLat / 180 * M_PI);
+      double north = (targetLat - d.latitudeDegrees) * M_PER_DEGREE_LAT;
+      double bearing = atan2(east, north) * 180 / M_PI;
+      double offCourse = fabs(fmod(bearing - d.courseDeg + 540, 360) - 180);
+      if (sqrt(east * east + north * north) < APPROACH_RADIUS_M && offCourse < APPROACH_MAX_ANGLE_DEG)
+        return PHASE_APPROACH;
+
+      return PHASE_CRUISE;
+    }
+
+    void event(const TelemetryRecord &r) {
+      if (r.type == TELEMETRY_DROP_RECORD || (r.type == TELEMETRY_MESSAGE && r.message.code == 'o')) dropped = true;
+    }
+
+  private:
+    double targetLat, targetLon;
+    bool dropped = false;
+};
+
+// Feeds decoded records into a flight
+class Ingest {
+
+  public:
+    Ingest(FlightStoreWriter &writer, double targetLat, double targetLon) : writer(writer), classifier(targetLat, targetLon) {}
+
+    void add(int64_t timeUs, const TelemetryRecord &r) {
+
+      if (r.type != TELEMETRY_DATA) {
+        // Points are sent again until acknowledged - keep the first copy. Ids restart with the plane (a start message), and the
+        // UTC of the mark is -1 before the GPS clock locks, so only a copy that comes soon after the last one is a resend
+        if (r.type == TELEMETRY_POINT) {
+          auto seen = points.find(r.point.id);
+          if (seen != points.end() && seen->second.utcSeconds == r.point.utcSeconds &&
+              timeUs - seen->second.lastUs < POINT_RESEND_WINDOW_US) {
+            seen->second.lastUs = timeUs;
+            return;
+          }
+          points[r.point.id] = {r.point.utcSeconds, timeUs};
+        }
+        if (r.type == TELEMETRY_MESSAGE && (r.message.code == 's' || r.message.code == 'h')) points.clear();
+        classifier.event(r);
+        writer.addEvent(timeUs, r);
+        events++;
+        return;
+      }
+
+      const TelemetryData &d = r.data;
+      FixRow row;
+      row.timeUs = timeUs;
+      row.lat = d.latitudeDegrees;
+      row.lon = d.longitudeDegrees;
+      row.altitudeFt = d.altitudeFt;
+      row.speedMPS = d.speedMPS;
+      row.courseDeg = d.courseDeg;
+      row.expectedErrorM = d.expectedErrorM;
+      row.batteryV = d.batteryV;
+      row.fixQuality = d.fixQuality;
+      row.satellites = d.satellites;
+      row.phase = classifier.classify(d);
+      writer.append(row);
+      fixes++;
+    }
+
+    uint64_t fixes = 0, events = 0;
+
+  private:
+    FlightStoreWriter &writer;
+    PhaseClassifier classifier;
+    struct SeenPoint {
+      float utcSeconds;
+      int64_t lastUs;  //Last copy received
+    };
+    std::map<uint16_t, SeenPoint> points;  //The last point stored with each id
+};
+
+static std::string flightPath(const std::string &dir, const std::string &flight) {
+  return dir + "/" + flight + FLIGHT_STORE_EXTENSION;
+}
+
+static std::vector<std::string> flightFiles(const std::string &dir) {
+  std::vector<std::string> files;
+  DIR *d = opendir(dir.c_str());
+  if (d == NULL) return files;
+  while (dirent *e = readdir(d)) {
+    std::string name = e->d_name;
+    if (name.size() > 4 && name.compare(name.size() - 4, 4, FLIGHT_STORE_EXTENSION) == 0) files.push_back(dir + "/" + name);
+  }
+  closedir(d);
+  std::sort(files.begin(), files.end());
+  return files;
+}
+
+static const char *option(int argc, char **argv, const char *name) {
+  for (int i = 0; i + 1 < argc; i++) {
+    if (!strcmp(argv[i], name)) return argv[i + 1];
+  }
+  return NULL;
+}
+
+static bool flag(int argc, char **argv, const char *name) {
+  for (int i = 0; i < argc; i++) {
+    if (!strcmp(argv[i], name)) return true;
+  }
+  return false;
+}
+
+static void parseTarget(int argc, char **argv, double &lat, double &lon) {
+  lat = DEFAULT_TARGET_LAT;
+  lon = DEFAULT_TARGET_LON;
+  if (const char *t = option(argc, argv, "--target")) sscanf(t, "%lf,%lf", &lat, &lon);
+}
+
+static int openWriter(FlightStoreWriter &writer, const std::string &dir, const char *flight, double lat, double lon) {
+  mkdir(dir.c_str(), 0755);
+  if (!writer.open(flightPath(dir, flight), flight, lat, lon)) {
+    fprintf(stderr, "can't open %s (not a flight store file, or a writer didn't finish it)\n", flightPath(dir, flight).c_str());
+    return 1;
+  }
+  return 0;
+}
+
+static int record(int argc, char **argv) {
+
+  double lat, lon;
+  parseTarget(argc, argv, lat, lon);
+  FlightStoreWriter writer;
+  if (openWriter(writer, argv[2], argv[3], lat, lon)) return 1;
+
+  TelemetryReader reader;
+  if (!reader.attach("flight_store", true)) {
+    fprintf(stderr, "can't attach to the relay's ring\n");
+    writer.close();
+    return 1;
+  }
+
+  signal(SIGINT, [](int) { quit = 1; });
+  signal(SIGTERM, [](int) { quit = 1; });
+
+  Ingest ingest(writer, lat, lon);
+  TelemetryRecord r;
+  while (!quit) {
+    if (reader.read(r)) {
+      ingest.add(r.receivedUs, r);
+    }
+    else {
+      usleep(20000);
+    }
+  }
+
+  printf("%llu fixes, %llu events, %llu overruns\n", (unsigned long long)ingest.fixes, (unsigned long long)ingest.events,
+         (unsigned long long)reader.getOverruns());
+  return writer.close() ? 0 : 1;
+}
+
+static int import(int argc, char **argv) {
+
+  if (argc < 5) return 2;
+  double lat, lon;
+  parseTarget(argc, argv, lat, lon);
+  const char *s = option(argc, argv, "--start-us");
+  int64_t timeUs = s ? atoll(s) : 0;
+  const char *rate = option(argc, argv, "--rate-hz");
+  int64_t periodUs = 1000000 / (rate ? atof(rate) : 4);
+
+  FILE *in = fopen(argv[4], "rb");
+  if (in == NULL) {
+    perror(argv[4]);
+    return 1;
+  }
+
+  FlightStoreWriter writer;
+  if (openWriter(writer, argv[2], argv[3], lat, lon)) return 1;
+
+  Ingest ingest(writer, lat, lon);
+  bool first = true;
+  DownlinkDecoder decoder([&](TelemetryRecord &r) {
+    if (r.type == TELEMETRY_DATA) {
+      if (!first) timeUs += periodUs;
+      first = false;
+    }
+    ingest.add(timeUs, r);
+  });
+
+  int c;
+  while ((c = fgetc(in)) != EOF) decoder.push(c);
+  fclose(in);
+
+  printf("%llu bytes, %llu fixes, %llu events, %llu bad frames\n", (unsigned long long)decoder.stats.bytes,
+         (unsigned long long)ingest.fixes, (unsigned long long)ingest.events, (unsigned long long)decoder.stats.badFrames);
+  return writer.close() ? 0 : 1;
+}
+
+static int query(int argc, char **argv) {
+
+  double nearLat = 0, nearLon = 0, radius = -1;
+  bool nearTarget = false;
+  if (const char *n = option(argc, argv, "--near")) {
+    if (sscanf(n, "%lf,%lf,%lf", &nearLat, &nearLon, &radius) != 3) return 2;
+  }
+  if (const char *n = option(argc, argv, "--near-target")) {
+    radius = atof(n);
+    nearTarget = true;
+  }
+
+  uint32_t phaseMask = (1 << NUM_PHASES) - 1;
+  if (const char *p = option(argc, argv, "--phase")) {
+    phaseMask = 0;
+    for (int i = 0; i < NUM_PHASES; i++) {
+      if (!strcmp(p, flightPhaseNames[i])) phaseMask = 1 << i;
+    }
+    if (phaseMask == 0) {
+      fprintf(stderr, "unknown phase %s\n", p);
+      return 2;
+    }
+  }
+
+  const char *f = option(argc, argv, "--from"), *t = option(argc, argv, "--to");
+  double from = f ? atof(f) : -INFINITY, to = t ? atof(t) : INFINITY;
+  bool quiet = flag(argc, argv, "--quiet");
+
+  uint64_t flights = 0, flightsSkipped = 0, blocks = 0, blocksSkipped = 0, matches = 0;
+  if (!quiet) printf("flight,time_us,lat,lon,altitude_ft,speed_mps,course_deg,expected_error_m,phase%s\n", radius >= 0 ? ",distance_m" : "");
+
+  for (const std::string &path : flightFiles(argv[2])) {
+
+    FlightStoreReader reader;
+    if (!reader.open(path)) {
+      fprintf(stderr, "skipping %s (unreadable or unfinished)\n", path.c_str());
+      continue;
+    }
+    const FlightFileFooter &footer = reader.getFooter();
+    flights++;
+
+    double cLat = nearTarget ? footer.targetLat : nearLat, cLon = nearTarget ? footer.targetLon : nearLon;
+    double dLat = radius / M_PER_DEGREE_LAT, dLon = radius / (M_PER_DEGREE_LAT * cos(cLat / 180 * M_PI));
+
+    // A summary (footer or block) that can't contain a match
+    auto prune = [&](const double *min, const double *max, uint32_t phases) {
+      if (!(phases & phaseMask) || max[COL_TIME] < from || min[COL_TIME] > to) return true;
+      return radius >= 0 && (max[COL_LAT] < cLat - dLat || min[COL_LAT] > cLat + dLat || max[COL_LON] < cLon - dLon ||
+                             min[COL_LON] > cLon + dLon);
+    };
+
+    if (footer.numBlocks == 0 || prune(footer.min, footer.max, footer.phaseMask)) {
+      flightsSkipped++;
+      blocksSkipped += footer.numBlocks;
+      continue;
+    }
+
+    for (uint32_t b = 0; b < footer.numBlocks; b++) {
+
+      const BlockSummary &s = reader.getSummary(b);
+      if (prune(s.min, s.max, s.phaseMask)) {
+        blocksSkipped++;
+        continue;
+      }
+      blocks++;
+
+      const int scanned[] = {COL_TIME, COL_LAT, COL_LON, COL_PHASE};
+      for (int c : scanned) reader.prefetch(b, c);
+      const int64_t *time = reader.column<int64_t>(b, COL_TIME);
+      const float *lat = reader.column<float>(b, COL_LAT), *lon = reader.column<float>(b, COL_LON);
+      const uint8_t *phase = reader.column<uint8_t>(b, COL_PHASE);
+
+      for (uint32_t i = 0; i < s.rows; i++) {
+        if (!((1 << phase[i]) & phaseMask) || time[i] < from || time[i] > to) continue;
+        double distance = radius >= 0 ? flatDistanceM(cLat, cLon, lat[i], lon[i]) : 0;
+        if (distance > radius && radius >= 0) continue;
+
+        matches++;
+        if (quiet) continue;
+        // Only the matching rows touch the other columns
+        printf("%s,%lld,%.7f,%.7f,%.1f,%.2f,%.1f,%.1f,%s", footer.flightId, (long long)time[i], lat[i], lon[i],
+               reader.column<float>(b, COL_ALT)[i], reader.column<float>(b, COL_SPEED)[i], reader.column<float>(b, COL_COURSE)[i],
+               reader.column<float>(b, COL_ERROR)[i], flightPhaseNames[phase[i]]);
+        if (radius >= 0) printf(",%.1f", distance);
+        printf("\n");
+      }
+    }
+  }
+
+  fprintf(stderr, "%llu matches; flights %llu (%llu skipped by footer), blocks scanned %llu, skipped %llu\n",
+          (unsigned long long)matches, (unsigned long long)flights, (unsigned long long)flightsSkipped, (unsigned long long)blocks,
+          (unsigned long long)blocksSkipped);
+  return 0;
+}
+
+static int events(int argc, char **argv) {
+
+  const char *f = option(argc, argv, "--from"), *t = option(argc, argv, "--to");
+  int64_t from = f ? atoll(f) : INT64_MIN, to = t ? atoll(t) : INT64_MAX;
+
+  for (const std::string &path : flightFiles(argv[2])) {
+    FlightStoreReader reader;
+    if (!reader.open(path)) continue;
+    const FlightFileFooter &footer = reader.getFooter();
+
+    // Events are in time order: binary search for the start
+    uint32_t lo = 0, hi = footer.numEvents;
+    while (lo < hi) {
+      uint32_t mid = (lo + hi) / 2;
+      if (reader.getEvent(mid).timeUs < from) lo = mid + 1;
+      else hi = mid;
+    }
+
+    for (uint32_t i = lo; i < footer.numEvents && reader.getEvent(i).timeUs <= to; i++) {
+      const EventRow &e = reader.getEvent(i);
+      const TelemetryRecord &r = e.record;
+      printf("%s,%lld,", footer.flightId, (long long)e.timeUs);
+      if (r.type == TELEMETRY_DROP_RECORD)
+        printf("drop,channel %u,src %u,miss %.1f m,p %.2f\n", r.dropRecord.channel, r.dropRecord.src, r.dropRecord.predictedMissM,
+               r.dropRecord.hitProbability);
+      else if (r.type == TELEMETRY_WIND)
+        printf("wind,%.1f E,%.1f N,quality %u\n", r.wind.windEast, r.wind.windNorth, r.wind.quality);
+      else if (r.type == TELEMETRY_POINT)
+        printf("point,%u,%.7f,%.7f\n", r.point.id, r.point.latitudeE7 * 1e-7, r.point.longitudeE7 * 1e-7);
+      else if (r.type == TELEMETRY_PARAM)
+        printf("param,%.16s,%g\n", r.param.name, r.param.value);
+      else if (r.message.hasValue)
+        printf("message,%c,%g\n", r.message.code, r.message.value);
+      else
+        printf("message,%c\n", r.message.code);
+    }
+  }
+  return 0;
+}
+
+static int info(int argc, char **argv) {
+
+  (void)argc;
+  for (const std::string &path : flightFiles(argv[2])) {
+    FlightStoreReader reader;
+    if (!reader.open(path)) {
+      printf("%s: unreadable or unfinished\n", path.c_str());
+      continue;
+    }
+    const FlightFileFooter &footer = reader.getFooter();
+    printf("%s: %llu fixes in %u blocks, %u events, %.1f s, target %.6f %.6f\n", footer.flightId,
+           (unsigned long long)footer.totalRows, footer.numBlocks, footer.numEvents,
+           footer.numBlocks ? (footer.max[COL_TIME] - footer.min[COL_TIME]) / 1e6 : 0.0, footer.targetLat, footer.targetLon);
+    for (uint32_t i = 0; i < footer.numSegments; i++) {
+      const PhaseSegment &s = reader.getSegment(i);
+      printf("  %-9s %lld .. %lld (blocks %u-%u)\n", flightPhaseNames[s.phase], (long long)s.startUs, (long long)s.endUs,
+             s.firstBlock, s.lastBlock);
+    }
+  }
+  return 0;
+}
+
+int main(int argc, char **argv) {
+
+  int result = 2;
+  if (argc >= 4 && !strcmp(argv[1], "record")) result = record(argc, argv);
+  else if (argc >= 5 && !strcmp(argv[1], "import")) result = import(argc, argv);
+  else if (argc >= 3 && !strcmp(argv[1], "query")) result = query(argc, argv);
+  else if (argc >= 3 && !strcmp(argv[1], "events")) result = events(argc, argv);
+  else if (argc >= 3 && !strcmp(argv[1], "info")) result = info(argc, argv);
+
+  if (result == 2) {
+    fprintf(stderr, "usage: flight_store record DIR FLIGHT [--target LAT,LON]\n"
+                    "       flight_store import DIR FLIGHT CAPTURE [--target LAT,LON] [--start-us T] [--rate-hz 4]\n"
+                    "       flight_store query DIR [--near LAT,LON,M | --near-target M] [--phase NAME] [--from US] [--to US] [--quiet]\n"
+                    "       flight_store events DIR [--from US] [--to US]\n"
+                    "       flight_store info DIR\n");
+  }
+  return result;
+}
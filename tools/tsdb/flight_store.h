@@ -0,0 +1,429 @@
+#ifndef _FLIGHT_STORE_H
+#define _FLIGHT_STORE_H
+
+/*
+  Flight store: one append-only columnar file per flight (host side, Linux/macOS).
+
+  Data packets (fixes) go into a table of fixed columns, FLIGHT_STORE_BLOCK_ROWS rows per block. Within a block each column is
+  contiguous, and blocks are page aligned, so a query that only needs time/lat/lon of a few blocks only faults in those pages of the
+  memory mapped file. Everything else (drop records, messages, wind, parameters) is kept as whole records in an event table.
+
+  File layout:
+    header (one page)
+    block 0, block 1, ...        each: column 0 x BLOCK_ROWS, column 1 x BLOCK_ROWS, ... padded to a page
+    block summaries              rows, phases present, min/max of every column
+    phase segments               runs of one flight phase: first/last block, start/end time
+    events                       time + TelemetryRecord, in time order
+    footer                       offsets and counts of the above, and min/max/phases over the whole flight
+
+  The summaries let a query skip a block (and the footer a whole flight) without touching its data - by time, phase, or a
+  latitude/longitude box.
+
+  The header holds the size of the file as of the last finished write, and the footer is the last bytes of that. Appending to an
+  existing flight leaves the old summaries/segments/events/footer where they are (they are read back first), adds new blocks after
+  them and then writes all of it again after those, so the data blocks themselves are never rewritten. Only once that is on disk does
+  the header move to the new footer, and the old copy is freed (a hole punched, where the filesystem can). A writer that dies part way
+  leaves the file as it was before it opened it: the header still points at the old footer, and the next writer cuts off what is past it.
+*/
+
+#include "../relay/telemetry_ring.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define FLIGHT_STORE_MAGIC 0x31535446  //"FTS1"
+#define FLIGHT_STORE_VERSION 2  //2: point records carry an id, positions in 1e-7 degrees
+#define FLIGHT_STORE_BLOCK_ROWS 1024  //~4 minutes of data packets at 4Hz
+#define FLIGHT_STORE_PAGE 4096
+#define FLIGHT_STORE_EXTENSION ".fts"
+#define FLIGHT_ID_LENGTH 32
+
+#define M_PER_DEGREE_LAT 111320.0
+
+enum FlightPhase { PHASE_GROUND, PHASE_CRUISE, PHASE_APPROACH, PHASE_POST_DROP, NUM_PHASES };
+static const char *const flightPhaseNames[NUM_PHASES] = {"ground", "cruise", "approach", "post_drop"};
+
+// Fix table columns
+enum FixColumn { COL_TIME, COL_LAT, COL_LON, COL_ALT, COL_SPEED, COL_COURSE, COL_ERROR, COL_BATTERY, COL_FIX, COL_SATS, COL_PHASE,
+                 NUM_COLUMNS };
+static const char *const fixColumnNames[NUM_COLUMNS] = {"time_us", "lat", "lon", "altitude_ft", "speed_mps", "course_deg",
+                                                        "expected_error_m", "battery_v", "fix_quality", "satellites", "phase"};
+static const uint8_t fixColumnSizes[NUM_COLUMNS] = {8, 4, 4, 4, 4, 4, 4, 4, 1, 1, 1};
+
+struct FixRow {
+  int64_t timeUs;
+  float lat, lon, altitudeFt, speedMPS, courseDeg, expectedErrorM, batteryV;
+  uint8_t fixQuality, satellites, phase;
+
+  double get(int column) const {
+    switch (column) {
+      case COL_TIME: return timeUs;
+      case COL_LAT: return lat;
+      case COL_LON: return lon;
+      case COL_ALT: return altitudeFt;
+      case COL_SPEED: return speedMPS;
+      case COL_COURSE: return courseDeg;
+      case COL_ERROR: return expectedErrorM;
+      case COL_BATTERY: return batteryV;
+      case COL_FIX: return fixQuality;
+      case COL_SATS: return satellites;
+      default: return phase;
+    }
+  }
+};
+
+struct FlightFileHeader {
+  uint32_t magic, version;
+  char flightId[FLIGHT_ID_LENGTH];
+  uint64_t committedSize;  //File size as of the last finished write - the footer is just before it. 0 (older files) = the whole file
+};
+
+struct BlockSummary {
+  uint64_t offset;
+  uint32_t rows;
+  uint32_t phaseMask;  //Bit per FlightPhase present
+  double min[NUM_COLUMNS], max[NUM_COLUMNS];
+};
+
+struct PhaseSegment {
+  uint32_t phase;
+  uint32_t firstBlock, lastBlock;
+  int64_t startUs, endUs;
+};
+
+struct EventRow {
+  int64_t timeUs;
+  TelemetryRecord record;
+};
+
+struct FlightFileFooter {
+  uint32_t magic, version;
+  char flightId[FLIGHT_ID_LENGTH];
+  double targetLat, targetLon;
+  uint64_t summariesOffset, segmentsOffset, eventsOffset;
+  uint32_t numBlocks, numSegments, numEvents;
+  uint32_t phaseMask;
+  uint64_t totalRows;
+  double min[NUM_COLUMNS], max[NUM_COLUMNS];
+  uint32_t endMagic;  //Last bytes of the file. Missing = the writer didn't finish
+};
+
+inline uint64_t columnOffset(int column) {
+  uint64_t offset = 0;
+  for (int c = 0; c < column; c++) offset += (uint64_t)fixColumnSizes[c] * FLIGHT_STORE_BLOCK_ROWS;
+  return offset;
+}
+
+inline uint64_t roundUpToPage(uint64_t offset) {
+  return (offset + FLIGHT_STORE_PAGE - 1) / FLIGHT_STORE_PAGE * FLIGHT_STORE_PAGE;
+}
+
+inline uint64_t blockSize() {
+  return roundUpToPage(columnOffset(NUM_COLUMNS));
+}
+
+// Where the finished part of a flight file ends (see FlightFileHeader::committedSize), 0 if it isn't one
+inline uint64_t committedSize(const FlightFileHeader &header, uint64_t fileSize) {
+  if (header.magic != FLIGHT_STORE_MAGIC || header.version != FLIGHT_STORE_VERSION) return 0;
+  if (header.committedSize == 0) return fileSize;
+  return header.committedSize <= fileSize ? header.committedSize : 0;
+}
+
+inline double flatDistanceM(double lat1, double lon1, double lat2, double lon2) {
+  double east = (lon2 - lon1) * M_PER_DEGREE_LAT * cos(lat1 / 180 * M_PI);
+  double north = (lat2 - lat1) * M_PER_DEGREE_LAT;
+  return sqrt(east * east + north * north);
+}
+
+class FlightStoreWriter {
+
+  public:
+    ~FlightStoreWriter() { close(); }
+
+    // Creates the flight, or reopens it to append. Fails on a file without a footer rather than guess where its data ends
+    bool open(const std::string &path, const char *flightId, double targetLat, double targetLon) {
+
+      fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+      if (fd < 0) return false;
+
+      struct stat st;
+      fstat(fd, &st);
+      memset(&footer, 0, sizeof(footer));
+      memset(&header, 0, sizeof(header));
+      oldTailStart = oldTailEnd = 0;
+
+      if (st.st_size == 0) {
+        header.magic = FLIGHT_STORE_MAGIC;
+        header.version = FLIGHT_STORE_VERSION;
+        strncpy(header.flightId, flightId, FLIGHT_ID_LENGTH - 1);
+        std::vector<uint8_t> page(FLIGHT_STORE_PAGE, 0);
+        memcpy(page.data(), &header, sizeof(header));
+        if (pwrite(fd, page.data(), page.size(), 0) != (ssize_t)page.size()) return fail();
+
+        strncpy(footer.flightId, flightId, FLIGHT_ID_LENGTH - 1);
+        footer.targetLat = targetLat;
+        footer.targetLon = targetLon;
+        for (int c = 0; c < NUM_COLUMNS; c++) {
+          footer.min[c] = INFINITY;
+          footer.max[c] = -INFINITY;
+        }
+        dataEnd = FLIGHT_STORE_PAGE;
+      }
+      else {
+        uint64_t size = 0;
+        if (readAt(&header, sizeof(header), 0)) size = committedSize(header, st.st_size);
+        if (size < FLIGHT_STORE_PAGE + sizeof(footer) || !readAt(&footer, sizeof(footer), size - sizeof(footer)) ||
+            footer.magic != FLIGHT_STORE_MAGIC || footer.endMagic != FLIGHT_STORE_MAGIC || footer.version != FLIGHT_STORE_VERSION)
+          return fail();
+
+        summaries.resize(footer.numBlocks);
+        segments.resize(footer.numSegments);
+        events.resize(footer.numEvents);
+        if (!readAt(summaries.data(), summaries.size() * sizeof(BlockSummary), footer.summariesOffset) ||
+            !readAt(segments.data(), segments.size() * sizeof(PhaseSegment), footer.segmentsOffset) ||
+            !readAt(events.data(), events.size() * sizeof(EventRow), footer.eventsOffset))
+          return fail();
+
+        // Anything past the footer is from a writer that didn't finish. The old footer stays until close() has replaced it
+        if ((uint64_t)st.st_size > size && ftruncate(fd, size) < 0) return fail();
+        oldTailStart = footer.summariesOffset;
+        oldTailEnd = size;
+        dataEnd = roundUpToPage(size);
+      }
+
+      block.assign(columnOffset(NUM_COLUMNS), 0);
+      rows = 0;
+      return true;
+    }
+
+    void append(const FixRow &row) {
+
+      for (int c = 0; c < NUM_COLUMNS; c++) {
+        memcpy(&block[columnOffset(c) + (uint64_t)rows * fixColumnSizes[c]], columnPointer(row, c), fixColumnSizes[c]);
+      }
+      rows++;
+
+      // Phase segments: extend the current one or start a new one
+      uint32_t blockIndex = summaries.size();
+      if (!segments.empty() && segments.back().phase == row.phase) {
+        segments.back().lastBlock = blockIndex;
+        segments.back().endUs = row.timeUs;
+      }
+      else {
+        segments.push_back({row.phase, blockIndex, blockIndex, row.timeUs, row.timeUs});
+      }
+
+      if (rows == FLIGHT_STORE_BLOCK_ROWS) flushBlock();
+    }
+
+    void addEvent(int64_t timeUs, const TelemetryRecord &record) {
+      EventRow e;
+      e.timeUs = timeUs;
+      e.record = record;
+      events.push_back(e);
+    }
+
+    bool close() {
+
+      if (fd < 0) return true;
+      bool ok = flushBlock();
+
+      // Events may arrive slightly out of order across appends
+      std::stable_sort(events.begin(), events.end(), [](const EventRow &a, const EventRow &b) { return a.timeUs < b.timeUs; });
+
+      footer.magic = footer.endMagic = FLIGHT_STORE_MAGIC;
+      footer.version = FLIGHT_STORE_VERSION;
+      footer.numBlocks = summaries.size();
+      footer.numSegments = segments.size();
+      footer.numEvents = events.size();
+      footer.summariesOffset = dataEnd;
+      footer.segmentsOffset = footer.summariesOffset + summaries.size() * sizeof(BlockSummary);
+      footer.eventsOffset = footer.segmentsOffset + segments.size() * sizeof(PhaseSegment);
+      uint64_t footerOffset = footer.eventsOffset + events.size() * sizeof(EventRow);
+
+      // Everything after the data blocks goes out in one write
+      std::vector<uint8_t> tail(footerOffset + sizeof(FlightFileFooter) - dataEnd);
+      uint8_t *p = tail.data();
+      if (!summaries.empty()) memcpy(p, summaries.data(), summaries.size() * sizeof(BlockSummary));
+      p += summaries.size() * sizeof(BlockSummary);
+      if (!segments.empty()) memcpy(p, segments.data(), segments.size() * sizeof(PhaseSegment));
+      p += segments.size() * sizeof(PhaseSegment);
+      if (!events.empty()) memcpy(p, events.data(), events.size() * sizeof(EventRow));
+      p += events.size() * sizeof(EventRow);
+      memcpy(p, &footer, sizeof(FlightFileFooter));
+
+      // The new footer must be on disk before the header points at it, and the header before the old footer goes
+      ok = ok && writeAt(tail.data(), tail.size(), dataEnd) && fsync(fd) == 0;
+      header.committedSize = footerOffset + sizeof(FlightFileFooter);
+      ok = ok && writeAt(&header, sizeof(header), 0) && fsync(fd) == 0;
+#ifdef FALLOC_FL_PUNCH_HOLE
+      if (ok && oldTailEnd > oldTailStart)
+        fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, oldTailStart, roundUpToPage(oldTailEnd) - oldTailStart);
+#endif
+      ::close(fd);
+      fd = -1;
+      return ok;
+    }
+
+    uint64_t getTotalRows() { return footer.totalRows + rows; }
+
+  private:
+    int fd = -1;
+    FlightFileHeader header;
+    FlightFileFooter footer;
+    uint64_t dataEnd = 0;
+    uint64_t oldTailStart = 0, oldTailEnd = 0;  //The summaries/segments/events/footer being replaced, when appending
+    std::vector<uint8_t> block;
+    uint32_t rows = 0;
+    std::vector<BlockSummary> summaries;
+    std::vector<PhaseSegment> segments;
+    std::vector<EventRow> events;
+
+    static const void *columnPointer(const FixRow &row, int c) {
+      switch (c) {
+        case COL_TIME: return &row.timeUs;
+        case COL_LAT: return &row.lat;
+        case COL_LON: return &row.lon;
+        case COL_ALT: return &row.altitudeFt;
+        case COL_SPEED: return &row.speedMPS;
+        case COL_COURSE: return &row.courseDeg;
+        case COL_ERROR: return &row.expectedErrorM;
+        case COL_BATTERY: return &row.batteryV;
+        case COL_FIX: return &row.fixQuality;
+        case COL_SATS: return &row.satellites;
+        default: return &row.phase;
+      }
+    }
+
+    FixRow rowAt(uint32_t i) {
+      FixRow row;
+      for (int c = 0; c < NUM_COLUMNS; c++) {
+        memcpy((void *)columnPointer(row, c), &block[columnOffset(c) + (uint64_t)i * fixColumnSizes[c]], fixColumnSizes[c]);
+      }
+      return row;
+    }
+
+    bool flushBlock() {
+
+      if (rows == 0) return true;
+
+      BlockSummary s;
+      s.offset = dataEnd;
+      s.rows = rows;
+      s.phaseMask = 0;
+      for (int c = 0; c < NUM_COLUMNS; c++) {
+        s.min[c] = INFINITY;
+        s.max[c] = -INFINITY;
+      }
+      for (uint32_t i = 0; i < rows; i++) {
+        FixRow row = rowAt(i);
+        s.phaseMask |= 1 << row.phase;
+        for (int c = 0; c < NUM_COLUMNS; c++) {
+          s.min[c] = std::min(s.min[c], row.get(c));
+          s.max[c] = std::max(s.max[c], row.get(c));
+        }
+      }
+
+      std::vector<uint8_t> padded(block);
+      padded.resize(blockSize(), 0);
+      if (!writeAt(padded.data(), padded.size(), dataEnd)) return false;
+
+      summaries.push_back(s);
+      footer.totalRows += rows;
+      footer.phaseMask |= s.phaseMask;
+      for (int c = 0; c < NUM_COLUMNS; c++) {
+        footer.min[c] = std::min(footer.min[c], s.min[c]);
+        footer.max[c] = std::max(footer.max[c], s.max[c]);
+      }
+      dataEnd += blockSize();
+      rows = 0;
+      std::fill(block.begin(), block.end(), 0);
+      return true;
+    }
+
+    bool readAt(void *p, size_t n, uint64_t offset) { return n == 0 || pread(fd, p, n, offset) == (ssize_t)n; }
+    bool writeAt(const void *p, size_t n, uint64_t offset) { return n == 0 || pwrite(fd, p, n, offset) == (ssize_t)n; }
+
+    bool fail() {
+      ::close(fd);
+      fd = -1;
+      return false;
+    }
+};
+
+// Read side: maps the whole file, but only the pages actually read (summaries, then the columns of the blocks a query keeps) are loaded
+class FlightStoreReader {
+
+  public:
+    ~FlightStoreReader() { close(); }
+
+    bool open(const std::string &path) {
+
+      int fd = ::open(path.c_str(), O_RDONLY);
+      if (fd < 0) return false;
+      struct stat st;
+      fstat(fd, &st);
+      size = st.st_size;
+      if (size < (off_t)(FLIGHT_STORE_PAGE + sizeof(FlightFileFooter))) {
+        ::close(fd);
+        return false;
+      }
+
+      base = (const uint8_t *)mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+      ::close(fd);
+      if (base == MAP_FAILED) {
+        base = NULL;
+        return false;
+      }
+
+      uint64_t committed = committedSize(*(const FlightFileHeader *)base, size);
+      if (committed < FLIGHT_STORE_PAGE + sizeof(FlightFileFooter)) {
+        close();
+        return false;
+      }
+      footer = (const FlightFileFooter *)(base + committed - sizeof(FlightFileFooter));
+      if (footer->magic != FLIGHT_STORE_MAGIC || footer->endMagic != FLIGHT_STORE_MAGIC || footer->version != FLIGHT_STORE_VERSION) {
+        close();
+        return false;
+      }
+      return true;
+    }
+
+    void close() {
+      if (base) munmap((void *)base, size);
+      base = NULL;
+    }
+
+    const FlightFileFooter &getFooter() { return *footer; }
+    const BlockSummary &getSummary(uint32_t block) { return ((const BlockSummary *)(base + footer->summariesOffset))[block]; }
+    const PhaseSegment &getSegment(uint32_t i) { return ((const PhaseSegment *)(base + footer->segmentsOffset))[i]; }
+    const EventRow &getEvent(uint32_t i) { return ((const EventRow *)(base + footer->eventsOffset))[i]; }
+
+    template <class T> const T *column(uint32_t block, int c) {
+      return (const T *)(base + getSummary(block).offset + columnOffset(c));
+    }
+
+    // Tell the kernel which columns of a block we are about to scan, so they are read in together
+    void prefetch(uint32_t block, int c) {
+      uint64_t start = getSummary(block).offset + columnOffset(c);
+      uint64_t pageStart = start / FLIGHT_STORE_PAGE * FLIGHT_STORE_PAGE;
+      madvise((void *)(base + pageStart), start - pageStart + (uint64_t)fixColumnSizes[c] * FLIGHT_STORE_BLOCK_ROWS, MADV_WILLNEED);
+    }
+
+  private:
+    const uint8_t *base = NULL;
+    off_t size = 0;
+    const FlightFileFooter *footer = NULL;
+};
+
+#endif //_FLIGHT_STORE_H